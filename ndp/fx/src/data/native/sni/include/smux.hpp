@@ -28,6 +28,10 @@ public:
 						 __in SNI_Conn * pParent,
 						 __out OUT SNI_Provider ** ppProv);
 
+	// Receive window of a Session provider, see SNI_QUERY_CONN_SMUXWINDOW
+	static void GetSessionWindowInfo( __in SNI_Provider * pProv, __out SNI_SMUX_WINDOW_INFO * pWindowInfo );
+	static DWORD SetSessionMaxWindow( __in SNI_Provider * pProv, DWORD dwMaxWindow );
+
 	DWORD ReadSync(__out SNI_Packet ** ppNewPacket, int timeout);
 	DWORD ReadAsync(__inout SNI_Packet ** ppNewPacket, LPVOID pPacketKey);
 	DWORD WriteSync(SNI_Packet * pPacket, SNI_ProvInfo * pProvInfo);
@@ -41,6 +45,11 @@ public:
 	void AddSessionRef();
 	void ReleaseSessionRef();
 
+	DWORD WriteFrame( __in SNI_Packet * pPacket, bool fCoalesce );
+	void WriteFrameDone();
+	void GetCoalesceInfo( __out SNI_SMUX_COALESCE_INFO * pCoalesceInfo );
+	DWORD SetCoalesceInfo( __in SNI_SMUX_COALESCE_INFO * pCoalesceInfo );
+
 private:
 
 	SNICritSec *m_SmuxCS;	//Critical section to protect multiple thread access
@@ -68,6 +77,19 @@ private:
 	//Count concurrent threads willing to access worker function.
 	LONG m_SyncWorkAccessCount;
 
+	//variables below are async specific, see Smux::WriteFrame
+	SNICritSec *m_WriteCS;
+
+	SNI_Packet *m_pCoalescePacket;	//frames gathered so far, their packets are chained to it
+	SNI_Packet *m_pCoalesceTail;
+	DWORD	m_cWritesPending;		//writes given to m_pNext that have not completed yet
+
+	BOOL	m_fCoalesce;
+	DWORD	m_cbCoalesceMax;
+
+	DWORD	m_cCoalescedFrames;
+	DWORD	m_cCoalescedWrites;
+
 public:
 
 	Smux(SNI_Conn *pConn);
@@ -110,6 +132,9 @@ private:
 
 	DWORD PostReadAsync(__inout SNI_Packet **ppPacket);
 
+	void FlushCoalescedFrames();
+	void CompleteCoalescedFrames( __in_opt SNI_Packet * pFrames, bool fSuccess );
+
 	void TerminateSessions();
 
 	//---------------------------------------------------------------------
@@ -194,6 +194,9 @@ typedef enum
 	SNI_QUERY_CONN_CHANNEL_PROVIDES_AUTHENTICATION_CONTEXT,
 	SNI_QUERY_CONN_PEERID,
 	SNI_QUERY_CONN_SUPPORTS_SYNC_OVER_ASYNC,
+	SNI_QUERY_CONN_SMUXWINDOW,
+	SNI_QUERY_CONN_SMUXCOALESCE,
+	SNI_QUERY_TCP_CONNECT_ATTEMPT_DELAY,
 #ifdef SNI_BASED_CLIENT
 	// NOTE: Keep all conditional QTypes at the end of the enum
 	SNI_QUERY_TCP_SKIP_IO_COMPLETION_ON_SUCCESS,
@@ -212,6 +215,9 @@ typedef enum
 //			will be used by SSB to dynamically assign a buffer to them to
 //			avoid memcpy ops. From SNI's point of view, these will be treated
 //			as "buffer-less" packets.
+//			SNI_Packet_Slice refers to part of the buffer of another packet
+//			and holds a reference on it, see SNIPacketAllocateSlice.  Smux
+//			uses it to hand out the frames of a read without copying them.
 //----------------------------------------------------------------------------
 typedef enum
 {
@@ -220,6 +226,7 @@ typedef enum
 	SNI_Packet_KeyHolderNoBuf,	// IMPORTANT! Has a "read" usage and completion routine
 	SNI_Packet_VaryingBufferRead,
 	SNI_Packet_VaryingBufferWrite,
+	SNI_Packet_Slice,			// Has a "read" usage and completion routine
 	SNI_Packet_InvalidType	// IMPORTANT! Please do not add packet types beyond this,
 							// add prior if needed.
 } SNI_Packet_IOType;
@@ -332,6 +339,45 @@ typedef struct
 	int PeerAddrLen;
 } PeerAddrInfo;
 
+//----------------------------------------------------------------------------
+// Name: 	SNI_SMUX_WINDOW_INFO
+//
+// Purpose:	Receive window counters of a MARS session, returned by 
+//			SNIGetInfo( SNI_QUERY_CONN_SMUXWINDOW ).  SNISetInfo with the 
+//			same QType takes a DWORD with the largest window the session 
+//			may grow to.
+//			
+//----------------------------------------------------------------------------
+typedef struct
+{
+	DWORD	dwWindow;			// packets the peer may currently have in flight
+	DWORD	dwMinWindow;
+	DWORD	dwMaxWindow;
+	DWORD	dwRtt;				// smoothed time in us from a window update to the next packet,
+								// which sizes the window when it grows
+	DWORD	cGrowths;
+	DWORD	cShrinks;
+} SNI_SMUX_WINDOW_INFO;
+
+//----------------------------------------------------------------------------
+// Name: 	SNI_SMUX_COALESCE_INFO
+//
+// Purpose:	Write coalescing of the sessions of a MARS connection, used with
+//			SNIGetInfo/SNISetInfo( SNI_QUERY_CONN_SMUXCOALESCE ) on the 
+//			connection that carries them.  SNISetInfo ignores the counters.
+//			Frames are only gathered behind a write of the connection that 
+//			is still pending, and are written when it completes, so a frame 
+//			waits no longer than that write.  There is no timer.  
+//			
+//----------------------------------------------------------------------------
+typedef struct
+{
+	BOOL	fEnabled;
+	DWORD	cbMaxBytes;			// a gathered write is sent once it holds this many bytes
+	DWORD	cFrames;			// frames written as part of a gathered write
+	DWORD	cWrites;			// gathered writes
+} SNI_SMUX_COALESCE_INFO;
+
 
 //----------------------------------------------------------------------------
 // Name: 	SNI_ListenInfo
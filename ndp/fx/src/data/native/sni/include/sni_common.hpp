@@ -94,11 +94,62 @@ extern SNIMemObj *gpmo;
 
 typedef LPTHREAD_START_ROUTINE WaitThreadRoutine;
 
-extern HANDLE ghIoCompletionPort;
-
 class SOS_IOCompRequest;
 typedef void  SOS_IOCompRoutine (SOS_IOCompRequest*  pVoid);	// Callback function for SOS to call into SNI
 
+//----------------------------------------------------------------------------
+// Name: 	SNICompletionPort
+//
+// Purpose:	The I/O completion port the SNIAsyncWait thread dispatches 
+//			completions from.  Network handles are associated with it, 
+//			providers post their own completions to it, and completions 
+//			are dequeued in batches with GetQueuedCompletionStatusEx.  
+//			A single thread dequeues, so completions are dispatched one 
+//			at a time in the order they were queued.  
+//
+//			This is an I/O completion port and nothing else.  All the 
+//			providers issue overlapped Windows I/O, so running SNI on 
+//			epoll or io_uring would take new providers rather than 
+//			another queue behind this class.  
+//			
+//----------------------------------------------------------------------------
+typedef struct
+{
+	SOS_IOCompRequest *	pSOSIo;		// NULL for the wake-ups posted at termination
+	DWORD				dwBytes;
+	DWORD				dwError;
+} SNICompletion;
+
+typedef ULONG (WINAPI * PFNRTLNTSTATUSTODOSERROR)( LONG Status );
+
+class SNICompletionPort
+{
+	HANDLE m_hPort;
+
+	// GetQueuedCompletionStatusEx returns the NTSTATUS of each completion, 
+	// this maps it to the error GetQueuedCompletionStatus would return.  
+	// Without it completions are dequeued one at a time.  
+	PFNRTLNTSTATUSTODOSERROR m_pfnRtlNtStatusToDosError;
+
+public:
+	SNICompletionPort();
+	~SNICompletionPort();
+
+	DWORD FInit();
+
+	DWORD Associate( HANDLE hNwk );
+
+	DWORD Post( __in_opt OVERLAPPED * pOvl, DWORD dwBytes );
+
+	// Waits for at least one completion and returns as many as are ready, 
+	// up to cCompletions.  
+	DWORD Dequeue( __out_ecount_part(cCompletions, *pcDequeued) SNICompletion * rgCompletions, 
+				   ULONG cCompletions, 
+				   __out ULONG * pcDequeued );
+};
+
+extern SNICompletionPort * gpCompletionPort;
+
 typedef LONG_PTR 	Counter;
 
 #else	// #ifdef SNI_BASED_CLIENT
@@ -267,6 +318,9 @@ extern "C"  inline SNI_Packet *SNIPacketAllocateEx( __in SNI_Conn * pConn,
 									SNI_Packet_IOType IOType,
 								   	SOS_IOCompRoutine pfunComp);
 
+extern "C"  inline SNI_Packet *SNIPacketAllocateSlice( __in SNI_Packet * pPacket, 
+									DWORD cbSlice);
+
 
 extern "C" LPSTR StrStrA_SYS(DWORD dwCmpFlags, LPCSTR lpstring1,int cchCount1, LPCSTR lpstring2, int cchCount2);
 extern "C" LPSTR StrChrA_SYS(__in_ecount(cchCount1) LPCSTR lpstring1, int cchCount1/* total char count*/, char character);
@@ -641,7 +695,7 @@ typedef enum {
 	REF_Write,				// user write requests
 	REF_InternalWrite,		// reads posted by sni providers for their own purposes
 	REF_ActiveCallbacks,	// Ref'd by SNIReadDone and SNIWriteDone during read and write completion calls.	
-	REF_PacketNotOwningBuf,	// SNI_Packet_KeyHolderNoBuf or SNI_Packet_VaryingBuffer*
+	REF_PacketNotOwningBuf,	// SNI_Packet_KeyHolderNoBuf, SNI_Packet_VaryingBuffer* or SNI_Packet_Slice
 	REF_Max
 } SNI_REF;
 
@@ -219,6 +219,80 @@ typedef enum
 inline SNI_Packet * SNIPacketContainingDescriptor( SOS_ObjectStoreDescriptor *pDescriptor);
 inline SOS_ObjectStoreDescriptor * SNIPacketGetDescriptor(SNI_Packet * pPacket);
 
+#ifdef SNI_BASED_CLIENT 
+
+#define SNI_MAGAZINE_SIZE		32
+#define SNI_MAGAZINE_BATCH		(SNI_MAGAZINE_SIZE / 2)
+#define SNI_CACHE_LINE_SIZE		64
+
+//----------------------------------------------------------------------------
+// Name: 	SNIPacketMagazine
+//
+// Purpose:	Per-processor cache of free packets in front of the SLIST of a
+//			memory region.  Threads allocating and releasing packets on
+//			different processors no longer touch the same list header; it
+//			is only used to refill or drain half a magazine at a time.
+//
+//			The magazines of a region hold at most half of
+//			MAX_PACKET_CACHE_SIZE, and the list holds the rest, so that
+//			the region caches no more packets than without them.  On
+//			machines with many processors the magazines get fewer than
+//			SNI_MAGAZINE_SIZE slots each, or none at all.
+//
+//			A magazine is protected by a spin lock that is only contended if
+//			a thread is preempted or moves to another processor while
+//			holding it, or while another processor steals from it.  The
+//			magazines of a region are cache line aligned and padded to whole
+//			cache lines so they never share one.
+//			
+//----------------------------------------------------------------------------
+class SNIPacketMagazine
+{
+public:
+	volatile LONG	m_lLock;
+	DWORD			m_cPackets;
+	SNI_Packet *	m_rgpPackets[SNI_MAGAZINE_SIZE];
+
+	// Statistics, updated under the lock
+	ULONGLONG		m_cHits;		// packets served from this magazine
+	ULONGLONG		m_cMisses;		// allocations that found this magazine empty
+	ULONGLONG		m_cSteals;		// packets taken by other processors
+
+private:
+	BYTE			m_rgbPad[SNI_CACHE_LINE_SIZE - 
+						(2 * sizeof(DWORD) + 
+						 SNI_MAGAZINE_SIZE * sizeof(SNI_Packet *) + 
+						 3 * sizeof(ULONGLONG)) % SNI_CACHE_LINE_SIZE];
+
+public:
+	void Lock()
+	{
+		for( DWORD cSpins = 0; 0 != InterlockedCompareExchange(&m_lLock, 1, 0); cSpins++ )
+		{
+			if( cSpins < 64 )
+			{
+				YieldProcessor();
+			}
+			else
+			{
+				SwitchToThread();
+			}
+		}
+	}
+
+	bool TryLock()
+	{
+		return 0 == m_lLock && 0 == InterlockedCompareExchange(&m_lLock, 1, 0);
+	}
+
+	void Unlock()
+	{
+		InterlockedExchange(&m_lLock, 0);
+	}
+};
+
+#endif
+
 //----------------------------------------------------------------------------
 // Name: 	SNIMemRegion
 //
@@ -237,6 +311,11 @@ private:
 
 #ifdef SNI_BASED_CLIENT 
 		InitializeSListHead(&m_SListHeader);
+		m_pbMagazines = NULL;
+		m_rgMagazines = NULL;
+		m_cMagazines = 0;
+		m_cMagazineSize = 0;
+		m_cListMax = MAX_PACKET_CACHE_SIZE;
 #else
 		m_pSOSPacketCache = NULL;
 		m_pPacketPmo = NULL;
@@ -253,12 +332,138 @@ private:
 
 	SLIST_HEADER m_SListHeader;
 
+	BYTE * m_pbMagazines;					// allocation holding m_rgMagazines
+	SNIPacketMagazine * m_rgMagazines;		// one per processor
+	DWORD m_cMagazines;
+	DWORD m_cMagazineSize;					// slots used in each magazine, even, 0 if none are
+	DWORD m_cListMax;						// packets the list holds besides the magazines
+
 	DWORD FInit(MemTagTypes eMemTag)
 	{
+		SYSTEM_INFO si;
+
 		InitTag(eMemTag);
+
+		GetSystemInfo(&si);
+		m_cMagazines = 0 < si.dwNumberOfProcessors ? si.dwNumberOfProcessors : 1;
+
+		m_cMagazineSize = ( MAX_PACKET_CACHE_SIZE / 2 / m_cMagazines ) & ~1;
+
+		if( SNI_MAGAZINE_SIZE < m_cMagazineSize )
+		{
+			m_cMagazineSize = SNI_MAGAZINE_SIZE;
+		}
+
+		m_cListMax = MAX_PACKET_CACHE_SIZE - m_cMagazines * m_cMagazineSize;
+
+		m_pbMagazines = NewNoX(gpmo) BYTE[ m_cMagazines * sizeof(SNIPacketMagazine) + SNI_CACHE_LINE_SIZE ];
+
+		if( NULL == m_pbMagazines )
+		{
+			m_cMagazines = 0;
+			return ERROR_OUTOFMEMORY;
+		}
+
+		m_rgMagazines = reinterpret_cast<SNIPacketMagazine *>(
+			(reinterpret_cast<ULONG_PTR>(m_pbMagazines) + SNI_CACHE_LINE_SIZE - 1) & ~(ULONG_PTR)(SNI_CACHE_LINE_SIZE - 1));
+
+		memset(m_rgMagazines, 0, m_cMagazines * sizeof(SNIPacketMagazine));
+
 		return ERROR_SUCCESS;
 	}
 
+	SNIPacketMagazine * GetMagazine()
+	{
+		return &m_rgMagazines[GetCurrentProcessorNumber() % m_cMagazines];
+	}
+
+	SNI_Packet * PopList()
+	{
+		SOS_ObjectStoreDescriptor *pDescriptor;
+
+		pDescriptor = static_cast<SOS_ObjectStoreDescriptor*>(InterlockedPopEntrySList(&m_SListHeader));
+
+		if( NULL == pDescriptor )
+			return NULL;
+		else
+			return SNIPacketContainingDescriptor(pDescriptor);
+	}
+
+	void PushList( __out_opt SNI_Packet *pPacket)
+	{
+		if( QueryDepthSList(&m_SListHeader) < m_cListMax - 1 )
+		{
+			SLIST_ENTRY* pEntry = static_cast<SLIST_ENTRY*>(SNIPacketGetDescriptor(pPacket));
+			InterlockedPushEntrySList(&m_SListHeader, pEntry);
+		}
+		else
+		{
+			// Strategy: Don't make an effort to clean up the "extra" entries, but don't push this one onto the stack
+			// if it will go over. This guarantees an *approximate* maximum 
+			// (bounded above by m_cListMax + ConcurrentThreadsAccessingTheStack)
+			
+			// It would cost a lot of performance to put a stronger guarantee on the maximal size, since
+			// we would need to synchronize access to two variables (stack head, stack size), which we 
+			// don't know how to do without using a true sync primitive, rather than the two separate
+			// Interlocked operations which are all that's required to maintain consistency of the list header and 
+			// an *approximate* depth guarantee.
+			SNIPacketDelete(pPacket);
+		}
+	}
+
+	// Takes a packet from the magazine of another processor when both the
+	// magazine of this one and the list are empty.  Busy magazines are skipped.
+	SNI_Packet * Steal( SNIPacketMagazine * pOwnMagazine )
+	{
+		for( DWORD i = 0; i < m_cMagazines; i++ )
+		{
+			SNIPacketMagazine * pMagazine = &m_rgMagazines[i];
+
+			if( pMagazine == pOwnMagazine || 0 == pMagazine->m_cPackets || !pMagazine->TryLock() )
+			{
+				continue;
+			}
+
+			SNI_Packet * pPacket = NULL;
+
+			if( 0 < pMagazine->m_cPackets )
+			{
+				pPacket = pMagazine->m_rgpPackets[--pMagazine->m_cPackets];
+				pMagazine->m_cSteals++;
+			}
+
+			pMagazine->Unlock();
+
+			if( NULL != pPacket )
+			{
+				return pPacket;
+			}
+		}
+
+		return NULL;
+	}
+
+	void FlushMagazines()
+	{
+		for( DWORD i = 0; i < m_cMagazines; i++ )
+		{
+			SNIPacketMagazine * pMagazine = &m_rgMagazines[i];
+			SNI_Packet * rgpPackets[SNI_MAGAZINE_SIZE];
+			DWORD cPackets;
+
+			pMagazine->Lock();
+			cPackets = pMagazine->m_cPackets;
+			memcpy(rgpPackets, pMagazine->m_rgpPackets, cPackets * sizeof(SNI_Packet *));
+			pMagazine->m_cPackets = 0;
+			pMagazine->Unlock();
+
+			for( DWORD j = 0; j < cPackets; j++ )
+			{
+				SNIPacketDelete(rgpPackets[j]);
+			}
+		}
+	}
+
 #else
 
 	SOS_ObjectStore	* m_pSOSPacketCache;
@@ -332,39 +537,135 @@ public:
 	~SNIMemRegion()
 	{
 		InterlockedFlushSList(&m_SListHeader);
+
+		delete [] m_pbMagazines;
+		m_pbMagazines = NULL;
+		m_rgMagazines = NULL;
+		m_cMagazines = 0;
+		m_cMagazineSize = 0;
 	}
 
 	SNI_Packet * Pop()
 	{
-		SOS_ObjectStoreDescriptor *pDescriptor;
+		if( 0 == m_cMagazineSize )
+		{
+			return PopList();
+		}
 
-		pDescriptor = static_cast<SOS_ObjectStoreDescriptor*>(InterlockedPopEntrySList(&m_SListHeader));
+		SNIPacketMagazine * pMagazine = GetMagazine();
+		SNI_Packet * pPacket = NULL;
 
-		if( NULL == pDescriptor )
-			return NULL;
+		pMagazine->Lock();
+
+		if( 0 < pMagazine->m_cPackets )
+		{
+			pPacket = pMagazine->m_rgpPackets[--pMagazine->m_cPackets];
+			pMagazine->m_cHits++;
+		}
 		else
-			return SNIPacketContainingDescriptor(pDescriptor);
+		{
+			pMagazine->m_cMisses++;
+		}
+
+		pMagazine->Unlock();
+
+		if( NULL != pPacket )
+		{
+			return pPacket;
+		}
+
+		// Refill half of the magazine from the list, outside of the lock.  The
+		// first packet goes to the caller.
+		pPacket = PopList();
+
+		if( NULL == pPacket )
+		{
+			return Steal(pMagazine);
+		}
+
+		SNI_Packet * rgpRefill[SNI_MAGAZINE_BATCH - 1];
+		DWORD cRefill = 0;
+
+		while( cRefill < m_cMagazineSize / 2 - 1 && 
+			NULL != (rgpRefill[cRefill] = PopList()) )
+		{
+			cRefill++;
+		}
+
+		if( 0 < cRefill )
+		{
+			DWORD iRefill = 0;
+
+			pMagazine->Lock();
+
+			while( iRefill < cRefill && pMagazine->m_cPackets < m_cMagazineSize )
+			{
+				pMagazine->m_rgpPackets[pMagazine->m_cPackets++] = rgpRefill[iRefill++];
+			}
+
+			pMagazine->Unlock();
+
+			// The magazine has been refilled by releases on this processor
+			// in the meantime.
+			while( iRefill < cRefill )
+			{
+				PushList(rgpRefill[iRefill++]);
+			}
+		}
+
+		return pPacket;
 	}
 
 	void Push( __out_opt SNI_Packet *pPacket)
 	{
-		if( QueryDepthSList(&m_SListHeader) < MAX_PACKET_CACHE_SIZE - 1 )
+		if( 0 == m_cMagazineSize )
 		{
-			SLIST_ENTRY* pEntry = static_cast<SLIST_ENTRY*>(SNIPacketGetDescriptor(pPacket));
-			InterlockedPushEntrySList(&m_SListHeader, pEntry);
+			PushList(pPacket);
+			return;
 		}
-		else
+
+		SNIPacketMagazine * pMagazine = GetMagazine();
+		SNI_Packet * rgpDrain[SNI_MAGAZINE_BATCH];
+		DWORD cDrain = 0;
+
+		pMagazine->Lock();
+
+		// Drain half of a full magazine to the list, outside of the lock.
+		if( m_cMagazineSize == pMagazine->m_cPackets )
 		{
-			// Strategy: Don't make an effort to clean up the "extra" entries, but don't push this one onto the stack
-			// if it will go over. This guarantees an *approximate* maximum 
-			// (bounded above by MAX_PACKET_CACHE_SIZE + ConcurrentThreadsAccessingTheStack)
-			
-			// It would cost a lot of performance to put a stronger guarantee on the maximal size, since
-			// we would need to synchronize access to two variables (stack head, stack size), which we 
-			// don't know how to do without using a true sync primitive, rather than the two separate
-			// Interlocked operations which are all that's required to maintain consistency of the list header and 
-			// an *approximate* depth guarantee.
-			SNIPacketDelete(pPacket);
+			cDrain = m_cMagazineSize / 2;
+			pMagazine->m_cPackets -= cDrain;
+			memcpy(rgpDrain, &pMagazine->m_rgpPackets[pMagazine->m_cPackets], cDrain * sizeof(SNI_Packet *));
+		}
+
+		pMagazine->m_rgpPackets[pMagazine->m_cPackets++] = pPacket;
+
+		pMagazine->Unlock();
+
+		for( DWORD i = 0; i < cDrain; i++ )
+		{
+			PushList(rgpDrain[i]);
+		}
+	}
+
+	// Adds up the statistics of the magazines of the region.
+	void GetMagazineStatistics( __out ULONGLONG * pcHits, 
+								__out ULONGLONG * pcMisses, 
+								__out ULONGLONG * pcSteals )
+	{
+		*pcHits = 0;
+		*pcMisses = 0;
+		*pcSteals = 0;
+
+		for( DWORD i = 0; i < m_cMagazines; i++ )
+		{
+			SNIPacketMagazine * pMagazine = &m_rgMagazines[i];
+
+			pMagazine->Lock();
+			*pcHits += pMagazine->m_cHits;
+			*pcMisses += pMagazine->m_cMisses;
+			*pcSteals += pMagazine->m_cSteals;
+			pMagazine->Unlock();
 		}
 	}
 
@@ -455,7 +756,13 @@ public:
 			// Free all the packets in this memory region's cache
 			SNI_Packet * pPacket;
 
+#ifdef SNI_BASED_CLIENT 
+			rgMemRegion[i].FlushMagazines();
+
+			while( NULL != (pPacket = rgMemRegion[i].PopList()) )
+#else
 			while( NULL != (pPacket = (SNI_Packet *) rgMemRegion[i].Pop()) )
+#endif
 			{
 				SNIPacketDelete(pPacket);
 			}
@@ -464,6 +771,18 @@ public:
 
 	static void Terminate( SNIMemRegion *rgMemRegion )
 	{
+#ifdef SNI_BASED_CLIENT 
+		for(DWORD i = 0; i < MAX_MEM_TAGS; i++)
+		{
+			ULONGLONG cHits, cMisses, cSteals;
+
+			rgMemRegion[i].GetMagazineStatistics(&cHits, &cMisses, &cSteals);
+
+			BidTraceU4( SNI_BID_TRACE_ON, SNI_TAG _T("MemTag: %d{MemTagTypes}, magazine hits: %I64u, misses: %I64u, steals: %I64u\n"), 
+				i, cHits, cMisses, cSteals );
+		}
+#endif
+
 		// Cleanup the memory regions
 		Flush(rgMemRegion); 
 
@@ -541,6 +860,7 @@ private:
 	LPVOID				m_pKey;			// Completion Key
 	SNIMemRegion*		m_pMemRegion;	//The memory region this packet belongs to.
 	SNI_Packet *		m_pNext;		// Chained packet
+	SNI_Packet *		m_pSliceOf;		// Packet owning the buffer of a SNI_Packet_Slice
 
 #ifndef SNI_BASED_CLIENT
 	BOOL				m_fZeroPayloadOnRelease;	// Zero out data portion before releasing
@@ -575,6 +895,7 @@ private:
 				m_bMemTag(checked_static_cast<BYTE>(dwMemTag)),
 #endif // !SNI_BASED_CLIENT
 				m_pNext(0),
+				m_pSliceOf(0),
 				m_OrigProv(INVALID_PROV),
 				m_cbTrailer(0),
 				m_cRef(1),
@@ -655,12 +976,16 @@ private:
 		// Key Holder packets must always have their buffer set to NULL
 		// "VaryingBuffer*" packets must have their buffer released
 		// by the Consumer.
+		// Slices let go of their buffer when they are released.
 		Assert( (SNI_Packet_KeyHolderNoBuf != m_IOType) ||
 				(NULL == m_pBuffer) );
+		Assert( (SNI_Packet_Slice != m_IOType) ||
+				((NULL == m_pBuffer) && (NULL == m_pSliceOf)) );
 
 		if (m_pBuffer &&
 			(SNI_Packet_VaryingBufferRead != m_IOType) &&
-			(SNI_Packet_VaryingBufferWrite != m_IOType) )
+			(SNI_Packet_VaryingBufferWrite != m_IOType) &&
+			(SNI_Packet_Slice != m_IOType) )
 		{
 #ifndef SNI_BASED_CLIENT
 
@@ -747,6 +1072,11 @@ public:
 				cBufferSize = BUF_0K;
 				IOCompRoutine = (SOS_IOCompRoutine *)SNIWriteDone;
 				break;
+			case SNI_Packet_Slice:
+				MemTag = REG_0K;
+				cBufferSize = BUF_0K;
+				IOCompRoutine = (SOS_IOCompRoutine *)SNIReadDone;
+				break;
 			case SNI_Packet_Read:
 				MemTag = pConn->m_MemTag;
 				cBufferSize = pConn->m_ConnInfo.ConsBufferSize + pConn->m_ConnInfo.ProvBufferSize;
@@ -877,6 +1207,43 @@ public:
 		return pPacket;
 	}
 
+	// Note: This is for Providers to hand out part of a packet's data without
+	// copying it.  The new packet refers to the cbSlice bytes of pPacket's data
+	// that start at its current offset, and holds a reference on the packet
+	// owning the buffer until it is released.  pPacket itself is not changed.
+	// A slice cannot be read into, so only complete data should be sliced.
+	//
+	friend SNI_Packet * SNIPacketAllocateSlice( SNI_Packet * pPacket, DWORD cbSlice )
+	{
+		BidTraceU2( SNI_BID_TRACE_ON, SNIAPI_TAG _T( "pPacket: %p{SNI_Packet*}, cbSlice: %d\n"), 
+						pPacket, cbSlice);
+
+		Assert( cbSlice <= pPacket->m_cbBuffer );
+
+		// Always refer to the packet that owns the buffer.
+		SNI_Packet * pOwner = (SNI_Packet_Slice == pPacket->m_IOType) ? pPacket->m_pSliceOf : pPacket;
+
+		Assert( (SNI_Packet_Read == pOwner->m_IOType) || (SNI_Packet_Write == pOwner->m_IOType) );
+
+		SNI_Packet * pSlice = SNIPacketAllocateEx2( pPacket->m_pConn, SNI_Packet_Slice, SNI_Consumer_SNI );
+
+		if (pSlice)
+		{
+			Assert( (NULL == pSlice->m_pBuffer) && (NULL == pSlice->m_pSliceOf) );
+
+			pSlice->m_pBuffer = SNIPacketGetBufPtr( pPacket );
+			pSlice->m_cBufferSize = cbSlice;
+			pSlice->m_cbBuffer = cbSlice;
+			pSlice->m_pSliceOf = pOwner;
+
+			SNIPacketAddRef( pOwner );
+		}
+
+		BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%p{SNI_Packet*}\n"), pSlice);
+		
+		return pSlice;
+	}
+
 
 	// This is a wrapper around NewNoX call to eliminate exception handler
 	// set up/teardown in the calling function; we do not want to inline 
@@ -1025,7 +1392,8 @@ public:
 
 #ifndef SNI_BASED_CLIENT
 		if ((SNI_Packet_Read == pPacket->m_IOType) ||
-			(SNI_Packet_Write == pPacket->m_IOType))
+			(SNI_Packet_Write == pPacket->m_IOType) ||
+			(SNI_Packet_Slice == pPacket->m_IOType))
 		{
 			Assert(pPacket->m_pBuffer != NULL);
 			BOOL fGlobalZeroingRequired = SOS_OS::GetCommonCriteriaModeEnabled ();
@@ -1080,6 +1448,20 @@ public:
 			pPacket->m_cbBuffer = 0;
 		}
 
+		// A slice drops its reference on the packet owning the buffer once
+		// it is back in the pool.
+		SNI_Packet * pSliceOf = NULL;
+
+		if (SNI_Packet_Slice == pPacket->m_IOType)
+		{
+			pSliceOf = pPacket->m_pSliceOf;
+			pPacket->m_pSliceOf = NULL;
+			pPacket->m_pBuffer = NULL;
+			pPacket->m_pNext = NULL;
+			pPacket->m_cBufferSize = 0;
+			pPacket->m_cbBuffer = 0;
+		}
+
 		pPacket->m_ConsBuf = SNI_Consumer_PacketIsReleased;
 
 		BidTraceU1( SNI_BID_TRACE_ON, SNI_TAG 
@@ -1104,6 +1486,11 @@ public:
 #endif
 		
 		pPacket->m_pMemRegion->Push(pPacket);
+
+		if (pSliceOf)
+		{
+			SNIPacketRelease(pSliceOf);
+		}
 	}
 
 	friend void SNIPacketReset(SNI_Conn * pConn, SNI_Packet_IOType IOType, SNI_Packet * pPacket, ConsumerNum ConsNum)
@@ -1143,6 +1530,31 @@ public:
 			pPacket->m_cBufferSize = 0;
 		}
 
+		// A slice lets go of the buffer it borrowed.  It was cached in the 
+		// REG_0K region and never owns a buffer, so it can only become another 
+		// "buffer-less" packet.  Asked to become a Read or Write packet it 
+		// becomes a key holder instead, which the caller still releases.  
+		if (SNI_Packet_Slice == pPacket->m_IOType)
+		{
+			SNIPacketRelease(pPacket->m_pSliceOf);
+			pPacket->m_pSliceOf = NULL;
+			pPacket->m_pBuffer = NULL;
+			pPacket->m_pNext = NULL;
+			pPacket->m_cBufferSize = 0;
+
+			if ((SNI_Packet_Read == IOType) || (SNI_Packet_Write == IOType))
+			{
+				Assert(false && "A slice cannot be reset to a packet owning a buffer\n");
+
+				SNI_SET_LAST_ERROR( INVALID_PROV, SNIE_SYSTEM, ERROR_INVALID_PARAMETER );
+				BidTrace2( ERROR_TAG _T( "%u#{SNI_Packet}, IOType: %d\n" ), 
+					SNIPacketGetBidId(pPacket), IOType ); 
+
+				pPacket->m_OffSet = 0;
+				IOType = SNI_Packet_KeyHolderNoBuf;
+			}
+		}
+
 		pPacket->m_cbBuffer = 0;
 		pPacket->m_IOType = IOType;
 		pPacket->m_ConsBuf = ConsNum;
@@ -1396,7 +1808,7 @@ public:
 		else
 			return ERROR_FAIL;		
 #else
-		if( PostQueuedCompletionStatus( ghIoCompletionPort, numBytes, 0, SNIPacketOverlappedStruct(pPacket)) )
+		if( ERROR_SUCCESS == gpCompletionPort->Post( SNIPacketOverlappedStruct(pPacket), numBytes ) )
 			return ERROR_SUCCESS;
 		else
 			return ERROR_FAIL;
@@ -89,6 +89,9 @@ typedef struct __CONNECTEXFUNC
 	LPFN_CONNECTEX pfnConnectEx; 
 } CONNECTEXFUNC;
 
+// Upper bound of SNI_QUERY_TCP_CONNECT_ATTEMPT_DELAY, in milliseconds (RFC 8305, section 8)
+#define TCP_MAX_CONNECT_ATTEMPT_DELAY	2000
+
 class Tcp : public SNI_Provider
 {
 private:	
@@ -120,9 +123,11 @@ private:
 public:
 	Tcp(SNI_Conn * pConn);
 	~Tcp();	
+	DWORD FInit();
 
 	static BOOL s_fAutoTuning;
 	static BOOL s_fSkipCompletionPort;
+	static DWORD s_dwConnectAttemptDelay;
 
 	static DWORD Initialize(PSNI_PROVIDER_INFO pInfo);
 	static DWORD Terminate();
@@ -189,8 +194,6 @@ private:
 
 	static bool IsNumericAddress( LPWSTR name);
 
-	DWORD Tcp::FInit(); 
-
 	DWORD ParallelOpen(__in ADDRINFOW *AddrInfoW, int timeout, DWORD dwStartTickCount);
 	
 	__inline  DWORD CheckAndAdjustSendBufferSizeBasedOnISB();
@@ -205,7 +208,7 @@ private:
 	BOOL FCloseRefHandle(); 
 
 	static DWORD ShouldEnableSkipIOCompletion(__out BOOL* pfShouldEnable);
-	static UINT GetAddrCount(const ADDRINFOW *AIW);
+	static void InterleaveAddressFamilies(const ADDRINFOW *AIW, __out_ecount(dwAddresses) const ADDRINFOW **rgpAddresses, DWORD dwAddresses);
 };
 
 #endif
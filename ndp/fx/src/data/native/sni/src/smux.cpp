@@ -39,7 +39,56 @@ BID_METATEXT( _T("<ApiGroup|SNI|SMUX_HEADER> 0x00001000: SNI SMUX packet headers
 }
 
 #define SMUX_HEADER_SIZE			16
+
+//
+// Each peer assumes a window of SMUX_BUFFER_QUEUE_SIZE packets until the first 
+// ACK, so that is also the smallest window a Session shrinks to.  When a 
+// reader waits on a peer that has used all of the window, the window grows 
+// to the bandwidth-delay product, the packets the peer could send in one 
+// round trip at the rate the last burst arrived, and at least doubles.  It 
+// loses a packet whenever more than half of it sits in the received queue.  
+// SMUX_MAX_RECEIVE_WINDOW bounds the window and the read semaphore.  
+//
 #define SMUX_BUFFER_QUEUE_SIZE 		4
+#define SMUX_MAX_RECEIVE_WINDOW 	64
+
+//
+// Sequence numbers wrap around, compare them by their distance
+//
+#define SMUX_SEQ_LE( a, b )		( (LONG)((a)-(b)) <= 0 )
+#define SMUX_SEQ_LT( a, b )		( (LONG)((a)-(b)) < 0 )
+
+//
+// Round trips on a LAN take less than a GetTickCount tick, so the window 
+// is timed in performance counter counts.  0 stands for no time taken.  
+//
+static LONGLONG SmuxQueryTime()
+{
+	LARGE_INTEGER liNow;
+
+	QueryPerformanceCounter( &liNow );
+
+	return liNow.QuadPart ? liNow.QuadPart : 1;
+}
+
+static DWORD SmuxTimeToUsec( LONGLONG llTime )
+{
+	LARGE_INTEGER liFrequency;
+
+	if( !QueryPerformanceFrequency( &liFrequency ) || 0 == liFrequency.QuadPart )
+	{
+		return 0;
+	}
+
+	ULONGLONG ullUsec = (ULONGLONG)llTime * 1000000 / liFrequency.QuadPart;
+
+	return ( ullUsec < MAXDWORD ) ? (DWORD)ullUsec : MAXDWORD;
+}
+
+//
+// Defaults of SNI_SMUX_COALESCE_INFO, see Smux::WriteFrame
+//
+#define SMUX_COALESCE_MAX_BYTES		8192
 
 #define SMUX_IDENTIFIER 83
 
@@ -75,6 +124,15 @@ class Session : public SNI_Provider
 	DWORD 	m_SequenceNumberForReceive;	//Sequence number for peer
 	DWORD	m_HighWaterForReceive;		//Maximum sequence number for peer that this Session can accept
 	DWORD 	m_LastHighWaterForReceive;			//Last ACK we send this is the limit for peer
+
+	DWORD	m_dwReceiveWindow;			//m_HighWaterForReceive minus the packets consumed
+	DWORD	m_dwMaxReceiveWindow;
+	LONGLONG	m_llWindowUpdateTime;	//when a window update unblocked the peer, 0 once the next packet arrived
+	LONGLONG	m_llRtt;				//smoothed time from such an update to the next packet
+	LONGLONG	m_llBurstTime;			//when the first packet after such an update arrived
+	DWORD	m_cBurstPackets;			//packets received since then
+	DWORD	m_cWindowGrowths;
+	DWORD	m_cWindowShrinks;
 	
 	DynamicQueue m_ReadPacketQueue;
 
@@ -122,6 +180,9 @@ public:
 	DWORD SendControlPacketIfGoodConn( BYTE Flag ); 
 	DWORD CheckConnection();
 	
+	void GetWindowInfo( __out SNI_SMUX_WINDOW_INFO * pWindowInfo );
+	DWORD SetMaxWindow( DWORD dwMaxWindow );
+	
 	Session(SNI_Conn *pConnection, SNI_Provider *pNext, USHORT SessionId, __in Smux *pSmux);
 
 	~Session();
@@ -143,11 +204,17 @@ private:
 	//Check to see if we need to send an ACK
 	bool NeedToSendACK()
 	{
-		Assert( m_HighWaterForReceive-m_LastHighWaterForReceive <=2 );
+		Assert( SMUX_SEQ_LE( m_LastHighWaterForReceive, m_HighWaterForReceive ) );
 
-		return ( m_LastHighWaterForReceive+2 == m_HighWaterForReceive );
+		return ( m_HighWaterForReceive-m_LastHighWaterForReceive >= 2 );
 	}
 
+	//Advances the high water for one packet consumed by the upper layer
+	void ConsumeReceivedPacket( bool fReaderWaited );
+
+	//Remembers that m_HighWaterForReceive was sent to the peer
+	void WindowAdvertised();
+
 	DWORD ProcessDataPacket(__inout SNI_Packet **ppPacket);
 
 	void CleanUp();
@@ -242,6 +309,17 @@ private:
 
 Session::~Session()
 {
+	BidTraceU5( SNI_BID_TRACE_ON, SNI_TAG _T("%u#, ")
+										 _T("window: %d, ")
+										 _T("rtt: %u us, ")
+										 _T("growths: %d, ")
+										 _T("shrinks: %d\n"), 
+										 GetBidId(), 
+										 m_dwReceiveWindow, 
+										 SmuxTimeToUsec( m_llRtt ), 
+										 m_cWindowGrowths, 
+										 m_cWindowShrinks ); 
+
 	BidRecycleItemIDA( &m_iBidId, SNI_ID_TAG ); 
 
 	if( m_fSync )
@@ -476,7 +554,7 @@ DWORD Session::FInit()
 		m_lpReadHandles[0] = CreateSemaphore( 
 					    NULL,   // no security attributes
 					    0,   // initial count
-					    SMUX_BUFFER_QUEUE_SIZE,   // maximum count
+					    SMUX_MAX_RECEIVE_WINDOW,   // maximum count
 					    NULL);  // unnamed semaphore
 					    
 		if( NULL == m_lpReadHandles[0] )
@@ -592,6 +670,140 @@ void Session::PrependSmuxHeader(SNI_Packet *pPacket, BYTE Flag)
 	SNIPacketPrependData(pPacket, (BYTE *)&m_SmuxHeader, SMUX_HEADER_SIZE);
 }
 
+// Note: Caller should own this Session's m_CS before calling this method.
+void Session::ConsumeReceivedPacket( bool fReaderWaited )
+{
+	//packets consumed so far, this one included
+	DWORD dwConsumed = m_HighWaterForReceive - m_dwReceiveWindow + 1;
+	DWORD cBacklog = m_SequenceNumberForReceive - dwConsumed;
+
+	if( fReaderWaited && 
+		m_SequenceNumberForReceive == m_LastHighWaterForReceive &&
+		m_dwReceiveWindow < m_dwMaxReceiveWindow )
+	{
+		//
+		// The reader waited for a packet while the peer waited for window, 
+		// so the window rather than either side limits the session.  Size 
+		// it for a round trip at the rate the last burst came in.  Without 
+		// a round trip or a burst measured yet, double it.  
+		//
+		DWORD dwTarget = 2 * m_dwReceiveWindow;
+
+		if( m_llRtt && m_llBurstTime )
+		{
+			LONGLONG llBurst = SmuxQueryTime() - m_llBurstTime;
+			ULONGLONG ullBdp = ( 0 < llBurst ) ? 
+				( (ULONGLONG)m_cBurstPackets * m_llRtt + llBurst - 1 ) / llBurst : 
+				0;
+
+			if( ullBdp > dwTarget )
+			{
+				dwTarget = ( ullBdp < m_dwMaxReceiveWindow ) ? (DWORD)ullBdp : m_dwMaxReceiveWindow;
+			}
+		}
+
+		m_dwReceiveWindow = ( dwTarget < m_dwMaxReceiveWindow ) ? 
+			dwTarget : m_dwMaxReceiveWindow;
+		m_cWindowGrowths++;
+	}
+	else if( m_dwReceiveWindow > SMUX_BUFFER_QUEUE_SIZE && 
+			 ( cBacklog > m_dwReceiveWindow / 2 || m_dwReceiveWindow > m_dwMaxReceiveWindow ) )
+	{
+		//
+		// The consumer falls behind, keep the credit of this packet.  The 
+		// high water stays where it is, it must never move back.  
+		//
+		m_dwReceiveWindow--;
+		m_cWindowShrinks++;
+	}
+	else
+	{
+		m_HighWaterForReceive++;
+		return;
+	}
+
+	DWORD dwHighWater = dwConsumed + m_dwReceiveWindow;
+
+	//
+	// Older peers only accept a high water that wraps around once the last 
+	// one is within SMUX_BUFFER_QUEUE_SIZE of the wrap, so stop there first
+	//
+	if( dwHighWater < m_LastHighWaterForReceive && 
+		m_LastHighWaterForReceive < (DWORD)-SMUX_BUFFER_QUEUE_SIZE )
+	{
+		dwHighWater = ( m_HighWaterForReceive > (DWORD)-SMUX_BUFFER_QUEUE_SIZE ) ? 
+			m_HighWaterForReceive : (DWORD)-SMUX_BUFFER_QUEUE_SIZE;
+		m_dwReceiveWindow = dwHighWater - dwConsumed;
+	}
+
+	Assert( SMUX_SEQ_LE( m_HighWaterForReceive, dwHighWater ) );
+
+	m_HighWaterForReceive = dwHighWater;
+
+	BidTraceU3( SNI_BID_TRACE_ON, SNI_TAG _T("%u#, ")
+										 _T("window: %d, ")
+										 _T("backlog: %d\n"), 
+										 GetBidId(), 
+										 m_dwReceiveWindow, 
+										 cBacklog ); 
+}
+
+// Note: Caller should own this Session's m_CS before calling this method.
+void Session::WindowAdvertised()
+{
+	//
+	// A peer that used up the window it knew about cannot send until this 
+	// update arrives, time it until the next packet does
+	//
+	if( m_SequenceNumberForReceive == m_LastHighWaterForReceive && 
+		m_HighWaterForReceive != m_LastHighWaterForReceive )
+	{
+		m_llWindowUpdateTime = SmuxQueryTime();
+	}
+
+	m_LastHighWaterForReceive = m_HighWaterForReceive;
+}
+
+void Session::GetWindowInfo( __out SNI_SMUX_WINDOW_INFO * pWindowInfo )
+{
+	CAutoSNICritSec a_cs( m_CS, SNI_AUTOCS_ENTER );
+
+	pWindowInfo->dwWindow = m_dwReceiveWindow;
+	pWindowInfo->dwMinWindow = SMUX_BUFFER_QUEUE_SIZE;
+	pWindowInfo->dwMaxWindow = m_dwMaxReceiveWindow;
+	pWindowInfo->dwRtt = SmuxTimeToUsec( m_llRtt );
+	pWindowInfo->cGrowths = m_cWindowGrowths;
+	pWindowInfo->cShrinks = m_cWindowShrinks;
+}
+
+DWORD Session::SetMaxWindow( DWORD dwMaxWindow )
+{
+	BidxScopeAutoSNI2( SNIAPI_TAG _T("%u#, ")
+							  _T("dwMaxWindow: %d\n"), 
+							  GetBidId(),
+							  dwMaxWindow);
+
+	//
+	// The read semaphore of sync sessions cannot count beyond 
+	// SMUX_MAX_RECEIVE_WINDOW packets
+	//
+	if( dwMaxWindow < SMUX_BUFFER_QUEUE_SIZE || dwMaxWindow > SMUX_MAX_RECEIVE_WINDOW )
+	{
+		BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), ERROR_INVALID_PARAMETER);
+
+		return ERROR_INVALID_PARAMETER;
+	}
+
+	CAutoSNICritSec a_cs( m_CS, SNI_AUTOCS_ENTER );
+
+	//a larger window shrinks back as packets are consumed
+	m_dwMaxReceiveWindow = dwMaxWindow;
+
+	BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), ERROR_SUCCESS);
+
+	return ERROR_SUCCESS;
+}
+
 DWORD Session::ProcessDataPacket(__inout SNI_Packet **ppPacket)
 {
 	BidxScopeAutoSNI2( SNIAPI_TAG _T("%u#, ")
@@ -609,8 +821,7 @@ DWORD Session::ProcessDataPacket(__inout SNI_Packet **ppPacket)
 	//
 	
 	if( pSmuxHeader->SequenceNumber != m_SequenceNumberForReceive+1  ||
-		!( pSmuxHeader->SequenceNumber <= m_LastHighWaterForReceive ||
-		      pSmuxHeader->SequenceNumber+SMUX_BUFFER_QUEUE_SIZE < m_LastHighWaterForReceive+SMUX_BUFFER_QUEUE_SIZE) ||
+		!SMUX_SEQ_LE( pSmuxHeader->SequenceNumber, m_LastHighWaterForReceive ) ||
 		pSmuxHeader->Length <= SMUX_HEADER_SIZE )
 	{
 		SNI_ASSERT_ON_INVALID_PACKET
@@ -624,6 +835,25 @@ DWORD Session::ProcessDataPacket(__inout SNI_Packet **ppPacket)
 
 	m_SequenceNumberForReceive = pSmuxHeader->SequenceNumber;
 
+	if( m_llWindowUpdateTime )
+	{
+		LONGLONG llNow = SmuxQueryTime();
+		LONGLONG llRtt = llNow - m_llWindowUpdateTime;
+
+		if( 0 < llRtt )
+		{
+			m_llRtt = m_llRtt ? ( 7 * m_llRtt + llRtt ) / 8 : llRtt;
+		}
+
+		m_llWindowUpdateTime = 0;
+
+		//the burst the update let through starts here
+		m_llBurstTime = llNow;
+		m_cBurstPackets = 0;
+	}
+
+	m_cBurstPackets++;
+
 	SNIPacketSetBufferSize( *ppPacket, pSmuxHeader->Length-SMUX_HEADER_SIZE);
 	SNIPacketIncrementOffset( *ppPacket, SMUX_HEADER_SIZE);
 
@@ -637,7 +867,7 @@ DWORD Session::ProcessDataPacket(__inout SNI_Packet **ppPacket)
 
 		Assert( !m_fSync );
 		
-		m_HighWaterForReceive++;
+		ConsumeReceivedPacket( true );
 
 		if( NeedToSendACK() )
 		{
@@ -748,7 +978,7 @@ DWORD Session::ReadAsync(__out SNI_Packet ** ppNewPacket, LPVOID pPacketKey)
 
 		SNIPacketSetKey( *ppNewPacket, pPacketKey);
 		
-		m_HighWaterForReceive++;	//client comsumed one buffer so increase window size
+		ConsumeReceivedPacket( false );
 
 		Assert( m_ReadPacketQueue.IsEmpty() );
 		
@@ -872,8 +1102,7 @@ DWORD Session::ReadDone(__inout SNI_Packet ** ppPacket, __out SNI_Packet **ppLef
 
 	Assert( sizeof(SmuxHeader) <= cbPacket );
 
-	if(!( m_HighWaterForSend <= pSmuxHeader->HighWater 
-		|| m_HighWaterForSend +SMUX_BUFFER_QUEUE_SIZE<pSmuxHeader->HighWater+SMUX_BUFFER_QUEUE_SIZE)
+	if( !SMUX_SEQ_LE( m_HighWaterForSend, pSmuxHeader->HighWater )
 		||pSmuxHeader->Length != cbPacket 
 		||m_fFINReceived
 		||pSmuxHeader->SessionId != m_SessionId)
@@ -1214,6 +1443,12 @@ DWORD Session::ReadSync(__out SNI_Packet ** ppNewPacket, int timeout)
 	// no need to dequeue.  
 	//
 
+	//
+	// A packet that did not come through the received queue is one the 
+	// reader had to wait for.  
+	//
+	bool fReaderWaited = ( NULL != *ppNewPacket );
+	
 	if( !*ppNewPacket )
 	{
 		*ppNewPacket = (SNI_Packet *) m_ReceivedPacketQueue.DeQueue();
@@ -1221,7 +1456,7 @@ DWORD Session::ReadSync(__out SNI_Packet ** ppNewPacket, int timeout)
 
 	Assert ( *ppNewPacket );
 		
-	m_HighWaterForReceive++;	//client comsumed one buffer so increase window size
+	ConsumeReceivedPacket( fReaderWaited );
 
 	if( NeedToSendACK())
 	{
@@ -1328,7 +1563,7 @@ DWORD Session::SendControlPacket( BYTE Flag )
 	if( m_fSync )
 		dwRet = m_pNext->WriteSync( pPacket, NULL);
 	else
-		dwRet = m_pNext->WriteAsync( pPacket, NULL);
+		dwRet = m_pSmux->WriteFrame( pPacket, false );
 
 	if( dwRet == ERROR_SUCCESS || dwRet == ERROR_IO_PENDING )
 	{
@@ -1343,7 +1578,7 @@ DWORD Session::SendControlPacket( BYTE Flag )
 			m_pConn->Release( REF_InternalWrite );
 			SNIPacketRelease( pPacket );
 		}
-		m_LastHighWaterForReceive = m_HighWaterForReceive;
+		WindowAdvertised();
 	}
 	else
 	{
@@ -1408,7 +1643,7 @@ DWORD Session::SendDataPacket( __out SNI_Packet *pPacket )
 
 	DWORD dwRet;
 	
-	Assert(m_SequenceNumberForSend < m_HighWaterForSend || m_SequenceNumberForSend +SMUX_BUFFER_QUEUE_SIZE<m_HighWaterForSend+ SMUX_BUFFER_QUEUE_SIZE);
+	Assert( SMUX_SEQ_LT( m_SequenceNumberForSend, m_HighWaterForSend ) );
 	m_SequenceNumberForSend++;	//first we increment Sequence number
 
 	PrependSmuxHeader( pPacket, SMUX_DATA);
@@ -1423,13 +1658,13 @@ DWORD Session::SendDataPacket( __out SNI_Packet *pPacket )
 	if( m_fSync )
 		dwRet = m_pNext->WriteSync( pPacket, NULL);
 	else
-		dwRet = m_pNext->WriteAsync( pPacket, NULL);
+		dwRet = m_pSmux->WriteFrame( pPacket, true );
 
 	if(dwRet == ERROR_SUCCESS || dwRet == ERROR_IO_PENDING )
 	{
 		Assert( dwRet != ERROR_IO_PENDING || !m_fSync);
 
-		m_LastHighWaterForReceive = m_HighWaterForReceive;
+		WindowAdvertised();
 	}
 
 	BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), dwRet);
@@ -1492,6 +1727,14 @@ Session::Session(SNI_Conn *pConn, SNI_Provider *pNext, USHORT SessionId, __in Sm
 	m_HighWaterForReceive = SMUX_BUFFER_QUEUE_SIZE;	//Default size of PacketQueue
 	m_LastHighWaterForReceive = SMUX_BUFFER_QUEUE_SIZE;		//Peer assume this value at the start
 
+	m_dwReceiveWindow = SMUX_BUFFER_QUEUE_SIZE;
+	m_dwMaxReceiveWindow = SMUX_MAX_RECEIVE_WINDOW;
+	m_llWindowUpdateTime = 0;
+	m_llRtt = 0;
+	m_llBurstTime = 0;
+	m_cBurstPackets = 0;
+	m_cWindowGrowths = 0;
+	m_cWindowShrinks = 0;
 
 	m_fFINSentOrToSend = false;
 	m_fFINReceived = false;
@@ -1658,6 +1901,8 @@ DWORD Session::WriteDone(__inout SNI_Packet ** ppPacket, DWORD dwBytes, DWORD dw
 	if( (*ppPacket)->m_OrigProv!=SESSION_PROV )
 	{
 		dwRet = m_pNext->WriteDone( ppPacket,  dwBytes, dwError);
+
+		m_pSmux->WriteFrameDone();
 	}
 	else
 	{
@@ -1720,7 +1965,7 @@ DWORD Session::WriteDone(__inout SNI_Packet ** ppPacket, DWORD dwBytes, DWORD dw
 					
 					m_pConn->AddRef( REF_InternalWrite );
 					
-					dwRet = m_pNext->WriteAsync( *ppPacket, NULL);
+					dwRet = m_pSmux->WriteFrame( *ppPacket, false );
 
 					if( dwRet == ERROR_IO_PENDING )
 					{
@@ -1947,6 +2192,8 @@ Smux::~Smux()
 
 	Assert( m_SessionListCS == NULL );
 
+	Assert( m_WriteCS == NULL );
+
 	Assert( !m_pPacketKeyHolder );
 
 	Assert( !m_nSessions );
@@ -2126,6 +2373,11 @@ void Smux::CleanUp()
 	Assert( m_SessionListCS != NULL );
 	DeleteCriticalSection( &m_SessionListCS );
 
+	Assert( m_WriteCS != NULL );
+	DeleteCriticalSection( &m_WriteCS );
+
+	Assert( !m_pCoalescePacket );
+
 	if( m_fSync )
 	{
 		CloseHandle( m_SyncWorkerMutex );
@@ -2161,6 +2413,24 @@ DWORD Smux::Close()
 
 		TerminateSessions();
 
+		//
+		// frames gathered but not written yet fail with their sessions
+		//
+		{
+			CAutoSNICritSec a_csWrite( m_WriteCS, SNI_AUTOCS_ENTER );
+
+			if( m_pCoalescePacket )
+			{
+				CompleteCoalescedFrames( SNIPacketGetNext( m_pCoalescePacket ), false );
+
+				SNIPacketSetNext( m_pCoalescePacket, NULL );
+				SNIPacketRelease( m_pCoalescePacket );
+
+				m_pCoalescePacket = NULL;
+				m_pCoalesceTail = NULL;
+			}
+		}
+
 		dwRet = m_pNext->Close();
 	}
 	else
@@ -2208,6 +2478,13 @@ DWORD Smux::FInit()
 		goto ErrorExit;
 	}
 
+	dwRet = SNICritSec::Initialize( &m_WriteCS );
+
+	if(ERROR_SUCCESS != dwRet)
+	{
+		goto ErrorExit;
+	}
+
 	if( m_fSync )
 	{
 		m_SyncWorkerMutex = CreateEvent( 0, FALSE, FALSE, 0);
@@ -2240,6 +2517,12 @@ ErrorExit:
 		Assert( m_SessionListCS == NULL );
 	}
 
+	if( m_WriteCS )
+	{
+		DeleteCriticalSection( &m_WriteCS );
+		Assert( m_WriteCS == NULL );
+	}
+
 	if( m_fSync )
 	{
 		if( m_SyncWorkerMutex != NULL )
@@ -2433,6 +2716,40 @@ DWORD Smux::GetWholePacket( __inout SNI_Packet **ppPacket, __out SNI_Packet **pp
 		pbLeftOver += cbWholePacketLength;
 		cbLeftOver = SNIPacketGetBufferSize( pPacket);
 		cbLeftOver -= cbWholePacketLength;
+
+		//	If the rest of the read starts with another complete packet, 
+		//	hand the first packet out as a slice of the buffer and keep 
+		//	the rest in place, so that a read holding the packets of many 
+		//	sessions is never copied.  The leftover is not read into again 
+		//	in that case, which transports only support at offset 0.  
+		//	Otherwise the rest is copied to the start of a new packet.  
+		//
+		if( cbLeftOver >= SMUX_HEADER_SIZE && 
+			((UNALIGNED SmuxHeader *)pbLeftOver)->Length <= cbLeftOver )
+		{
+			SNI_Packet *pWholePacket;
+
+			pWholePacket = SNIPacketAllocateSlice( pPacket, cbWholePacketLength );
+			if( pWholePacket == NULL )
+			{
+				SNI_SET_LAST_ERROR( SMUX_PROV, SNIE_4, ERROR_OUTOFMEMORY );
+
+				BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), ERROR_OUTOFMEMORY);
+		
+				return ERROR_OUTOFMEMORY;
+			}
+
+			SNIPacketIncrementOffset( pPacket, cbWholePacketLength);
+			SNIPacketSetBufferSize( pPacket, cbLeftOver);
+			pPacket->m_OrigProv = SMUX_PROV;
+
+			*ppPacket = pWholePacket;
+			*ppLeftOver = pPacket;
+
+			BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), ERROR_SUCCESS);
+	
+			return ERROR_SUCCESS;
+		}
 		
 		pLeftOver = SNIPacketAllocate(m_pConn, SNI_Packet_Read);
 		if( pLeftOver == NULL )
@@ -2534,6 +2851,61 @@ DWORD Smux::Initialize( PSNI_PROVIDER_INFO pInfo )
 	return ERROR_SUCCESS;
 }
 
+void Smux::GetSessionWindowInfo( __in SNI_Provider * pProv, __out SNI_SMUX_WINDOW_INFO * pWindowInfo )
+{
+	Assert( SESSION_PROV == pProv->m_Prot );
+
+	static_cast<Session *>(pProv)->GetWindowInfo( pWindowInfo );
+}
+
+DWORD Smux::SetSessionMaxWindow( __in SNI_Provider * pProv, DWORD dwMaxWindow )
+{
+	Assert( SESSION_PROV == pProv->m_Prot );
+
+	return static_cast<Session *>(pProv)->SetMaxWindow( dwMaxWindow );
+}
+
+void Smux::GetCoalesceInfo( __out SNI_SMUX_COALESCE_INFO * pCoalesceInfo )
+{
+	CAutoSNICritSec a_csWrite( m_WriteCS, SNI_AUTOCS_ENTER );
+
+	pCoalesceInfo->fEnabled = m_fCoalesce;
+	pCoalesceInfo->cbMaxBytes = m_cbCoalesceMax;
+	pCoalesceInfo->cFrames = m_cCoalescedFrames;
+	pCoalesceInfo->cWrites = m_cCoalescedWrites;
+}
+
+DWORD Smux::SetCoalesceInfo( __in SNI_SMUX_COALESCE_INFO * pCoalesceInfo )
+{
+	BidxScopeAutoSNI3( SNIAPI_TAG _T("%u#, ")
+							  _T("fEnabled: %d{BOOL}, ")
+							  _T("cbMaxBytes: %d\n"), 
+							  GetBidId(),
+							  pCoalesceInfo->fEnabled, 
+							  pCoalesceInfo->cbMaxBytes);
+
+	if( m_fSync )
+	{
+		BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), ERROR_INVALID_PARAMETER);
+
+		return ERROR_INVALID_PARAMETER;
+	}
+	
+	CAutoSNICritSec a_csWrite( m_WriteCS, SNI_AUTOCS_ENTER );
+
+	m_fCoalesce = pCoalesceInfo->fEnabled;
+	m_cbCoalesceMax = pCoalesceInfo->cbMaxBytes;
+
+	if( m_pCoalescePacket && !m_fCoalesce )
+	{
+		FlushCoalescedFrames();
+	}
+
+	BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), ERROR_SUCCESS);
+
+	return ERROR_SUCCESS;
+}
+
 void Smux::InternalClose()
 {
 	BidxScopeAutoSNI1( SNIAPI_TAG _T("%u#\n"), GetBidId() );
@@ -3273,6 +3645,18 @@ Smux::Smux(SNI_Conn *pConn):SNI_Provider( pConn )
 	
 	m_SyncWorkAccessCount = 0;
 
+	m_WriteCS = NULL;
+
+	m_pCoalescePacket = NULL;
+	m_pCoalesceTail = NULL;
+	m_cWritesPending = 0;
+
+	m_fCoalesce = TRUE;
+	m_cbCoalesceMax = SMUX_COALESCE_MAX_BYTES;
+
+	m_cCoalescedFrames = 0;
+	m_cCoalescedWrites = 0;
+
 	BidObtainItemID2A( &m_iBidId, SNI_ID_TAG "%p{.} created by %u#{SNI_Conn}", 
 		this, pConn->GetBidId() );
 }
@@ -3494,16 +3878,224 @@ DWORD Smux::WriteDone(SNI_Packet ** ppPacket, DWORD dwBytes, DWORD dwError)
 
 	Assert( !m_fSync );
 
-	//WriteDone should be called for Session
+	//
+	// Sessions write their own packets, the only writes that complete here 
+	// are the frames Smux::FlushCoalescedFrames gathered for them
+	//
+	SNI_Packet *pFrames = SNIPacketGetNext( *ppPacket );
+
+	SNIPacketSetNext( *ppPacket, NULL );
+
+	DWORD dwRet;
 	
-	Assert( 0 && "This function is not implemented\n" );
-	BidTrace0( ERROR_TAG _T("This function is not implemented\n") );
+	dwRet = m_pNext->WriteDone( ppPacket, dwBytes, dwError );
 
-	SNI_SET_LAST_ERROR( SMUX_PROV, SNIE_15, ERROR_FAIL );
+	{
+		CAutoSNICritSec a_csWrite( m_WriteCS, SNI_AUTOCS_ENTER );
 
-	BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), ERROR_FAIL);
+		CompleteCoalescedFrames( pFrames, ERROR_SUCCESS == dwRet && 0 != dwBytes );
+	}
 
-	return ERROR_FAIL;
+	if( *ppPacket )
+	{
+		SNIPacketRelease( *ppPacket );
+
+		*ppPacket = NULL;
+	}
+
+	WriteFrameDone();
+
+	m_pConn->Release( REF_InternalWrite );
+
+	BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), dwRet);
+
+	return dwRet;
+}
+
+//
+// Async Sessions write their SMUX frames through this function.  If no 
+// write is pending on the connection the frame is written right away.  
+// Otherwise small data frames are copied into one packet, which is also 
+// one SSL record, and the packet is written as soon as a pending write 
+// completes or it holds m_cbCoalesceMax bytes.  Frames are only gathered 
+// while a write is pending, and Smux::WriteFrameDone writes them when it 
+// completes, so no frame waits longer than the write ahead of it; there is 
+// no timer.  The packets of the gathered frames complete with that write.  
+//
+// Frames that are not gathered flush the gathered ones first, so the 
+// frames of a Session always reach the peer in the order they were sent.  
+//
+// Note: Caller should own the Session's m_CS before calling this method.
+//
+DWORD Smux::WriteFrame( __in SNI_Packet * pPacket, bool fCoalesce )
+{
+	BidxScopeAutoSNI3( SNIAPI_TAG _T("%u#, ")
+							  _T("pPacket: %p{SNI_Packet*}, ")
+							  _T("fCoalesce: %d{bool}\n"), 
+							  GetBidId(),
+							  pPacket, 
+							  fCoalesce);
+
+	Assert( !m_fSync );
+
+	CAutoSNICritSec a_csWrite( m_WriteCS, SNI_AUTOCS_ENTER );
+
+	DWORD dwRet;
+
+	DWORD cbFrame = SNIPacketGetBufferSize( pPacket );
+
+	if( fCoalesce && 
+		m_fCoalesce && 
+		cbFrame <= m_cbCoalesceMax / 2 &&
+		( m_cWritesPending || m_pCoalescePacket ) )
+	{
+		if( m_pCoalescePacket && 
+			cbFrame > SNIPacketGetBufUnusedSize( m_pCoalescePacket, SNI_Packet_Write ) )
+		{
+			FlushCoalescedFrames();
+		}
+
+		if( !m_pCoalescePacket )
+		{
+			m_pCoalescePacket = SNIPacketAllocate( m_pConn, SNI_Packet_Write );
+
+			m_pCoalesceTail = m_pCoalescePacket;
+		}
+
+		//
+		// Without a packet to gather into, or with a connection buffer too 
+		// small for the frame, just write it
+		//
+		if( m_pCoalescePacket && 
+			cbFrame <= SNIPacketGetBufUnusedSize( m_pCoalescePacket, SNI_Packet_Write ) )
+		{
+			BYTE *pbFrame;
+
+			SNIPacketGetData( pPacket, &pbFrame, &cbFrame );
+			SNIPacketAppendData( m_pCoalescePacket, pbFrame, cbFrame );
+
+			SNIPacketSetNext( m_pCoalesceTail, pPacket );
+			m_pCoalesceTail = pPacket;
+
+			m_cCoalescedFrames++;
+
+			if( SNIPacketGetBufferSize( m_pCoalescePacket ) >= m_cbCoalesceMax )
+			{
+				FlushCoalescedFrames();
+			}
+
+			BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), ERROR_IO_PENDING);
+
+			return ERROR_IO_PENDING;
+		}
+
+		if( m_pCoalescePacket && 0 == SNIPacketGetBufferSize( m_pCoalescePacket ) )
+		{
+			SNIPacketRelease( m_pCoalescePacket );
+
+			m_pCoalescePacket = NULL;
+			m_pCoalesceTail = NULL;
+		}
+	}
+
+	if( m_pCoalescePacket )
+	{
+		FlushCoalescedFrames();
+	}
+
+	dwRet = m_pNext->WriteAsync( pPacket, NULL );
+
+	if( ERROR_IO_PENDING == dwRet )
+	{
+		m_cWritesPending++;
+	}
+
+	BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), dwRet);
+
+	return dwRet;
+}
+
+//
+// Called for every write Smux::WriteFrame or Smux::FlushCoalescedFrames
+// left pending once it completed
+//
+void Smux::WriteFrameDone()
+{
+	BidxScopeAutoSNI1( SNIAPI_TAG _T("%u#\n"), GetBidId() );
+
+	CAutoSNICritSec a_csWrite( m_WriteCS, SNI_AUTOCS_ENTER );
+
+	Assert( m_cWritesPending );
+
+	m_cWritesPending--;
+
+	if( m_pCoalescePacket )
+	{
+		FlushCoalescedFrames();
+	}
+}
+
+// Note: Caller should own m_WriteCS before calling this method.
+void Smux::FlushCoalescedFrames()
+{
+	BidxScopeAutoSNI1( SNIAPI_TAG _T("%u#\n"), GetBidId() );
+
+	Assert( m_pCoalescePacket );
+
+	SNI_Packet *pPacket = m_pCoalescePacket;
+
+	m_pCoalescePacket = NULL;
+	m_pCoalesceTail = NULL;
+
+	m_pConn->AddRef( REF_InternalWrite );
+
+	DWORD dwRet;
+
+	dwRet = m_pNext->WriteAsync( pPacket, NULL );
+
+	if( ERROR_IO_PENDING == dwRet )
+	{
+		m_cWritesPending++;
+		m_cCoalescedWrites++;
+	}
+	else
+	{
+		m_pConn->Release( REF_InternalWrite );
+
+		CompleteCoalescedFrames( SNIPacketGetNext( pPacket ), ERROR_SUCCESS == dwRet );
+
+		SNIPacketSetNext( pPacket, NULL );
+		SNIPacketRelease( pPacket );
+	}
+
+	BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), dwRet);
+}
+
+//
+// Completes the Session packets of gathered frames the way 
+// Session::SendPendingPackets completes a packet it wrote.  
+//
+// Note: Caller should own m_WriteCS before calling this method.
+//
+void Smux::CompleteCoalescedFrames( __in_opt SNI_Packet * pFrames, bool fSuccess )
+{
+	while( pFrames )
+	{
+		SNI_Packet *pPacket = pFrames;
+
+		pFrames = SNIPacketGetNext( pPacket );
+
+		SNIPacketSetNext( pPacket, NULL );
+
+		pPacket->m_OrigProv = SESSION_PROV;
+
+		if( ERROR_SUCCESS != SNIPacketPostQCS( pPacket, fSuccess ? SNIPacketGetBufferSize( pPacket ) : 0 ) )
+		{
+			//this assertion is used to catch unexpected system call failure.
+			Assert( 0 && "SNIPacketPostQCS failed\n" );
+			BidTrace0( ERROR_TAG _T("SNIPacketPostQCS failed\n") );
+		}
+	}
 }
 
 DWORD Smux::WriteSync(SNI_Packet * pPacket, SNI_ProvInfo * pProvInfo)
@@ -87,14 +87,156 @@ typedef struct _SNI_Accept
 // Globals
 #ifdef SNI_BASED_CLIENT
 
-HANDLE	ghIoCompletionPort = NULL;
+SNICompletionPort * gpCompletionPort = NULL;
 bool	g_fTerminate;
 DWORD	gnWorkerThreadCount = 0;
 HANDLE	rghWorkerThreads[64];
 SNIMemObj	  * gpmo		= NULL;
 
+// Completions the SNIAsyncWait thread dequeues at once
+#define SNI_COMPLETION_BATCH_SIZE	16
+
 DWORD WINAPI SNIAsyncWait (PVOID);
 
+//----------------------------------------------------------------------------
+// SNICompletionPort
+//----------------------------------------------------------------------------
+
+SNICompletionPort::SNICompletionPort() : m_hPort(NULL), m_pfnRtlNtStatusToDosError(NULL)
+{
+}
+
+SNICompletionPort::~SNICompletionPort()
+{
+	if( m_hPort )
+	{
+		CloseHandle( m_hPort );
+	}
+}
+
+DWORD SNICompletionPort::FInit()
+{
+	m_hPort = CreateIoCompletionPort( INVALID_HANDLE_VALUE,
+								      NULL,
+								      0,
+								      0 );
+	if( !m_hPort )
+	{
+		DWORD dwError = GetLastError();
+
+		SNI_SET_LAST_ERROR( INVALID_PROV, SNIE_10, dwError );
+
+		return dwError;
+	}
+
+	HMODULE hNtDll = GetModuleHandleW( L"ntdll.dll" );
+
+	if( hNtDll )
+	{
+		m_pfnRtlNtStatusToDosError = (PFNRTLNTSTATUSTODOSERROR) GetProcAddress( hNtDll, "RtlNtStatusToDosError" );
+	}
+
+	return ERROR_SUCCESS;
+}
+
+DWORD SNICompletionPort::Associate( HANDLE hNwk )
+{
+	if( NULL == CreateIoCompletionPort( hNwk, m_hPort, 0, 0) )
+	{
+		DWORD dwError = GetLastError();
+		
+		SNI_SET_LAST_ERROR( INVALID_PROV, SNIE_9, dwError );
+
+		return dwError;
+	}
+
+	return ERROR_SUCCESS;
+}
+
+DWORD SNICompletionPort::Post( __in_opt OVERLAPPED * pOvl, DWORD dwBytes )
+{
+	if( !PostQueuedCompletionStatus( m_hPort, dwBytes, 0, pOvl) )
+	{
+		return GetLastError();
+	}
+
+	return ERROR_SUCCESS;
+}
+
+DWORD SNICompletionPort::Dequeue( __out_ecount_part(cCompletions, *pcDequeued) SNICompletion * rgCompletions, 
+								 ULONG cCompletions, 
+								 __out ULONG * pcDequeued )
+{
+	Assert( 0 < cCompletions );
+
+	*pcDequeued = 0;
+
+	if( NULL == m_pfnRtlNtStatusToDosError || 1 == cCompletions )
+	{
+		DWORD dwBytesTransferred = 0;
+		ULONG_PTR ulKey;
+		LPOVERLAPPED pOvl = NULL;
+		DWORD dwError = ERROR_SUCCESS;
+
+		//	If pOvl isn't NULL the I/O failed, not the call, and its 
+		//	completion is returned with the error
+		//
+		if( 0 == GetQueuedCompletionStatus( m_hPort,
+										    &dwBytesTransferred,
+										    &ulKey,
+										    &pOvl,
+										    INFINITE) )
+		{
+			dwError = GetLastError();
+
+			if( NULL == pOvl )
+			{
+				return dwError;
+			}
+		}
+
+		rgCompletions[0].pSOSIo = (SOS_IOCompRequest *) pOvl;
+		rgCompletions[0].dwBytes = dwBytesTransferred;
+		rgCompletions[0].dwError = dwError;
+
+		*pcDequeued = 1;
+
+		return ERROR_SUCCESS;
+	}
+
+	OVERLAPPED_ENTRY rgEntries[SNI_COMPLETION_BATCH_SIZE];
+	ULONG cEntries;
+
+	if( cCompletions > ARRAYSIZE(rgEntries) )
+	{
+		cCompletions = ARRAYSIZE(rgEntries);
+	}
+
+	if( 0 == GetQueuedCompletionStatusEx( m_hPort,
+										  rgEntries,
+										  cCompletions,
+										  &cEntries,
+										  INFINITE,
+										  FALSE) )
+	{
+		return GetLastError();
+	}
+
+	for( ULONG i = 0; i < cEntries; i++ )
+	{
+		// Internal holds the status of the completion itself, the 
+		// Internal field of the OVERLAPPED is not set by posted ones
+		LONG Status = (LONG) rgEntries[i].Internal;
+
+		rgCompletions[i].pSOSIo = (SOS_IOCompRequest *) rgEntries[i].lpOverlapped;
+		rgCompletions[i].dwBytes = rgEntries[i].dwNumberOfBytesTransferred;
+		rgCompletions[i].dwError = ( 0 <= Status ) ? ERROR_SUCCESS : m_pfnRtlNtStatusToDosError( Status );
+	}
+
+	*pcDequeued = cEntries;
+
+	return ERROR_SUCCESS;
+}
 
 #ifdef SNIX
 volatile LONG g_dwInitLock = 0;
@@ -966,16 +1108,7 @@ DWORD SNIxInitialize()
 
 inline DWORD SNIRegisterWithIOCP(HANDLE hNwk)
 {
-	if( NULL == CreateIoCompletionPort( hNwk, ghIoCompletionPort, 0, 0) )
-	{
-		DWORD dwError = GetLastError();
-		
-		SNI_SET_LAST_ERROR( INVALID_PROV, SNIE_9, dwError );
-
-		return dwError;
-	}
-
-	return ERROR_SUCCESS;
+	return gpCompletionPort->Associate( hNwk );
 }
 
 #else	// #ifdef SNI_BASED_CLIENT
@@ -1309,23 +1442,33 @@ DWORD SNIInitializeEx(void * pmo,
 	if( !gfIsWin9x )
 	{
 		// Create the completion port
-		ghIoCompletionPort = CreateIoCompletionPort( INVALID_HANDLE_VALUE,
-												     NULL,
-												     0,
-												     0 );
-		if( !ghIoCompletionPort )
+		SNICompletionPort * pCompletionPort = NewNoX(gpmo) SNICompletionPort;
+		
+		if( !pCompletionPort )
 		{
-			dwError = GetLastError();
+			dwError = ERROR_OUTOFMEMORY;
 
-			SNI_SET_LAST_ERROR( INVALID_PROV, SNIE_10, dwError );
+			SNI_SET_LAST_ERROR( INVALID_PROV, SNIE_4, dwError );
+
+			goto ErrorExit;
+		}
 
+		gpCompletionPort = pCompletionPort;
+
+		dwError = pCompletionPort->FInit();
+		
+		if( ERROR_SUCCESS != dwError )
+		{
 			goto ErrorExit;
 		}
 		
-		// Start at least one AsyncWait thread 
+		// Start exactly one AsyncWait thread 
 		// Note: We need to do this before init'ing providers, since some mite interact with 
 		// the IOCP during their init procedures
-
+		// Note: Completions posted for a session, by Smux::SendPendingPackets and 
+		// Smux::CompleteCoalescedFrames among others, rely on being dispatched one 
+		// at a time and in the order they were posted, which only holds with a 
+		// single thread.  
 		dwError = SNICreateWaitThread(SNIAsyncWait, NULL);
 		
 		if( ERROR_SUCCESS != dwError )
@@ -1390,10 +1533,10 @@ ErrorExit:
 		DeleteCriticalSection( &g_csLocalDBInitialize );
 	}
 	
-	if ( ghIoCompletionPort )
+	if ( gpCompletionPort )
 	{
-		CloseHandle( ghIoCompletionPort );
-		ghIoCompletionPort = NULL; 
+		delete gpCompletionPort;
+		gpCompletionPort = NULL; 
 	}
 
 	if( NULL != SNIMemRegion::s_rgClientMemRegion )
@@ -1566,14 +1709,14 @@ DWORD SNITerminate()
 	// Cleanup IOCP only if its NOT Win9x
 	if( !gfIsWin9x )
 	{
-		Assert( ghIoCompletionPort );
+		Assert( gpCompletionPort );
 
 		Assert( !g_fTerminate );
 		g_fTerminate = true;
 
-		// We create only one WaitThread - so do a PostQCS to indicate
+		// We create only one WaitThread - so do a Post to indicate
 		// we are shutting down
-		PostQueuedCompletionStatus( ghIoCompletionPort, 0, 0, 0);
+		gpCompletionPort->Post( NULL, 0 );
 	}
 
 	if( gnWorkerThreadCount )
@@ -1596,8 +1739,8 @@ DWORD SNITerminate()
 
 	if( !gfIsWin9x )
 	{
-		CloseHandle( ghIoCompletionPort );
-		ghIoCompletionPort = NULL; 
+		delete gpCompletionPort;
+		gpCompletionPort = NULL; 
 	}
 
 	if( NULL != SNIMemRegion::s_rgClientMemRegion )
@@ -3192,6 +3335,11 @@ DWORD SNIQueryInfo(  UINT QType, __out VOID * pbQInfo)
 			}	
 			break;
 #endif
+		case SNI_QUERY_TCP_CONNECT_ATTEMPT_DELAY:
+
+			*(DWORD *)pbQInfo = Tcp::s_dwConnectAttemptDelay;
+			break;
+
 #ifdef SNI_BASED_CLIENT
 
 		case SNI_QUERY_TCP_SKIP_IO_COMPLETION_ON_SUCCESS:
@@ -3649,6 +3797,42 @@ DWORD SNIGetInfo( __in SNI_Conn * pConn, UINT QType, __out VOID * pbQInfo)
 			}
 			break;
 
+		case SNI_QUERY_CONN_SMUXWINDOW:
+			{
+				CAutoSNICritSec a_cs(pConn->m_csProvList, SNI_AUTOCS_ENTER);
+				for( pProv = pConn->m_pProvHead; pProv; pProv = pProv->m_pNext)
+					if( SESSION_PROV == pProv->m_Prot )
+						break;
+
+				if( NULL == pProv )
+				{
+					dwError = ERROR_INVALID_PARAMETER;
+					SNI_SET_LAST_ERROR( INVALID_PROV, SNIE_10, dwError );
+					break;
+				}
+
+				Smux::GetSessionWindowInfo( pProv, (SNI_SMUX_WINDOW_INFO *)pbQInfo );
+			}
+			break;
+
+		case SNI_QUERY_CONN_SMUXCOALESCE:
+			{
+				CAutoSNICritSec a_cs(pConn->m_csProvList, SNI_AUTOCS_ENTER);
+				for( pProv = pConn->m_pProvHead; pProv; pProv = pProv->m_pNext)
+					if( SMUX_PROV == pProv->m_Prot )
+						break;
+
+				if( NULL == pProv )
+				{
+					dwError = ERROR_INVALID_PARAMETER;
+					SNI_SET_LAST_ERROR( INVALID_PROV, SNIE_10, dwError );
+					break;
+				}
+
+				((Smux *)pProv)->GetCoalesceInfo( (SNI_SMUX_COALESCE_INFO *)pbQInfo );
+			}
+			break;
+
 		default:
 			//this assertion is used to catch unexpected coding errors.
 			Assert( 0 && " QType is unknown\n" );
@@ -3752,6 +3936,66 @@ DWORD SNISetInfo( __out SNI_Conn * pConn, UINT QType, __in VOID * pbQInfo)
 			
 			break;
 
+		case SNI_QUERY_CONN_SMUXWINDOW:
+			{
+				DWORD dwRet = ERROR_INVALID_PARAMETER;
+				
+				CAutoSNICritSec a_cs(pConn->m_csProvList, SNI_AUTOCS_ENTER);
+				for( pProv = pConn->m_pProvHead; pProv; pProv = pProv->m_pNext)
+				{
+					if( SESSION_PROV == pProv->m_Prot )
+					{
+						dwRet = Smux::SetSessionMaxWindow( pProv, *(DWORD *)pbQInfo );
+						break;
+					}
+				}
+
+				if( ERROR_SUCCESS != dwRet )
+				{
+					SNI_SET_LAST_ERROR( INVALID_PROV, SNIE_10, dwRet );
+					BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), dwRet);
+					return dwRet;
+				}
+			}
+			break;
+
+		case SNI_QUERY_CONN_SMUXCOALESCE:
+			{
+				DWORD dwRet = ERROR_INVALID_PARAMETER;
+				
+				CAutoSNICritSec a_cs(pConn->m_csProvList, SNI_AUTOCS_ENTER);
+				for( pProv = pConn->m_pProvHead; pProv; pProv = pProv->m_pNext)
+				{
+					if( SMUX_PROV == pProv->m_Prot )
+					{
+						dwRet = ((Smux *)pProv)->SetCoalesceInfo( (SNI_SMUX_COALESCE_INFO *)pbQInfo );
+						break;
+					}
+				}
+
+				if( ERROR_SUCCESS != dwRet )
+				{
+					SNI_SET_LAST_ERROR( INVALID_PROV, SNIE_10, dwRet );
+					BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), dwRet);
+					return dwRet;
+				}
+			}
+			break;
+
+		case SNI_QUERY_TCP_CONNECT_ATTEMPT_DELAY:
+
+			if( TCP_MAX_CONNECT_ATTEMPT_DELAY < *(DWORD *)pbQInfo )
+			{
+				SNI_SET_LAST_ERROR( INVALID_PROV, SNIE_10, ERROR_INVALID_PARAMETER );
+
+				BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), ERROR_INVALID_PARAMETER);
+				
+				return ERROR_INVALID_PARAMETER;
+			}
+			
+			Tcp::s_dwConnectAttemptDelay = *(DWORD *)pbQInfo;
+			break;
+
 #ifdef SNI_BASED_CLIENT
 		case SNI_QUERY_TCP_SKIP_IO_COMPLETION_ON_SUCCESS:
 			
@@ -4070,46 +4314,18 @@ DWORD WINAPI SNIAsyncWait (PVOID)
 {
 	BidxScopeAutoSNI0( SNIAPI_TAG _T( "\n"));
 	
-	SOS_IOCompRequest * pSOSIo = NULL;
-	DWORD dwBytesTransferred;
-	ULONG_PTR ulKey;
+	SNICompletion rgCompletions[SNI_COMPLETION_BATCH_SIZE];
+	ULONG cCompletions;
 	DWORD dwError;
 
 	while(true)
 	{
-		// Reset the pointer to overlapped structure, transferred bytes and the error
-		//
-		pSOSIo = NULL;
-		dwBytesTransferred = 0;
-		dwError = 0;
-
-        // 	There are several reasons why GetQueuedCompletionStatus
-        //	could fail
-        //
-        //	1. If pOverlapped isn't NULL, then the 
-        //	GetQueuedCompletionStatus call succeeded, it's 
-        //	just that the I/O operation that generated the 
-        //	completion failed. We will still call the completion
-        //	routine down below but with an error code
-        //	2. If pOverlapped is NULL, then we have a timeout
-        //	(GLE of WAIT_TIMEOUT). That is not possible in our
-        //	case because we use a timeout of INFINITE in our
-        //	call to GetQueuedCompletionStatus
-        //	3. If pOverlapped is NULL, GLE is not WAIT_TIMEOUT,
-        // 	then we have a real failure.
-        //
-
-		if( 0 == GetQueuedCompletionStatus( ghIoCompletionPort,
-	                                          			&dwBytesTransferred,
-				                              		(PULONG_PTR)&ulKey,
-				                                          (LPOVERLAPPED *) &pSOSIo,
-				                                          INFINITE) )
-		{
-			dwError = GetLastError();
-		}
+		cCompletions = 0;
+
+		dwError = gpCompletionPort->Dequeue( rgCompletions, ARRAYSIZE(rgCompletions), &cCompletions );
 
 		// Catastrophic error - we have nothing to go by, ignore
-		if( !pSOSIo )
+		if( ERROR_SUCCESS != dwError )
 		{
 			if( !g_fTerminate )
 			{
@@ -4122,16 +4338,43 @@ DWORD WINAPI SNIAsyncWait (PVOID)
 			return ERROR_SUCCESS;
 		}
 
-		// Update SOS_IOCompRequest and call IO Completion Routine
-		//
-		pSOSIo->SetErrorCode (dwError);
-		pSOSIo->SetActualBytes (dwBytesTransferred);
+		bool fWakeUp = false;
+
+		// The batch is dispatched in the order it was dequeued, which is the 
+		// order the completions were queued in
+		for( ULONG i = 0; i < cCompletions; i++ )
+		{
+			SOS_IOCompRequest * pSOSIo = rgCompletions[i].pSOSIo;
+
+			if( !pSOSIo )
+			{
+				fWakeUp = true;
+				continue;
+			}
+
+			// Update SOS_IOCompRequest and call IO Completion Routine
+			//
+			pSOSIo->SetErrorCode (rgCompletions[i].dwError);
+			pSOSIo->SetActualBytes (rgCompletions[i].dwBytes);
+
+			// Call the callback function associated with this Packet
+			// Note: For Accept, this is a hack - the object is not really a SNI_Packet but an SNI_Accept
+			// struct, but since the SOSIo object is the FIRST member of the struct, we are okay
+			(SNIPacketCompFunc((SNI_Packet *)pSOSIo))( pSOSIo );
+		}
 
-		// Call the callback function associated with this Packet
-		// Note: For Accept, this is a hack - the object is not really a SNI_Packet but an SNI_Accept
-		// struct, but since the SOSIo object is the FIRST member of the struct, we are okay
-		(SNIPacketCompFunc((SNI_Packet *)pSOSIo))( pSOSIo );
+		if( fWakeUp )
+		{
+			if( !g_fTerminate )
+			{
+				//This assertion is used to catch unexpected coding errors.
+				Assert( 0 && " Completion without an overlapped structure\n" );
+				BidTrace0( ERROR_TAG _T("Completion without an overlapped structure\n") );
+				continue;
+			}
 
+			return ERROR_SUCCESS;
+		}
 	}
 }
 
@@ -4185,15 +4428,15 @@ DWORD SNIPostQCS(OVERLAPPED * pOvl, DWORD dwBytes)
 	BidxScopeAutoSNI2( SNIAPI_TAG _T( "pOvl: %p{OVERLAPPED*}, dwBytes: %d\n"), 
 					pOvl, dwBytes);
 	
-	if( PostQueuedCompletionStatus( ghIoCompletionPort, dwBytes, 0, pOvl) )
+	DWORD dwError = gpCompletionPort->Post( pOvl, dwBytes );
+	
+	if( ERROR_SUCCESS == dwError )
 	{
 		BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), ERROR_SUCCESS);
 		return ERROR_SUCCESS;
 	}
 	else
 	{
-		DWORD dwError = GetLastError();
-
 		SNI_SET_LAST_ERROR( INVALID_PROV, SNIE_24, dwError );
 
 		BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), dwError);
@@ -70,6 +70,10 @@ static PFN_WIN32_SETFILECOMPLETIONNOTIFICATIONMODES g_pfnWin32SetFileCompletionN
 BOOL Tcp::s_fAutoTuning = FALSE; 
 BOOL Tcp::s_fSkipCompletionPort = FALSE;
 
+// Milliseconds between the starts of two parallel connection attempts, 
+// 0 starts all of them at once.  See SNI_QUERY_TCP_CONNECT_ATTEMPT_DELAY.
+DWORD Tcp::s_dwConnectAttemptDelay = 250;
+
 // DevNote: The followings are copied from ws2tcpip.h and ws2ipdef.h of LH(vistasp1). 
 // Remove them when integrated with LH winsdk.
 //
@@ -4125,7 +4129,45 @@ bool Tcp::IsNumericAddress( LPWSTR name)
 	
 }
 
-// Using ConnectEx, create a connected socket based on the specified linked list of ADDRINFO, by opening sockets in parallel.
+// Fills rgpAddresses with the dwAddresses addresses of AIW in the order Tcp::SocketOpenParallel 
+// tries them: address families alternate, starting with the family of the first address, so that
+// a family that cannot be reached does not hold up the other (RFC 8305, section 4).
+void Tcp::InterleaveAddressFamilies(const ADDRINFOW *AIW, __out_ecount(dwAddresses) const ADDRINFOW **rgpAddresses, DWORD dwAddresses)
+{
+	const ADDRINFOW *pFirstFamily = AIW;
+	const ADDRINFOW *pOtherFamily = AIW;
+	bool fFirstFamily = true;
+
+	for(DWORD i=0;i<dwAddresses;i++)
+	{
+		while( NULL != pFirstFamily && pFirstFamily->ai_family != AIW->ai_family )
+		{
+			pFirstFamily = pFirstFamily->ai_next;
+		}
+		while( NULL != pOtherFamily && pOtherFamily->ai_family == AIW->ai_family )
+		{
+			pOtherFamily = pOtherFamily->ai_next;
+		}
+
+		if( NULL == pOtherFamily || (fFirstFamily && NULL != pFirstFamily) )
+		{
+			Assert( NULL != pFirstFamily );
+			rgpAddresses[i] = pFirstFamily;
+			pFirstFamily = pFirstFamily->ai_next;
+		}
+		else
+		{
+			rgpAddresses[i] = pOtherFamily;
+			pOtherFamily = pOtherFamily->ai_next;
+		}
+		fFirstFamily = !fFirstFamily;
+	}
+}
+
+// Using ConnectEx, create a connected socket based on the specified linked list of ADDRINFO, by racing connection attempts.
+// The attempts are started s_dwConnectAttemptDelay milliseconds apart, or as soon as all the started ones have failed, 
+// and the first one to connect wins (RFC 8305, section 5). At most MAXIMUM_WAIT_OBJECTS attempts are pending at a time, 
+// the remaining addresses are tried as pending attempts fail.
 DWORD Tcp::SocketOpenParallel(const ADDRINFOW *AIW, DWORD timeout)
 {
 	BidxScopeAutoSNI4( SNIAPI_TAG _T("%u#, ")
@@ -4139,27 +4181,33 @@ DWORD Tcp::SocketOpenParallel(const ADDRINFOW *AIW, DWORD timeout)
 	DWORD dwAddresses = 0;
 	DWORD dwStart = GetTickCount();
 	DWORD timeleft = timeout;
+	DWORD dwAttemptDelay = s_dwConnectAttemptDelay;
+	DWORD dwLastAttempt = dwStart;
+	DWORD dwNextAddress = 0;
+	DWORD dwMaxConnectionsPending;
 	DWORD dwConnectionsPending = 0;
 	TcpConnection *pTcpConnections = NULL;
 	TcpConnection **ppPendingTcpConnections = NULL;
 	HANDLE *rgConnectionEvents = NULL;
+	const ADDRINFOW **rgpAddresses = NULL;
 	
 	// walk the struct and find out how many addresses it has.
 	const ADDRINFOW *pAIWTemp = AIW;
 	for(; NULL != pAIWTemp; pAIWTemp = pAIWTemp->ai_next)
 	{
 		dwAddresses++;
-		
-		// WaitForMultipleObjects can only handle up to 64 handles, and 64 target addresses is way more than we think
-		// we need, so artificially cap at 64 to avoid the massive extra effort to support an arbitrary number of target addresses.
-		if( dwAddresses > 64 )
-		{
-			dwRet = ERROR_FAIL;
-			SNI_SET_LAST_ERROR(TCP_PROV, SNIE_47, dwRet);
-			goto Exit;
-		}
 	}
 	
+	// WaitForMultipleObjects can only handle up to MAXIMUM_WAIT_OBJECTS handles, which caps the attempts pending at a time.
+	dwMaxConnectionsPending = (dwAddresses < MAXIMUM_WAIT_OBJECTS) ? dwAddresses : MAXIMUM_WAIT_OBJECTS;
+	
+	// Make sure every address is attempted within the first half of the timeout, however many there are.
+	if( INFINITE != timeout && dwAttemptDelay > timeout / (2 * dwAddresses) )
+	{
+		dwAttemptDelay = timeout / (2 * dwAddresses);
+	}
+	BidTraceU1( SNI_BID_TRACE_ON, SNI_TAG _T("attempt delay: %d\n"), dwAttemptDelay );
+	
 	pTcpConnections = NewNoX(gpmo) TcpConnection[dwAddresses];
 	if( NULL == pTcpConnections )
 	{
@@ -4168,8 +4216,16 @@ DWORD Tcp::SocketOpenParallel(const ADDRINFOW *AIW, DWORD timeout)
 		goto Exit;
 	}
 	
+	rgpAddresses = NewNoX(gpmo) const ADDRINFOW*[dwAddresses];
+	if( NULL == rgpAddresses )
+	{
+		dwRet = ERROR_OUTOFMEMORY;
+		SNI_SET_LAST_ERROR(TCP_PROV, SNIE_10, dwRet);
+		goto Exit;
+	}
+	
 	// An array of pointers into locations in pTcpConnections - holds only pointers to connections with a pending Overlapped IO.
-	ppPendingTcpConnections = NewNoX(gpmo) TcpConnection*[dwAddresses];
+	ppPendingTcpConnections = NewNoX(gpmo) TcpConnection*[dwMaxConnectionsPending];
 	if( NULL == ppPendingTcpConnections )
 	{
 		dwRet = ERROR_OUTOFMEMORY;
@@ -4177,7 +4233,7 @@ DWORD Tcp::SocketOpenParallel(const ADDRINFOW *AIW, DWORD timeout)
 		goto Exit;
 	}
 	
-	rgConnectionEvents = NewNoX(gpmo) HANDLE[dwAddresses];
+	rgConnectionEvents = NewNoX(gpmo) HANDLE[dwMaxConnectionsPending];
 	if( NULL == rgConnectionEvents )
 	{
 		dwRet = ERROR_OUTOFMEMORY;
@@ -4185,43 +4241,62 @@ DWORD Tcp::SocketOpenParallel(const ADDRINFOW *AIW, DWORD timeout)
 		goto Exit;
 	}
 	
-	pAIWTemp = AIW;
-	for(DWORD i=0;i<dwAddresses;i++)
-	{
-		Assert(NULL != pAIWTemp);
+	InterleaveAddressFamilies(AIW, rgpAddresses, dwAddresses);
 
-		// For each of these TcpConnection API calls, we have nothing to do in case of actual failure, except 
-		// to move on to the next address. If all the parallel connection attempts eventually fail, the 
-		// error code from wherever the failure occurred will be considered in calculating the overall return code,
-		// but that consideration will be done by the TcpConnection objects themselves, not by this function.
+	while( dwNextAddress < dwAddresses || 0 < dwConnectionsPending )
+	{
+		// Time until the next attempt may start, INFINITE if none can be started now.
+		DWORD dwUntilNextAttempt = INFINITE;
+		
+		if( dwNextAddress < dwAddresses && dwConnectionsPending < dwMaxConnectionsPending )
+		{
+			DWORD dwSinceLastAttempt = GetTickCount() - dwLastAttempt;
+			
+			dwUntilNextAttempt = (0 == dwConnectionsPending || dwSinceLastAttempt >= dwAttemptDelay) ? 0 : dwAttemptDelay - dwSinceLastAttempt;
+		}
 		
-		if( ERROR_SUCCESS == pTcpConnections[i].FInit(this, pAIWTemp) )
+		if( 0 == dwUntilNextAttempt )
 		{
-			if( ERROR_SUCCESS == pTcpConnections[i].FInitForAsync() )
+			TcpConnection *pConnection = &(pTcpConnections[dwNextAddress]);
+			const ADDRINFOW *pAddress = rgpAddresses[dwNextAddress];
+			
+			dwNextAddress++;
+			dwLastAttempt = GetTickCount();
+			
+			// For each of these TcpConnection API calls, we have nothing to do in case of actual failure, except 
+			// to move on to the next address. If all the parallel connection attempts eventually fail, the 
+			// error code from wherever the failure occurred will be considered in calculating the overall return code,
+			// but that consideration will be done by the TcpConnection objects themselves, not by this function.
+			
+			if( ERROR_SUCCESS == pConnection->FInit(this, pAddress) )
 			{
-				DWORD dwAsyncOpenError = pTcpConnections[i].AsyncOpen();
-				if( ERROR_SUCCESS == dwAsyncOpenError )
-				{
-					// Connection succeeded. Retrieve the connected socket and exit.
-					m_sock = pTcpConnections[i].RelinquishSocket();
-					goto Exit;
-				}
-				else if( ERROR_IO_PENDING == dwAsyncOpenError )
+				if( ERROR_SUCCESS == pConnection->FInitForAsync() )
 				{
-					// Overlapped was pending. Add the object and its Event handle to our pending lists and continue on to the next target address.
-					ppPendingTcpConnections[dwConnectionsPending] = &(pTcpConnections[i]);
-					rgConnectionEvents[dwConnectionsPending] = (pTcpConnections[i]).GetEventForOutstandingOverlappedIO();
-					dwConnectionsPending++;
+					DWORD dwAsyncOpenError = pConnection->AsyncOpen();
+					if( ERROR_SUCCESS == dwAsyncOpenError )
+					{
+						// Connection succeeded. Retrieve the connected socket and exit.
+						m_sock = pConnection->RelinquishSocket();
+						dwRet = ERROR_SUCCESS;
+						goto Exit;
+					}
+					else if( ERROR_IO_PENDING == dwAsyncOpenError )
+					{
+						// Overlapped was pending. Add the object and its Event handle to our pending lists.
+						ppPendingTcpConnections[dwConnectionsPending] = pConnection;
+						rgConnectionEvents[dwConnectionsPending] = pConnection->GetEventForOutstandingOverlappedIO();
+						dwConnectionsPending++;
+					}
 				}
 			}
+			continue;
 		}
-		pAIWTemp = pAIWTemp->ai_next;
-	}
-
-	while( 0 < dwConnectionsPending )
-	{		
-		// Wait for *any* of the pending Overlapped IOs' event handles to complete
-		dwRet = WaitForMultipleObjects(dwConnectionsPending, rgConnectionEvents, FALSE /*bWaitAll*/, timeleft );
+		
+		Assert( 0 < dwConnectionsPending );
+		
+		// Wait for *any* of the pending Overlapped IOs' event handles to complete, or for the next attempt to be due
+		bool fWaitForNextAttempt = (dwUntilNextAttempt < timeleft);
+		dwRet = WaitForMultipleObjects(dwConnectionsPending, rgConnectionEvents, FALSE /*bWaitAll*/, fWaitForNextAttempt ? dwUntilNextAttempt : timeleft );
 		
 		// if this C_ASSERT were false, the if condition below it would also need to check that WAIT_OBJECT_0 <= dwRet. Since the C_ASSERT is true,
 		// that additional check would result in a compiler warning that the expression is always true...
@@ -4256,6 +4331,7 @@ DWORD Tcp::SocketOpenParallel(const ADDRINFOW *AIW, DWORD timeout)
 			{
 				// in case of completion with an error, there's nothing to do - we already removed it from the pending list, so keep looping as long as we have more
 				// The specific error code will be taken into account later, when the error code for the whole parallel connection attempt is computed.
+				// The next address, if any, is attempted right away once no attempt is pending.
 			}
 		}
 		else if( WAIT_FAILED == dwRet )
@@ -4264,6 +4340,10 @@ DWORD Tcp::SocketOpenParallel(const ADDRINFOW *AIW, DWORD timeout)
 			dwRet = TcpConnection::CalculateReturnCode(pTcpConnections, dwAddresses, dwRet, TcpConnectionErrorLevel_WaitForObjects);
 			goto Exit;
 		}
+		else if( WAIT_TIMEOUT == dwRet && fWaitForNextAttempt )
+		{
+			// The next attempt is due, it is started on the next iteration.
+		}
 		else
 		{
 			// either a timeout, or an unexpected return code from WaitForMultipleObjects. Either way, use the return code Windows gave us.
@@ -4272,7 +4352,7 @@ DWORD Tcp::SocketOpenParallel(const ADDRINFOW *AIW, DWORD timeout)
 			goto Exit;
 		}
 
-		// Only recompute timeout after each iteration, to ensure we always do at least one iteration, to make a best
+		// Only recompute timeout after each wait, to ensure we always do at least one wait, to make a best
 		// effort at giving the connection a chance to return WSAECONNREFUSED.
 		if( timeout != INFINITE )
 		{
@@ -4286,7 +4366,9 @@ DWORD Tcp::SocketOpenParallel(const ADDRINFOW *AIW, DWORD timeout)
 
 	}
 	
-	// All error conditions and the Success case go straight to Exit. So, if we got here, we must have waited on all the connections
+	// All error conditions and the Success case go straight to Exit. So, if we got here, we must have attempted all the addresses 
+	// and waited on all the connections
+	Assert( dwNextAddress == dwAddresses );
 	Assert( dwConnectionsPending == 0 );
 	// Moreover, all the connections must have failed.
 	Assert( INVALID_SOCKET == m_sock );
@@ -4357,6 +4439,11 @@ Exit:
 		delete []rgConnectionEvents;
 		rgConnectionEvents = NULL;
 	}
+	if( NULL != rgpAddresses )
+	{
+		delete []rgpAddresses;
+		rgpAddresses = NULL;
+	}
 	
 	BidTraceU1( SNI_BID_TRACE_ON, RETURN_TAG _T("%d{WINERR}\n"), dwRet);
 	return dwRet;
@@ -4563,19 +4650,11 @@ DWORD Tcp::Open( 	SNI_Conn 		* pConn,
 
 	dwRet = ERROR_SUCCESS;
 	// When TransparentNetworkResolution:
-	// 1. Try first IP addr with 500ms timeout, if the server has more than 64 IP addrs, using sequential connection and original timeout 
-	//     store in pProtElem->Tcp.totalTimeout
+	// 1. Try first IP addr with 500ms timeout
 	// 2. Try parallel connection if first step failed
 	// 
-	bool fAddrInfoCountGreaterThan64 = false;
-	if (!pProtElem->Tcp.fParallel && (pProtElem->Tcp.transparentNetworkIPResolution == TransparentNetworkResolutionMode::SequentialMode || pProtElem->Tcp.transparentNetworkIPResolution == TransparentNetworkResolutionMode::ParallelMode))
-	{
-		fAddrInfoCountGreaterThan64 = (GetAddrCount(AddrInfoW) > 64);
-	}
-
-    if (pProtElem->Tcp.fParallel || (pProtElem->Tcp.transparentNetworkIPResolution == TransparentNetworkResolutionMode::ParallelMode && !fAddrInfoCountGreaterThan64))
+    if (pProtElem->Tcp.fParallel || pProtElem->Tcp.transparentNetworkIPResolution == TransparentNetworkResolutionMode::ParallelMode)
 	{
-		Assert(!fAddrInfoCountGreaterThan64);
 		dwRet = pTcpProv->ParallelOpen(AddrInfoW, timeout, dwStart);
 		if (dwRet != ERROR_SUCCESS)
 		{
@@ -4588,13 +4667,6 @@ DWORD Tcp::Open( 	SNI_Conn 		* pConn,
 		//to a old servers which don't listen on ipv6 addresses
 		ADDRINFOW *AIW;
 		int afs[] = {AF_INET, AF_INET6};
-		
-		// If fTransparentNetworkIPResolution and the address has more than 64 IP, open with sequential mode and reset timeout
-		// with the original timeout stored in SNI_CLIENT_CONSUMER_INFO
-		if (pProtElem->Tcp.transparentNetworkIPResolution == TransparentNetworkResolutionMode::SequentialMode && fAddrInfoCountGreaterThan64)
-		{
-			timeout = pProtElem->Tcp.totalTimeout;
-		}
 
 		for( int i = 0; i < sizeof(afs)/sizeof(int); i++ )
 		{
@@ -4642,7 +4714,7 @@ DWORD Tcp::Open( 	SNI_Conn 		* pConn,
 				
                 // When transparentNetworkIPResolution is Sequential, only try the first IP address
                 //
-				if (pProtElem->Tcp.transparentNetworkIPResolution == TransparentNetworkResolutionMode::SequentialMode && !fAddrInfoCountGreaterThan64)
+				if (pProtElem->Tcp.transparentNetworkIPResolution == TransparentNetworkResolutionMode::SequentialMode)
 
                 {
                     break;
@@ -6060,20 +6132,3 @@ DWORD Tcp::ShouldEnableSkipIOCompletion(__out BOOL* pfShouldEnable)
 	return dwRet;
 }
 
-// Get the IP addr count
-UINT Tcp::GetAddrCount(const ADDRINFOW *AIW)
-{
-    DWORD dwAddresses = 0;
-    const ADDRINFOW *paiTemp = AIW;
-    for (; NULL != paiTemp; paiTemp = paiTemp->ai_next)
-    {
-        // Skip address families that we don't know how to use.
-        if ((AF_INET != paiTemp->ai_family && AF_INET6 != paiTemp->ai_family))
-            continue;
-
-        dwAddresses++;
-    }
-
-    return dwAddresses;
-}
-
@@ -0,0 +1,851 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Reads the method bodies of a managed assembly and reports, for each method, the size of its
+//  IL and the number of its basic blocks: the blocks the JIT starts from before it optimizes
+//  anything.  Given the same corpus compiled by two compilers, it compares them method by
+//  method, so that a change to the branch optimizer shows what it saves and where it costs.
+//
+//  A block starts at the first instruction, at every branch, switch and leave target, after
+//  every branch, switch, leave, return, throw, rethrow, jmp, endfinally and endfilter, and at
+//  the start and end of every try, handler and filter.
+//
+//  The assembly is read straight from the file, so the tool builds anywhere.
+//
+//  Build:
+//      cl /O2 /EHsc ilstats.cpp
+//      g++ -O2 ilstats.cpp -o ilstats
+//
+//  Run:
+//      ilstats <assembly> [-json <file>]
+//          Reports every method and the totals.
+//      ilstats -before <assembly> -after <assembly> [-json <file>]
+//          Reports the methods whose IL differs and the totals, and fails if any method
+//          got bigger or got more blocks.
+//
+//-------------------------------------------------------------------------------------------------
+
+#include "../inc/benchharness.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+struct MethodStats
+{
+    unsigned cbCode;
+    unsigned cBlocks;
+    unsigned cBranches;
+};
+
+// Methods are named Namespace.Type::Method, followed by #n for the n-th overload.
+typedef std::map<std::string, MethodStats> AssemblyStats;
+
+//-------------------------------------------------------------------------------------------------
+//
+// IL decoding (ECMA-335, partition III).
+//
+//-------------------------------------------------------------------------------------------------
+
+enum OperandKind
+{
+    OperandNone,
+    OperandByte,
+    OperandShort,
+    OperandInt,
+    OperandLong,
+    OperandBranch8,
+    OperandBranch32,
+    OperandSwitch,
+};
+
+enum FlowKind
+{
+    FlowNext,
+    FlowBranch,         // conditional; falls through too
+    FlowJump,           // unconditional
+    FlowEnd,            // return, throw, rethrow, jmp, endfinally, endfilter
+};
+
+struct OpcodeInfo
+{
+    OperandKind operand;
+    FlowKind flow;
+};
+
+static
+OpcodeInfo OneByteOpcode(unsigned char op)
+{
+    OpcodeInfo info = { OperandNone, FlowNext };
+
+    if (op >= 0x0E && op <= 0x13)           // ldarg.s .. stloc.s
+    {
+        info.operand = OperandByte;
+    }
+    else if (op == 0x1F)                    // ldc.i4.s
+    {
+        info.operand = OperandByte;
+    }
+    else if (op == 0x20 || op == 0x22)      // ldc.i4, ldc.r4
+    {
+        info.operand = OperandInt;
+    }
+    else if (op == 0x21 || op == 0x23)      // ldc.i8, ldc.r8
+    {
+        info.operand = OperandLong;
+    }
+    else if (op == 0x27)                    // jmp
+    {
+        info.operand = OperandInt;
+        info.flow = FlowEnd;
+    }
+    else if (op == 0x28 || op == 0x29)      // call, calli
+    {
+        info.operand = OperandInt;
+    }
+    else if (op == 0x2A || op == 0x7A)      // ret, throw
+    {
+        info.flow = FlowEnd;
+    }
+    else if (op >= 0x2B && op <= 0x37)      // br.s .. blt.un.s
+    {
+        info.operand = OperandBranch8;
+        info.flow = op == 0x2B ? FlowJump : FlowBranch;
+    }
+    else if (op >= 0x38 && op <= 0x44)      // br .. blt.un
+    {
+        info.operand = OperandBranch32;
+        info.flow = op == 0x38 ? FlowJump : FlowBranch;
+    }
+    else if (op == 0x45)                    // switch
+    {
+        info.operand = OperandSwitch;
+        info.flow = FlowBranch;
+    }
+    else if ((op >= 0x6F && op <= 0x75) ||  // callvirt .. isinst
+             op == 0x79 ||                  // unbox
+             (op >= 0x7B && op <= 0x81) ||  // ldfld .. stobj
+             op == 0x8C || op == 0x8D ||    // box, newarr
+             op == 0x8F ||                  // ldelema
+             (op >= 0xA3 && op <= 0xA5) ||  // ldelem, stelem, unbox.any
+             op == 0xC2 || op == 0xC6 ||    // refanyval, mkrefany
+             op == 0xD0)                    // ldtoken
+    {
+        info.operand = OperandInt;
+    }
+    else if (op == 0xDC)                    // endfinally
+    {
+        info.flow = FlowEnd;
+    }
+    else if (op == 0xDD)                    // leave
+    {
+        info.operand = OperandBranch32;
+        info.flow = FlowJump;
+    }
+    else if (op == 0xDE)                    // leave.s
+    {
+        info.operand = OperandBranch8;
+        info.flow = FlowJump;
+    }
+
+    return info;
+}
+
+static
+OpcodeInfo TwoByteOpcode(unsigned char op)
+{
+    OpcodeInfo info = { OperandNone, FlowNext };
+
+    if (op == 0x06 || op == 0x07 ||         // ldftn, ldvirtftn
+        op == 0x15 || op == 0x16 ||         // initobj, constrained.
+        op == 0x1C)                         // sizeof
+    {
+        info.operand = OperandInt;
+    }
+    else if (op >= 0x09 && op <= 0x0E)      // ldarg .. stloc
+    {
+        info.operand = OperandShort;
+    }
+    else if (op == 0x12 || op == 0x19)      // unaligned., no.
+    {
+        info.operand = OperandByte;
+    }
+    else if (op == 0x11 || op == 0x1A)      // endfilter, rethrow
+    {
+        info.flow = FlowEnd;
+    }
+
+    return info;
+}
+
+static
+unsigned ReadU16(const unsigned char *pb)
+{
+    return pb[0] | (pb[1] << 8);
+}
+
+static
+unsigned ReadU32(const unsigned char *pb)
+{
+    return pb[0] | (pb[1] << 8) | (pb[2] << 16) | ((unsigned)pb[3] << 24);
+}
+
+// Counts the blocks and the branches of the code; the leaders found in the exception
+// clauses are passed in.
+static
+bool AnalyzeCode(
+    const unsigned char *pbCode,
+    unsigned cbCode,
+    std::set<unsigned> &leaders,
+    MethodStats &stats)
+{
+    unsigned offset = 0;
+
+    leaders.insert(0);
+    stats.cBranches = 0;
+
+    while (offset < cbCode)
+    {
+        unsigned char op = pbCode[offset++];
+        OpcodeInfo info;
+
+        if (op == 0xFE)
+        {
+            if (offset >= cbCode)
+            {
+                return false;
+            }
+
+            info = TwoByteOpcode(pbCode[offset++]);
+        }
+        else
+        {
+            info = OneByteOpcode(op);
+        }
+
+        std::vector<unsigned> targets;
+
+        switch (info.operand)
+        {
+        case OperandNone:
+            break;
+
+        case OperandByte:
+            offset += 1;
+            break;
+
+        case OperandShort:
+            offset += 2;
+            break;
+
+        case OperandInt:
+            offset += 4;
+            break;
+
+        case OperandLong:
+            offset += 8;
+            break;
+
+        case OperandBranch8:
+            if (offset + 1 > cbCode)
+            {
+                return false;
+            }
+
+            targets.push_back(offset + 1 + (signed char)pbCode[offset]);
+            offset += 1;
+            break;
+
+        case OperandBranch32:
+            if (offset + 4 > cbCode)
+            {
+                return false;
+            }
+
+            targets.push_back(offset + 4 + (int)ReadU32(&pbCode[offset]));
+            offset += 4;
+            break;
+
+        case OperandSwitch:
+            {
+                if (offset + 4 > cbCode)
+                {
+                    return false;
+                }
+
+                unsigned cTargets = ReadU32(&pbCode[offset]);
+                unsigned offsetNext = offset + 4 + cTargets * 4;
+
+                if (cTargets > cbCode || offsetNext > cbCode)
+                {
+                    return false;
+                }
+
+                for (unsigned i = 0; i < cTargets; i++)
+                {
+                    targets.push_back(offsetNext + (int)ReadU32(&pbCode[offset + 4 + i * 4]));
+                }
+
+                offset = offsetNext;
+            }
+            break;
+        }
+
+        if (offset > cbCode)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < targets.size(); i++)
+        {
+            leaders.insert(targets[i]);
+        }
+
+        if (info.flow != FlowNext)
+        {
+            if (info.flow != FlowEnd)
+            {
+                stats.cBranches++;
+            }
+
+            leaders.insert(offset);
+        }
+    }
+
+    // A block that would start at the end of the code is not a block.
+    leaders.erase(cbCode);
+    stats.cbCode = cbCode;
+    stats.cBlocks = (unsigned)leaders.size();
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//
+// Assembly reading (ECMA-335, partition II).  Only what it takes to get from the file to the
+// MethodDef table and the method bodies.
+//
+//-------------------------------------------------------------------------------------------------
+
+class AssemblyReader
+{
+public:
+    bool Load(const char *szFile)
+    {
+        FILE *pFile = fopen(szFile, "rb");
+
+        if (!pFile)
+        {
+            return false;
+        }
+
+        unsigned char rgbBuffer[4096];
+        size_t cbRead;
+
+        while ((cbRead = fread(rgbBuffer, 1, sizeof(rgbBuffer), pFile)) > 0)
+        {
+            m_image.insert(m_image.end(), rgbBuffer, rgbBuffer + cbRead);
+        }
+
+        fclose(pFile);
+        return ReadHeaders() && ReadMetadata();
+    }
+
+    bool ReadMethods(AssemblyStats &stats)
+    {
+        std::map<std::string, unsigned> overloads;
+
+        for (unsigned iMethod = 1; iMethod <= m_rgcRows[TableMethodDef]; iMethod++)
+        {
+            const unsigned char *pbRow = Row(TableMethodDef, iMethod);
+            unsigned rva = ReadU32(pbRow);
+            std::string name = TypeNameOfMethod(iMethod) + "::" + String(pbRow + 8);
+            MethodStats method = { 0, 0, 0 };
+
+            // Abstract, extern and runtime implemented methods have no body.
+            if (rva && !ReadMethodBody(rva, method))
+            {
+                fprintf(stderr, "cannot read the body of %s\n", name.c_str());
+                return false;
+            }
+
+            char szOverload[16];
+            sprintf(szOverload, "#%u", overloads[name]++);
+            stats[name + szOverload] = method;
+        }
+
+        return true;
+    }
+
+private:
+    enum
+    {
+        TableModule = 0x00,
+        TableTypeRef = 0x01,
+        TableTypeDef = 0x02,
+        TableFieldPtr = 0x03,
+        TableField = 0x04,
+        TableMethodPtr = 0x05,
+        TableMethodDef = 0x06,
+        TableParam = 0x08,
+        TableModuleRef = 0x1A,
+        TableTypeSpec = 0x1B,
+        TableAssemblyRef = 0x23,
+        TableCount = 64,
+    };
+
+    // The offset in the file of the data at an RVA, or 0 if no section holds it.
+    size_t Offset(unsigned rva, unsigned cb)
+    {
+        for (size_t i = 0; i < m_sections.size(); i++)
+        {
+            const Section &section = m_sections[i];
+
+            if (rva >= section.rva && rva - section.rva + cb <= section.cbRaw)
+            {
+                size_t offset = section.offsetRaw + (rva - section.rva);
+
+                return offset + cb <= m_image.size() ? offset : 0;
+            }
+        }
+
+        return 0;
+    }
+
+    bool ReadHeaders()
+    {
+        if (m_image.size() < 0x40 || m_image[0] != 'M' || m_image[1] != 'Z')
+        {
+            return false;
+        }
+
+        size_t offsetPE = ReadU32(&m_image[0x3C]);
+
+        if (offsetPE + 24 > m_image.size() || ReadU32(&m_image[offsetPE]) != 0x00004550)
+        {
+            return false;
+        }
+
+        unsigned cSections = ReadU16(&m_image[offsetPE + 6]);
+        unsigned cbOptionalHeader = ReadU16(&m_image[offsetPE + 20]);
+        size_t offsetOptional = offsetPE + 24;
+        size_t offsetSections = offsetOptional + cbOptionalHeader;
+
+        if (offsetSections + cSections * 40 > m_image.size())
+        {
+            return false;
+        }
+
+        // The CLI header is data directory 14; the directories start at 96 in a PE32 optional
+        // header and at 112 in a PE32+ one.
+        bool fPE32Plus = ReadU16(&m_image[offsetOptional]) == 0x20B;
+        size_t offsetDirectory = offsetOptional + (fPE32Plus ? 112 : 96) + 14 * 8;
+
+        if (offsetDirectory + 8 > offsetSections)
+        {
+            return false;
+        }
+
+        for (unsigned i = 0; i < cSections; i++)
+        {
+            const unsigned char *pbSection = &m_image[offsetSections + i * 40];
+            Section section;
+
+            section.rva = ReadU32(pbSection + 12);
+            section.cbRaw = ReadU32(pbSection + 16);
+            section.offsetRaw = ReadU32(pbSection + 20);
+            m_sections.push_back(section);
+        }
+
+        size_t offsetCli = Offset(ReadU32(&m_image[offsetDirectory]), 72);
+
+        if (!offsetCli)
+        {
+            return false;
+        }
+
+        m_offsetMetadata = Offset(ReadU32(&m_image[offsetCli + 8]), ReadU32(&m_image[offsetCli + 12]));
+        return m_offsetMetadata != 0;
+    }
+
+    bool ReadMetadata()
+    {
+        const unsigned char *pbRoot = &m_image[m_offsetMetadata];
+
+        if (ReadU32(pbRoot) != 0x424A5342)  // BSJB
+        {
+            return false;
+        }
+
+        unsigned cbVersion = ReadU32(pbRoot + 12);
+        const unsigned char *pbStream = pbRoot + 16 + cbVersion + 4;
+        unsigned cStreams = ReadU16(pbRoot + 16 + cbVersion + 2);
+        const unsigned char *pbTables = NULL;
+
+        for (unsigned i = 0; i < cStreams; i++)
+        {
+            unsigned offset = ReadU32(pbStream);
+            const char *szName = (const char *)pbStream + 8;
+
+            if (strcmp(szName, "#~") == 0 || strcmp(szName, "#-") == 0)
+            {
+                pbTables = pbRoot + offset;
+            }
+            else if (strcmp(szName, "#Strings") == 0)
+            {
+                m_pszStrings = (const char *)pbRoot + offset;
+            }
+
+            // The name is padded to a multiple of four bytes, terminator included.
+            pbStream += 8 + ((strlen(szName) + 4) & ~3);
+        }
+
+        if (!pbTables || !m_pszStrings)
+        {
+            return false;
+        }
+
+        unsigned char heapSizes = pbTables[6];
+        unsigned __int64 qwValid = (unsigned __int64)ReadU32(pbTables + 8) | ((unsigned __int64)ReadU32(pbTables + 12) << 32);
+        const unsigned char *pbRowCount = pbTables + 24;
+
+        for (unsigned i = 0; i < TableCount; i++)
+        {
+            m_rgcRows[i] = 0;
+
+            if (qwValid & ((unsigned __int64)1 << i))
+            {
+                m_rgcRows[i] = ReadU32(pbRowCount);
+                pbRowCount += 4;
+            }
+        }
+
+        m_cbString = (heapSizes & 1) ? 4 : 2;
+        m_cbGuid = (heapSizes & 2) ? 4 : 2;
+        m_cbBlob = (heapSizes & 4) ? 4 : 2;
+
+        // The tables up to MethodDef are all this tool reads; their rows give the offsets.
+        static const unsigned rgResolutionScope[] = { TableModule, TableModuleRef, TableAssemblyRef, TableTypeRef };
+        static const unsigned rgTypeDefOrRef[] = { TableTypeDef, TableTypeRef, TableTypeSpec };
+        unsigned cbResolutionScope = CodedIndexSize(rgResolutionScope, 4, 2);
+        unsigned cbTypeDefOrRef = CodedIndexSize(rgTypeDefOrRef, 3, 2);
+        unsigned cbField = IndexSize(m_rgcRows[TableFieldPtr] ? TableFieldPtr : TableField);
+        unsigned cbMethod = IndexSize(m_rgcRows[TableMethodPtr] ? TableMethodPtr : TableMethodDef);
+
+        m_rgcbRow[TableModule] = 2 + m_cbString + 3 * m_cbGuid;
+        m_rgcbRow[TableTypeRef] = cbResolutionScope + 2 * m_cbString;
+        m_offsetMethodList = 4 + 2 * m_cbString + cbTypeDefOrRef + cbField;
+        m_rgcbRow[TableTypeDef] = m_offsetMethodList + cbMethod;
+        m_rgcbRow[TableFieldPtr] = IndexSize(TableField);
+        m_rgcbRow[TableField] = 2 + m_cbString + m_cbBlob;
+        m_rgcbRow[TableMethodPtr] = IndexSize(TableMethodDef);
+        m_rgcbRow[TableMethodDef] = 8 + m_cbString + m_cbBlob + IndexSize(TableParam);
+
+        const unsigned char *pbRows = pbRowCount;
+
+        for (unsigned i = TableModule; i <= TableMethodDef; i++)
+        {
+            m_rgpbTable[i] = pbRows;
+            pbRows += (size_t)m_rgcRows[i] * m_rgcbRow[i];
+        }
+
+        if (m_rgcRows[TableMethodPtr])
+        {
+            fprintf(stderr, "unoptimized metadata is not supported\n");
+            return false;
+        }
+
+        return pbRows <= &m_image[0] + m_image.size();
+    }
+
+    unsigned IndexSize(unsigned table)
+    {
+        return m_rgcRows[table] < 0x10000 ? 2 : 4;
+    }
+
+    unsigned CodedIndexSize(const unsigned *rgTables, unsigned cTables, unsigned cTagBits)
+    {
+        for (unsigned i = 0; i < cTables; i++)
+        {
+            if (m_rgcRows[rgTables[i]] >= (1u << (16 - cTagBits)))
+            {
+                return 4;
+            }
+        }
+
+        return 2;
+    }
+
+    // Rows are numbered from 1.
+    const unsigned char *Row(unsigned table, unsigned iRow)
+    {
+        return m_rgpbTable[table] + (size_t)(iRow - 1) * m_rgcbRow[table];
+    }
+
+    const char *String(const unsigned char *pbIndex)
+    {
+        return m_pszStrings + (m_cbString == 2 ? ReadU16(pbIndex) : ReadU32(pbIndex));
+    }
+
+    // The type whose method list holds the method: the last one whose list starts at or
+    // before it.
+    std::string TypeNameOfMethod(unsigned iMethod)
+    {
+        unsigned iOwner = 0;
+
+        for (unsigned iType = 1; iType <= m_rgcRows[TableTypeDef]; iType++)
+        {
+            const unsigned char *pbMethodList = Row(TableTypeDef, iType) + m_offsetMethodList;
+            unsigned iFirst = IndexSize(TableMethodDef) == 2 ? ReadU16(pbMethodList) : ReadU32(pbMethodList);
+
+            if (iFirst <= iMethod)
+            {
+                iOwner = iType;
+            }
+        }
+
+        if (!iOwner)
+        {
+            return "?";
+        }
+
+        const unsigned char *pbType = Row(TableTypeDef, iOwner);
+        std::string name = String(pbType + 4 + m_cbString);
+
+        return (name.empty() ? name : name + ".") + String(pbType + 4);
+    }
+
+    bool ReadMethodBody(unsigned rva, MethodStats &stats)
+    {
+        size_t offset = Offset(rva, 1);
+
+        if (!offset)
+        {
+            return false;
+        }
+
+        const unsigned char *pbHeader = &m_image[offset];
+        std::set<unsigned> leaders;
+
+        // Tiny header: the code size is in the upper six bits.
+        if ((pbHeader[0] & 3) == 2)
+        {
+            unsigned cbCode = pbHeader[0] >> 2;
+
+            return Offset(rva, 1 + cbCode) && AnalyzeCode(pbHeader + 1, cbCode, leaders, stats);
+        }
+
+        if ((pbHeader[0] & 3) != 3 || !Offset(rva, 12))
+        {
+            return false;
+        }
+
+        unsigned flags = ReadU16(pbHeader) & 0xFFF;
+        unsigned cbHeader = (pbHeader[1] >> 4) * 4;
+        unsigned cbCode = ReadU32(pbHeader + 4);
+
+        if (!Offset(rva, cbHeader + cbCode))
+        {
+            return false;
+        }
+
+        // More sections: the exception clauses, after the code, four byte aligned.
+        if (flags & 0x8)
+        {
+            unsigned rvaSection = (rva + cbHeader + cbCode + 3) & ~3u;
+            bool fMoreSections = true;
+
+            while (fMoreSections)
+            {
+                size_t offsetSection = Offset(rvaSection, 4);
+
+                if (!offsetSection)
+                {
+                    return false;
+                }
+
+                const unsigned char *pbSection = &m_image[offsetSection];
+                bool fFat = (pbSection[0] & 0x40) != 0;
+                unsigned cbSection = fFat ? (ReadU32(pbSection) >> 8) : pbSection[1];
+
+                if (!Offset(rvaSection, cbSection))
+                {
+                    return false;
+                }
+
+                if (pbSection[0] & 0x1)
+                {
+                    unsigned cbClause = fFat ? 24 : 12;
+
+                    for (unsigned i = 0; (i + 1) * cbClause + 4 <= cbSection; i++)
+                    {
+                        const unsigned char *pbClause = pbSection + 4 + i * cbClause;
+                        unsigned clauseFlags = fFat ? ReadU32(pbClause) : ReadU16(pbClause);
+                        unsigned tryOffset = fFat ? ReadU32(pbClause + 4) : ReadU16(pbClause + 2);
+                        unsigned tryLength = fFat ? ReadU32(pbClause + 8) : pbClause[4];
+                        unsigned handlerOffset = fFat ? ReadU32(pbClause + 12) : ReadU16(pbClause + 5);
+                        unsigned handlerLength = fFat ? ReadU32(pbClause + 16) : pbClause[7];
+
+                        leaders.insert(tryOffset);
+                        leaders.insert(tryOffset + tryLength);
+                        leaders.insert(handlerOffset);
+                        leaders.insert(handlerOffset + handlerLength);
+
+                        // A filter runs from its start to the handler.
+                        if (clauseFlags & 0x1)
+                        {
+                            leaders.insert(fFat ? ReadU32(pbClause + 20) : ReadU32(pbClause + 8));
+                        }
+                    }
+                }
+
+                fMoreSections = (pbSection[0] & 0x80) != 0;
+                rvaSection += (cbSection + 3) & ~3u;
+            }
+        }
+
+        return AnalyzeCode(pbHeader + cbHeader, cbCode, leaders, stats);
+    }
+
+    struct Section
+    {
+        unsigned rva;
+        unsigned cbRaw;
+        unsigned offsetRaw;
+    };
+
+    std::vector<unsigned char> m_image;
+    std::vector<Section> m_sections;
+    size_t m_offsetMetadata;
+    const char *m_pszStrings;
+    unsigned m_cbString;
+    unsigned m_cbGuid;
+    unsigned m_cbBlob;
+    unsigned m_offsetMethodList;    // of the MethodList column in a TypeDef row
+    unsigned m_rgcRows[TableCount];
+    unsigned m_rgcbRow[TableMethodDef + 1];
+    const unsigned char *m_rgpbTable[TableMethodDef + 1];
+
+public:
+    AssemblyReader() :
+        m_offsetMetadata(0),
+        m_pszStrings(NULL),
+        m_cbString(2),
+        m_cbGuid(2),
+        m_cbBlob(2),
+        m_offsetMethodList(0)
+    {
+    }
+};
+
+static
+bool ReadAssembly(const char *szFile, AssemblyStats &stats)
+{
+    AssemblyReader reader;
+
+    if (!reader.Load(szFile) || !reader.ReadMethods(stats))
+    {
+        fprintf(stderr, "cannot read the methods of %s\n", szFile);
+        return false;
+    }
+
+    return true;
+}
+
+static
+void Total(const AssemblyStats &stats, MethodStats &total)
+{
+    total.cbCode = total.cBlocks = total.cBranches = 0;
+
+    for (AssemblyStats::const_iterator it = stats.begin(); it != stats.end(); ++it)
+    {
+        total.cbCode += it->second.cbCode;
+        total.cBlocks += it->second.cBlocks;
+        total.cBranches += it->second.cBranches;
+    }
+}
+
+// The value of each result is the number of blocks; the bytes are the size of the IL and the
+// operations the number of branches.
+static
+void AddResult(BenchReport &report, const std::string &name, const MethodStats &stats)
+{
+    report.AddResult(name.c_str(), 0, stats.cBranches, stats.cbCode, stats.cBlocks);
+}
+
+int __cdecl main(int argc, _In_count_(argc) char **argv)
+{
+    const char *szBefore = BenchGetOption(argc, argv, "-before");
+    const char *szAfter = BenchGetOption(argc, argv, "-after");
+    const char *szAssembly = (argc == 2 || (argc == 4 && argv[1][0] != '-')) ? argv[1] : NULL;
+
+    if (!szAssembly && !(szBefore && szAfter))
+    {
+        fprintf(stderr, "usage: ilstats <assembly> [-json <file>]\n"
+                        "       ilstats -before <assembly> -after <assembly> [-json <file>]\n");
+        return 2;
+    }
+
+    BenchReport report("ilstats", BenchGetOption(argc, argv, "-json"));
+    AssemblyStats before;
+    AssemblyStats after;
+    MethodStats total;
+
+    if (szAssembly)
+    {
+        if (!ReadAssembly(szAssembly, after))
+        {
+            return 1;
+        }
+
+        for (AssemblyStats::const_iterator it = after.begin(); it != after.end(); ++it)
+        {
+            AddResult(report, it->first, it->second);
+        }
+
+        Total(after, total);
+        AddResult(report, "total", total);
+        return BenchFinish();
+    }
+
+    if (!ReadAssembly(szBefore, before) || !ReadAssembly(szAfter, after))
+    {
+        return 1;
+    }
+
+    // The same corpus has the same methods.
+    BENCH_CHECK(before.size() == after.size());
+
+    for (AssemblyStats::const_iterator it = after.begin(); it != after.end(); ++it)
+    {
+        AssemblyStats::const_iterator itBefore = before.find(it->first);
+
+        if (!BENCH_CHECK(itBefore != before.end()))
+        {
+            fprintf(stderr, "%s is new\n", it->first.c_str());
+            continue;
+        }
+
+        const MethodStats &old = itBefore->second;
+
+        if (old.cbCode != it->second.cbCode || old.cBlocks != it->second.cBlocks)
+        {
+            AddResult(report, it->first + " (before)", old);
+            AddResult(report, it->first + " (after)", it->second);
+        }
+
+        if (!BENCH_CHECK(it->second.cbCode <= old.cbCode && it->second.cBlocks <= old.cBlocks))
+        {
+            fprintf(stderr, "%s grew: %u bytes, %u blocks -> %u bytes, %u blocks\n",
+                    it->first.c_str(), old.cbCode, old.cBlocks, it->second.cbCode, it->second.cBlocks);
+        }
+    }
+
+    Total(before, total);
+    AddResult(report, "total (before)", total);
+    Total(after, total);
+    AddResult(report, "total (after)", total);
+
+    return BenchFinish();
+}
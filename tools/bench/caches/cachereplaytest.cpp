@@ -0,0 +1,230 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Replays a stream of compilation cache traffic against HashedCacheT and RedBlackTreeT, checks
+//  that both give the same answers, and measures them.
+//
+//  The stream follows the way Semantics uses the name lookup cache: a Find for every cached
+//  lookup, and an Insert of the result when the Find misses.  A few names in a few scopes take
+//  most of the lookups, and the cache is cleared now and then, as it is when the project is
+//  decompiled after an edit.  The keys are made of addresses laid out like the ones of the
+//  string pool and the symbol allocators, so their hashes only differ in the bits pointers do.
+//  The same stream is replayed against the LookupKey and the NamespaceRingKey caches, with the
+//  KeyOperations of compilerproject.h, so the hashes and compares are the ones the compiler
+//  runs.
+//
+//  Build in the compiler's build environment, like the command line compiler: the core
+//  compiler precompiled header on the include path, linked with the core compiler library.
+//
+//  Run:
+//      cachereplaytest [-json <file>] [-operations <count>] [-keys <count>] [-clears <count>]
+//
+//-------------------------------------------------------------------------------------------------
+
+#include "StdAfx.h"
+#include "..\inc\benchharness.h"
+
+#include <vector>
+
+// One operation of the stream: look the key up, and insert it if it is not there.  A Clear
+// precedes the operation when fClear is set.
+struct CacheOperation
+{
+    unsigned iKey;
+    bool fClear;
+};
+
+// Addresses spaced like allocations of cbStride bytes from a block at qwBase.
+static
+void *FakeAddress(unsigned __int64 qwBase, unsigned iItem, unsigned cbStride)
+{
+    return (void *)(size_t)(qwBase + (unsigned __int64)iItem * cbStride);
+}
+
+static
+void BuildLookupKeys(unsigned cKeys, std::vector<LookupKey> &keys)
+{
+    BenchRandom random(1);
+    unsigned cNames = cKeys / 4 + 1;
+    unsigned cScopes = cKeys / 16 + 1;
+
+    keys.resize(cKeys);
+
+    for (unsigned i = 0; i < cKeys; i++)
+    {
+        LookupKey &key = keys[i];
+
+        // Spread the names over the pool and the scopes over the symbol allocator; the flags
+        // and the masks take the few values the binder passes.
+        key.Name = (STRING_INFO *)FakeAddress(0x0000000012340000ULL, i % cNames, 48);
+        key.Scope = FakeAddress(0x00000000ABC00000ULL, random.Next(cScopes), 160);
+        key.Flags = (unsigned __int64)random.Next(4) << (random.Next(2) * 8);
+        key.BindspaceMask = 1 << random.Next(3);
+        key.GenericTypeArity = random.Next(8) == 0 ? 1 + random.Next(2) : 0;
+        key.IgnoreFlags = random.Next(4) == 0 ? random.Next(4) : 0;
+        key.m_pProject = (CompilerProject *)FakeAddress(0x0000000001000000ULL, random.Next(3), 4096);
+    }
+}
+
+static
+void BuildNamespaceRingKeys(unsigned cKeys, std::vector<NamespaceRingKey> &keys)
+{
+    keys.resize(cKeys);
+
+    for (unsigned i = 0; i < cKeys; i++)
+    {
+        keys[i].CompilerHost = (CompilerHost *)FakeAddress(0x0000000002000000ULL, i % 2, 4096);
+        keys[i].NamespaceRing = (BCSYM_NamespaceRing *)FakeAddress(0x00000000ABC00000ULL, i / 2, 64);
+    }
+}
+
+// Skewed toward the low keys: half of the operations go to about a tenth of the keys.
+static
+void BuildStream(unsigned cOperations, unsigned cKeys, unsigned cClears, std::vector<CacheOperation> &stream)
+{
+    BenchRandom random(2);
+    unsigned cOperationsPerClear = cClears ? cOperations / (cClears + 1) : 0;
+
+    stream.resize(cOperations);
+
+    for (unsigned i = 0; i < cOperations; i++)
+    {
+        stream[i].iKey = random.Next(random.Next(cKeys) + 1);
+        stream[i].fClear = cOperationsPerClear && i && i % cOperationsPerClear == 0;
+    }
+}
+
+template <typename KeyType>
+struct HashedReplayNode :
+    public HashedCacheNodeBaseT<KeyType>
+{
+    unsigned iKey;
+};
+
+template <typename KeyType>
+struct RedBlackReplayNode :
+    public RedBlackNodeBaseT<KeyType>
+{
+    unsigned iKey;
+};
+
+// Replays the stream and records, for each operation, the key the cache answered with, or
+// ~0 if the lookup missed.
+template <typename CacheType, typename NodeType, typename KeyType>
+double ReplayStream(
+    const std::vector<KeyType> &keys,
+    const std::vector<CacheOperation> &stream,
+    std::vector<unsigned> &answers,
+    unsigned *pcMisses)
+{
+    NorlsAllocator norls(NORLSLOC);
+    CacheType cache(&norls);
+    unsigned cMisses = 0;
+
+    answers.resize(stream.size());
+
+    BenchStopwatch stopwatch;
+
+    for (size_t i = 0; i < stream.size(); i++)
+    {
+        const KeyType *pKey = &keys[stream[i].iKey];
+        NodeType *pNode = NULL;
+
+        if (stream[i].fClear)
+        {
+            cache.Clear();
+            norls.FreeHeap();
+        }
+
+        if (cache.Find(pKey, &pNode))
+        {
+            answers[i] = pNode->iKey;
+        }
+        else
+        {
+            cMisses++;
+            answers[i] = ~0u;
+
+            if (cache.Insert(pKey, &pNode))
+            {
+                pNode->iKey = stream[i].iKey;
+            }
+        }
+    }
+
+    double dblMsec = stopwatch.ElapsedMsec();
+
+    *pcMisses = cMisses;
+    return dblMsec;
+}
+
+template <typename KeyType, typename KeyOperations>
+void ReplayCache(
+    BenchReport &report,
+    const char *szCache,
+    const std::vector<KeyType> &keys,
+    const std::vector<CacheOperation> &stream)
+{
+    typedef HashedReplayNode<KeyType> HashedNode;
+    typedef RedBlackReplayNode<KeyType> RedBlackNode;
+    typedef HashedCacheT<KeyType, KeyOperations, HashedNode, EmptyNodeOperationsT<HashedNode> > HashedCache;
+    typedef RedBlackTreeT<KeyType, KeyOperations, RedBlackNode, EmptyNodeOperationsT<RedBlackNode> > RedBlackTree;
+
+    std::vector<unsigned> hashedAnswers;
+    std::vector<unsigned> redBlackAnswers;
+    unsigned cHashedMisses = 0;
+    unsigned cRedBlackMisses = 0;
+    char szName[64];
+
+    double dblHashedMsec = ReplayStream<HashedCache, HashedNode>(keys, stream, hashedAnswers, &cHashedMisses);
+    double dblRedBlackMsec = ReplayStream<RedBlackTree, RedBlackNode>(keys, stream, redBlackAnswers, &cRedBlackMisses);
+
+    // Both containers answer every operation alike, and a hit always finds the key it was
+    // inserted for.
+    BENCH_CHECK(cHashedMisses == cRedBlackMisses);
+    BENCH_CHECK(hashedAnswers == redBlackAnswers);
+
+    for (size_t i = 0; i < stream.size(); i++)
+    {
+        if (!BENCH_CHECK(hashedAnswers[i] == ~0u || hashedAnswers[i] == stream[i].iKey))
+        {
+            break;
+        }
+    }
+
+    // The value of each result is the miss ratio.
+    double dblMissRatio = stream.empty() ? 0 : (double)cHashedMisses / stream.size();
+
+    sprintf_s(szName, sizeof(szName), "%s: HashedCacheT", szCache);
+    report.AddResult(szName, dblHashedMsec, stream.size(), 0, dblMissRatio);
+
+    sprintf_s(szName, sizeof(szName), "%s: RedBlackTreeT", szCache);
+    report.AddResult(szName, dblRedBlackMsec, stream.size(), 0, dblMissRatio);
+}
+
+int __cdecl main(int argc, _In_count_(argc) char **argv)
+{
+    BenchReport report("caches", BenchGetOption(argc, argv, "-json"));
+    unsigned cOperations = BenchGetOption(argc, argv, "-operations", 4000000u);
+    unsigned cKeys = BenchGetOption(argc, argv, "-keys", 50000u);
+    unsigned cClears = BenchGetOption(argc, argv, "-clears", 4u);
+    std::vector<LookupKey> lookupKeys;
+    std::vector<NamespaceRingKey> namespaceRingKeys;
+    std::vector<CacheOperation> stream;
+
+    if (cKeys == 0)
+    {
+        fprintf(stderr, "usage: cachereplaytest [-json <file>] [-operations <count>] [-keys <count>] [-clears <count>]\n");
+        return 2;
+    }
+
+    BuildLookupKeys(cKeys, lookupKeys);
+    BuildNamespaceRingKeys(cKeys, namespaceRingKeys);
+    BuildStream(cOperations, cKeys, cClears, stream);
+
+    ReplayCache<LookupKey, LookupKeyOperations>(report, "name lookup", lookupKeys, stream);
+    ReplayCache<NamespaceRingKey, NamespaceRingKeyOperations>(report, "merged namespace", namespaceRingKeys, stream);
+
+    return BenchFinish();
+}
@@ -0,0 +1,277 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Checks that the CRC32 kernels of vb\language\shared\crc32.cpp agree with a bit at a time
+//  reference, and measures them over symbol name and anonymous type key corpora.
+//
+//  crc32.cpp is included so that its static kernels can be called directly.
+//
+//  Build:
+//      Windows, in the compiler's build environment:
+//          cl /O2 /EHsc /I..\..\..\vb\language\shared crc32test.cpp
+//      gcc or clang:
+//          g++ -O2 -msse4.1 -mpclmul -Iposix -I../../../vb/language/shared crc32test.cpp -o crc32test
+//
+//  Run:
+//      crc32test [-json <file>] [-names <count>]
+//
+//-------------------------------------------------------------------------------------------------
+
+#include "../inc/benchharness.h"
+#include "../../../vb/language/shared/crc32.cpp"
+
+#include <vector>
+#include <string>
+
+// The definition of the CRC: one bit at a time, no tables.
+static
+DWORD ReferenceCRC32(
+    DWORD crc,
+    const BYTE * pByte,
+    size_t uLength)
+{
+    for (; uLength > 0; uLength--, pByte++)
+    {
+        crc ^= *pByte;
+
+        for (int iBit = 0; iBit < 8; iBit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+    }
+
+    return crc;
+}
+
+// The byte at a time table kernel that crc32.cpp used before the faster kernels.
+static
+DWORD BytewiseCRC32(
+    DWORD crc,
+    const BYTE * pByte,
+    size_t uLength)
+{
+    for (; uLength > 0; uLength--)
+    {
+        crc = NewCRC32(crc, *pByte++);
+    }
+
+    return crc;
+}
+
+static
+void CheckKnownValues()
+{
+    static const char szCheck[] = "123456789";
+
+    // The CRC32 check value is the complement of the register.
+    BENCH_CHECK(~(DWORD)CRC32(szCheck, 9) == 0xCBF43926);
+    BENCH_CHECK((DWORD)CRC32(szCheck, 0) == ~DWORD(0));
+}
+
+// Every kernel, at every length up to a few blocks past the folding kernel's minimum, at
+// every alignment within 16 bytes, with several seeds.
+static
+void CheckKernels()
+{
+    const size_t cbMaximum = 1100;
+    BenchRandom random;
+    std::vector<BYTE> buffer(cbMaximum + 16);
+    static const DWORD rgSeeds[] = { ~DWORD(0), 0, 0x12345678, 0xEDB88320 };
+
+    for (size_t i = 0; i < buffer.size(); i++)
+    {
+        buffer[i] = (BYTE)random.Next();
+    }
+
+    initslicetable();
+
+    for (size_t uAlignment = 0; uAlignment < 16; uAlignment++)
+    {
+        for (size_t uLength = 0; uLength <= cbMaximum; uLength++)
+        {
+            const BYTE *pByte = &buffer[uAlignment];
+
+            for (size_t iSeed = 0; iSeed < sizeof(rgSeeds) / sizeof(rgSeeds[0]); iSeed++)
+            {
+                DWORD crcReference = ReferenceCRC32(rgSeeds[iSeed], pByte, uLength);
+
+                BENCH_CHECK(BytewiseCRC32(rgSeeds[iSeed], pByte, uLength) == crcReference);
+                BENCH_CHECK(UpdateCRC32SliceBy8(rgSeeds[iSeed], pByte, uLength) == crcReference);
+#if CRC32_CLMUL
+                if (g_fCRC32UseCarrylessMultiply && uLength >= CRC32_CLMUL_MINIMUM_LENGTH)
+                {
+                    BENCH_CHECK(UpdateCRC32Clmul(rgSeeds[iSeed], pByte, uLength) == crcReference);
+                }
+#endif
+                BENCH_CHECK(CRC32(rgSeeds[iSeed]).Update(pByte, uLength) == crcReference);
+            }
+        }
+    }
+
+    // A buffer fed in pieces gives the CRC of the whole.
+    for (size_t uSplit = 0; uSplit <= cbMaximum; uSplit += 7)
+    {
+        CRC32 crc;
+
+        crc.Update(&buffer[0], uSplit);
+        crc.Update(&buffer[uSplit], cbMaximum - uSplit);
+        BENCH_CHECK((DWORD)crc == ReferenceCRC32(~DWORD(0), &buffer[0], cbMaximum));
+    }
+}
+
+// Qualified names like the ones Builder hashes when it caches symbols, and the keys of
+// anonymous types, which are the property names and types in declaration order.
+static
+void BuildCorpora(
+    unsigned cNames,
+    std::vector<std::string> &symbolNames,
+    std::vector<std::string> &anonymousTypeKeys)
+{
+    static const char * const rgNamespaces[] =
+    {
+        "System", "System.Collections.Generic", "System.Linq", "System.Xml.Linq",
+        "Microsoft.VisualBasic.CompilerServices", "Contoso.Orders.Data", "Contoso.Orders.Services"
+    };
+    static const char * const rgWords[] =
+    {
+        "Customer", "Order", "Line", "Item", "Address", "Invoice", "Query", "Result",
+        "Provider", "Factory", "Manager", "Handler", "Collection", "Enumerator", "Builder"
+    };
+    static const char * const rgTypes[] =
+    {
+        "Integer", "String", "Date", "Decimal", "Boolean", "Long", "Double", "Object"
+    };
+    const size_t cNamespaces = sizeof(rgNamespaces) / sizeof(rgNamespaces[0]);
+    const size_t cWords = sizeof(rgWords) / sizeof(rgWords[0]);
+    const size_t cTypes = sizeof(rgTypes) / sizeof(rgTypes[0]);
+    BenchRandom random;
+
+    for (unsigned i = 0; i < cNames; i++)
+    {
+        std::string name = rgNamespaces[random.Next(cNamespaces)];
+        unsigned cParts = 1 + random.Next(3);
+
+        for (unsigned iPart = 0; iPart < cParts; iPart++)
+        {
+            name += '.';
+            name += rgWords[random.Next(cWords)];
+            name += rgWords[random.Next(cWords)];
+        }
+
+        if (random.Next(4) == 0)
+        {
+            name += "`";
+            name += (char)('1' + random.Next(3));
+        }
+
+        symbolNames.push_back(name);
+
+        std::string key = "VB$AnonymousType_";
+        unsigned cProperties = 1 + random.Next(6);
+
+        key += (char)('0' + random.Next(10));
+
+        for (unsigned iProperty = 0; iProperty < cProperties; iProperty++)
+        {
+            key += iProperty ? ',' : '<';
+            key += rgWords[random.Next(cWords)];
+            key += " As ";
+            key += rgTypes[random.Next(cTypes)];
+        }
+
+        key += '>';
+        anonymousTypeKeys.push_back(key);
+    }
+}
+
+typedef DWORD (*CRC32Kernel)(DWORD crc, const BYTE *pByte, size_t uLength);
+
+static
+void MeasureKernel(
+    BenchReport &report,
+    const char *szName,
+    CRC32Kernel pfnKernel,
+    const std::vector<std::string> &corpus,
+    unsigned cRepetitions)
+{
+    DWORD crcTotal = 0;
+    unsigned __int64 cBytes = 0;
+    BenchStopwatch stopwatch;
+
+    for (unsigned iRepetition = 0; iRepetition < cRepetitions; iRepetition++)
+    {
+        for (size_t i = 0; i < corpus.size(); i++)
+        {
+            crcTotal ^= pfnKernel(~DWORD(0), (const BYTE *)corpus[i].data(), corpus[i].size());
+            cBytes += corpus[i].size();
+        }
+    }
+
+    double dblMsec = stopwatch.ElapsedMsec();
+
+    // Keeps the loop from being optimized away, and shows that the kernels agree.
+    static DWORD s_crcExpected;
+    static const std::vector<std::string> *s_pCorpus;
+
+    if (s_pCorpus != &corpus)
+    {
+        s_pCorpus = &corpus;
+        s_crcExpected = crcTotal;
+    }
+
+    BENCH_CHECK(crcTotal == s_crcExpected);
+    report.AddResult(szName, dblMsec, (unsigned __int64)corpus.size() * cRepetitions, cBytes, dblMsec > 0 ? cBytes / dblMsec / 1000.0 : 0);
+}
+
+static
+DWORD PublicCRC32(
+    DWORD crc,
+    const BYTE * pByte,
+    size_t uLength)
+{
+    return CRC32(crc).Update(pByte, uLength);
+}
+
+int __cdecl main(int argc, _In_count_(argc) char **argv)
+{
+    BenchReport report("crc32", BenchGetOption(argc, argv, "-json"));
+    unsigned cNames = BenchGetOption(argc, argv, "-names", 100000u);
+    std::vector<std::string> symbolNames;
+    std::vector<std::string> anonymousTypeKeys;
+    std::vector<std::string> largeBuffers;
+
+    CheckKnownValues();
+    CheckKernels();
+
+    BuildCorpora(cNames, symbolNames, anonymousTypeKeys);
+
+    for (unsigned i = 0; i < 64; i++)
+    {
+        largeBuffers.push_back(std::string(4096 + i, (char)i));
+    }
+
+    // The value of each result is the throughput in MB/s.
+    const struct
+    {
+        const char *szCorpus;
+        const std::vector<std::string> *pCorpus;
+        unsigned cRepetitions;
+    } rgCorpora[] =
+    {
+        { "symbol names", &symbolNames, 10 },
+        { "anonymous type keys", &anonymousTypeKeys, 10 },
+        { "4KB buffers", &largeBuffers, 2000 },
+    };
+
+    for (size_t iCorpus = 0; iCorpus < sizeof(rgCorpora) / sizeof(rgCorpora[0]); iCorpus++)
+    {
+        std::string name = rgCorpora[iCorpus].szCorpus;
+
+        MeasureKernel(report, (name + ": bytewise").c_str(), BytewiseCRC32, *rgCorpora[iCorpus].pCorpus, rgCorpora[iCorpus].cRepetitions);
+        MeasureKernel(report, (name + ": slice-by-8").c_str(), UpdateCRC32SliceBy8, *rgCorpora[iCorpus].pCorpus, rgCorpora[iCorpus].cRepetitions);
+        MeasureKernel(report, (name + ": CRC32::Update").c_str(), PublicCRC32, *rgCorpora[iCorpus].pCorpus, rgCorpora[iCorpus].cRepetitions);
+    }
+
+    return BenchFinish();
+}
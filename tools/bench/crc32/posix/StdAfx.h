@@ -0,0 +1,51 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Stands in for the shared precompiled header when crc32.cpp is built by crc32test.cpp with
+//  gcc or clang.  Only what crc32.cpp uses is defined.
+//
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__)
+#define _M_X64 1
+#elif defined(__i386__)
+#define _M_IX86 1
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <cpuid.h>
+
+// <cpuid.h> defines __cpuid as a macro with a different signature than the Visual C++
+// intrinsic.
+#undef __cpuid
+
+static inline void __cpuid(int rgCpuInfo[4], int iFunction)
+{
+    unsigned uEax = 0, uEbx = 0, uEcx = 0, uEdx = 0;
+
+    __get_cpuid((unsigned)iFunction, &uEax, &uEbx, &uEcx, &uEdx);
+    rgCpuInfo[0] = (int)uEax;
+    rgCpuInfo[1] = (int)uEbx;
+    rgCpuInfo[2] = (int)uEcx;
+    rgCpuInfo[3] = (int)uEdx;
+}
+#endif
+
+typedef uint8_t BYTE;
+typedef uint32_t DWORD;
+typedef uint64_t UINT64;
+
+#define __int64 long long
+// crc32.cpp only uses __declspec(align(16)).
+#define __declspec(modifier) __attribute__((aligned(16)))
+#define UNALIGNED
+#define _Inout_count_(size)
+#define VSASSERT(condition, message)
+
+#include "crc32.h"
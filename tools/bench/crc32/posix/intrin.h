@@ -0,0 +1,11 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Stands in for the Visual C++ <intrin.h> when crc32.cpp is built with gcc or clang.
+//
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <x86intrin.h>
@@ -0,0 +1,316 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  A minimal harness shared by the standalone tests and benchmarks under tools\bench.
+//
+//  Each test is a single translation unit that includes the sources it exercises and this
+//  header, and is built with the plain compiler command line given at the top of the test.
+//  There is no framework: checks count their failures, stopwatches time the interesting
+//  loops, and the results are written as one JSON object so that runs can be compared by a
+//  script.  BenchFinish prints the verdict and gives the process exit code.
+//
+//  Typical use:
+//
+//      int __cdecl main(int argc, char **argv)
+//      {
+//          BenchReport report("crc32", BenchGetOption(argc, argv, "-json"));
+//
+//          BENCH_CHECK(ComputeSomething() == Expected);
+//
+//          BenchStopwatch stopwatch;
+//          for (...) { ... }
+//          report.AddResult("kernel", stopwatch.ElapsedMsec(), cIterations, cBytes);
+//
+//          return BenchFinish();
+//      }
+//
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// The tests that do not depend on Windows also build with gcc and clang.
+#ifndef _WIN32
+#define __cdecl
+#define __int64 long long
+#define _In_count_(size)
+#endif
+
+//-------------------------------------------------------------------------------------------------
+//
+// Checks.  A failed check is reported and counted; the test carries on so that one run shows
+// every failure.
+//
+//-------------------------------------------------------------------------------------------------
+
+inline unsigned &BenchFailureCount()
+{
+    static unsigned s_cFailures = 0;
+    return s_cFailures;
+}
+
+inline unsigned &BenchCheckCount()
+{
+    static unsigned s_cChecks = 0;
+    return s_cChecks;
+}
+
+inline bool BenchCheck(bool fPassed, const char *szExpression, const char *szFile, int iLine)
+{
+    BenchCheckCount()++;
+
+    if (!fPassed)
+    {
+        // Only the first few failures of a check in a loop are interesting.
+        if (BenchFailureCount()++ < 20)
+        {
+            fprintf(stderr, "%s(%d): check failed: %s\n", szFile, iLine, szExpression);
+        }
+    }
+
+    return fPassed;
+}
+
+#define BENCH_CHECK(expr) BenchCheck(!!(expr), #expr, __FILE__, __LINE__)
+
+// Returns the process exit code: 0 if every check passed.
+inline int BenchFinish()
+{
+    if (BenchFailureCount())
+    {
+        fprintf(stderr, "FAILED: %u of %u checks\n", BenchFailureCount(), BenchCheckCount());
+        return 1;
+    }
+
+    fprintf(stderr, "PASSED: %u checks\n", BenchCheckCount());
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+//
+// Command line.  Options are "-name value" pairs or "-name" flags.
+//
+//-------------------------------------------------------------------------------------------------
+
+inline const char *BenchGetOption(int argc, _In_count_(argc) char **argv, const char *szName, const char *szDefault = NULL)
+{
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], szName) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+
+    return szDefault;
+}
+
+inline unsigned BenchGetOption(int argc, _In_count_(argc) char **argv, const char *szName, unsigned uDefault)
+{
+    const char *szValue = BenchGetOption(argc, argv, szName);
+
+    return szValue ? (unsigned)strtoul(szValue, NULL, 10) : uDefault;
+}
+
+inline bool BenchHasFlag(int argc, _In_count_(argc) char **argv, const char *szName)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], szName) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------------
+//
+// Timing.
+//
+//-------------------------------------------------------------------------------------------------
+
+class BenchStopwatch
+{
+public:
+    BenchStopwatch()
+    {
+        Restart();
+    }
+
+    void Restart()
+    {
+        m_qwStart = Now();
+    }
+
+    double ElapsedMsec() const
+    {
+        return (double)(Now() - m_qwStart) * 1000.0 / (double)Frequency();
+    }
+
+    // The raw counter, for tests that timestamp events on several threads.
+    static unsigned __int64 Now()
+    {
+#ifdef _WIN32
+        LARGE_INTEGER liNow;
+        QueryPerformanceCounter(&liNow);
+        return (unsigned __int64)liNow.QuadPart;
+#else
+        struct timespec tsNow;
+        clock_gettime(CLOCK_MONOTONIC, &tsNow);
+        return (unsigned __int64)tsNow.tv_sec * 1000000000 + tsNow.tv_nsec;
+#endif
+    }
+
+    static unsigned __int64 Frequency()
+    {
+#ifdef _WIN32
+        LARGE_INTEGER liFrequency;
+        QueryPerformanceFrequency(&liFrequency);
+        return (unsigned __int64)liFrequency.QuadPart;
+#else
+        return 1000000000;
+#endif
+    }
+
+private:
+    unsigned __int64 m_qwStart;
+};
+
+//-------------------------------------------------------------------------------------------------
+//
+// Results.  Every result names what was measured, the time it took, and how many operations
+// and bytes it covered.  The report goes to stdout, or to the file given to the constructor,
+// when the report is destroyed.
+//
+//-------------------------------------------------------------------------------------------------
+
+class BenchReport
+{
+public:
+    BenchReport(const char *szSuite, const char *szFile = NULL) :
+        m_szSuite(szSuite),
+        m_szFile(szFile),
+        m_cResults(0)
+    {
+    }
+
+    ~BenchReport()
+    {
+        FILE *pFile = stdout;
+
+        if (m_szFile)
+        {
+            pFile = fopen(m_szFile, "w");
+
+            if (!pFile)
+            {
+                fprintf(stderr, "cannot write %s\n", m_szFile);
+                return;
+            }
+        }
+
+        fprintf(pFile, "{\"suite\":\"%s\",\"passed\":%s,\"results\":[", m_szSuite, BenchFailureCount() ? "false" : "true");
+
+        for (unsigned i = 0; i < m_cResults; i++)
+        {
+            const Result &result = m_rgResults[i];
+
+            fprintf(pFile,
+                    "%s\n{\"name\":\"%s\",\"timeMs\":%.3f,\"operations\":%llu,\"bytes\":%llu,\"value\":%.3f}",
+                    i ? "," : "",
+                    result.szName,
+                    result.dblMsec,
+                    (unsigned long long)result.cOperations,
+                    (unsigned long long)result.cBytes,
+                    result.dblValue);
+        }
+
+        fprintf(pFile, "\n]}\n");
+
+        if (pFile != stdout)
+        {
+            fclose(pFile);
+        }
+    }
+
+    // dblValue is a result specific figure (a ratio, a latency, a count) for the results
+    // that are not just a time.
+    void AddResult(const char *szName, double dblMsec, unsigned __int64 cOperations, unsigned __int64 cBytes = 0, double dblValue = 0)
+    {
+        if (m_cResults < MaxResults)
+        {
+            Result &result = m_rgResults[m_cResults++];
+
+            strncpy(result.szName, szName, sizeof(result.szName) - 1);
+            result.szName[sizeof(result.szName) - 1] = '\0';
+            result.dblMsec = dblMsec;
+            result.cOperations = cOperations;
+            result.cBytes = cBytes;
+            result.dblValue = dblValue;
+        }
+
+        fprintf(stderr, "%-48s %12.3f ms %12llu ops %14.3f\n", szName, dblMsec, (unsigned long long)cOperations, dblValue);
+    }
+
+private:
+    enum { MaxResults = 256 };
+
+    struct Result
+    {
+        char szName[64];
+        double dblMsec;
+        unsigned __int64 cOperations;
+        unsigned __int64 cBytes;
+        double dblValue;
+    };
+
+    const char *m_szSuite;
+    const char *m_szFile;
+    unsigned m_cResults;
+    Result m_rgResults[MaxResults];
+};
+
+//-------------------------------------------------------------------------------------------------
+//
+// A deterministic generator for test data, so that runs see the same inputs.
+//
+//-------------------------------------------------------------------------------------------------
+
+class BenchRandom
+{
+public:
+    BenchRandom(unsigned __int64 qwSeed = 0x2545F4914F6CDD1DULL) :
+        m_qwState(qwSeed ? qwSeed : 1)
+    {
+    }
+
+    // xorshift64*
+    unsigned __int64 Next()
+    {
+        m_qwState ^= m_qwState >> 12;
+        m_qwState ^= m_qwState << 25;
+        m_qwState ^= m_qwState >> 27;
+        return m_qwState * 0x2545F4914F6CDD1DULL;
+    }
+
+    // A value in [0, uBound).
+    unsigned Next(unsigned uBound)
+    {
+        return uBound ? (unsigned)(Next() % uBound) : 0;
+    }
+
+private:
+    unsigned __int64 m_qwState;
+};
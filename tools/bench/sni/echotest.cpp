@@ -0,0 +1,551 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Drives the asynchronous I/O path of the SNI client against a loopback echo server.  The
+//  path runs from SNIReadAsync and SNIWriteAsync through the completion port to the
+//  SNIAsyncWait thread and the consumer callbacks.
+//
+//  Each connection keeps up to -depth writes of -bytes in flight, and always has one read
+//  pending for the echo.  The next write is issued from the write completion, the next read
+//  from the read completion.  Every byte carries a pattern of its connection and stream
+//  offset, so the echo is checked for lost, repeated and reordered data.  The round trip of a
+//  message ends when its last byte comes back.
+//
+//  Each scenario reports its message rate and the average and worst round trip of its
+//  messages.  The scenarios range from one connection in lock step to many pipelined ones.
+//
+//  Build in the SNI client build environment, like the managed wrapper: SNI_BASED_CLIENT
+//  defined, the SNI include and src directories on the include path, linked with the SNI
+//  client library.  It only runs on Windows: the SNI client has no Linux I/O backend, see
+//  SNICompletionPort.
+//
+//  Run:
+//      echotest [-json <file>] [-connections <count>] [-depth <writes>] [-messages <total>]
+//               [-bytes <per message>]
+//
+//-------------------------------------------------------------------------------------------------
+
+#include "snipch.hpp"
+#include "..\inc\benchharness.h"
+#include "snibench.h"
+
+#include <vector>
+
+struct Scenario
+{
+    const char *szName;
+    unsigned cConnections;
+    unsigned cDepth;                // writes each connection keeps in flight
+};
+
+static const Scenario s_rgScenarios[] =
+{
+    // Every completion is followed by a round trip before the next one.
+    { "pingpong",           1,      1 },
+    // One connection keeps the completion thread busy.
+    { "pipelined",          1,      16 },
+    // Completions of many connections interleave.
+    { "fanout",             64,     1 },
+    { "fanoutpipelined",    64,     16 },
+};
+
+// The consumer buffer size of the connections, the largest message.
+static const LONG UserDataLength = 4096;
+
+// The content of a byte of a connection's stream.
+inline BYTE PatternByte(unsigned iConnection, unsigned __int64 qwOffset)
+{
+    return (BYTE)(qwOffset * 7 + iConnection);
+}
+
+//-------------------------------------------------------------------------------------------------
+//
+// The server.  A thread per connection sends back whatever it receives.
+//
+//-------------------------------------------------------------------------------------------------
+
+class EchoServer
+{
+public:
+    EchoServer() :
+        m_listener(INVALID_SOCKET),
+        m_usPort(0),
+        m_hThread(NULL)
+    {
+        InitializeCriticalSection(&m_cs);
+    }
+
+    ~EchoServer()
+    {
+        DeleteCriticalSection(&m_cs);
+    }
+
+    bool Start()
+    {
+        m_listener = BenchBindLoopback(AF_INET, true, &m_usPort);
+
+        if (m_listener == INVALID_SOCKET)
+        {
+            return false;
+        }
+
+        m_hThread = CreateThread(NULL, 0, AcceptThread, this, 0, NULL);
+        return m_hThread != NULL;
+    }
+
+    // The connections end when the clients close them.
+    void Stop()
+    {
+        if (m_listener != INVALID_SOCKET)
+        {
+            closesocket(m_listener);
+            m_listener = INVALID_SOCKET;
+        }
+
+        if (m_hThread)
+        {
+            WaitForSingleObject(m_hThread, INFINITE);
+            CloseHandle(m_hThread);
+            m_hThread = NULL;
+        }
+
+        for (size_t i = 0; i < m_connectionThreads.size(); i++)
+        {
+            WaitForSingleObject(m_connectionThreads[i], INFINITE);
+            CloseHandle(m_connectionThreads[i]);
+        }
+
+        m_connectionThreads.clear();
+    }
+
+    USHORT Port() const
+    {
+        return m_usPort;
+    }
+
+private:
+    static DWORD WINAPI AcceptThread(LPVOID pvServer)
+    {
+        EchoServer *pServer = (EchoServer *)pvServer;
+        SOCKET sock;
+
+        // Stop closes the listener, which fails the accept.
+        while ((sock = accept(pServer->m_listener, NULL, NULL)) != INVALID_SOCKET)
+        {
+            HANDLE hThread = CreateThread(NULL, 0, ConnectionThread, (LPVOID)sock, 0, NULL);
+
+            if (!hThread)
+            {
+                closesocket(sock);
+                continue;
+            }
+
+            EnterCriticalSection(&pServer->m_cs);
+            pServer->m_connectionThreads.push_back(hThread);
+            LeaveCriticalSection(&pServer->m_cs);
+        }
+
+        return 0;
+    }
+
+    static DWORD WINAPI ConnectionThread(LPVOID pvSocket)
+    {
+        SOCKET sock = (SOCKET)pvSocket;
+        BOOL fNoDelay = TRUE;
+        char rgbBuffer[64 * 1024];
+        int cbReceived;
+
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&fNoDelay, sizeof(fNoDelay));
+
+        while ((cbReceived = recv(sock, rgbBuffer, sizeof(rgbBuffer), 0)) > 0)
+        {
+            if (!BenchSendAll(sock, rgbBuffer, cbReceived))
+            {
+                break;
+            }
+        }
+
+        closesocket(sock);
+        return 0;
+    }
+
+    SOCKET m_listener;
+    USHORT m_usPort;
+    HANDLE m_hThread;
+    CRITICAL_SECTION m_cs;
+    std::vector<HANDLE> m_connectionThreads;
+};
+
+//-------------------------------------------------------------------------------------------------
+//
+// The clients.
+//
+//-------------------------------------------------------------------------------------------------
+
+struct EchoClient
+{
+    SNI_Conn *pConn;
+    unsigned iConnection;
+    unsigned cMessages;
+    DWORD cbMessage;
+    unsigned cDepth;
+
+    // Writes, under cs so that they go out in the order of their messages
+    CRITICAL_SECTION cs;
+    unsigned cMessagesSent;
+    unsigned cWritesPending;
+
+    // Reads, only ever one pending
+    unsigned __int64 cbReceived;
+    unsigned cMessagesEchoed;
+    std::vector<unsigned __int64> sendTimes;
+
+    // Results
+    double dblRoundTripMsec;
+    double dblMaxRoundTripMsec;
+    DWORD dwError;
+    bool fCorrupt;
+    LONG fDone;
+    volatile LONG *pcRunning;
+    HANDLE hAllDone;
+};
+
+static
+void FinishClient(EchoClient *pClient, DWORD dwError)
+{
+    if (InterlockedExchange(&pClient->fDone, 1) == 0)
+    {
+        pClient->dwError = dwError;
+
+        if (InterlockedDecrement(pClient->pcRunning) == 0)
+        {
+            SetEvent(pClient->hAllDone);
+        }
+    }
+}
+
+// Keeps cDepth writes in flight.  The caller holds pClient->cs.
+static
+void SendMessages(EchoClient *pClient)
+{
+    while (!pClient->fDone &&
+           pClient->cMessagesSent < pClient->cMessages &&
+           pClient->cWritesPending < pClient->cDepth)
+    {
+        SNI_Packet *pPacket = SNIPacketAllocate(pClient->pConn, SNI_Packet_Write);
+        unsigned __int64 qwOffset = (unsigned __int64)pClient->cMessagesSent * pClient->cbMessage;
+        BYTE rgbMessage[UserDataLength];
+
+        if (!pPacket)
+        {
+            FinishClient(pClient, ERROR_OUTOFMEMORY);
+            return;
+        }
+
+        for (DWORD i = 0; i < pClient->cbMessage; i++)
+        {
+            rgbMessage[i] = PatternByte(pClient->iConnection, qwOffset + i);
+        }
+
+        SNIPacketSetData(pPacket, rgbMessage, pClient->cbMessage);
+        pClient->sendTimes[pClient->cMessagesSent++] = BenchStopwatch::Now();
+
+        DWORD dwError = SNIWriteAsync(pClient->pConn, pPacket);
+
+        // The pending write holds a reference of its own.
+        SNIPacketRelease(pPacket);
+
+        if (dwError == ERROR_IO_PENDING)
+        {
+            pClient->cWritesPending++;
+        }
+        else if (dwError != ERROR_SUCCESS)
+        {
+            FinishClient(pClient, dwError);
+            return;
+        }
+    }
+}
+
+static
+void __cdecl WriteCompletion(LPVOID pvClient, SNI_Packet *pPacket, DWORD dwError)
+{
+    EchoClient *pClient = (EchoClient *)pvClient;
+
+    UNREFERENCED_PARAMETER(pPacket);
+
+    EnterCriticalSection(&pClient->cs);
+
+    pClient->cWritesPending--;
+
+    if (dwError != ERROR_SUCCESS)
+    {
+        FinishClient(pClient, dwError);
+    }
+    else
+    {
+        SendMessages(pClient);
+    }
+
+    LeaveCriticalSection(&pClient->cs);
+}
+
+// Checks an echo and ends the round trips of the messages it completes.
+static
+void ReceiveEcho(EchoClient *pClient, SNI_Packet *pPacket)
+{
+    BYTE *pbData;
+    DWORD cbData;
+
+    SNIPacketGetData(pPacket, &pbData, &cbData);
+
+    for (DWORD i = 0; i < cbData; i++)
+    {
+        if (pbData[i] != PatternByte(pClient->iConnection, pClient->cbReceived + i))
+        {
+            pClient->fCorrupt = true;
+            FinishClient(pClient, ERROR_INVALID_DATA);
+            return;
+        }
+    }
+
+    pClient->cbReceived += cbData;
+
+    unsigned __int64 qwNow = BenchStopwatch::Now();
+
+    while (pClient->cMessagesEchoed < pClient->cMessages &&
+           (unsigned __int64)(pClient->cMessagesEchoed + 1) * pClient->cbMessage <= pClient->cbReceived)
+    {
+        double dblMsec = (double)(qwNow - pClient->sendTimes[pClient->cMessagesEchoed]) * 1000.0 / (double)BenchStopwatch::Frequency();
+
+        pClient->dblRoundTripMsec += dblMsec;
+
+        if (dblMsec > pClient->dblMaxRoundTripMsec)
+        {
+            pClient->dblMaxRoundTripMsec = dblMsec;
+        }
+
+        pClient->cMessagesEchoed++;
+    }
+
+    if (pClient->cbReceived > (unsigned __int64)pClient->cMessages * pClient->cbMessage)
+    {
+        // More came back than was sent.
+        pClient->fCorrupt = true;
+        FinishClient(pClient, ERROR_INVALID_DATA);
+    }
+    else if (pClient->cMessagesEchoed == pClient->cMessages)
+    {
+        FinishClient(pClient, ERROR_SUCCESS);
+    }
+}
+
+// Posts reads until one is pending.  A read that completes at once has no completion.
+static
+void ReceiveEchoes(EchoClient *pClient)
+{
+    while (!pClient->fDone)
+    {
+        SNI_Packet *pPacket = NULL;
+        DWORD dwError = SNIReadAsync(pClient->pConn, &pPacket, NULL);
+
+        if (dwError == ERROR_IO_PENDING)
+        {
+            return;
+        }
+
+        if (dwError != ERROR_SUCCESS)
+        {
+            FinishClient(pClient, dwError);
+            return;
+        }
+
+        ReceiveEcho(pClient, pPacket);
+        SNIPacketRelease(pPacket);
+    }
+}
+
+// SNI releases the packet when this returns.
+static
+void __cdecl ReadCompletion(LPVOID pvClient, SNI_Packet *pPacket, DWORD dwError)
+{
+    EchoClient *pClient = (EchoClient *)pvClient;
+
+    if (dwError != ERROR_SUCCESS)
+    {
+        FinishClient(pClient, dwError);
+        return;
+    }
+
+    ReceiveEcho(pClient, pPacket);
+    ReceiveEchoes(pClient);
+}
+
+static
+void RunScenario(
+    const Scenario &scenario,
+    USHORT usPort,
+    unsigned cMessages,
+    DWORD cbMessage,
+    BenchReport &report)
+{
+    std::vector<EchoClient> clients(scenario.cConnections);
+    unsigned cMessagesPerConnection = (cMessages + scenario.cConnections - 1) / scenario.cConnections;
+    volatile LONG cRunning = (LONG)scenario.cConnections;
+    HANDLE hAllDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+    unsigned __int64 cMessagesEchoed = 0;
+    double dblRoundTripMsec = 0;
+    double dblMaxRoundTripMsec = 0;
+    unsigned cFailed = 0;
+    char szName[64];
+
+    if (!BENCH_CHECK(hAllDone != NULL))
+    {
+        return;
+    }
+
+    for (unsigned i = 0; i < scenario.cConnections; i++)
+    {
+        EchoClient &client = clients[i];
+
+        InitializeCriticalSection(&client.cs);
+
+        client.pConn = NULL;
+        client.iConnection = i;
+        client.cMessages = cMessagesPerConnection;
+        client.cbMessage = cbMessage;
+        client.cDepth = scenario.cDepth;
+        client.cMessagesSent = 0;
+        client.cWritesPending = 0;
+        client.cbReceived = 0;
+        client.cMessagesEchoed = 0;
+        client.sendTimes.resize(cMessagesPerConnection);
+        client.dblRoundTripMsec = 0;
+        client.dblMaxRoundTripMsec = 0;
+        client.dwError = ERROR_SUCCESS;
+        client.fCorrupt = false;
+        client.fDone = 0;
+        client.pcRunning = &cRunning;
+        client.hAllDone = hAllDone;
+
+        DWORD dwError = BenchOpenLoopback(usPort, UserDataLength, &client.pConn, ReadCompletion, WriteCompletion, &client);
+
+        if (!BENCH_CHECK(dwError == ERROR_SUCCESS))
+        {
+            client.pConn = NULL;
+            FinishClient(&client, dwError);
+        }
+    }
+
+    // The connections are all open before the clock starts.
+    BenchStopwatch stopwatch;
+
+    for (unsigned i = 0; i < scenario.cConnections; i++)
+    {
+        EchoClient &client = clients[i];
+
+        if (!client.pConn)
+        {
+            continue;
+        }
+
+        ReceiveEchoes(&client);
+
+        EnterCriticalSection(&client.cs);
+        SendMessages(&client);
+        LeaveCriticalSection(&client.cs);
+    }
+
+    BENCH_CHECK(WaitForSingleObject(hAllDone, 5 * 60 * 1000) == WAIT_OBJECT_0);
+
+    double dblMsec = stopwatch.ElapsedMsec();
+
+    for (unsigned i = 0; i < scenario.cConnections; i++)
+    {
+        EchoClient &client = clients[i];
+
+        // Ends the callbacks of a client before its state goes away.
+        if (client.pConn)
+        {
+            SNIClose(client.pConn);
+        }
+
+        DeleteCriticalSection(&client.cs);
+
+        if (client.dwError != ERROR_SUCCESS || client.fCorrupt || !client.fDone)
+        {
+            cFailed++;
+        }
+
+        cMessagesEchoed += client.cMessagesEchoed;
+        dblRoundTripMsec += client.dblRoundTripMsec;
+
+        if (client.dblMaxRoundTripMsec > dblMaxRoundTripMsec)
+        {
+            dblMaxRoundTripMsec = client.dblMaxRoundTripMsec;
+        }
+    }
+
+    CloseHandle(hAllDone);
+
+    BENCH_CHECK(cFailed == 0);
+    BENCH_CHECK(cMessagesEchoed == (unsigned __int64)cMessagesPerConnection * scenario.cConnections);
+
+    sprintf_s(szName, sizeof(szName), "%s/messages", scenario.szName);
+    report.AddResult(szName, dblMsec, cMessagesEchoed, cMessagesEchoed * cbMessage, dblMsec ? cMessagesEchoed / dblMsec : 0);
+
+    sprintf_s(szName, sizeof(szName), "%s/roundtrip", scenario.szName);
+    report.AddResult(szName, dblMsec, cMessagesEchoed, 0, cMessagesEchoed ? dblRoundTripMsec / cMessagesEchoed : 0);
+
+    sprintf_s(szName, sizeof(szName), "%s/maxroundtrip", scenario.szName);
+    report.AddResult(szName, dblMsec, cMessagesEchoed, 0, dblMaxRoundTripMsec);
+}
+
+int __cdecl main(int argc, _In_count_(argc) char **argv)
+{
+    BenchReport report("sniecho", BenchGetOption(argc, argv, "-json"));
+    unsigned cMessages = BenchGetOption(argc, argv, "-messages", 200000u);
+    DWORD cbMessage = BenchGetOption(argc, argv, "-bytes", 512u);
+    std::vector<Scenario> scenarios;
+    EchoServer server;
+
+    if (BenchGetOption(argc, argv, "-connections") || BenchGetOption(argc, argv, "-depth"))
+    {
+        Scenario scenario = { "custom", 1, 1 };
+
+        scenario.cConnections = BenchGetOption(argc, argv, "-connections", 1u);
+        scenario.cDepth = BenchGetOption(argc, argv, "-depth", 1u);
+        scenarios.push_back(scenario);
+    }
+    else
+    {
+        scenarios.assign(s_rgScenarios, s_rgScenarios + ARRAYSIZE(s_rgScenarios));
+    }
+
+    if (cMessages == 0 || cbMessage == 0 || cbMessage > (DWORD)UserDataLength ||
+        scenarios[0].cConnections == 0 || scenarios[0].cDepth == 0)
+    {
+        fprintf(stderr, "usage: echotest [-json <file>] [-connections <count>] [-depth <writes>] [-messages <total>] [-bytes <per message, at most %d>]\n", UserDataLength);
+        return 2;
+    }
+
+    if (!BENCH_CHECK(BenchStartWinsock()) ||
+        !BENCH_CHECK(SNIInitialize() == ERROR_SUCCESS))
+    {
+        return BenchFinish();
+    }
+
+    if (BENCH_CHECK(server.Start()))
+    {
+        for (size_t i = 0; i < scenarios.size(); i++)
+        {
+            RunScenario(scenarios[i], server.Port(), cMessages, cbMessage, report);
+        }
+    }
+
+    server.Stop();
+    SNITerminate();
+    WSACleanup();
+    return BenchFinish();
+}
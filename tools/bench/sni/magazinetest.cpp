@@ -0,0 +1,324 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Stresses the per-processor packet magazines of the SNI client memory regions
+//  (SNIPacketMagazine in sni\include\sni_io.hpp).  Many threads allocate and release packets,
+//  some of them released by another thread, and each phase reports its allocation rate with
+//  the magazine hits, misses and steals it caused.
+//
+//  The packets belong to a connection object that is never opened, so only the test threads
+//  allocate from its memory region while a phase runs.  Every allocation pops the magazine of
+//  its processor once, which the hits and misses of a phase have to add up to, unless there
+//  are so many processors that the region has no magazine slots at all.  Each packet
+//  carries a stamp of the thread and the allocation that got it, checked when it is released,
+//  so a packet handed out twice is caught.
+//
+//  Build in the SNI client build environment, like the managed wrapper: SNI_BASED_CLIENT
+//  defined, the SNI include and src directories on the include path, linked with the SNI
+//  client library.
+//
+//  Run:
+//      magazinetest [-json <file>] [-threads <count>] [-operations <per thread>] [-buffer <bytes>]
+//
+//-------------------------------------------------------------------------------------------------
+
+#include "snipch.hpp"
+#include "..\inc\benchharness.h"
+
+#include <vector>
+
+// How a phase holds and hands off the packets it allocates.
+struct Phase
+{
+    const char *szName;
+    unsigned cHeld;                 // packets a thread holds before it releases them
+    unsigned uHandoffPercent;       // of the released packets, the share released by the next thread
+    bool fEvenThreadsOnly;          // only even threads hand off, odd threads only receive
+};
+
+static const Phase s_rgPhases[] =
+{
+    // Every allocation after the first is served by the thread's own magazine.
+    { "local",      1,      0,      false },
+    // More than a magazine is held, so releases drain to the list and allocations refill.
+    { "burst",      48,     0,      false },
+    // Packets move between processors in both directions.
+    { "handoff",    8,      50,     false },
+    // Even threads only allocate and odd threads only release, so the even threads live on
+    // refills and steals.
+    { "oneway",     8,      100,    true },
+};
+
+// The packets another thread released to this one, padded so that two mailboxes do not
+// share a cache line.
+struct Mailbox
+{
+    CRITICAL_SECTION cs;
+    std::vector<SNI_Packet *> packets;
+    BYTE rgbPad[SNI_CACHE_LINE_SIZE];
+};
+
+struct PacketStamp
+{
+    unsigned iThread;
+    unsigned iOperation;
+};
+
+struct Worker
+{
+    const Phase *pPhase;
+    SNI_Conn *pConn;
+    Mailbox *rgMailboxes;
+    unsigned iThread;
+    unsigned cThreads;
+    unsigned cOperations;
+    HANDLE hStart;
+
+    // Results
+    unsigned cAllocationFailures;
+    unsigned cBadStamps;
+};
+
+static
+bool CheckStamp(SNI_Packet *pPacket, const PacketStamp &stamp)
+{
+    BYTE *pbData;
+    DWORD cbData;
+
+    SNIPacketGetData(pPacket, &pbData, &cbData);
+    return cbData == sizeof(stamp) && memcmp(pbData, &stamp, sizeof(stamp)) == 0;
+}
+
+static
+void ReleaseMailbox(Mailbox *pMailbox)
+{
+    std::vector<SNI_Packet *> packets;
+
+    EnterCriticalSection(&pMailbox->cs);
+    packets.swap(pMailbox->packets);
+    LeaveCriticalSection(&pMailbox->cs);
+
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        SNIPacketRelease(packets[i]);
+    }
+}
+
+static
+DWORD WINAPI WorkerThread(LPVOID pvWorker)
+{
+    Worker *pWorker = (Worker *)pvWorker;
+    const Phase *pPhase = pWorker->pPhase;
+    bool fHandsOff = !pPhase->fEvenThreadsOnly || pWorker->iThread % 2 == 0;
+    Mailbox *pOwnMailbox = &pWorker->rgMailboxes[pWorker->iThread];
+    Mailbox *pNextMailbox = &pWorker->rgMailboxes[(pWorker->iThread + 1) % pWorker->cThreads];
+    BenchRandom random(pWorker->iThread + 1);
+    std::vector<SNI_Packet *> held;
+    std::vector<PacketStamp> stamps;
+
+    held.reserve(pPhase->cHeld);
+    stamps.reserve(pPhase->cHeld);
+
+    WaitForSingleObject(pWorker->hStart, INFINITE);
+
+    for (unsigned iOperation = 0; iOperation < pWorker->cOperations; iOperation++)
+    {
+        SNI_Packet *pPacket = SNIPacketAllocate(pWorker->pConn, SNI_Packet_Write);
+        PacketStamp stamp = { pWorker->iThread, iOperation };
+
+        if (!pPacket)
+        {
+            pWorker->cAllocationFailures++;
+            continue;
+        }
+
+        SNIPacketSetData(pPacket, (const BYTE *)&stamp, sizeof(stamp));
+        held.push_back(pPacket);
+        stamps.push_back(stamp);
+
+        if (held.size() == pPhase->cHeld)
+        {
+            for (size_t i = 0; i < held.size(); i++)
+            {
+                if (!CheckStamp(held[i], stamps[i]))
+                {
+                    pWorker->cBadStamps++;
+                }
+
+                if (fHandsOff && random.Next(100) < pPhase->uHandoffPercent)
+                {
+                    EnterCriticalSection(&pNextMailbox->cs);
+                    pNextMailbox->packets.push_back(held[i]);
+                    LeaveCriticalSection(&pNextMailbox->cs);
+                }
+                else
+                {
+                    SNIPacketRelease(held[i]);
+                }
+            }
+
+            held.clear();
+            stamps.clear();
+        }
+
+        if (iOperation % 16 == 0)
+        {
+            ReleaseMailbox(pOwnMailbox);
+        }
+    }
+
+    for (size_t i = 0; i < held.size(); i++)
+    {
+        SNIPacketRelease(held[i]);
+    }
+
+    ReleaseMailbox(pOwnMailbox);
+    return 0;
+}
+
+static
+void RunPhase(
+    const Phase &phase,
+    SNI_Conn *pConn,
+    unsigned cThreads,
+    unsigned cOperations,
+    BenchReport &report)
+{
+    SNIMemRegion *pMemRegion = &SNIMemRegion::s_rgClientMemRegion[pConn->m_MemTag];
+    std::vector<Mailbox> mailboxes(cThreads);
+    std::vector<Worker> workers(cThreads);
+    std::vector<HANDLE> threads;
+    HANDLE hStart = CreateEvent(NULL, TRUE, FALSE, NULL);
+    ULONGLONG cHitsBefore, cMissesBefore, cStealsBefore;
+    ULONGLONG cHits, cMisses, cSteals;
+    unsigned __int64 cAllocations = 0;
+    unsigned cBadStamps = 0;
+    char szName[64];
+
+    if (!BENCH_CHECK(hStart != NULL))
+    {
+        return;
+    }
+
+    for (unsigned i = 0; i < cThreads; i++)
+    {
+        Worker &worker = workers[i];
+
+        InitializeCriticalSection(&mailboxes[i].cs);
+
+        worker.pPhase = &phase;
+        worker.pConn = pConn;
+        worker.rgMailboxes = &mailboxes[0];
+        worker.iThread = i;
+        worker.cThreads = cThreads;
+        worker.cOperations = cOperations;
+        worker.hStart = hStart;
+        worker.cAllocationFailures = 0;
+        worker.cBadStamps = 0;
+
+        HANDLE hThread = CreateThread(NULL, 0, WorkerThread, &worker, 0, NULL);
+
+        if (BENCH_CHECK(hThread != NULL))
+        {
+            threads.push_back(hThread);
+        }
+        else
+        {
+            worker.cOperations = 0;
+        }
+    }
+
+    pMemRegion->GetMagazineStatistics(&cHitsBefore, &cMissesBefore, &cStealsBefore);
+
+    BenchStopwatch stopwatch;
+
+    SetEvent(hStart);
+
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+
+    double dblMsec = stopwatch.ElapsedMsec();
+
+    // A thread that finished first may have been handed packets after its last look.
+    for (unsigned i = 0; i < cThreads; i++)
+    {
+        ReleaseMailbox(&mailboxes[i]);
+        DeleteCriticalSection(&mailboxes[i].cs);
+    }
+
+    pMemRegion->GetMagazineStatistics(&cHits, &cMisses, &cSteals);
+    cHits -= cHitsBefore;
+    cMisses -= cMissesBefore;
+    cSteals -= cStealsBefore;
+
+    for (unsigned i = 0; i < cThreads; i++)
+    {
+        BENCH_CHECK(workers[i].cAllocationFailures == 0);
+        cAllocations += workers[i].cOperations - workers[i].cAllocationFailures;
+        cBadStamps += workers[i].cBadStamps;
+    }
+
+    BENCH_CHECK(cBadStamps == 0);
+    BENCH_CHECK(cHits + cMisses == cAllocations || cHits + cMisses == 0);
+    BENCH_CHECK(cSteals <= cMisses);
+
+    CloseHandle(hStart);
+
+    sprintf_s(szName, sizeof(szName), "%s/allocations", phase.szName);
+    report.AddResult(szName, dblMsec, cAllocations, 0, dblMsec ? cAllocations / dblMsec : 0);
+
+    sprintf_s(szName, sizeof(szName), "%s/hits", phase.szName);
+    report.AddResult(szName, dblMsec, cHits, 0, cAllocations ? (double)cHits / cAllocations : 0);
+
+    sprintf_s(szName, sizeof(szName), "%s/misses", phase.szName);
+    report.AddResult(szName, dblMsec, cMisses, 0, cAllocations ? (double)cMisses / cAllocations : 0);
+
+    sprintf_s(szName, sizeof(szName), "%s/steals", phase.szName);
+    report.AddResult(szName, dblMsec, cSteals, 0, cAllocations ? (double)cSteals / cAllocations : 0);
+}
+
+int __cdecl main(int argc, _In_count_(argc) char **argv)
+{
+    BenchReport report("snimagazine", BenchGetOption(argc, argv, "-json"));
+    SYSTEM_INFO si;
+
+    GetSystemInfo(&si);
+
+    // Twice as many threads as processors, so threads are preempted and migrate while they
+    // hold a magazine.
+    unsigned cThreads = BenchGetOption(argc, argv, "-threads", 2u * si.dwNumberOfProcessors);
+    unsigned cOperations = BenchGetOption(argc, argv, "-operations", 1000000u);
+    DWORD cbBuffer = BenchGetOption(argc, argv, "-buffer", 4096u - 128u);
+    SNI_Conn *pConn = NULL;
+
+    if (cThreads == 0 || cOperations == 0 || cbBuffer < sizeof(PacketStamp) || cbBuffer > BUF_64K)
+    {
+        fprintf(stderr, "usage: magazinetest [-json <file>] [-threads <count>] [-operations <per thread>] [-buffer <bytes>]\n");
+        return 2;
+    }
+
+    if (!BENCH_CHECK(SNIInitialize() == ERROR_SUCCESS))
+    {
+        return BenchFinish();
+    }
+
+    if (BENCH_CHECK(SNI_Conn::InitObject(&pConn) == ERROR_SUCCESS))
+    {
+        // Chooses the memory region of the packets.
+        BENCH_CHECK(SNISetInfo(pConn, SNI_QUERY_CONN_BUFSIZE, &cbBuffer) == ERROR_SUCCESS);
+
+        for (size_t i = 0; i < ARRAYSIZE(s_rgPhases); i++)
+        {
+            RunPhase(s_rgPhases[i], pConn, cThreads, cOperations, report);
+        }
+
+        pConn->Release(REF_Active);
+    }
+
+    SNITerminate();
+    return BenchFinish();
+}
@@ -0,0 +1,383 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Races connection attempts with Tcp::SocketOpenParallel (sni\src\tcp.cpp) over the addresses
+//  of a fake resolver.  Tcp::Open resolves with GetAddrInfoW; this test builds the ADDRINFOW
+//  list itself, from local listeners that stand in for the servers behind a name:
+//  - live: accepts connections, and counts them
+//  - refused: bound without listening, so connections to it are refused
+//  - silent: 192.0.2.1 from TEST-NET-1 (RFC 5737), which never answers, or fails at once
+//    where there is no route
+//
+//  Each scenario lists the addresses in the order the resolver returns them.  It sets the
+//  delay between attempts, and checks whether a connection was made and how long it took.
+//  The scenarios cover:
+//  - a live address behind a silent or refused one
+//  - a live IPv6 address behind IPv4 ones, which interleaving tries second
+//  - more addresses than one wait can take
+//  - names with no live address at all, which have to fail within their timeout
+//  Each scenario reports its elapsed time.
+//
+//  Build in the SNI client build environment, like the managed wrapper: SNI_BASED_CLIENT
+//  defined, the SNI include and src directories on the include path, linked with the SNI
+//  client library.
+//
+//  Run:
+//      parallelconnecttest [-json <file>]
+//
+//-------------------------------------------------------------------------------------------------
+
+#include "snipch.hpp"
+#include "..\inc\benchharness.h"
+#include "snibench.h"
+
+#include <string>
+#include <vector>
+
+// The addresses of a scenario, one character each:
+//  L, l    live IPv4, IPv6
+//  R, r    refused IPv4, IPv6
+//  S       silent IPv4
+struct Scenario
+{
+    const char *szName;
+    const char *szAddresses;
+    unsigned cFirstRepeats;         // times the first address is repeated
+    DWORD dwAttemptDelay;
+    DWORD dwTimeout;
+    bool fConnects;
+    DWORD dwMostMsec;               // the longest the scenario may take
+};
+
+static const Scenario s_rgScenarios[] =
+{
+    { "live",           "L",        1,      250,    10000,  true,   1000 },
+    // The live address is tried after one attempt delay at the latest, not after the
+    // silent one timed out.
+    { "silentfirst",    "SL",       1,      250,    20000,  true,   1000 },
+    { "refusedfirst",   "RL",       1,      250,    20000,  true,   1000 },
+    // Interleaving tries the IPv6 address second, not fourth.
+    { "interleaved",    "Rl",       3,      250,    20000,  true,   500 },
+    // More addresses than WaitForMultipleObjects takes, all started at once.
+    { "manyaddresses",  "RL",       100,    0,      20000,  true,   15000 },
+    { "allrefused",     "R",        4,      250,    10000,  false,  12000 },
+    { "alldead",        "S",        3,      250,    2000,   false,  4000 },
+};
+
+// The silent address, and a port it would not serve anyway.
+#define SILENT_ADDRESS      0xC0000201      // 192.0.2.1
+#define SILENT_PORT         1433
+
+//-------------------------------------------------------------------------------------------------
+//
+// The listeners.
+//
+//-------------------------------------------------------------------------------------------------
+
+class LiveListener
+{
+public:
+    LiveListener() :
+        m_listener(INVALID_SOCKET),
+        m_usPort(0),
+        m_hThread(NULL),
+        m_cAccepted(0)
+    {
+    }
+
+    bool Start(int family)
+    {
+        m_listener = BenchBindLoopback(family, true, &m_usPort);
+
+        if (m_listener == INVALID_SOCKET)
+        {
+            return false;
+        }
+
+        m_hThread = CreateThread(NULL, 0, AcceptThread, this, 0, NULL);
+        return m_hThread != NULL;
+    }
+
+    void Stop()
+    {
+        if (m_listener != INVALID_SOCKET)
+        {
+            closesocket(m_listener);
+            m_listener = INVALID_SOCKET;
+        }
+
+        if (m_hThread)
+        {
+            WaitForSingleObject(m_hThread, INFINITE);
+            CloseHandle(m_hThread);
+            m_hThread = NULL;
+        }
+    }
+
+    USHORT Port() const
+    {
+        return m_usPort;
+    }
+
+    LONG Accepted() const
+    {
+        return m_cAccepted;
+    }
+
+private:
+    static DWORD WINAPI AcceptThread(LPVOID pvListener)
+    {
+        LiveListener *pListener = (LiveListener *)pvListener;
+        SOCKET sock;
+
+        // Stop closes the listener, which fails the accept.
+        while ((sock = accept(pListener->m_listener, NULL, NULL)) != INVALID_SOCKET)
+        {
+            InterlockedIncrement(&pListener->m_cAccepted);
+            closesocket(sock);
+        }
+
+        return 0;
+    }
+
+    SOCKET m_listener;
+    USHORT m_usPort;
+    HANDLE m_hThread;
+    volatile LONG m_cAccepted;
+};
+
+// The loopback listeners of both families.  IPv6 ones are missing where ::1 is not available.
+struct Listeners
+{
+    LiveListener live4;
+    LiveListener live6;
+    SOCKET refused4;
+    SOCKET refused6;
+    USHORT usRefusedPort4;
+    USHORT usRefusedPort6;
+    bool fIpv6;
+
+    LONG Accepted() const
+    {
+        return live4.Accepted() + (fIpv6 ? live6.Accepted() : 0);
+    }
+};
+
+//-------------------------------------------------------------------------------------------------
+//
+// The fake resolver.
+//
+//-------------------------------------------------------------------------------------------------
+
+class FakeResolver
+{
+public:
+    // Returns NULL if an address needs IPv6 and the listeners have none.
+    const ADDRINFOW *Resolve(const std::string &addresses, const Listeners &listeners)
+    {
+        m_addresses.resize(addresses.size());
+        m_addrInfos.resize(addresses.size());
+
+        for (size_t i = 0; i < addresses.size(); i++)
+        {
+            SOCKADDR_STORAGE &address = m_addresses[i];
+            ADDRINFOW &addrInfo = m_addrInfos[i];
+            char chKind = addresses[i];
+            bool fIpv6 = chKind == 'l' || chKind == 'r';
+
+            if (fIpv6 && !listeners.fIpv6)
+            {
+                return NULL;
+            }
+
+            memset(&address, 0, sizeof(address));
+            memset(&addrInfo, 0, sizeof(addrInfo));
+
+            if (fIpv6)
+            {
+                SOCKADDR_IN6 *pAddress = (SOCKADDR_IN6 *)&address;
+
+                pAddress->sin6_family = AF_INET6;
+                pAddress->sin6_addr = in6addr_loopback;
+                pAddress->sin6_port = htons(chKind == 'l' ? listeners.live6.Port() : listeners.usRefusedPort6);
+                addrInfo.ai_addrlen = sizeof(SOCKADDR_IN6);
+            }
+            else
+            {
+                SOCKADDR_IN *pAddress = (SOCKADDR_IN *)&address;
+
+                pAddress->sin_family = AF_INET;
+
+                if (chKind == 'S')
+                {
+                    pAddress->sin_addr.s_addr = htonl(SILENT_ADDRESS);
+                    pAddress->sin_port = htons(SILENT_PORT);
+                }
+                else
+                {
+                    pAddress->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                    pAddress->sin_port = htons(chKind == 'L' ? listeners.live4.Port() : listeners.usRefusedPort4);
+                }
+
+                addrInfo.ai_addrlen = sizeof(SOCKADDR_IN);
+            }
+
+            addrInfo.ai_family = address.ss_family;
+            addrInfo.ai_socktype = SOCK_STREAM;
+            addrInfo.ai_protocol = IPPROTO_TCP;
+            addrInfo.ai_addr = (sockaddr *)&address;
+            addrInfo.ai_next = i + 1 < addresses.size() ? &m_addrInfos[i + 1] : NULL;
+        }
+
+        return &m_addrInfos[0];
+    }
+
+private:
+    std::vector<SOCKADDR_STORAGE> m_addresses;
+    std::vector<ADDRINFOW> m_addrInfos;
+};
+
+//-------------------------------------------------------------------------------------------------
+//
+// The scenarios.
+//
+//-------------------------------------------------------------------------------------------------
+
+static
+void RunScenario(
+    const Scenario &scenario,
+    SNI_Conn *pConn,
+    Listeners &listeners,
+    BenchReport &report)
+{
+    std::string addresses(scenario.cFirstRepeats, scenario.szAddresses[0]);
+    FakeResolver resolver;
+    DWORD dwAttemptDelay = scenario.dwAttemptDelay;
+    DWORD dwQueriedDelay = 0;
+    char szName[64];
+
+    addresses += scenario.szAddresses + 1;
+
+    const ADDRINFOW *pAddrInfo = resolver.Resolve(addresses, listeners);
+
+    if (!pAddrInfo)
+    {
+        printf("%s: skipped, ::1 is not available\n", scenario.szName);
+        return;
+    }
+
+    if (!BENCH_CHECK(SNISetInfo(NULL, SNI_QUERY_TCP_CONNECT_ATTEMPT_DELAY, &dwAttemptDelay) == ERROR_SUCCESS) ||
+        !BENCH_CHECK(SNIQueryInfo(SNI_QUERY_TCP_CONNECT_ATTEMPT_DELAY, &dwQueriedDelay) == ERROR_SUCCESS) ||
+        !BENCH_CHECK(dwQueriedDelay == dwAttemptDelay))
+    {
+        return;
+    }
+
+    Tcp *pTcp = NewNoX(gpmo) Tcp(pConn);
+
+    if (!BENCH_CHECK(pTcp != NULL))
+    {
+        return;
+    }
+
+    if (!BENCH_CHECK(pTcp->FInit() == ERROR_SUCCESS))
+    {
+        pTcp->Release();
+        return;
+    }
+
+    LONG cAcceptedBefore = listeners.Accepted();
+    BenchStopwatch stopwatch;
+
+    DWORD dwError = pTcp->SocketOpenParallel(pAddrInfo, scenario.dwTimeout);
+
+    double dblMsec = stopwatch.ElapsedMsec();
+
+    if (dwError == ERROR_SUCCESS)
+    {
+        pTcp->Close();
+    }
+
+    pTcp->Release();
+
+    // The accept thread of the winner may still be on its way.
+    for (unsigned i = 0; i < 100 && scenario.fConnects && listeners.Accepted() == cAcceptedBefore; i++)
+    {
+        Sleep(10);
+    }
+
+    if (scenario.fConnects)
+    {
+        BENCH_CHECK(dwError == ERROR_SUCCESS);
+        BENCH_CHECK(listeners.Accepted() > cAcceptedBefore);
+    }
+    else
+    {
+        BENCH_CHECK(dwError != ERROR_SUCCESS);
+        BENCH_CHECK(listeners.Accepted() == cAcceptedBefore);
+    }
+
+    BENCH_CHECK(dblMsec <= scenario.dwMostMsec);
+
+    printf("%s: %u addresses, %s after %.0f ms (%u)\n",
+        scenario.szName, (unsigned)addresses.size(), dwError == ERROR_SUCCESS ? "connected" : "failed", dblMsec, dwError);
+
+    sprintf_s(szName, sizeof(szName), "%s/elapsed", scenario.szName);
+    report.AddResult(szName, dblMsec, addresses.size(), 0, dblMsec);
+}
+
+int __cdecl main(int argc, _In_count_(argc) char **argv)
+{
+    BenchReport report("sniparallelconnect", BenchGetOption(argc, argv, "-json"));
+    DWORD dwBufferSize = 4096;
+    DWORD dwDefaultDelay = 0;
+    SNI_Conn *pConn = NULL;
+    Listeners listeners;
+
+    if (!BENCH_CHECK(BenchStartWinsock()) ||
+        !BENCH_CHECK(SNIInitialize() == ERROR_SUCCESS))
+    {
+        return BenchFinish();
+    }
+
+    BENCH_CHECK(SNIQueryInfo(SNI_QUERY_TCP_CONNECT_ATTEMPT_DELAY, &dwDefaultDelay) == ERROR_SUCCESS);
+
+    listeners.refused4 = BenchBindLoopback(AF_INET, false, &listeners.usRefusedPort4);
+    listeners.refused6 = BenchBindLoopback(AF_INET6, false, &listeners.usRefusedPort6);
+    listeners.fIpv6 = listeners.refused6 != INVALID_SOCKET && listeners.live6.Start(AF_INET6);
+
+    if (BENCH_CHECK(listeners.refused4 != INVALID_SOCKET) &&
+        BENCH_CHECK(listeners.live4.Start(AF_INET)) &&
+        BENCH_CHECK(SNI_Conn::InitObject(&pConn) == ERROR_SUCCESS))
+    {
+        // The Tcp objects of the scenarios belong to this connection, which is never opened.
+        BENCH_CHECK(SNISetInfo(pConn, SNI_QUERY_CONN_BUFSIZE, &dwBufferSize) == ERROR_SUCCESS);
+
+        for (size_t i = 0; i < ARRAYSIZE(s_rgScenarios); i++)
+        {
+            RunScenario(s_rgScenarios[i], pConn, listeners, report);
+        }
+
+        pConn->Release(REF_Active);
+    }
+
+    SNISetInfo(NULL, SNI_QUERY_TCP_CONNECT_ATTEMPT_DELAY, &dwDefaultDelay);
+
+    listeners.live4.Stop();
+    listeners.live6.Stop();
+
+    if (listeners.refused4 != INVALID_SOCKET)
+    {
+        closesocket(listeners.refused4);
+    }
+
+    if (listeners.refused6 != INVALID_SOCKET)
+    {
+        closesocket(listeners.refused6);
+    }
+
+    SNITerminate();
+    WSACleanup();
+    return BenchFinish();
+}
@@ -0,0 +1,626 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Measures MARS sessions (sni\src\smux.cpp) over loopback against a minimal SMUX server that
+//  simulates latency.  Each latency is measured twice: once with the receive window free to
+//  grow, and once with the window held at its initial SMUX_BUFFER_QUEUE_SIZE packets.
+//
+//  The server answers each request of a session by streaming DATA frames. A request gives a
+//  packet count and a packet size. The server never sends past the high water the client last
+//  advertised. Everything the client sends reaches the server -latency ms late, both the
+//  requests and the window updates. So a request takes a round trip of that length, and a
+//  window of W packets carries at most W packets per round trip.
+//
+//  For each run it reports:
+//  - the round trip of a small packet
+//  - the throughput of a stream
+//  - the window the session ended with, its smoothed round trip, and how often it grew and
+//    shrank
+//  With 20 ms of latency or more, the growing window has to at least double the throughput of
+//  the fixed one.
+//
+//  Build in the SNI client build environment, like the managed wrapper: SNI_BASED_CLIENT
+//  defined, the SNI include and src directories on the include path, linked with the SNI
+//  client library.
+//
+//  Run:
+//      smuxwindowtest [-json <file>] [-latency <ms>] [-packets <count>] [-bytes <per packet>]
+//
+//-------------------------------------------------------------------------------------------------
+
+#include "snipch.hpp"
+#include "..\inc\benchharness.h"
+#include "snibench.h"
+
+#include <deque>
+#include <vector>
+
+//-------------------------------------------------------------------------------------------------
+//
+// The wire format of sni\src\smux.cpp.
+//
+//-------------------------------------------------------------------------------------------------
+
+#define SMUX_IDENTIFIER         83
+#define SMUX_SYN                1
+#define SMUX_ACK                2
+#define SMUX_FIN                4
+#define SMUX_DATA               8
+#define SMUX_HEADER_SIZE        16
+#define SMUX_INITIAL_WINDOW     4       // SMUX_BUFFER_QUEUE_SIZE, what each side assumes before an ACK
+
+#define SMUX_SEQ_LE(a, b)       ((LONG)((a) - (b)) <= 0)
+#define SMUX_SEQ_LT(a, b)       ((LONG)((a) - (b)) < 0)
+
+struct SmuxHeader
+{
+    BYTE SMID;
+    BYTE Flags;
+    USHORT SessionId;
+    DWORD Length;
+    DWORD SequenceNumber;
+    DWORD HighWater;
+};
+
+C_ASSERT(sizeof(SmuxHeader) == SMUX_HEADER_SIZE);
+
+// The payload of the requests the client sends.
+struct StreamRequest
+{
+    DWORD cPackets;
+    DWORD cbPacket;
+};
+
+// The consumer buffer size of the connections, the largest packet the server may send.
+static const LONG UserDataLength = 4096;
+
+// The content of byte i of the packet with the given sequence number.
+inline BYTE PatternByte(DWORD dwSequenceNumber, DWORD i)
+{
+    return (BYTE)(dwSequenceNumber * 31 + i);
+}
+
+//-------------------------------------------------------------------------------------------------
+//
+// The server.  It takes one connection at a time and serves the one session the client opens
+// on it.
+//
+//-------------------------------------------------------------------------------------------------
+
+// A frame from the client, and when the server may see it.
+struct ClientFrame
+{
+    unsigned __int64 qwDue;
+    BYTE Flags;
+    USHORT SessionId;
+    DWORD SequenceNumber;
+    DWORD HighWater;
+    StreamRequest request;
+};
+
+struct ServerConnection
+{
+    SOCKET sock;
+    unsigned __int64 qwLatency;         // in BenchStopwatch ticks
+    CRITICAL_SECTION cs;
+    HANDLE hArrived;
+    std::deque<ClientFrame> frames;
+    bool fClosed;
+};
+
+static
+bool SendFrame(
+    SOCKET sock,
+    USHORT usSessionId,
+    BYTE Flags,
+    DWORD dwSequenceNumber,
+    DWORD dwHighWater,
+    DWORD cbPayload)
+{
+    BYTE rgbFrame[SMUX_HEADER_SIZE + UserDataLength];
+    SmuxHeader *pHeader = (SmuxHeader *)rgbFrame;
+
+    pHeader->SMID = SMUX_IDENTIFIER;
+    pHeader->Flags = Flags;
+    pHeader->SessionId = usSessionId;
+    pHeader->Length = SMUX_HEADER_SIZE + cbPayload;
+    pHeader->SequenceNumber = dwSequenceNumber;
+    pHeader->HighWater = dwHighWater;
+
+    for (DWORD i = 0; i < cbPayload; i++)
+    {
+        rgbFrame[SMUX_HEADER_SIZE + i] = PatternByte(dwSequenceNumber, i);
+    }
+
+    return BenchSendAll(sock, rgbFrame, SMUX_HEADER_SIZE + cbPayload);
+}
+
+// Queues the frames of the client for the server loop, each due -latency after it arrived.
+static
+DWORD WINAPI ServerReaderThread(LPVOID pvConnection)
+{
+    ServerConnection *pConnection = (ServerConnection *)pvConnection;
+    SmuxHeader header;
+    BYTE rgbPayload[64];
+
+    while (BenchReceiveAll(pConnection->sock, &header, sizeof(header)))
+    {
+        ClientFrame frame;
+        DWORD cbPayload = header.Length - SMUX_HEADER_SIZE;
+
+        if (header.SMID != SMUX_IDENTIFIER ||
+            header.Length < SMUX_HEADER_SIZE ||
+            cbPayload > sizeof(rgbPayload) ||
+            !BenchReceiveAll(pConnection->sock, rgbPayload, cbPayload))
+        {
+            break;
+        }
+
+        memset(&frame, 0, sizeof(frame));
+        frame.qwDue = BenchStopwatch::Now() + pConnection->qwLatency;
+        frame.Flags = header.Flags;
+        frame.SessionId = header.SessionId;
+        frame.SequenceNumber = header.SequenceNumber;
+        frame.HighWater = header.HighWater;
+
+        if (header.Flags == SMUX_DATA && cbPayload == sizeof(StreamRequest))
+        {
+            memcpy(&frame.request, rgbPayload, sizeof(StreamRequest));
+        }
+
+        EnterCriticalSection(&pConnection->cs);
+        pConnection->frames.push_back(frame);
+        LeaveCriticalSection(&pConnection->cs);
+
+        SetEvent(pConnection->hArrived);
+    }
+
+    EnterCriticalSection(&pConnection->cs);
+    pConnection->fClosed = true;
+    LeaveCriticalSection(&pConnection->cs);
+
+    SetEvent(pConnection->hArrived);
+    return 0;
+}
+
+static
+void ServeConnection(SOCKET sock, DWORD dwLatency)
+{
+    ServerConnection connection;
+    std::deque<StreamRequest> requests;
+    StreamRequest current = { 0, 0 };
+    USHORT usSessionId = 0;
+    DWORD dwSequenceNumber = 0;
+    DWORD dwClientHighWater = SMUX_INITIAL_WINDOW;
+    DWORD dwClientSequenceNumber = 0;
+    BOOL fNoDelay = TRUE;
+
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&fNoDelay, sizeof(fNoDelay));
+
+    connection.sock = sock;
+    connection.qwLatency = (unsigned __int64)dwLatency * BenchStopwatch::Frequency() / 1000;
+    connection.hArrived = CreateEvent(NULL, FALSE, FALSE, NULL);
+    connection.fClosed = false;
+    InitializeCriticalSection(&connection.cs);
+
+    HANDLE hReader = CreateThread(NULL, 0, ServerReaderThread, &connection, 0, NULL);
+
+    while (hReader && connection.hArrived)
+    {
+        std::vector<ClientFrame> due;
+        DWORD dwWait = INFINITE;
+        bool fClosed;
+        bool fAck = false;
+
+        EnterCriticalSection(&connection.cs);
+
+        unsigned __int64 qwNow = BenchStopwatch::Now();
+
+        while (!connection.frames.empty() && connection.frames.front().qwDue <= qwNow)
+        {
+            due.push_back(connection.frames.front());
+            connection.frames.pop_front();
+        }
+
+        if (!connection.frames.empty())
+        {
+            dwWait = (DWORD)((connection.frames.front().qwDue - qwNow) * 1000 / BenchStopwatch::Frequency()) + 1;
+        }
+
+        fClosed = connection.fClosed;
+
+        LeaveCriticalSection(&connection.cs);
+
+        if (fClosed)
+        {
+            break;
+        }
+
+        for (size_t i = 0; i < due.size(); i++)
+        {
+            const ClientFrame &frame = due[i];
+
+            if (frame.Flags == SMUX_SYN)
+            {
+                usSessionId = frame.SessionId;
+            }
+            else if (frame.Flags == SMUX_DATA)
+            {
+                dwClientSequenceNumber = frame.SequenceNumber;
+                requests.push_back(frame.request);
+                fAck = true;
+            }
+
+            if (SMUX_SEQ_LT(dwClientHighWater, frame.HighWater))
+            {
+                dwClientHighWater = frame.HighWater;
+            }
+        }
+
+        // The server keeps the client at the initial window; it only ever has a request in
+        // flight.
+        if (fAck && !SendFrame(sock, usSessionId, SMUX_ACK, dwSequenceNumber, dwClientSequenceNumber + SMUX_INITIAL_WINDOW, 0))
+        {
+            break;
+        }
+
+        if (current.cPackets == 0 && !requests.empty())
+        {
+            current = requests.front();
+            requests.pop_front();
+
+            if (current.cbPacket == 0 || current.cbPacket > (DWORD)UserDataLength)
+            {
+                break;
+            }
+        }
+
+        if (current.cPackets && SMUX_SEQ_LE(dwSequenceNumber + 1, dwClientHighWater))
+        {
+            dwSequenceNumber++;
+            current.cPackets--;
+
+            if (!SendFrame(sock, usSessionId, SMUX_DATA, dwSequenceNumber, dwClientSequenceNumber + SMUX_INITIAL_WINDOW, current.cbPacket))
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        WaitForSingleObject(connection.hArrived, dwWait);
+    }
+
+    shutdown(sock, SD_BOTH);
+    closesocket(sock);
+
+    if (hReader)
+    {
+        WaitForSingleObject(hReader, INFINITE);
+        CloseHandle(hReader);
+    }
+
+    if (connection.hArrived)
+    {
+        CloseHandle(connection.hArrived);
+    }
+
+    DeleteCriticalSection(&connection.cs);
+}
+
+class SmuxServer
+{
+public:
+    SmuxServer() :
+        m_listener(INVALID_SOCKET),
+        m_usPort(0),
+        m_dwLatency(0),
+        m_hThread(NULL)
+    {
+    }
+
+    bool Start()
+    {
+        m_listener = BenchBindLoopback(AF_INET, true, &m_usPort);
+
+        if (m_listener == INVALID_SOCKET)
+        {
+            return false;
+        }
+
+        m_hThread = CreateThread(NULL, 0, AcceptThread, this, 0, NULL);
+        return m_hThread != NULL;
+    }
+
+    void Stop()
+    {
+        if (m_listener != INVALID_SOCKET)
+        {
+            closesocket(m_listener);
+            m_listener = INVALID_SOCKET;
+        }
+
+        if (m_hThread)
+        {
+            WaitForSingleObject(m_hThread, INFINITE);
+            CloseHandle(m_hThread);
+            m_hThread = NULL;
+        }
+    }
+
+    USHORT Port() const
+    {
+        return m_usPort;
+    }
+
+    // Applies to the connections accepted from now on.
+    void SetLatency(DWORD dwLatency)
+    {
+        m_dwLatency = dwLatency;
+    }
+
+private:
+    static DWORD WINAPI AcceptThread(LPVOID pvServer)
+    {
+        SmuxServer *pServer = (SmuxServer *)pvServer;
+        SOCKET sock;
+
+        // Stop closes the listener, which fails the accept.
+        while ((sock = accept(pServer->m_listener, NULL, NULL)) != INVALID_SOCKET)
+        {
+            ServeConnection(sock, pServer->m_dwLatency);
+        }
+
+        return 0;
+    }
+
+    SOCKET m_listener;
+    USHORT m_usPort;
+    volatile DWORD m_dwLatency;
+    HANDLE m_hThread;
+};
+
+//-------------------------------------------------------------------------------------------------
+//
+// The client.
+//
+//-------------------------------------------------------------------------------------------------
+
+struct Session
+{
+    SNI_Conn *pConn;
+    SNI_Conn *pSession;
+    DWORD dwLastSequenceNumber;         // of the last packet the server sent
+};
+
+static
+bool OpenSession(USHORT usPort, bool fFixedWindow, __out Session *pSession)
+{
+    SNI_CONSUMER_INFO consumerInfo;
+    WCHAR wszSession[] = L"session:";
+    DWORD dwInfo = 0;
+
+    pSession->pConn = NULL;
+    pSession->pSession = NULL;
+    pSession->dwLastSequenceNumber = 0;
+
+    if (!BENCH_CHECK(BenchOpenLoopback(usPort, UserDataLength, &pSession->pConn) == ERROR_SUCCESS))
+    {
+        return false;
+    }
+
+    consumerInfo.DefaultUserDataLength = UserDataLength;
+
+    if (!BENCH_CHECK(SNIAddProvider(pSession->pConn, SMUX_PROV, &dwInfo) == ERROR_SUCCESS) ||
+        !BENCH_CHECK(SNIOpenSync(&consumerInfo, wszSession, pSession->pConn, &pSession->pSession, TRUE, 10000) == ERROR_SUCCESS))
+    {
+        SNIClose(pSession->pConn);
+        pSession->pConn = NULL;
+        return false;
+    }
+
+    if (fFixedWindow)
+    {
+        DWORD dwMaxWindow = SMUX_INITIAL_WINDOW;
+
+        BENCH_CHECK(SNISetInfo(pSession->pSession, SNI_QUERY_CONN_SMUXWINDOW, &dwMaxWindow) == ERROR_SUCCESS);
+    }
+
+    return true;
+}
+
+static
+void CloseSession(Session *pSession)
+{
+    SNIClose(pSession->pSession);
+    SNIClose(pSession->pConn);
+}
+
+static
+bool SendRequest(Session *pSession, DWORD cPackets, DWORD cbPacket)
+{
+    StreamRequest request = { cPackets, cbPacket };
+    SNI_Packet *pPacket = SNIPacketAllocate(pSession->pSession, SNI_Packet_Write);
+
+    if (!BENCH_CHECK(pPacket != NULL))
+    {
+        return false;
+    }
+
+    SNIPacketSetData(pPacket, (const BYTE *)&request, sizeof(request));
+
+    DWORD dwError = SNIWriteSync(pSession->pSession, pPacket, NULL);
+
+    SNIPacketRelease(pPacket);
+    return BENCH_CHECK(dwError == ERROR_SUCCESS);
+}
+
+static
+bool ReceivePackets(Session *pSession, DWORD cPackets, DWORD cbPacket)
+{
+    for (DWORD iPacket = 0; iPacket < cPackets; iPacket++)
+    {
+        SNI_Packet *pPacket = NULL;
+        BYTE *pbData;
+        DWORD cbData;
+
+        if (!BENCH_CHECK(SNIReadSync(pSession->pSession, &pPacket, 30000) == ERROR_SUCCESS))
+        {
+            return false;
+        }
+
+        SNIPacketGetData(pPacket, &pbData, &cbData);
+
+        DWORD dwSequenceNumber = ++pSession->dwLastSequenceNumber;
+        bool fIntact = cbData == cbPacket;
+
+        for (DWORD i = 0; fIntact && i < cbData; i++)
+        {
+            fIntact = pbData[i] == PatternByte(dwSequenceNumber, i);
+        }
+
+        SNIPacketRelease(pPacket);
+
+        if (!BENCH_CHECK(fIntact))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Measures one session and returns its stream throughput in MB/s, 0 if it failed.
+static
+double MeasureSession(
+    SmuxServer &server,
+    DWORD dwLatency,
+    bool fFixedWindow,
+    DWORD cPackets,
+    DWORD cbPacket,
+    BenchReport &report)
+{
+    static const DWORD cPings = 10;
+    const char *szWindow = fFixedWindow ? "fixed" : "growing";
+    SNI_SMUX_WINDOW_INFO windowInfo;
+    Session session;
+    char szName[64];
+    bool fOk = true;
+
+    server.SetLatency(dwLatency);
+
+    if (!OpenSession(server.Port(), fFixedWindow, &session))
+    {
+        return 0;
+    }
+
+    BenchStopwatch stopwatch;
+
+    for (DWORD i = 0; fOk && i < cPings; i++)
+    {
+        fOk = SendRequest(&session, 1, 16) && ReceivePackets(&session, 1, 16);
+    }
+
+    double dblPingMsec = stopwatch.ElapsedMsec();
+
+    stopwatch.Restart();
+
+    fOk = fOk && SendRequest(&session, cPackets, cbPacket) && ReceivePackets(&session, cPackets, cbPacket);
+
+    double dblStreamMsec = stopwatch.ElapsedMsec();
+    unsigned __int64 cbStream = (unsigned __int64)cPackets * cbPacket;
+    double dblThroughput = dblStreamMsec ? cbStream / dblStreamMsec / 1000 : 0;
+
+    BENCH_CHECK(SNIGetInfo(session.pSession, SNI_QUERY_CONN_SMUXWINDOW, &windowInfo) == ERROR_SUCCESS);
+
+    CloseSession(&session);
+
+    if (!fOk)
+    {
+        return 0;
+    }
+
+    // Nothing reaches the server before its time.
+    BENCH_CHECK(dblPingMsec / cPings >= dwLatency);
+
+    BENCH_CHECK(windowInfo.dwMinWindow <= windowInfo.dwWindow);
+    BENCH_CHECK(windowInfo.dwWindow <= windowInfo.dwMaxWindow);
+
+    if (fFixedWindow)
+    {
+        BENCH_CHECK(windowInfo.dwWindow == SMUX_INITIAL_WINDOW);
+        BENCH_CHECK(windowInfo.cGrowths == 0);
+    }
+
+    sprintf_s(szName, sizeof(szName), "%ums/%s/ping", dwLatency, szWindow);
+    report.AddResult(szName, dblPingMsec, cPings, 0, dblPingMsec / cPings);
+
+    sprintf_s(szName, sizeof(szName), "%ums/%s/stream", dwLatency, szWindow);
+    report.AddResult(szName, dblStreamMsec, cPackets, cbStream, dblThroughput);
+
+    sprintf_s(szName, sizeof(szName), "%ums/%s/window", dwLatency, szWindow);
+    report.AddResult(szName, 0, 0, 0, windowInfo.dwWindow);
+
+    sprintf_s(szName, sizeof(szName), "%ums/%s/rtt", dwLatency, szWindow);
+    report.AddResult(szName, windowInfo.dwRtt / 1000.0, 0, 0, windowInfo.dwRtt);
+
+    sprintf_s(szName, sizeof(szName), "%ums/%s/growths", dwLatency, szWindow);
+    report.AddResult(szName, 0, windowInfo.cGrowths, 0, windowInfo.cGrowths);
+
+    sprintf_s(szName, sizeof(szName), "%ums/%s/shrinks", dwLatency, szWindow);
+    report.AddResult(szName, 0, windowInfo.cShrinks, 0, windowInfo.cShrinks);
+
+    return dblThroughput;
+}
+
+int __cdecl main(int argc, _In_count_(argc) char **argv)
+{
+    BenchReport report("smuxwindow", BenchGetOption(argc, argv, "-json"));
+    DWORD cPackets = BenchGetOption(argc, argv, "-packets", 400u);
+    DWORD cbPacket = BenchGetOption(argc, argv, "-bytes", 4000u);
+    std::vector<DWORD> latencies;
+    SmuxServer server;
+
+    if (BenchGetOption(argc, argv, "-latency"))
+    {
+        latencies.push_back(BenchGetOption(argc, argv, "-latency", 0u));
+    }
+    else
+    {
+        static const DWORD s_rgLatencies[] = { 0, 5, 20, 50 };
+
+        latencies.assign(s_rgLatencies, s_rgLatencies + ARRAYSIZE(s_rgLatencies));
+    }
+
+    if (cPackets == 0 || cbPacket == 0 || cbPacket > (DWORD)UserDataLength)
+    {
+        fprintf(stderr, "usage: smuxwindowtest [-json <file>] [-latency <ms>] [-packets <count>] [-bytes <per packet, at most %d>]\n", UserDataLength);
+        return 2;
+    }
+
+    if (!BENCH_CHECK(BenchStartWinsock()) ||
+        !BENCH_CHECK(SNIInitialize() == ERROR_SUCCESS))
+    {
+        return BenchFinish();
+    }
+
+    if (BENCH_CHECK(server.Start()))
+    {
+        for (size_t i = 0; i < latencies.size(); i++)
+        {
+            double dblGrowing = MeasureSession(server, latencies[i], false, cPackets, cbPacket, report);
+            double dblFixed = MeasureSession(server, latencies[i], true, cPackets, cbPacket, report);
+
+            if (latencies[i] >= 20)
+            {
+                BENCH_CHECK(dblGrowing >= 2 * dblFixed);
+            }
+        }
+    }
+
+    server.Stop();
+    SNITerminate();
+    WSACleanup();
+    return BenchFinish();
+}
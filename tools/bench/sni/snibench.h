@@ -0,0 +1,128 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Helpers shared by the SNI tests that talk to a server of their own: loopback sockets for
+//  the test servers, and SNI client connections to them.  Include after snipch.hpp and
+//  benchharness.h.
+//
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+// The SNI client starts Winsock itself; the test servers may run before it.
+inline bool BenchStartWinsock()
+{
+    WSADATA wsaData;
+
+    return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+}
+
+// A socket bound to the loopback address of the family on an ephemeral port.  With fListen
+// it accepts connections; without it connections to the port are refused.
+inline SOCKET BenchBindLoopback(int family, bool fListen, __out USHORT *pusPort)
+{
+    SOCKADDR_STORAGE address;
+    int cbAddress = family == AF_INET6 ? sizeof(SOCKADDR_IN6) : sizeof(SOCKADDR_IN);
+    SOCKET sock = socket(family, SOCK_STREAM, IPPROTO_TCP);
+
+    *pusPort = 0;
+
+    if (sock == INVALID_SOCKET)
+    {
+        return INVALID_SOCKET;
+    }
+
+    memset(&address, 0, sizeof(address));
+
+    if (family == AF_INET6)
+    {
+        ((SOCKADDR_IN6 *)&address)->sin6_family = AF_INET6;
+        ((SOCKADDR_IN6 *)&address)->sin6_addr = in6addr_loopback;
+    }
+    else
+    {
+        ((SOCKADDR_IN *)&address)->sin_family = AF_INET;
+        ((SOCKADDR_IN *)&address)->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+
+    if (bind(sock, (sockaddr *)&address, cbAddress) != 0 ||
+        (fListen && listen(sock, SOMAXCONN) != 0) ||
+        getsockname(sock, (sockaddr *)&address, &cbAddress) != 0)
+    {
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+
+    // sin_port and sin6_port are at the same offset.
+    *pusPort = ntohs(((SOCKADDR_IN *)&address)->sin_port);
+    return sock;
+}
+
+inline bool BenchSendAll(SOCKET sock, const void *pv, int cb)
+{
+    const char *pb = (const char *)pv;
+
+    while (cb > 0)
+    {
+        int cbSent = send(sock, pb, cb, 0);
+
+        if (cbSent <= 0)
+        {
+            return false;
+        }
+
+        pb += cbSent;
+        cb -= cbSent;
+    }
+
+    return true;
+}
+
+// Fails when the peer closes the connection before cb bytes arrived.
+inline bool BenchReceiveAll(SOCKET sock, void *pv, int cb)
+{
+    char *pb = (char *)pv;
+
+    while (cb > 0)
+    {
+        int cbReceived = recv(sock, pb, cb, 0);
+
+        if (cbReceived <= 0)
+        {
+            return false;
+        }
+
+        pb += cbReceived;
+        cb -= cbReceived;
+    }
+
+    return true;
+}
+
+// Opens an SNI connection to a test server on the IPv4 loopback address.  A connection with
+// completion routines is asynchronous and completes its I/O on the SNI completion port; one
+// without them is synchronous.
+inline DWORD BenchOpenLoopback(
+    USHORT usPort,
+    LONG cbUserData,
+    __out SNI_Conn **ppConn,
+    PIOCOMP_FN fnReadComp = NULL,
+    PIOCOMP_FN fnWriteComp = NULL,
+    LPVOID pvConsumerKey = NULL)
+{
+    SNI_CLIENT_CONSUMER_INFO clientInfo;
+    WCHAR wszConnect[32];
+
+    swprintf_s(wszConnect, ARRAYSIZE(wszConnect), L"tcp:127.0.0.1,%u", usPort);
+
+    clientInfo.ConsumerInfo.DefaultUserDataLength = cbUserData;
+    clientInfo.ConsumerInfo.ConsumerKey = pvConsumerKey;
+    clientInfo.ConsumerInfo.fnReadComp = fnReadComp;
+    clientInfo.ConsumerInfo.fnWriteComp = fnWriteComp;
+    clientInfo.wszConnectionString = wszConnect;
+    clientInfo.fSynchronousConnection = fnReadComp == NULL;
+    clientInfo.timeout = 10000;
+
+    return SNIOpenSyncEx(&clientInfo, ppConn);
+}
@@ -0,0 +1,399 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Checks that the SSE2 string hashing and comparison of vb\language\compiler\stringpool.cpp
+//  give the same results as the scalar code they replaced, and measures both over identifier
+//  corpora.
+//
+//  stringpool.cpp is included so that the file local dmemcmp and the inline
+//  StringPool::ComputeStringHashValue can be called directly; the
+//  scalar reference below is the code as it was before the SSE2 kernels.
+//
+//  The identifiers are the compiler's own string constants and keyword spellings, generated
+//  mixed case and non-ASCII identifiers, and, with -identifiers, one identifier per line from
+//  a UTF-16 file (e.g. the identifiers of a real code base).
+//
+//  Build in the compiler's build environment, like the command line compiler: the core
+//  compiler precompiled header on the include path, linked with the core compiler library.
+//
+//  Run:
+//      stringpooltest [-json <file>] [-identifiers <file>] [-repetitions <count>]
+//
+//-------------------------------------------------------------------------------------------------
+
+#include "..\..\..\vb\language\compiler\stringpool.cpp"
+#include "..\inc\benchharness.h"
+
+#include <string>
+#include <vector>
+
+//-------------------------------------------------------------------------------------------------
+//
+// The scalar code as it was before the SSE2 kernels.
+//
+//-------------------------------------------------------------------------------------------------
+
+#define ReferenceLowerCasePair(dwWchPair)     \
+        (((dwWchPair) & 0xff80ff80) == 0 ?    \
+            ((dwWchPair) | 0x00200020) :      \
+            ((LowerCase((WCHAR)((dwWchPair) >> 16)) << 16) | LowerCase((WCHAR)((dwWchPair) & 0xffff))))
+
+static
+unsigned long ReferenceStringHashValue(
+    _In_ const unsigned long * pl,
+    size_t cl,
+    size_t r,
+    bool CaseSensitive)
+{
+    unsigned long hash = 0;
+    unsigned long l = 0;
+
+    for (; 0 < cl; -- cl, ++ pl)
+    {
+        // Reading the long as two WCHARs handles the unaligned strings on every platform.
+        const unsigned short * pus = (const unsigned short *)pl;
+
+        l = pus[0] | (pus[1] << 16);
+
+        if (!CaseSensitive)
+        {
+            l = ReferenceLowerCasePair(l);
+        }
+
+        hash = _lrotl(hash, 2) + ((l >> 9) + l) * 0x10004001;
+    }
+
+    if (r)
+    {
+        l = (unsigned)(*((const unsigned short *)pl));
+
+        if (!CaseSensitive)
+        {
+            l = ReferenceLowerCasePair(l | 0x00200000);
+        }
+
+        hash = _lrotl(hash, 2) + ((l >> 9) + l) * 0x10004001;
+    }
+
+    return hash;
+}
+
+#undef ReferenceLowerCasePair
+
+static
+bool ReferenceIsEqual(
+    const WCHAR * pwch1,
+    const WCHAR * pwch2,
+    size_t cch)
+{
+    return memcmp(pwch1, pwch2, cch * sizeof(WCHAR)) == 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+//
+// Corpora.
+//
+//-------------------------------------------------------------------------------------------------
+
+static
+void AddPoolCorpus(
+    StringPool &pool,
+    std::vector<std::wstring> &identifiers)
+{
+    for (unsigned iString = 0; iString < STRING_CONST_MAX; iString++)
+    {
+        STRING *pstr = pool.GetStringConstant(iString);
+
+        if (pstr)
+        {
+            identifiers.push_back(std::wstring(pstr, StringPool::StringLength(pstr)));
+        }
+    }
+}
+
+// Identifiers of every length up to 80, in several casings, some with non-ASCII letters at
+// the start, the middle or the end, so that the SSE2 kernels stop at every position.
+static
+void AddGeneratedCorpus(std::vector<std::wstring> &identifiers)
+{
+    static const WCHAR wszAscii[] = L"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+    static const WCHAR rgwchNonAscii[] = { 0x00E9, 0x00DF, 0x00C4, 0x0130, 0x0131, 0x03A3, 0x03C3, 0x0416, 0x0436, 0x4E2D, 0xFF21 };
+    BenchRandom random;
+
+    for (unsigned cch = 1; cch <= 80; cch++)
+    {
+        for (unsigned iVariant = 0; iVariant < 40; iVariant++)
+        {
+            std::wstring identifier;
+
+            for (unsigned ich = 0; ich < cch; ich++)
+            {
+                identifier += wszAscii[random.Next(DIM(wszAscii) - 1)];
+            }
+
+            // A third of them get a non-ASCII letter somewhere.
+            if (iVariant % 3 == 0)
+            {
+                identifier[random.Next(cch)] = rgwchNonAscii[random.Next(DIM(rgwchNonAscii))];
+            }
+
+            identifiers.push_back(identifier);
+        }
+    }
+}
+
+static
+bool AddFileCorpus(
+    const char *szFile,
+    std::vector<std::wstring> &identifiers)
+{
+    FILE *pFile = NULL;
+    WCHAR wszLine[512];
+
+    if (fopen_s(&pFile, szFile, "rt, ccs=UNICODE"))
+    {
+        return false;
+    }
+
+    while (fgetws(wszLine, DIM(wszLine), pFile))
+    {
+        size_t cch = wcslen(wszLine);
+
+        while (cch && iswspace(wszLine[cch - 1]))
+        {
+            cch--;
+        }
+
+        if (cch)
+        {
+            identifiers.push_back(std::wstring(wszLine, cch));
+        }
+    }
+
+    fclose(pFile);
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+//
+// Checks.
+//
+//-------------------------------------------------------------------------------------------------
+
+// Copies the identifier into the buffer at a WCHAR offset, so that both the 4 byte aligned
+// and the unaligned paths are taken, and terminates it the way the pool's strings are.
+static
+unsigned long *PlaceIdentifier(
+    std::vector<WCHAR> &buffer,
+    const std::wstring &identifier,
+    size_t ichOffset)
+{
+    buffer.assign(identifier.size() + ichOffset + 8, L'\0');
+    memcpy(&buffer[ichOffset], identifier.data(), identifier.size() * sizeof(WCHAR));
+
+    return (unsigned long *)&buffer[ichOffset];
+}
+
+static
+void CheckHashes(const std::vector<std::wstring> &identifiers)
+{
+    std::vector<WCHAR> buffer;
+
+    for (size_t i = 0; i < identifiers.size(); i++)
+    {
+        size_t cl = identifiers[i].size() >> 1;
+        size_t r = identifiers[i].size() & 1;
+
+        for (size_t ichOffset = 0; ichOffset < 2; ichOffset++)
+        {
+            unsigned long *pl = PlaceIdentifier(buffer, identifiers[i], ichOffset);
+
+            BENCH_CHECK(StringPool::ComputeStringHashValue(pl, cl, r, true) == ReferenceStringHashValue(pl, cl, r, true));
+            BENCH_CHECK(StringPool::ComputeStringHashValue(pl, cl, r, false) == ReferenceStringHashValue(pl, cl, r, false));
+        }
+    }
+}
+
+// dmemcmp against memcmp, for equal strings and for strings that differ in one WCHAR at
+// every position.
+static
+void CheckComparisons(const std::vector<std::wstring> &identifiers)
+{
+    std::vector<WCHAR> buffer1;
+    std::vector<WCHAR> buffer2;
+
+    for (size_t i = 0; i < identifiers.size(); i += 7)
+    {
+        const std::wstring &identifier = identifiers[i];
+        size_t cl = identifier.size() >> 1;
+        size_t r = identifier.size() & 1;
+
+        for (size_t ichOffset = 0; ichOffset < 2; ichOffset++)
+        {
+            unsigned *pul1 = (unsigned *)PlaceIdentifier(buffer1, identifier, 0);
+            unsigned *pul2 = (unsigned *)PlaceIdentifier(buffer2, identifier, ichOffset);
+
+            BENCH_CHECK(dmemcmp(pul1, pul2, cl, r) == 0);
+
+            for (size_t ich = 0; ich < identifier.size(); ich++)
+            {
+                WCHAR *pwch2 = (WCHAR *)pul2;
+
+                pwch2[ich] ^= 0x0100;
+                BENCH_CHECK((dmemcmp(pul1, pul2, cl, r) == 0) == ReferenceIsEqual((WCHAR *)pul1, pwch2, identifier.size()));
+                pwch2[ich] ^= 0x0100;
+            }
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+//
+// Measurements.
+//
+//-------------------------------------------------------------------------------------------------
+
+typedef unsigned long (_fastcall *HashFunction)(unsigned long *pl, size_t cl, size_t r, bool CaseSensitive);
+
+static
+unsigned long _fastcall ReferenceHashFunction(unsigned long *pl, size_t cl, size_t r, bool CaseSensitive)
+{
+    return ReferenceStringHashValue(pl, cl, r, CaseSensitive);
+}
+
+static
+unsigned long _fastcall PoolHashFunction(unsigned long *pl, size_t cl, size_t r, bool CaseSensitive)
+{
+    return StringPool::ComputeStringHashValue(pl, cl, r, CaseSensitive);
+}
+
+// Keeps the measured loops from being optimized away.
+static volatile unsigned long g_hashSink;
+
+static
+void MeasureHash(
+    BenchReport &report,
+    const char *szName,
+    HashFunction pfnHash,
+    const std::vector<std::wstring> &identifiers,
+    bool CaseSensitive,
+    unsigned cRepetitions)
+{
+    unsigned long hashTotal = 0;
+    unsigned __int64 cBytes = 0;
+    BenchStopwatch stopwatch;
+
+    for (unsigned iRepetition = 0; iRepetition < cRepetitions; iRepetition++)
+    {
+        for (size_t i = 0; i < identifiers.size(); i++)
+        {
+            hashTotal += pfnHash((unsigned long *)identifiers[i].c_str(), identifiers[i].size() >> 1, identifiers[i].size() & 1, CaseSensitive);
+            cBytes += identifiers[i].size() * sizeof(WCHAR);
+        }
+    }
+
+    double dblMsec = stopwatch.ElapsedMsec();
+
+    g_hashSink = hashTotal;
+
+    // The value is the throughput in MB/s.
+    report.AddResult(szName, dblMsec, (unsigned __int64)identifiers.size() * cRepetitions, cBytes, dblMsec > 0 ? cBytes / dblMsec / 1000.0 : 0);
+}
+
+// What the compiler actually does with identifiers: look them up, almost always finding
+// them, in a differently cased spelling now and then.  Only ASCII letters are recased, so
+// the other casing is certain to be found.
+static
+void MeasurePool(
+    BenchReport &report,
+    const std::vector<std::wstring> &identifiers,
+    unsigned cRepetitions)
+{
+    StringPool pool;
+    std::vector<std::wstring> upper = identifiers;
+    BenchStopwatch stopwatch;
+
+    for (size_t i = 0; i < upper.size(); i++)
+    {
+        for (size_t ich = 0; ich < upper[i].size(); ich++)
+        {
+            if (upper[i][ich] >= L'a' && upper[i][ich] <= L'z')
+            {
+                upper[i][ich] -= L'a' - L'A';
+            }
+        }
+    }
+
+    for (size_t i = 0; i < identifiers.size(); i++)
+    {
+        pool.AddStringWithLen(identifiers[i].c_str(), identifiers[i].size());
+    }
+
+    report.AddResult("pool: add", stopwatch.ElapsedMsec(), identifiers.size());
+
+    stopwatch.Restart();
+
+    for (unsigned iRepetition = 0; iRepetition < cRepetitions; iRepetition++)
+    {
+        for (size_t i = 0; i < identifiers.size(); i++)
+        {
+            BENCH_CHECK(pool.LookupStringWithLen(identifiers[i].c_str(), identifiers[i].size(), true) != NULL);
+        }
+    }
+
+    report.AddResult("pool: lookup", stopwatch.ElapsedMsec(), (unsigned __int64)identifiers.size() * cRepetitions);
+
+    stopwatch.Restart();
+
+    for (unsigned iRepetition = 0; iRepetition < cRepetitions; iRepetition++)
+    {
+        for (size_t i = 0; i < upper.size(); i++)
+        {
+            BENCH_CHECK(pool.LookupStringWithLen(upper[i].c_str(), upper[i].size(), false) != NULL);
+        }
+    }
+
+    report.AddResult("pool: lookup other casing", stopwatch.ElapsedMsec(), (unsigned __int64)upper.size() * cRepetitions);
+}
+
+int __cdecl main(int argc, _In_count_(argc) char **argv)
+{
+    BenchReport report("stringpool", BenchGetOption(argc, argv, "-json"));
+    const char *szIdentifiers = BenchGetOption(argc, argv, "-identifiers");
+    unsigned cRepetitions = BenchGetOption(argc, argv, "-repetitions", 50u);
+    std::vector<std::wstring> identifiers;
+
+    VBCompilerLibraryManager libraryManager("stringpooltest");
+
+    if (!libraryManager.IsValid())
+    {
+        fprintf(stderr, "cannot initialize the compiler library\n");
+        return 1;
+    }
+
+    {
+        StringPool pool;
+
+        AddPoolCorpus(pool, identifiers);
+    }
+
+    AddGeneratedCorpus(identifiers);
+
+    if (szIdentifiers && !AddFileCorpus(szIdentifiers, identifiers))
+    {
+        fprintf(stderr, "cannot read %s\n", szIdentifiers);
+        return 1;
+    }
+
+    CheckHashes(identifiers);
+    CheckComparisons(identifiers);
+
+    MeasureHash(report, "hash case sensitive: scalar", ReferenceHashFunction, identifiers, true, cRepetitions);
+    MeasureHash(report, "hash case sensitive: StringPool", PoolHashFunction, identifiers, true, cRepetitions);
+    MeasureHash(report, "hash case insensitive: scalar", ReferenceHashFunction, identifiers, false, cRepetitions);
+    MeasureHash(report, "hash case insensitive: StringPool", PoolHashFunction, identifiers, false, cRepetitions);
+    MeasurePool(report, identifiers, cRepetitions);
+
+    return BenchFinish();
+}
@@ -0,0 +1,308 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Compiles a corpus made by vbcorpusgen in process, through CompilerProject, and writes the
+//  compiler's per-phase times and NorlsAllocator / PageHeap counters as JSON.
+//
+//  Every iteration creates a new compiler, so nothing is shared between iterations.  The
+//  settings the command line driver would pass are given to the compiler through its
+//  environment (see Compiler::ReadEnvironmentSettings).
+//
+//  Build in the compiler's build environment, like the command line compiler: the core
+//  compiler precompiled header on the include path, linked with the core compiler library
+//  and vb\language\include\commandlineresources.cpp.
+//
+//  Run:
+//      vbcbench -corpus <directory> [-json <file>] [-iterations <count>] [-parallelism <threads>]
+//               [-out <directory>] [-trace <file>]
+//
+//  The JSON is {"corpusFiles":<count>,"iterations":[...]} with one ReportTimesAsJson object per
+//  iteration.  -trace writes the sections of the last iteration, thread by thread, with
+//  ReportTimesAsTrace; load the file into chrome://tracing.
+//
+//-------------------------------------------------------------------------------------------------
+
+#include "StdAfx.h"
+#include "..\..\..\vb\language\compiler\commandline\timing.h"
+#include "..\inc\benchharness.h"
+
+#include <string>
+#include <vector>
+
+// The minimum a host has to provide: the SDK path to find the standard libraries, and the
+// target framework.
+class BenchCompilerHost : public IVbCompilerHost
+{
+public:
+    BenchCompilerHost() :
+        m_cRefs(1)
+    {
+    }
+
+    STDMETHODIMP QueryInterface(REFIID riid, void **ppv)
+    {
+        if (riid == IID_IUnknown || riid == IID_IVbCompilerHost)
+        {
+            *ppv = static_cast<IVbCompilerHost *>(this);
+            AddRef();
+            return S_OK;
+        }
+
+        *ppv = NULL;
+        return E_NOINTERFACE;
+    }
+
+    STDMETHODIMP_(ULONG) AddRef()
+    {
+        return InterlockedIncrement(&m_cRefs);
+    }
+
+    // The host lives on main's stack; the count only has to be right.
+    STDMETHODIMP_(ULONG) Release()
+    {
+        return InterlockedDecrement(&m_cRefs);
+    }
+
+    STDMETHODIMP OutputString(LPCWSTR Output)
+    {
+        fwprintf(stderr, L"%s", Output);
+        return S_OK;
+    }
+
+    STDMETHODIMP GetSdkPath(BSTR *pSdkPath)
+    {
+        *pSdkPath = ::GetNDPSystemPath();
+        return (*pSdkPath == NULL) ? E_OUTOFMEMORY : S_OK;
+    }
+
+    STDMETHODIMP GetTargetLibraryType(VBTargetLibraryType *pTargetLibraryType)
+    {
+        *pTargetLibraryType = TLB_Desktop;
+        return S_OK;
+    }
+
+private:
+    LONG m_cRefs;
+};
+
+// The files and the references of a corpus, read from the corpus.rsp written by vbcorpusgen.
+struct Corpus
+{
+    std::vector<std::wstring> files;
+    std::vector<std::wstring> references;
+};
+
+static
+bool ReadCorpus(const std::wstring &directory, Corpus &corpus)
+{
+    FILE *pFile = NULL;
+    WCHAR wszLine[MAX_PATH];
+    static const WCHAR wszReference[] = L"/reference:";
+
+    if (_wfopen_s(&pFile, (directory + L"corpus.rsp").c_str(), L"r"))
+    {
+        return false;
+    }
+
+    while (fgetws(wszLine, DIM(wszLine), pFile))
+    {
+        std::wstring line = wszLine;
+
+        while (!line.empty() && iswspace(line[line.size() - 1]))
+        {
+            line.erase(line.size() - 1);
+        }
+
+        if (line.compare(0, DIM(wszReference) - 1, wszReference) == 0)
+        {
+            corpus.references.push_back(line.substr(DIM(wszReference) - 1));
+        }
+        else if (!line.empty() && line[0] != L'/')
+        {
+            corpus.files.push_back(directory + line);
+        }
+    }
+
+    fclose(pFile);
+    return !corpus.files.empty();
+}
+
+// Writes the iteration's JSON object, or null if the compile could not be started, and the
+// trace if a trace file is given.
+static
+HRESULT CompileCorpus(
+    const Corpus &corpus,
+    _In_z_ WCHAR *wszOutputDirectory,
+    FILE *pJsonFile,
+    _In_opt_z_ const WCHAR *wszTraceFile,
+    ULONG *pcErrors)
+{
+    HRESULT hr = S_OK;
+    BenchCompilerHost host;
+    CComPtr<IVbCompiler> spCompiler;
+    CComPtr<IVbCompilerProject> spProject;
+    CComBSTR bstrSdkPath;
+    VbCompilerOptions options;
+    ULONG cWarnings = 0;
+    bool fReported = false;
+
+    *pcErrors = 0;
+
+    // Creating the compiler reads the settings from the environment.
+    IfFailGo(VBCreateBasicCompiler(false, DelayLoadUICallback, &host, &spCompiler));
+    IfFailGo(spCompiler->CreateProject(L"corpus", spCompiler, NULL, &host, &spProject));
+
+    ::ZeroMemory(&options, sizeof(options));
+    options.OutputType = OUTPUT_Library;
+    options.WarningLevel = WARN_Regular;
+    options.wszExeName = L"corpus.dll";
+    options.wszOutputPath = wszOutputDirectory;
+    options.wszTemporaryPath = wszOutputDirectory;
+    options.bOptimize = true;
+    IfFailGo(spProject->SetCompilerOptions(&options));
+
+    IfFailGo(host.GetSdkPath(&bstrSdkPath));
+
+    for (size_t i = 0; i < corpus.references.size(); i++)
+    {
+        std::wstring reference = std::wstring(bstrSdkPath) + corpus.references[i];
+
+        IfFailGo(spProject->AddMetaDataReference(reference.c_str(), TRUE));
+    }
+
+    for (size_t i = 0; i < corpus.files.size(); i++)
+    {
+        IfFailGo(spProject->AddFile(corpus.files[i].c_str(), VSITEMID_NIL, FALSE));
+    }
+
+    // Only the compile is timed; setting up the project is not.
+    ActivateTiming();
+    hr = spCompiler->Compile(&cWarnings, pcErrors, NULL);
+    FinishTiming();
+
+    ReportTimesAsJson(pJsonFile);
+    fReported = true;
+
+    if (wszTraceFile)
+    {
+        ReportTimesAsTrace(wszTraceFile);
+    }
+
+Error:
+    if (!fReported)
+    {
+        fwprintf(pJsonFile, L"null");
+    }
+
+    if (spProject)
+    {
+        spProject->Disconnect();
+    }
+
+    return hr;
+}
+
+int __cdecl main(int argc, _In_count_(argc) char **argv)
+{
+    const char *szCorpus = BenchGetOption(argc, argv, "-corpus");
+    const char *szJson = BenchGetOption(argc, argv, "-json");
+    const char *szOutput = BenchGetOption(argc, argv, "-out");
+    const char *szTrace = BenchGetOption(argc, argv, "-trace");
+    unsigned cIterations = BenchGetOption(argc, argv, "-iterations", 3u);
+    unsigned cThreads = BenchGetOption(argc, argv, "-parallelism", 0u);
+    WCHAR wszValue[MAX_PATH];
+    WCHAR wszTemporaryPath[MAX_PATH];
+    WCHAR wszTraceFile[MAX_PATH];
+    Corpus corpus;
+    FILE *pJsonFile = stdout;
+
+    if (!szCorpus || cIterations == 0)
+    {
+        fprintf(stderr, "usage: vbcbench -corpus <directory> [-json <file>] [-iterations <count>] [-parallelism <threads>]\n"
+                        "                [-out <directory>] [-trace <file>]\n");
+        return 2;
+    }
+
+    VBCompilerLibraryManager libraryManager("vbcbench");
+
+    if (!libraryManager.IsValid())
+    {
+        fprintf(stderr, "cannot initialize the compiler library\n");
+        return 1;
+    }
+
+    swprintf_s(wszValue, DIM(wszValue), L"%S\\", szCorpus);
+
+    if (!ReadCorpus(wszValue, corpus))
+    {
+        fprintf(stderr, "cannot read %s\\corpus.rsp\n", szCorpus);
+        return 1;
+    }
+
+    if (szOutput)
+    {
+        swprintf_s(wszTemporaryPath, DIM(wszTemporaryPath), L"%S\\", szOutput);
+    }
+    else
+    {
+        GetTempPathW(DIM(wszTemporaryPath), wszTemporaryPath);
+    }
+
+    // The command line driver has no switch for this; the compiler takes it from the
+    // environment.  0 threads leaves the default, one per processor.
+    if (cThreads)
+    {
+        swprintf_s(wszValue, DIM(wszValue), L"%u", cThreads);
+        SetEnvironmentVariableW(L"VBC_COMPILER_PARALLELISM", wszValue);
+    }
+
+    if (szTrace)
+    {
+        swprintf_s(wszTraceFile, DIM(wszTraceFile), L"%S", szTrace);
+    }
+
+    if (szJson && fopen_s(&pJsonFile, szJson, "w"))
+    {
+        fprintf(stderr, "cannot write %s\n", szJson);
+        return 1;
+    }
+
+    fwprintf(pJsonFile, L"{\"corpusFiles\":%u,\"iterations\":[\n", (unsigned)corpus.files.size());
+
+    for (unsigned iIteration = 0; iIteration < cIterations; iIteration++)
+    {
+        ULONG cErrors = 0;
+        HRESULT hr;
+
+        if (iIteration)
+        {
+            fwprintf(pJsonFile, L",\n");
+        }
+
+        hr = CompileCorpus(
+            corpus,
+            wszTemporaryPath,
+            pJsonFile,
+            (szTrace && iIteration + 1 == cIterations) ? wszTraceFile : NULL,
+            &cErrors);
+
+        BENCH_CHECK(SUCCEEDED(hr));
+        BENCH_CHECK(cErrors == 0);
+
+        if (FAILED(hr))
+        {
+            fprintf(stderr, "iteration %u failed: 0x%08x\n", iIteration, hr);
+            break;
+        }
+    }
+
+    fwprintf(pJsonFile, L"]}\n");
+
+    if (pJsonFile != stdout)
+    {
+        fclose(pJsonFile);
+    }
+
+    return BenchFinish();
+}
@@ -0,0 +1,316 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Generates a synthetic VB corpus for vbcbench.
+//
+//  Every file declares one generic pair class and one class whose members exercise deeply
+//  nested generic types, LINQ queries, XML literals, async and iterator methods, and large
+//  Select Case blocks.  Each class calls into the one of the previous file, so the files have
+//  to be bound together.  The output is deterministic for a given set of options.
+//
+//  A response file, corpus.rsp, lists the files and the references they need, so the same
+//  corpus can also be compiled by vbc.exe:  vbc @corpus.rsp
+//
+//  Build:
+//      cl /O2 /EHsc vbcorpusgen.cpp
+//      g++ -O2 vbcorpusgen.cpp -o vbcorpusgen
+//
+//  Run:
+//      vbcorpusgen -out <directory> [-files <count>] [-depth <generic nesting>] [-cases <count>]
+//
+//-------------------------------------------------------------------------------------------------
+
+#include "../inc/benchharness.h"
+
+#include <string>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// The number of files that share a namespace.
+static const unsigned FilesPerNamespace = 50;
+
+struct CorpusOptions
+{
+    unsigned cFiles;
+    unsigned cGenericDepth;
+    unsigned cCases;
+};
+
+static
+std::string Format(const char *szFormat, unsigned uValue)
+{
+    char szBuffer[64];
+
+    sprintf(szBuffer, szFormat, uValue);
+    return szBuffer;
+}
+
+// Dictionary(Of Integer, List(Of ... String ...)) nested cDepth times.
+static
+std::string NestedGenericType(unsigned cDepth)
+{
+    std::string type = "String";
+
+    for (unsigned i = 0; i < cDepth; i++)
+    {
+        type = (i % 2 ? "List(Of " : "Dictionary(Of Integer, ") + type + ")";
+    }
+
+    return type;
+}
+
+static
+void WriteFile(FILE *pFile, unsigned iFile, const CorpusOptions &options)
+{
+    std::string pair = Format("Pair%u", iFile);
+    std::string type = Format("Type%u", iFile);
+    std::string nested = NestedGenericType(options.cGenericDepth);
+    std::string nestedPair = pair + "(Of Integer, " + nested + ")";
+
+    fprintf(pFile,
+        "' Generated by vbcorpusgen: file %u of %u.\n"
+        "Option Strict On\n"
+        "Option Infer On\n"
+        "\n"
+        "Imports System\n"
+        "Imports System.Collections.Generic\n"
+        "Imports System.Linq\n"
+        "Imports System.Threading.Tasks\n"
+        "Imports System.Xml.Linq\n"
+        "\n"
+        "Namespace Bench.Group%u\n"
+        "\n",
+        iFile + 1, options.cFiles,
+        iFile / FilesPerNamespace);
+
+    // The generic pair.
+    fprintf(pFile,
+        "    Public Class %s(Of TKey, TValue)\n"
+        "        Public Property Key As TKey\n"
+        "        Public Property Value As TValue\n"
+        "\n"
+        "        Public Sub New(key As TKey, value As TValue)\n"
+        "            Me.Key = key\n"
+        "            Me.Value = value\n"
+        "        End Sub\n"
+        "\n"
+        "        Public Function Swap() As %s(Of TValue, TKey)\n"
+        "            Return New %s(Of TValue, TKey)(Value, Key)\n"
+        "        End Function\n"
+        "    End Class\n"
+        "\n",
+        pair.c_str(), pair.c_str(), pair.c_str());
+
+    fprintf(pFile, "    Public Class %s\n\n", type.c_str());
+
+    // Deep generics, and a generic method with constraints.
+    fprintf(pFile,
+        "        Public Shared Function Nest(value As Integer) As %s\n"
+        "            Dim result As New %s(value, New %s())\n"
+        "            Return result\n"
+        "        End Function\n"
+        "\n"
+        "        Public Shared Function Map(Of TIn, TOut As {Class, New})(source As IEnumerable(Of TIn), update As Action(Of TIn, TOut)) As List(Of TOut)\n"
+        "            Dim result As New List(Of TOut)\n"
+        "            For Each item In source\n"
+        "                Dim mapped As New TOut()\n"
+        "                update(item, mapped)\n"
+        "                result.Add(mapped)\n"
+        "            Next\n"
+        "            Return result\n"
+        "        End Function\n"
+        "\n",
+        nestedPair.c_str(), nestedPair.c_str(), nested.c_str());
+
+    // LINQ.
+    fprintf(pFile,
+        "        Public Shared Function Query(items As IEnumerable(Of %s(Of Integer, String))) As List(Of String)\n"
+        "            Dim grouped = From item In items\n"
+        "                          Where item.Key Mod 3 <> 0\n"
+        "                          Group item By Bucket = item.Key Mod 10 Into Members = Group, Total = Sum(item.Key)\n"
+        "                          Order By Bucket Descending\n"
+        "                          Select Name = Bucket.ToString() & \":\" & Total.ToString(), Count = Members.Count()\n"
+        "            Dim joined = From a In items\n"
+        "                         Join b In items On a.Key Equals b.Key + 1\n"
+        "                         Let combined = a.Value & b.Value\n"
+        "                         Where combined.Length > %u\n"
+        "                         Select combined\n"
+        "            Dim longest = Aggregate item In items Into Max(item.Value.Length)\n"
+        "            Return (From g In grouped Where g.Count > longest Select g.Name).Concat(joined).ToList()\n"
+        "        End Function\n"
+        "\n",
+        pair.c_str(), iFile % 7);
+
+    // XML literals.
+    fprintf(pFile,
+        "        Public Shared Function ToXml(items As IEnumerable(Of %s(Of Integer, String))) As XElement\n"
+        "            Dim document = <%s count=<%%= items.Count() %%>>\n"
+        "                               <%%= From item In items Select <item key=<%%= item.Key %%>><%%= item.Value %%></item> %%>\n"
+        "                           </%s>\n"
+        "            Dim first = document.<item>.FirstOrDefault()\n"
+        "            If first IsNot Nothing Then\n"
+        "                document.@first = first.@key\n"
+        "            End If\n"
+        "            Return document\n"
+        "        End Function\n"
+        "\n",
+        pair.c_str(), type.c_str(), type.c_str());
+
+    // Async and iterator methods.
+    fprintf(pFile,
+        "        Public Shared Async Function LoadAsync(count As Integer) As Task(Of Integer)\n"
+        "            Dim total = 0\n"
+        "            For index = 0 To count - 1\n"
+        "                total += Await Task.FromResult(index)\n"
+        "                If total > 1000 Then\n"
+        "                    Await Task.Yield()\n"
+        "                End If\n"
+        "            Next\n"
+        "            Try\n"
+        "                total += Await ComputeAsync(total)\n"
+        "            Catch ex As InvalidOperationException\n"
+        "                total = -1\n"
+        "            End Try\n"
+        "            Return total\n"
+        "        End Function\n"
+        "\n"
+        "        Private Shared Async Function ComputeAsync(value As Integer) As Task(Of Integer)\n"
+        "            Await Task.Delay(0)\n"
+        "            Return value * %u\n"
+        "        End Function\n"
+        "\n"
+        "        Public Shared Iterator Function Sequence(count As Integer) As IEnumerable(Of %s(Of Integer, String))\n"
+        "            For index = 0 To count - 1\n"
+        "                Yield New %s(Of Integer, String)(index, \"value\" & index.ToString())\n"
+        "            Next\n"
+        "        End Function\n"
+        "\n",
+        iFile + 2, pair.c_str(), pair.c_str());
+
+    // A large Select Case over integers, with ranges, and one over strings.
+    fprintf(pFile,
+        "        Public Shared Function Classify(value As Integer, name As String) As Integer\n"
+        "            Select Case value\n");
+
+    for (unsigned iCase = 0; iCase < options.cCases; iCase++)
+    {
+        fprintf(pFile,
+            "                Case %u\n"
+            "                    Return %u\n",
+            iCase, (iCase * 2654435761u + iFile) % 100003);
+    }
+
+    fprintf(pFile,
+        "                Case %u To %u\n"
+        "                    Return value \\ 2\n"
+        "                Case Is > %u\n"
+        "                    Return value Mod 97\n"
+        "            End Select\n"
+        "\n"
+        "            Select Case name\n",
+        options.cCases, options.cCases * 2, options.cCases * 100);
+
+    for (unsigned iCase = 0; iCase < options.cCases / 4; iCase++)
+    {
+        fprintf(pFile,
+            "                Case \"Name%u\"\n"
+            "                    Return %u\n",
+            iCase, iCase);
+    }
+
+    fprintf(pFile,
+        "                Case Else\n"
+        "                    Return -1\n"
+        "            End Select\n"
+        "        End Function\n"
+        "\n");
+
+    // The dependency on the previous file.
+    if (iFile == 0)
+    {
+        fprintf(pFile,
+            "        Public Shared Function Chain(depth As Integer) As Integer\n"
+            "            Return depth\n"
+            "        End Function\n");
+    }
+    else
+    {
+        fprintf(pFile,
+            "        Public Shared Function Chain(depth As Integer) As Integer\n"
+            "            Dim items = Global.Bench.Group%u.Type%u.Sequence(depth).ToList()\n"
+            "            Return Global.Bench.Group%u.Type%u.Chain(depth + 1) + Classify(depth, items.Count.ToString()) + Query(Sequence(depth)).Count\n"
+            "        End Function\n",
+            (iFile - 1) / FilesPerNamespace, iFile - 1,
+            (iFile - 1) / FilesPerNamespace, iFile - 1);
+    }
+
+    fprintf(pFile,
+        "\n"
+        "    End Class\n"
+        "\n"
+        "End Namespace\n");
+}
+
+int __cdecl main(int argc, _In_count_(argc) char **argv)
+{
+    const char *szOutput = BenchGetOption(argc, argv, "-out");
+    CorpusOptions options;
+
+    options.cFiles = BenchGetOption(argc, argv, "-files", 200u);
+    options.cGenericDepth = BenchGetOption(argc, argv, "-depth", 6u);
+    options.cCases = BenchGetOption(argc, argv, "-cases", 250u);
+
+    if (!szOutput || options.cFiles == 0 || options.cGenericDepth == 0)
+    {
+        fprintf(stderr, "usage: vbcorpusgen -out <directory> [-files <count>] [-depth <generic nesting, at least 1>] [-cases <count>]\n");
+        return 2;
+    }
+
+#ifdef _WIN32
+    _mkdir(szOutput);
+#else
+    mkdir(szOutput, 0777);
+#endif
+
+    std::string directory = std::string(szOutput) + "/";
+    FILE *pResponseFile = fopen((directory + "corpus.rsp").c_str(), "w");
+
+    if (!pResponseFile)
+    {
+        fprintf(stderr, "cannot write %scorpus.rsp\n", directory.c_str());
+        return 1;
+    }
+
+    fprintf(pResponseFile,
+        "/target:library\n"
+        "/out:corpus.dll\n"
+        "/reference:System.Core.dll\n"
+        "/reference:System.Xml.dll\n"
+        "/reference:System.Xml.Linq.dll\n");
+
+    for (unsigned iFile = 0; iFile < options.cFiles; iFile++)
+    {
+        std::string name = Format("File%04u.vb", iFile);
+        FILE *pFile = fopen((directory + name).c_str(), "w");
+
+        if (!pFile)
+        {
+            fprintf(stderr, "cannot write %s%s\n", directory.c_str(), name.c_str());
+            fclose(pResponseFile);
+            return 1;
+        }
+
+        WriteFile(pFile, iFile, options);
+        fclose(pFile);
+
+        fprintf(pResponseFile, "%s\n", name.c_str());
+    }
+
+    fclose(pResponseFile);
+    return 0;
+}
@@ -228,7 +228,6 @@ void CodeGenerator::AssignBlockLocalSlots
 *****************************************************************************/
 void CodeGenerator::AssignLocalSlots()
 {
-    TemporaryIterator   iterTemp;
     TemporaryManager  * ptempmgr = m_ptreeFunc->AsProcedureBlock().ptempmgr;
 
     BCSYM_Variable *ActiveHandlerTemporary = NULL;
@@ -264,16 +263,11 @@ void CodeGenerator::AssignLocalSlots()
     AssignBlockLocalSlots(m_ptreeFunc->AsProcedureBlock(), m_MethodScope);
 
 
-    // Now iterate over the method's temps and assign their slot numbers.
+    // Now assign slot numbers to the method's temps.
     // The On Error temporary locals allocated above will appear in this list.
     //
     VSASSERT(ptempmgr, "Where's the tempmgr?  Every proc should have one!");
-    iterTemp.Init(ptempmgr);
-
-    while (Temporary *Current = iterTemp.GetNext())
-    {
-        AddVariableToMethod(m_MethodScope, Current->Symbol, VAR_IS_COMP_GEN);
-    }
+    AssignTemporarySlots(ptempmgr);
 
     // As a shortcut, cache the On Error slot numbers.
     if (ActiveHandlerTemporary)
@@ -295,6 +289,171 @@ void CodeGenerator::AssignLocalSlots()
 }
 
 
+/*****************************************************************************
+// Assign slot numbers to the method's temps.
+//
+// Long lived temps are never reused by the TemporaryManager, so state machines
+// and lowered queries end up with a local for every For limit, Select selector,
+// enumerator, With or Using object.  Such a temp is only live inside the block
+// it was allocated for, so when optimizing, temps of the same type whose blocks
+// do not overlap share one slot (see CanShareTemporarySlot for which temps
+// qualify).  User locals keep their own slots.
+*****************************************************************************/
+void CodeGenerator::AssignTemporarySlots
+(
+    TemporaryManager *ptempmgr
+)
+{
+    TemporaryIterator iterTemp;
+    iterTemp.Init(ptempmgr);
+
+    // Debug and ENC builds keep a slot per temp.  So do methods with On Error,
+    // because Resume can re-enter a block without going through its start.
+    if (!m_Project->GenerateOptimalIL() ||
+        m_Project->GenerateENCableCode() ||
+        m_ptreeFunc->AsProcedureBlock().fSeenOnErr)
+    {
+        while (Temporary *Current = iterTemp.GetNext())
+        {
+            AddVariableToMethod(m_MethodScope, Current->Symbol, VAR_IS_COMP_GEN);
+        }
+
+        return;
+    }
+
+    DynamicHashTable<ILTree::ExecutableBlock *, BLOCK_EXTENT> Extents;
+    unsigned uNextBlock = 0;
+
+    NumberBlocks(m_ptreeFunc->AsProcedureBlock(), uNextBlock, Extents);
+
+    DynamicArray<SLOT_TEMPORARY> SlotTemporaries;
+
+    while (Temporary *Current = iterTemp.GetNext())
+    {
+        BLOCK_EXTENT Extent;
+
+        // Blocks that are not in the method's tree (e.g. those of trees that were
+        // rewritten) have no extent, so their temps keep their own slots.
+        if (!CanShareTemporarySlot(Current) ||
+            !Extents.GetValue(Current->Block, &Extent))
+        {
+            AddVariableToMethod(m_MethodScope, Current->Symbol, VAR_IS_COMP_GEN);
+            continue;
+        }
+
+        BCSYM_Variable *SharedSlotVariable = NULL;
+
+        for (ULONG iCandidate = 0; iCandidate < SlotTemporaries.Count() && !SharedSlotVariable; iCandidate++)
+        {
+            BCSYM_Variable *Candidate = SlotTemporaries.Element(iCandidate).pvar;
+
+            if (!TypeHelpers::EquivalentTypes(Candidate->GetCompilerType(), Current->Symbol->GetCompilerType()))
+            {
+                continue;
+            }
+
+            // The slot is free if no temp that already uses it lives in a block
+            // that overlaps this one.
+            bool IsSlotFree = true;
+
+            for (ULONG iUser = 0; iUser < SlotTemporaries.Count() && IsSlotFree; iUser++)
+            {
+                SLOT_TEMPORARY &User = SlotTemporaries.Element(iUser);
+
+                if (User.pvar->GetLocalSlot() == Candidate->GetLocalSlot() &&
+                    User.Extent.uFirst <= Extent.uLast &&
+                    Extent.uFirst <= User.Extent.uLast)
+                {
+                    IsSlotFree = false;
+                }
+            }
+
+            if (IsSlotFree)
+            {
+                SharedSlotVariable = Candidate;
+            }
+        }
+
+        if (SharedSlotVariable)
+        {
+            Current->Symbol->SetLocalSlot(SharedSlotVariable->GetLocalSlot());
+        }
+        else
+        {
+            AddVariableToMethod(m_MethodScope, Current->Symbol, VAR_IS_COMP_GEN);
+        }
+
+        SLOT_TEMPORARY &SlotTemporary = SlotTemporaries.Add();
+        SlotTemporary.pvar = Current->Symbol;
+        SlotTemporary.Extent = Extent;
+    }
+}
+
+/*****************************************************************************
+// Can this temp share its slot with the temps of other blocks?
+//
+// Only temps of For, For Each, Select, With and Using blocks qualify.  Their
+// temps are captured on entry to the block and only referenced inside it, and
+// the language does not allow a GoTo into any of them.  Other long lived temps
+// (e.g. those of the procedure or of a state machine's MoveNext) may be live
+// for the entire function, so they keep their own slots.
+*****************************************************************************/
+bool CodeGenerator::CanShareTemporarySlot
+(
+    Temporary *ptemp
+)
+{
+    if (ptemp->Lifetime != LifetimeLongLived || ptemp->Block == NULL)
+    {
+        return false;
+    }
+
+    switch (ptemp->Block->bilop)
+    {
+        case SB_FOR:
+        case SB_FOR_EACH:
+        case SB_SELECT:
+        case SB_WITH:
+        case SB_USING:
+            break;
+
+        default:
+            return false;
+    }
+
+    return
+        ptemp->Symbol->GetRewrittenName() == NULL &&
+        !ptemp->Symbol->GetType()->IsPointerType();
+}
+
+/*****************************************************************************
+// Number the method's executable blocks in pre-order and record the extent
+// of each.
+*****************************************************************************/
+void CodeGenerator::NumberBlocks
+(
+    ILTree::ExecutableBlock &exblock,
+    unsigned &uNextBlock,
+    DynamicHashTable<ILTree::ExecutableBlock *, BLOCK_EXTENT> &Extents
+)
+{
+    BLOCK_EXTENT Extent;
+    Extent.uFirst = uNextBlock++;
+
+    for (ILTree::ILNode *ptreeStatementInBlock = exblock.ptreeChild;
+         ptreeStatementInBlock;
+         ptreeStatementInBlock = ptreeStatementInBlock->AsStatement().Next)
+    {
+        if (ptreeStatementInBlock->IsExecutableBlockNode())
+        {
+            NumberBlocks(ptreeStatementInBlock->AsExecutableBlock(), uNextBlock, Extents);
+        }
+    }
+
+    Extent.uLast = uNextBlock - 1;
+    Extents.SetValue(&exblock, Extent);
+}
+
 /*****************************************************************************
 // Create the signature for the locals
 *****************************************************************************/
@@ -103,6 +103,8 @@ struct CODE_BLOCK : CSingleLink<CODE_BLOCK>
     Vtypes            JumpType;           // branch expression's type - used during final codegen pass
     unsigned short    usCodeSize;         // size in bytes of code buffer
     bool              fLive;              // used during final codegen pass
+    bool              fEHBoundary;        // starts or follows an EH region - used during final codegen pass
+    bool              fThreadVisited;     // on the path of the branch being threaded - used during final codegen pass
 };
 
 //-------------------------------------------------------------------------------------------------
@@ -190,6 +192,27 @@ struct LINETBL
     SourceFile        *pSourceFile;      // physical source file the code is present in
 };
 
+//-------------------------------------------------------------------------------------------------
+//
+// The extent of an executable block: the pre-order numbers of the block and of the last block
+// nested in it.  Two blocks overlap if one is nested in the other.
+//
+struct BLOCK_EXTENT
+{
+    unsigned          uFirst;
+    unsigned          uLast;
+};
+
+//-------------------------------------------------------------------------------------------------
+//
+// A long lived temporary that was given a slot, and the block it lives in
+//
+struct SLOT_TEMPORARY
+{
+    BCSYM_Variable  * pvar;
+    BLOCK_EXTENT      Extent;
+};
+
 struct ScopeMember : public CSingleLink<ScopeMember>
 {
     // Use a union here to support Constants
@@ -476,6 +499,9 @@ private:
 
     void AssignBlockLocalSlots(ILTree::ExecutableBlock &exblock, BlockScope *CurrentScope);
     void AssignLocalSlots();
+    void AssignTemporarySlots(TemporaryManager *ptempmgr);
+    bool CanShareTemporarySlot(Temporary *ptemp);
+    void NumberBlocks(ILTree::ExecutableBlock &exblock, unsigned &uNextBlock, DynamicHashTable<ILTree::ExecutableBlock *, BLOCK_EXTENT> &Extents);
     void AssignParameterSlots();
     void CreateLocalsSignature();
 
@@ -507,6 +533,7 @@ private:
     bool IsShortBranch(OPCODE opcode);
     bool IsConditionalBranch(OPCODE opcode);
     OPCODE MapShort2LongJumpOpcode(OPCODE opcodeShortJump);
+    OPCODE InvertConditionalBranch(OPCODE opcode, Vtypes JumpType);
     void StartHiddenIL();
     void StartEpilogueIL();
     void UpdateLineTable(Location &Loc, SourceFile *pSourceFile = NULL);
@@ -524,6 +551,10 @@ private:
     void CollateSwitchTable(CODE_BLOCK * pcblkSwitch);
     void OptimizeGeneratedIL();
     void OptimizeBranches();
+    void MarkEHBoundaries();
+    bool ThreadBranches(CODE_BLOCK *pcblk);
+    CODE_BLOCK *ThreadBranch(CODE_BLOCK *pcblkDest);
+    CODE_BLOCK *NextThreadedBlock(CODE_BLOCK *pcblk);
     void MarkLiveBlocks(CODE_BLOCK *pcblk);
     unsigned long CalculateBlockAddresses();
     void EmitEHClauses();
@@ -680,6 +680,59 @@ OPCODE opcodeShortJump
     }
 }
 
+//========================================================================
+// Returns the short branch that is taken exactly when the given one is
+// not, or CEE_NOP if there is none.  An unordered comparison of floating
+// point values fails both an ordered comparison and its opposite, so for
+// those the ordered and unordered forms trade places.
+//========================================================================
+
+OPCODE CodeGenerator::InvertConditionalBranch
+(
+OPCODE opcode,
+Vtypes JumpType
+)
+{
+    switch (opcode)
+    {
+    case CEE_BRTRUE_S:  return CEE_BRFALSE_S;
+    case CEE_BRFALSE_S: return CEE_BRTRUE_S;
+    case CEE_BEQ_S:     return CEE_BNE_UN_S;
+    case CEE_BNE_UN_S:  return CEE_BEQ_S;
+    }
+
+    if (IsIntegralType(JumpType) || JumpType == t_char)
+    {
+        switch (opcode)
+        {
+        case CEE_BGE_S:     return CEE_BLT_S;
+        case CEE_BGE_UN_S:  return CEE_BLT_UN_S;
+        case CEE_BGT_S:     return CEE_BLE_S;
+        case CEE_BGT_UN_S:  return CEE_BLE_UN_S;
+        case CEE_BLE_S:     return CEE_BGT_S;
+        case CEE_BLE_UN_S:  return CEE_BGT_UN_S;
+        case CEE_BLT_S:     return CEE_BGE_S;
+        case CEE_BLT_UN_S:  return CEE_BGE_UN_S;
+        }
+    }
+    else if (JumpType == t_single || JumpType == t_double)
+    {
+        switch (opcode)
+        {
+        case CEE_BGE_S:     return CEE_BLT_UN_S;
+        case CEE_BGE_UN_S:  return CEE_BLT_S;
+        case CEE_BGT_S:     return CEE_BLE_UN_S;
+        case CEE_BGT_UN_S:  return CEE_BLE_S;
+        case CEE_BLE_S:     return CEE_BGT_UN_S;
+        case CEE_BLE_UN_S:  return CEE_BGT_S;
+        case CEE_BLT_S:     return CEE_BGE_UN_S;
+        case CEE_BLT_UN_S:  return CEE_BGE_S;
+        }
+    }
+
+    return CEE_NOP;
+}
+
 //========================================================================
 // Begins a block of hidden IL in the line table
 //========================================================================
@@ -1068,9 +1121,10 @@ void CodeGenerator::AddConstantToMethod
     // we must compute and emit the token for the constant signature right now in the IL emitted,
     // store it here, and we will refer to this in pdb emit.
 
-    ConstantVariable->SignatureToken = m_pmdemit->ComputeSignatureToken(
+    m_pmdemit->DefineSignatureToken(
         ConstantVariable->Signature,
-        ConstantVariable->SignatureSize);
+        ConstantVariable->SignatureSize,
+        &ConstantVariable->SignatureToken);
     VSASSERT( ConstantVariable->SignatureToken != mdTokenNil, "Why is the signature token for a constant mdTokenNil?" );
 
     m_pmdemit->ReleaseSignature(&signature);
@@ -1299,90 +1353,294 @@ SameDestination
 }
 
 //========================================================================
-// Perform simple branch optimizations
+// Mark the blocks that branches must not be threaded into: the first
+// blocks of the try, filter, catch and finally regions, which may only be
+// entered at their start, and the blocks the EH clauses are measured to.
 //========================================================================
 
-void CodeGenerator::OptimizeBranches
+void CodeGenerator::MarkEHBoundaries
 (
 )
 {
     CSingleListIter<CODE_BLOCK> Iter(&m_cblkCodeList);
     CODE_BLOCK * pcblk;
 
-    // 
-    Iter.Reset();
     while (pcblk = Iter.Next())
     {
-        // transform the pattern:
-        // br x                   nop
-        // x:           INTO      x:
-        //
-        if (pcblk->opcodeJump == CEE_BR_S && SameDestination(pcblk, pcblk->pcblkJumpDest))
+        pcblk->fEHBoundary = false;
+        pcblk->fThreadVisited = false;
+    }
+
+    CSingleListIter<TRY_BLOCK> IterTry(&m_tryList);
+    TRY_BLOCK * ptry;
+
+    while (ptry = IterTry.Next())
+    {
+        ptry->pcblkTry->fEHBoundary = true;
+
+        CSingleListIter<CATCH_BLOCK> IterCatch(&ptry->catchList);
+        CATCH_BLOCK * pcatch;
+
+        while (pcatch = IterCatch.Next())
         {
-            pcblk->opcodeJump = CEE_NOP;
-            continue;
+            if (pcatch->pcblkFilter)
+            {
+                pcatch->pcblkFilter->fEHBoundary = true;
+            }
+
+            pcatch->pcblkCatch->fEHBoundary = true;
+            pcatch->pcblkLast->fEHBoundary = true;
         }
 
-        // transform the pattern:
-        // brfalse x              pop
-        // x:           INTO      x:
-        //
-        if ((pcblk->opcodeJump == CEE_BRFALSE_S || pcblk->opcodeJump == CEE_BRTRUE_S) &&
-            SameDestination(pcblk, pcblk->pcblkJumpDest))
+        if (ptry->pcblkFinally)
         {
-            pcblk->opcodeJump = CEE_POP;
-            pcblk->pcblkJumpDest = NULL;
-            continue;
+            ptry->pcblkFinally->fEHBoundary = true;
+        }
+
+        if (ptry->pcblkFallThrough)
+        {
+            ptry->pcblkFallThrough->fEHBoundary = true;
+        }
+    }
+}
+
+//========================================================================
+// Follow a branch destination through empty blocks that fall through or
+// only branch elsewhere, and return the block the branch really lands
+// on. A branch can only reach a block of another EH region at the start
+// of that region, so the walk stops at EH boundaries. Empty blocks can
+// branch to each other in a loop; a walk that comes back to a block it
+// passed keeps the original destination.
+//========================================================================
+
+CODE_BLOCK *CodeGenerator::ThreadBranch
+(
+CODE_BLOCK *pcblkDest
+)
+{
+    if (pcblkDest->fEHBoundary)
+    {
+        return pcblkDest;
+    }
+
+    CODE_BLOCK * pcblkStart = pcblkDest;
+    bool fLoop = false;
+
+    while (pcblkDest->usCodeSize == 0)
+    {
+        CODE_BLOCK * pcblkNext = NextThreadedBlock(pcblkDest);
+
+        if (pcblkNext == NULL || pcblkNext->fEHBoundary)
+        {
+            break;
+        }
+
+        pcblkDest->fThreadVisited = true;
+
+        if (pcblkNext->fThreadVisited)
+        {
+            fLoop = true;
+            break;
+        }
+
+        pcblkDest = pcblkNext;
+    }
+
+    // Clear the marks, which are exactly the blocks the walk passed.
+    for (CODE_BLOCK * pcblk = pcblkStart; pcblk && pcblk->fThreadVisited; pcblk = NextThreadedBlock(pcblk))
+    {
+        pcblk->fThreadVisited = false;
+    }
+
+    return fLoop ? pcblkStart : pcblkDest;
+}
+
+//========================================================================
+// The block an empty block passes control to, or NULL if it does not
+// simply pass it on
+//========================================================================
+
+CODE_BLOCK *CodeGenerator::NextThreadedBlock
+(
+CODE_BLOCK *pcblk
+)
+{
+    if (pcblk->opcodeJump == CEE_NOP)
+    {
+        return pcblk->Next();
+    }
+
+    if (pcblk->opcodeJump == CEE_BR_S)
+    {
+        return pcblk->pcblkJumpDest;
+    }
+
+    return NULL;
+}
+
+//========================================================================
+// Thread the branches out of a block. Returns true if any changed
+//========================================================================
+
+bool CodeGenerator::ThreadBranches
+(
+CODE_BLOCK *pcblk
+)
+{
+    bool fModified = false;
+
+    if (IsShortBranch(pcblk->opcodeJump))
+    {
+        CODE_BLOCK * pcblkDest = ThreadBranch(pcblk->pcblkJumpDest);
+
+        if (pcblkDest != pcblk->pcblkJumpDest)
+        {
+            pcblk->pcblkJumpDest = pcblkDest;
+            fModified = true;
         }
 
         // transform the pattern:
+        // br x                   ret
+        // x: ret       INTO      x: ret
         //
-        // <conditionalbranch> x              !<conditionalbranch> y
-        // br y                     INTO      x:
-        // x:
-        //
-        // 
+        if (pcblk->opcodeJump == CEE_BR_S &&
+            pcblkDest->usCodeSize == 0 &&
+            pcblkDest->opcodeJump == CEE_RET)
+        {
+            pcblk->opcodeJump = CEE_RET;
+            pcblk->pcblkJumpDest = NULL;
+            fModified = true;
+        }
+    }
+    else if (pcblk->opcodeJump == CEE_SWITCH)
+    {
+        SWITCH_TABLE * pswTable = pcblk->pswTable;
 
-        if (pcblk->Next() &&
-            pcblk->Next()->usCodeSize == 0 &&
-            pcblk->Next()->opcodeJump == CEE_BR_S &&
-            pcblk->pcblkJumpDest == pcblk->Next()->Next() &&
-            IsIntegralType(pcblk->JumpType))
+        for (unsigned i = 0; i < pswTable->cEntries; i++)
         {
-            OPCODE NewBranchOpcode = CEE_NOP;
+            CODE_ADDRESS * pcodeaddr = &pswTable->pcodeaddrs[i];
 
-            switch (pcblk->opcodeJump)
+            if (pcodeaddr->pcblk && pcodeaddr->uOffset == 0)
             {
-                case CEE_BRTRUE_S:  NewBranchOpcode = CEE_BRFALSE_S; break;
-                case CEE_BRFALSE_S: NewBranchOpcode = CEE_BRTRUE_S; break;
-                case CEE_BEQ_S:     NewBranchOpcode = CEE_BNE_UN_S; break;
-                case CEE_BNE_UN_S:  NewBranchOpcode = CEE_BEQ_S; break;
-                case CEE_BGE_S:     NewBranchOpcode = CEE_BLT_S; break;
-                case CEE_BGE_UN_S:  NewBranchOpcode = CEE_BLT_UN_S; break;
-                case CEE_BGT_S:     NewBranchOpcode = CEE_BLE_S; break;
-                case CEE_BGT_UN_S:  NewBranchOpcode = CEE_BLE_UN_S; break;
-                case CEE_BLE_S:     NewBranchOpcode = CEE_BGT_S; break;
-                case CEE_BLE_UN_S:  NewBranchOpcode = CEE_BGT_UN_S; break;
-                case CEE_BLT_S:     NewBranchOpcode = CEE_BGE_S; break;
-                case CEE_BLT_UN_S:  NewBranchOpcode = CEE_BGE_UN_S; break;
-
-                default:
-                    VSASSERT(pcblk->opcodeJump == CEE_BR_S || pcblk->opcodeJump == CEE_LEAVE_S,
-                             "OptimizeBranches: unexpected branch opcode");
-                    continue;
+                CODE_BLOCK * pcblkDest = ThreadBranch(pcodeaddr->pcblk);
+
+                if (pcblkDest != pcodeaddr->pcblk)
+                {
+                    pcodeaddr->pcblk = pcblkDest;
+                    fModified = true;
+                }
             }
+        }
+    }
+
+    return fModified;
+}
+
+//========================================================================
+// Perform branch optimizations on the live blocks. Each pass first
+// threads every branch through empty blocks and then applies the
+// peepholes below; a peephole can leave an empty block behind that
+// opens up more threading, so passes repeat until nothing changes.
+//========================================================================
 
-            VSASSERT(NewBranchOpcode != CEE_NOP, "OptimizeBranches: should have chosen a new branch opcode by now");
+void CodeGenerator::OptimizeBranches
+(
+)
+{
+    CSingleListIter<CODE_BLOCK> Iter(&m_cblkCodeList);
+    CODE_BLOCK * pcblk;
+    bool fModified = true;
+
+    MarkEHBoundaries();
 
-            pcblk->opcodeJump = NewBranchOpcode;
-            pcblk->pcblkJumpDest = pcblk->Next()->pcblkJumpDest;
-            // advance the iterator because it's already sitting on the block
-            // we want to delete.
-            Iter.Next();
-            m_cblkCodeList.Peel(pcblk->Next());
+    while (fModified)
+    {
+        fModified = false;
+
+        // Thread all branches before any block is removed, so that no
+        // branch is left pointing at a removed block.
+        Iter.Reset();
+        while (pcblk = Iter.Next())
+        {
+            if (ThreadBranches(pcblk))
+            {
+                fModified = true;
+            }
         }
 
-    }  // while
+        Iter.Reset();
+        while (pcblk = Iter.Next())
+        {
+            // transform the pattern:
+            // br x                   nop
+            // x:           INTO      x:
+            //
+            if (pcblk->opcodeJump == CEE_BR_S && SameDestination(pcblk, pcblk->pcblkJumpDest))
+            {
+                pcblk->opcodeJump = CEE_NOP;
+                fModified = true;
+                continue;
+            }
+
+            // transform the pattern:
+            // brfalse x              pop
+            // x:           INTO      x:
+            //
+            if ((pcblk->opcodeJump == CEE_BRFALSE_S || pcblk->opcodeJump == CEE_BRTRUE_S) &&
+                SameDestination(pcblk, pcblk->pcblkJumpDest))
+            {
+                pcblk->opcodeJump = CEE_POP;
+                pcblk->pcblkJumpDest = NULL;
+                fModified = true;
+                continue;
+            }
+
+            // transform the pattern:
+            //
+            // <conditionalbranch> x              !<conditionalbranch> y
+            // br y                     INTO      x:
+            // x:
+            //
+            // The br block can only be removed if nothing else branches to
+            // it. Threading moved every other branch past it unless it is an
+            // EH boundary, or y is one, or y is an empty block that threading
+            // could not see through (a loop of empty blocks).
+            //
+            CODE_BLOCK * pcblkBranch = pcblk->Next();
+
+            if (IsConditionalBranch(pcblk->opcodeJump) &&
+                pcblkBranch &&
+                pcblkBranch->usCodeSize == 0 &&
+                pcblkBranch->opcodeJump == CEE_BR_S &&
+                !pcblkBranch->fEHBoundary &&
+                !pcblkBranch->pcblkJumpDest->fEHBoundary &&
+                !(pcblkBranch->pcblkJumpDest->usCodeSize == 0 &&
+                  (pcblkBranch->pcblkJumpDest->opcodeJump == CEE_NOP ||
+                   pcblkBranch->pcblkJumpDest->opcodeJump == CEE_BR_S)) &&
+                SameDestination(pcblkBranch, pcblk->pcblkJumpDest))
+            {
+                OPCODE NewBranchOpcode = InvertConditionalBranch(pcblk->opcodeJump, pcblk->JumpType);
+
+                if (NewBranchOpcode == CEE_NOP)
+                {
+                    continue;
+                }
+
+                pcblk->opcodeJump = NewBranchOpcode;
+                pcblk->pcblkJumpDest = pcblkBranch->pcblkJumpDest;
+                // advance the iterator because it's already sitting on the block
+                // we want to delete.
+                Iter.Next();
+                m_cblkCodeList.Peel(pcblkBranch);
+
+                // Scope and line table addresses in the removed block move
+                // on to the next live block.
+                pcblkBranch->fLive = false;
+                fModified = true;
+            }
+
+        }  // while
+    }
 }
 
 //========================================================================
@@ -2381,7 +2639,7 @@ bool CodeGenerator::StackContainsRestrictedTypes(_In_ Location* pLocation)
         if (IsRestrictedType(iterator.Current(), m_Project->GetCompilerHost()) ||
             IsRestrictedArrayType(iterator.Current(), m_Project->GetCompilerHost()))
         {
-            ErrorTable* pErrors = m_pmdemit->GetBuilder()->GetErrorTable();
+            ErrorTable* pErrors = m_pmdemit->GetErrorTable();
             StringBuffer textBuffer;
             pErrors->CreateError(ERRID_AsyncRestrictedType1,
                                  pLocation,
@@ -2487,7 +2745,7 @@ bool CodeGenerator::TrySpillEvaluationStackCore(_In_ Location* pLocation, _Out_o
     if (StackContainsUnspillableTypes())
     {
         VSFAIL("There's an unspillable type on the evaluation stack; how did this happen?");
-        m_pmdemit->GetBuilder()->GetErrorTable()->CreateError(ERRID_InternalCompilerError, pLocation);
+        m_pmdemit->GetErrorTable()->CreateError(ERRID_InternalCompilerError, pLocation);
         return false;
     }
 
@@ -4697,7 +4697,7 @@ void CodeGenerator::LogRuntimeHelperNotFoundError(
     NameOfMissingType.AppendString( g_rgRTLangClasses[ g_rgRTLangMembers[ RuntimeHelperMethod ].rtParent ].wszClassName);
     NameOfMissingType.AppendChar( L'.' );
     NameOfMissingType.AppendString( g_rgRTLangMembers[ RuntimeHelperMethod ].wszName);
-    m_pmdemit->GetBuilder()->GetErrorTable()->CreateError( ERRID_MissingRuntimeHelper, ErrorLocation, NameOfMissingType.GetString());
+    m_pmdemit->GetErrorTable()->CreateError( ERRID_MissingRuntimeHelper, ErrorLocation, NameOfMissingType.GetString());
 }
 
 /*****************************************************************************
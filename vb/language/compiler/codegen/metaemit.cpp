@@ -245,6 +245,287 @@ MetaEmit::~MetaEmit()
     }
 }
 
+//============================================================================
+// MetaEmitLock
+//============================================================================
+
+MetaEmitLock::MetaEmitLock
+(
+    _In_ Builder *pBuilder
+)
+: m_pBuilder(NULL)
+, m_pOrigErrorTable(NULL)
+{
+    if (pBuilder->m_fConcurrentCodeGen)
+    {
+        pBuilder->m_csMetadata.Lock();
+        m_pBuilder = pBuilder;
+        m_pOrigErrorTable = pBuilder->m_pErrorTable;
+    }
+}
+
+MetaEmitLock::MetaEmitLock
+(
+    _In_ MetaEmit *pMetaemit
+)
+: m_pBuilder(NULL)
+, m_pOrigErrorTable(NULL)
+{
+    Builder *pBuilder = pMetaemit->m_pBuilder;
+
+    // A recording instance only logs its requests, see TokenRequestLog.
+    if (pBuilder->m_fConcurrentCodeGen &&
+        !(pMetaemit->m_pTokenRequests && pMetaemit->m_pTokenRequests->IsRecording()))
+    {
+        pBuilder->m_csMetadata.Lock();
+        m_pBuilder = pBuilder;
+        m_pOrigErrorTable = pBuilder->m_pErrorTable;
+
+        // Errors reported while defining tokens for this instance belong
+        // to the method it is generating code for.
+        if (pMetaemit->m_pErrorTableOverride)
+        {
+            pBuilder->m_pErrorTable = pMetaemit->m_pErrorTableOverride;
+        }
+    }
+}
+
+MetaEmitLock::~MetaEmitLock()
+{
+    if (m_pBuilder)
+    {
+        m_pBuilder->m_pErrorTable = m_pOrigErrorTable;
+        m_pBuilder->m_csMetadata.Unlock();
+    }
+}
+
+//============================================================================
+// TokenRequestLog
+//============================================================================
+
+TokenRequestLog::TokenRequestLog()
+: m_pnra(NULL)
+, m_fRecording(true)
+{
+}
+
+TokenRequestLog::Request &TokenRequestLog::AddRequest
+(
+    RequestKind kind
+)
+{
+    VSASSERT(m_fRecording, "Token requests are only recorded in the first pass.");
+
+    Request &request = m_daRequests.Add();
+
+    memset(&request, 0, sizeof(request));
+    request.m_kind = kind;
+
+    return request;
+}
+
+// The placeholders only have to be valid tokens of the right table: the
+// image they end up in is thrown away.
+
+mdTypeRef TokenRequestLog::RecordTypeRef
+(
+    BCSYM *ptyp,
+    Location *pReferencingLocation
+)
+{
+    Request &request = AddRequest(Request_TypeRef);
+
+    request.m_psym = ptyp;
+    request.m_pLocation = pReferencingLocation;
+
+    return TokenFromRid(m_daRequests.Count(), mdtTypeRef);
+}
+
+mdMemberRef TokenRequestLog::RecordMemberRef
+(
+    BCSYM_NamedRoot *pnamed,
+    BCSYM_GenericBinding *pBinding,
+    Location *pReferencingLocation,
+    ErrorTable *pAlternateErrorTable
+)
+{
+    Request &request = AddRequest(Request_MemberRef);
+
+    request.m_psym = pnamed;
+    request.m_pBinding = pBinding;
+    request.m_pLocation = pReferencingLocation;
+    request.m_pErrorTable = pAlternateErrorTable;
+
+    return TokenFromRid(m_daRequests.Count(), mdtMemberRef);
+}
+
+mdMemberRef TokenRequestLog::RecordRTMemberRef
+(
+    RuntimeMembers rtHelper,
+    ErrorTable *pErrorTable,
+    Location *pErrorLocation
+)
+{
+    Request &request = AddRequest(Request_RTMemberRef);
+
+    request.m_rtHelper = rtHelper;
+    request.m_pErrorTable = pErrorTable;
+    request.m_pLocation = pErrorLocation;
+
+    return TokenFromRid(m_daRequests.Count(), mdtMemberRef);
+}
+
+mdMemberRef TokenRequestLog::RecordArrayRef
+(
+    ARRAYINFO ArrayRef,
+    BCSYM_ArrayType *parr,
+    unsigned cDims,
+    Location *pReferencingLocation
+)
+{
+    Request &request = AddRequest(Request_ArrayRef);
+
+    request.m_ArrayRef = ArrayRef;
+    request.m_psym = parr;
+    request.m_cDims = cDims;
+    request.m_pLocation = pReferencingLocation;
+
+    return TokenFromRid(m_daRequests.Count(), mdtMemberRef);
+}
+
+mdString TokenRequestLog::RecordString
+(
+    _In_count_(cchLen) const WCHAR *wsz,
+    size_t cchLen
+)
+{
+    Request &request = AddRequest(Request_String);
+
+    // The string may live in the code generator's allocator, which is gone
+    // by the time the log is replayed.
+    WCHAR *wszCopy = (WCHAR *)m_pnra->Alloc(VBMath::Multiply(cchLen + 1, sizeof(WCHAR)));
+
+    memcpy(wszCopy, wsz, cchLen * sizeof(WCHAR));
+    wszCopy[cchLen] = L'\0';
+    request.m_wsz = wszCopy;
+    request.m_cchLen = cchLen;
+
+    return TokenFromRid(m_daRequests.Count(), mdtString);
+}
+
+void TokenRequestLog::Replay
+(
+    _In_ MetaEmit *pMetaemit
+)
+{
+    VSASSERT(!m_fRecording, "Replaying a log that is still recording.");
+
+    for (ULONG iRequest = 0; iRequest < m_daRequests.Count(); iRequest++)
+    {
+        Request &request = m_daRequests.Element(iRequest);
+
+        switch (request.m_kind)
+        {
+        case Request_TypeRef:
+            pMetaemit->DefineTypeRefBySymbol(request.m_psym, request.m_pLocation);
+            break;
+
+        case Request_MemberRef:
+            pMetaemit->DefineMemberRefBySymbol(request.m_psym->PNamedRoot(),
+                                               request.m_pBinding,
+                                               request.m_pLocation,
+                                               request.m_pErrorTable);
+            break;
+
+        case Request_RTMemberRef:
+            pMetaemit->DefineRTMemberRef(request.m_rtHelper, request.m_pErrorTable, request.m_pLocation);
+            break;
+
+        case Request_ArrayRef:
+            switch (request.m_ArrayRef)
+            {
+            case ARRAY_Ctor:
+                pMetaemit->DefineArrayCtorRef(request.m_psym->PArrayType(), request.m_pLocation);
+                break;
+
+            case ARRAY_LoadRef:
+                pMetaemit->DefineArrayLoadRef(request.m_psym->PArrayType(), request.m_cDims, request.m_pLocation);
+                break;
+
+            case ARRAY_LoadAddrRef:
+                pMetaemit->DefineArrayLoadAddrRef(request.m_psym->PArrayType(), request.m_cDims, request.m_pLocation);
+                break;
+
+            case ARRAY_StoreRef:
+                pMetaemit->DefineArrayStoreRef(request.m_psym->PArrayType(), request.m_cDims, request.m_pLocation);
+                break;
+
+            default:
+                VSFAIL("Unexpected array reference.");
+            }
+            break;
+
+        case Request_String:
+            pMetaemit->AddDataString(request.m_wsz, request.m_cchLen);
+            break;
+
+        default:
+            VSFAIL("Unexpected token request.");
+        }
+    }
+}
+
+void TokenRequestLog::DeferSignature
+(
+    COR_SIGNATURE *pSig,
+    unsigned cbSig,
+    _Out_ mdSignature *ptkSignature
+)
+{
+    if (m_fRecording)
+    {
+        // The signature holds placeholders, it is never defined.
+        *ptkSignature = TokenFromRid(1, mdtSignature);
+        return;
+    }
+
+    DeferredSignature &signature = m_daSignatures.Add();
+
+    // The locals signature is built in memory that is reused right away.
+    signature.m_pSig = (COR_SIGNATURE *)m_pnra->Alloc(cbSig);
+    memcpy(signature.m_pSig, pSig, cbSig);
+    signature.m_cbSig = cbSig;
+    signature.m_ptkSignature = ptkSignature;
+    signature.m_tkSignature = mdTokenNil;
+
+    *ptkSignature = TokenFromRid(m_daSignatures.Count(), mdtSignature);
+}
+
+void TokenRequestLog::DefineSignatures
+(
+    _In_ MetaEmit *pMetaemit
+)
+{
+    for (ULONG iSignature = 0; iSignature < m_daSignatures.Count(); iSignature++)
+    {
+        DeferredSignature &signature = m_daSignatures.Element(iSignature);
+
+        signature.m_tkSignature = pMetaemit->ComputeSignatureToken(signature.m_pSig, signature.m_cbSig);
+        *signature.m_ptkSignature = signature.m_tkSignature;
+    }
+}
+
+mdSignature TokenRequestLog::GetSignatureToken
+(
+    mdSignature tkPlaceholder
+)
+{
+    VSASSERT(RidFromToken(tkPlaceholder) >= 1 && RidFromToken(tkPlaceholder) <= m_daSignatures.Count(),
+             "Not a deferred signature.");
+
+    return m_daSignatures.Element(RidFromToken(tkPlaceholder) - 1).m_tkSignature;
+}
+
 //****************************************************************************
 // Helpers for the PE builder.
 //****************************************************************************
@@ -262,6 +543,13 @@ mdTypeRef MetaEmit::DefineTypeRefBySymbol
     Location *pReferencingLocation // [in] the location in the code that is referring to this symbol.
 )
 {
+    if (m_pTokenRequests && m_pTokenRequests->IsRecording())
+    {
+        return m_pTokenRequests->RecordTypeRef(ptyp, pReferencingLocation);
+    }
+
+    MetaEmitLock lock(this);
+
     mdTypeRef         tr = mdTypeRefNil;
 
     if (ptyp->IsPointerType())
@@ -2343,6 +2631,13 @@ mdMemberRef MetaEmit::DefineMemberRefBySymbol
     ErrorTable *pAlternateErrorTable // Alternate error table, could be NULL. Useful for reporting errors in different files for partial classes.
 )
 {
+    if (m_pTokenRequests && m_pTokenRequests->IsRecording())
+    {
+        return m_pTokenRequests->RecordMemberRef(pnamed, pBinding, pReferencingLocation, pAlternateErrorTable);
+    }
+
+    MetaEmitLock lock(this);
+
     // Backup the default error table so that it can be restored later.
     ErrorTable *pOrigErrorTable = m_pBuilder->m_pErrorTable;
 
@@ -2375,10 +2670,16 @@ mdMemberRef MetaEmit::DefineMemberRefBySymbol
                 pBinding->PGenericTypeBinding() :
                 pBinding->GetParentBinding();
 
-        if (TypeBinding)
+        if (TypeBinding && FindCachedMemberRef(pnamed, TypeBinding, &tkMemberRef))
+        {
+            // The signature has already been encoded for an equal binding.
+        }
+        else if (TypeBinding)
         {
             // This is a member of an instantation of a generic type.
 
+            unsigned cErrorsBefore = GetErrorEntryCount();
+
             Signature signature;
             StartNewSignature(&signature);
 
@@ -2428,6 +2729,8 @@ mdMemberRef MetaEmit::DefineMemberRefBySymbol
             tkMemberRef = DefineMemberRefByName(GetMetaMemberRef(), GetSigSize(), pnamed, mdTypeRefParent,
                                             !m_ReferredToEmbeddableInteropType); // Dev10 #676210: Can't use DefineImportMember when embeddable type is in the picture
 
+            CacheMemberRef(pnamed, TypeBinding, tkMemberRef, cErrorsBefore);
+
             m_TrackReferrencesToEmbeddableInteropTypes = old_m_TrackReferrencesToEmbeddableInteropTypes;
             m_ReferredToEmbeddableInteropType = old_m_ReferredToEmbeddableInteropType;
 
@@ -2461,8 +2764,10 @@ mdMemberRef MetaEmit::DefineMemberRefBySymbol
 
         tkMemberRef = (mdMemberRef)GetToken(pnamed);
     }
-    else
+    else if (!FindCachedMemberRef(pnamed, NULL, &tkMemberRef))
     {
+        unsigned cErrorsBefore = GetErrorEntryCount();
+
         Signature signature;
 
         StartNewSignature(&signature);
@@ -2560,6 +2865,8 @@ mdMemberRef MetaEmit::DefineMemberRefBySymbol
         tkMemberRef = DefineMemberRefByName(GetMetaMemberRef(), GetSigSize(), pnamed, mdTypeRefParent, 
                                             !m_ReferredToEmbeddableInteropType); // Dev10 #676210: Can't use DefineImportMember when embeddable type is in the picture
 
+        CacheMemberRef(pnamed, NULL, tkMemberRef, cErrorsBefore);
+
         m_TrackReferrencesToEmbeddableInteropTypes = old_m_TrackReferrencesToEmbeddableInteropTypes;
         m_ReferredToEmbeddableInteropType = old_m_ReferredToEmbeddableInteropType;
         
@@ -2579,6 +2886,76 @@ mdMemberRef MetaEmit::DefineMemberRefBySymbol
     return tkMemberRef;
 }
 
+//============================================================================
+// Looks up the MemberRef that DefineMemberRefBySymbol defined for the member
+// of an equal binding.
+//============================================================================
+
+bool MetaEmit::FindCachedMemberRef
+(
+    BCSYM_NamedRoot *pnamed,
+    BCSYM_GenericTypeBinding *pBinding,
+    _Out_ mdMemberRef *ptkMemberRef
+)
+{
+    *ptkMemberRef = mdTokenNil;
+
+#if !IDE
+    MemberRefSignatureCache::Key key;
+
+    if (!pnamed->IsStaticLocalBackingField() &&
+        MemberRefSignatureCache::BuildKey(pnamed, pBinding, &key))
+    {
+        const MemberRefSignatureCache::Entry *pEntry = m_pBuilder->m_MemberRefSignatureCache.Find(key);
+
+        if (pEntry)
+        {
+            *ptkMemberRef = pEntry->m_tkMemberRef;
+            return true;
+        }
+    }
+#endif !IDE
+
+    return false;
+}
+
+//============================================================================
+// Remembers the MemberRef DefineMemberRefBySymbol has just defined from the
+// current signature.  References that involve embeddable interop types or
+// that reported errors are left out, so that every later reference still
+// gets its PIA bookkeeping and its errors.
+//============================================================================
+
+void MetaEmit::CacheMemberRef
+(
+    BCSYM_NamedRoot *pnamed,
+    BCSYM_GenericTypeBinding *pBinding,
+    mdMemberRef tkMemberRef,
+    unsigned cErrorsBefore
+)
+{
+#if !IDE
+    MemberRefSignatureCache::Key key;
+
+    if (!m_ReferredToEmbeddableInteropType &&
+        !pnamed->IsStaticLocalBackingField() &&
+        GetErrorEntryCount() == cErrorsBefore &&
+        MemberRefSignatureCache::BuildKey(pnamed, pBinding, &key))
+    {
+        m_pBuilder->m_MemberRefSignatureCache.Add(
+            key,
+            tkMemberRef,
+            (COR_SIGNATURE *)GetMetaMemberRef()->m_pSignature,
+            GetMetaMemberRef()->m_cbSizeSig);
+    }
+#endif !IDE
+}
+
+unsigned MetaEmit::GetErrorEntryCount()
+{
+    return m_pBuilder->m_pErrorTable ? m_pBuilder->m_pErrorTable->GetEntryCount() : 0;
+}
+
 //============================================================================
 // Define a runtime member reference
 //============================================================================
@@ -2590,6 +2967,13 @@ mdMemberRef MetaEmit::DefineRTMemberRef
     Location *pErrorLocation
 )
 {
+    if (m_pTokenRequests && m_pTokenRequests->IsRecording())
+    {
+        return m_pTokenRequests->RecordRTMemberRef(rtHelper, pErrorTable, pErrorLocation);
+    }
+
+    MetaEmitLock lock(this);
+
     RuntimeMemberDescriptor * prtdesc = &(g_rgRTLangMembers[rtHelper]);
     mdMemberRef tkMemberRef;
     BCSYM_NamedRoot *pRuntimeMember;
@@ -2974,6 +3358,13 @@ mdMemberRef MetaEmit::DefineArrayCtorRef
     Location *pReferencingLocation
 )
 {
+    if (m_pTokenRequests && m_pTokenRequests->IsRecording())
+    {
+        return m_pTokenRequests->RecordArrayRef(ARRAY_Ctor, parr, parr->GetRank(), pReferencingLocation);
+    }
+
+    MetaEmitLock lock(this);
+
     mdMemberRef     tkMemberRef;
 
     unsigned        curDim;
@@ -3055,6 +3446,13 @@ mdMemberRef MetaEmit::DefineArrayLoadRef
     Location *pReferencingLocation
 )
 {
+    if (m_pTokenRequests && m_pTokenRequests->IsRecording())
+    {
+        return m_pTokenRequests->RecordArrayRef(ARRAY_LoadRef, parr, cDims, pReferencingLocation);
+    }
+
+    MetaEmitLock lock(this);
+
     unsigned        curDim;
     BCSYM         * psymType;
     ArrayValue    * pValue;
@@ -3137,6 +3535,13 @@ mdMemberRef MetaEmit::DefineArrayLoadAddrRef
     Location *pReferencingLocation
 )
 {
+    if (m_pTokenRequests && m_pTokenRequests->IsRecording())
+    {
+        return m_pTokenRequests->RecordArrayRef(ARRAY_LoadAddrRef, parr, cDims, pReferencingLocation);
+    }
+
+    MetaEmitLock lock(this);
+
     unsigned        curDim;
     BCSYM         * psymType;
     ArrayValue    * pValue;
@@ -3220,6 +3625,13 @@ mdMemberRef MetaEmit::DefineArrayStoreRef
     Location *pReferencingLocation
 )
 {
+    if (m_pTokenRequests && m_pTokenRequests->IsRecording())
+    {
+        return m_pTokenRequests->RecordArrayRef(ARRAY_StoreRef, parr, cDims, pReferencingLocation);
+    }
+
+    MetaEmitLock lock(this);
+
     unsigned        curDim;
     BCSYM         * psymType;
     ArrayValue    * pValue;
@@ -3307,6 +3719,13 @@ mdString MetaEmit::AddDataString
     size_t cchLen
 )
 {
+    if (m_pTokenRequests && m_pTokenRequests->IsRecording())
+    {
+        return m_pTokenRequests->RecordString(wsz, cchLen);
+    }
+
+    MetaEmitLock lock(this);
+
     mdString tkString;
 
     VSASSERT(cchLen >= 0, "Expected character count to be valid.");
@@ -3482,6 +3901,8 @@ mdSignature MetaEmit::ComputeSignatureToken(
     unsigned cbSigLocals
     )
 {
+    MetaEmitLock lock(this);
+
     mdSignature SignatureToken = mdTokenNil;
     m_pmdEmit->GetTokenFromSig(
         pSigLocals,
@@ -3490,6 +3911,23 @@ mdSignature MetaEmit::ComputeSignatureToken(
     return SignatureToken;
 }
 
+void MetaEmit::DefineSignatureToken
+(
+    COR_SIGNATURE *pSig,
+    unsigned cbSig,
+    _Out_ mdSignature *ptkSignature
+)
+{
+    if (m_pTokenRequests)
+    {
+        m_pTokenRequests->DeferSignature(pSig, cbSig, ptkSignature);
+    }
+    else
+    {
+        *ptkSignature = ComputeSignatureToken(pSig, cbSig);
+    }
+}
+
 //============================================================================
 // Emit the header and trailer information for this method.  Returns
 // the location to put the IL into.
@@ -3541,9 +3979,9 @@ BYTE *MetaEmit::EmitImage
             // LATER AnthonyL: Do we need to ensure that we don't emit duplicate
             //   : signatures?
             //
-            m_SignatureToken = ComputeSignatureToken(pSigLocals, cbSigLocals);
+            DefineSignatureToken(pSigLocals, cbSigLocals, &pHeader->LocalVarSigTok);
+            m_SignatureToken = pHeader->LocalVarSigTok;
             VSASSERT( m_SignatureToken != mdTokenNil, "Why is the signature token mdTokenNil?");
-            pHeader->LocalVarSigTok = m_SignatureToken;
         }
         else
         {
@@ -4706,6 +5144,8 @@ void MetaEmit::EncodeType
     unsigned stType                 // default is stNormal
 )
 {
+    MetaEmitLock lock(this);
+
     if (psymType)
     {
         if (psymType->IsEnum())
@@ -14,6 +14,7 @@ struct MetaMemberRef;
 struct ArrayKey;
 struct GenericMethodInstantiation;
 struct GenericTypeInstantiation;
+class TokenRequestLog;
 
 enum CorSigType
 {
@@ -351,6 +352,14 @@ public:
         unsigned cbSigLocals
         );
 
+    // Stores the token for the signature in *ptkSignature, which may happen
+    // only later when a token request log is set, see TokenRequestLog.
+    void DefineSignatureToken(
+        COR_SIGNATURE *pSig,
+        unsigned cbSig,
+        _Out_ mdSignature *ptkSignature
+        );
+
     mdSignature GetSignatureToken()
     {
         return m_SignatureToken;
@@ -429,6 +438,27 @@ public:
 
     Builder * GetBuilder() { return m_pBuilder; }
 
+    // Errors found while generating code with this instance are reported
+    // here.  This is the builder's table unless SetErrorTable was called.
+    ErrorTable * GetErrorTable()
+    {
+        return m_pErrorTableOverride ? m_pErrorTableOverride : m_pBuilder->GetErrorTable();
+    }
+
+    // Used when method bodies are compiled concurrently: each method gets
+    // its own temporary table, merged back once all of them are done.
+    void SetErrorTable(ErrorTable *pErrorTable)
+    {
+        m_pErrorTableOverride = pErrorTable;
+    }
+
+    // Used when method bodies are compiled concurrently: the tokens the
+    // method asks for go through this log, see TokenRequestLog.
+    void SetTokenRequestLog(TokenRequestLog *pTokenRequests)
+    {
+        m_pTokenRequests = pTokenRequests;
+    }
+
     CompilationCaches * GetCompilationCaches(){ return m_pCompilationCaches; }
 
     // Clears the list of exceptions so we can start a new method
@@ -449,7 +479,8 @@ public:
 
     static void ResolveTypeForwarders(_In_ void* pCompilerObj, _In_ void *pImportScope, mdTypeRef token, _Out_ IMetaDataAssemblyImport **ppNewScope, _Out_ const void ** ppbHashValue, _Out_ ULONG *pcbHashValue);
 private:
-    
+    friend class MetaEmitLock;
+
     static BCSYM * GetTokenFromHash(_In_ MetaDataFile *pMetaDataFile, mdToken token, _Out_ bool* pfTypeForward = NULL);
     
     //========================================================================
@@ -464,6 +495,11 @@ private:
     // Create ALink object in m_pALink to help emit if not already created
     void GetALinkHelper();
 
+    // Helpers for DefineMemberRefBySymbol, see MemberRefSignatureCache.
+    bool FindCachedMemberRef(BCSYM_NamedRoot *pnamed, BCSYM_GenericTypeBinding *pBinding, _Out_ mdMemberRef *ptkMemberRef);
+    void CacheMemberRef(BCSYM_NamedRoot *pnamed, BCSYM_GenericTypeBinding *pBinding, mdMemberRef tkMemberRef, unsigned cErrorsBefore);
+    unsigned GetErrorEntryCount();
+
     //========================================================================
     // Datamembers
     //========================================================================
@@ -519,6 +555,125 @@ private:
     bool m_fTinyHeader;
     unsigned m_oExceptionTable;
     bool m_bIsHighEntropyVA;
+
+    // See SetErrorTable.
+    ErrorTable *m_pErrorTableOverride;
+
+    // See SetTokenRequestLog.
+    TokenRequestLog *m_pTokenRequests;
+};
+
+// Serializes access to the project-wide metadata state (the token hash
+// table, the metadata emitter and the builder's error table) while method
+// bodies are being compiled concurrently, and does nothing otherwise.
+// Recursive, so entry points may call each other freely.
+class MetaEmitLock
+{
+public:
+    MetaEmitLock(_In_ Builder *pBuilder);
+    MetaEmitLock(_In_ MetaEmit *pMetaemit);
+    ~MetaEmitLock();
+
+private:
+    // Do not generate
+    MetaEmitLock(const MetaEmitLock&);
+    MetaEmitLock& operator=(const MetaEmitLock&);
+
+    Builder *m_pBuilder;            // NULL if the lock was not taken
+    ErrorTable *m_pOrigErrorTable;
+};
+
+// The tokens one method body asks for while the bodies of a container are
+// compiled concurrently.  Defining them as the workers go would number the
+// member refs, type refs and user strings in whatever order the workers got
+// there, so each body is generated twice:
+//
+//  - while recording, the requests are only logged and answered with
+//    placeholder tokens, and nothing shared is touched;
+//  - the logs are then replayed on one thread in method order, which defines
+//    the tokens exactly as a serial build would;
+//  - the second generation finds every token already defined.  Only the
+//    signatures of its locals and constants are new, so they are deferred
+//    and defined in method order once all bodies are done.
+class TokenRequestLog
+{
+public:
+    TokenRequestLog();
+
+    // Where strings and signatures are copied to.  Set by the worker that
+    // compiles the body, as the allocator is not shared between workers.
+    void SetAllocator(_In_ NorlsAllocator *pnra)
+    {
+        m_pnra = pnra;
+    }
+
+    bool IsRecording()
+    {
+        return m_fRecording;
+    }
+
+    // Ends the recording: from now on signatures are deferred instead.
+    void StopRecording()
+    {
+        m_fRecording = false;
+    }
+
+    mdTypeRef RecordTypeRef(BCSYM *ptyp, Location *pReferencingLocation);
+    mdMemberRef RecordMemberRef(BCSYM_NamedRoot *pnamed, BCSYM_GenericBinding *pBinding, Location *pReferencingLocation, ErrorTable *pAlternateErrorTable);
+    mdMemberRef RecordRTMemberRef(RuntimeMembers rtHelper, ErrorTable *pErrorTable, Location *pErrorLocation);
+    mdMemberRef RecordArrayRef(ARRAYINFO ArrayRef, BCSYM_ArrayType *parr, unsigned cDims, Location *pReferencingLocation);
+    mdString RecordString(_In_count_(cchLen) const WCHAR *wsz, size_t cchLen);
+
+    // Defines the recorded tokens, in the order they were asked for.
+    void Replay(_In_ MetaEmit *pMetaemit);
+
+    // Stores a placeholder in *ptkSignature until DefineSignatures.
+    void DeferSignature(COR_SIGNATURE *pSig, unsigned cbSig, _Out_ mdSignature *ptkSignature);
+
+    // Defines the deferred signatures and stores their tokens.
+    void DefineSignatures(_In_ MetaEmit *pMetaemit);
+
+    // Maps a placeholder handed out by DeferSignature to its token.
+    mdSignature GetSignatureToken(mdSignature tkPlaceholder);
+
+private:
+    enum RequestKind
+    {
+        Request_TypeRef,
+        Request_MemberRef,
+        Request_RTMemberRef,
+        Request_ArrayRef,
+        Request_String
+    };
+
+    struct Request
+    {
+        RequestKind m_kind;
+        BCSYM *m_psym;
+        BCSYM_GenericBinding *m_pBinding;
+        Location *m_pLocation;
+        ErrorTable *m_pErrorTable;
+        RuntimeMembers m_rtHelper;
+        ARRAYINFO m_ArrayRef;
+        unsigned m_cDims;
+        const WCHAR *m_wsz;
+        size_t m_cchLen;
+    };
+
+    struct DeferredSignature
+    {
+        COR_SIGNATURE *m_pSig;
+        unsigned m_cbSig;
+        mdSignature *m_ptkSignature;
+        mdSignature m_tkSignature;
+    };
+
+    Request &AddRequest(RequestKind kind);
+
+    NorlsAllocator *m_pnra;
+    bool m_fRecording;
+    DynamicArray<Request> m_daRequests;
+    DynamicArray<DeferredSignature> m_daSignatures;
 };
 
 
@@ -494,6 +494,7 @@ Builder::Builder
     :m_pCompiler(pCompiler),
     m_pCompilerProject(pProject),
     m_nra(NORLSLOC),
+    m_fConcurrentCodeGen(false),
     m_ProjectHashTable(&m_nra),
     m_pPDBForwardProcCache(NULL),
     m_pModulesCache(NULL)
@@ -602,6 +603,17 @@ void Builder::ClearCaches()
     m_ProjectHashTable.Clear();
     m_NoPiaTypeDefToTypeRefMap.Clear();
 
+#if !IDE
+#if DEBUG
+    if (VSFSWITCH(fCompCaches))
+    {
+        m_MemberRefSignatureCache.DumpStats();
+    }
+#endif DEBUG
+
+    m_MemberRefSignatureCache.Clear();
+#endif !IDE
+
     // clear out the table which caches tokens for the runtime members
     for (i = 1; i < (unsigned)MaxRuntimeMember; i++)
     {
@@ -615,52 +627,299 @@ void Builder::ClearCaches()
     }
 }
 
-#if IDE 
+#if !IDE
 
-HRESULT Builder::GetSymbolHashKey(BCSYM_NamedRoot *pnamed, SymbolHash *pHash)
+//****************************************************************************
+// MemberRefSignatureCache
+//****************************************************************************
+
+MemberRefSignatureCache::MemberRefSignatureCache() :
+    m_nra(NORLSLOC),
+    m_cbSize(0),
+    m_cEntries(0),
+    m_cHits(0),
+    m_cMisses(0)
 {
-    AssertIfNull(pHash);
-    VerifyOutPtr(pHash);
+}
 
-    if (pnamed)
+//============================================================================
+// Flattens a member and the binding of its type into the symbols they are
+// built from.
+//============================================================================
+
+bool MemberRefSignatureCache::BuildKey
+(
+    BCSYM_NamedRoot *pMember,
+    BCSYM_GenericTypeBinding *pBinding,
+    _Out_ Key *pKey
+)
+{
+    pKey->m_pMember = pMember;
+    pKey->m_cParts = 0;
+
+    return AppendType(pBinding, pKey);
+}
+
+bool MemberRefSignatureCache::AppendType
+(
+    BCSYM *pType,
+    _Inout_ Key *pKey
+)
+{
+    // A type appends at most three parts before its components.
+    if (pKey->m_cParts + 3 > Key::MaxParts)
     {
-        int nValsToHash = 1;
-        const BYTE *rgpbToBeHashed[2] = { NULL, NULL };
-        DWORD rgcbToBeHashed[2] = { 0, 0 };
+        return false;
+    }
 
-        StringBuffer sbHashKey;
-        pnamed->GetQualifiedEmittedName(&sbHashKey);
+    pType = pType->DigThroughNamedType();
 
-        rgpbToBeHashed[0] = reinterpret_cast<const BYTE *>(sbHashKey.GetString());
-        rgcbToBeHashed[0] = (sbHashKey.GetStringLength() * sizeof(WCHAR));
+    if (pType == NULL)
+    {
+        pKey->m_rgParts[pKey->m_cParts++] = KeyPart_Null;
+        return true;
+    }
+    else if (pType->IsArrayType())
+    {
+        pKey->m_rgParts[pKey->m_cParts++] = KeyPart_Array;
+        pKey->m_rgParts[pKey->m_cParts++] = pType->PArrayType()->GetRank();
+        return AppendType(pType->PArrayType()->GetRoot(), pKey);
+    }
+    else if (pType->IsPointerType())
+    {
+        pKey->m_rgParts[pKey->m_cParts++] = KeyPart_Pointer;
+        return AppendType(pType->PPointerType()->GetRoot(), pKey);
+    }
+    else if (pType->IsGenericBinding())
+    {
+        BCSYM_GenericBinding *pGenericBinding = pType->PGenericBinding();
+        unsigned ArgumentCount = pGenericBinding->GetArgumentCount();
 
-        // Note: sbMethod needs to be declared in this scope since its contents may
-        //       be placed in rgpbToBeHashed, which is used in the ComputeCRC64 call
-        StringBuffer sbMethod;
+        pKey->m_rgParts[pKey->m_cParts++] = KeyPart_Binding;
+        pKey->m_rgParts[pKey->m_cParts++] = (UINT_PTR)pGenericBinding->GetGeneric();
+        pKey->m_rgParts[pKey->m_cParts++] = ArgumentCount;
 
-        if (pnamed->IsProc())
+        for (unsigned i = 0; i < ArgumentCount; i++)
         {
-            pnamed->GetBasicRep(m_pCompiler,NULL,&sbMethod);
-            if (sbMethod.GetStringLength() > 0)
+            if (!AppendType(pGenericBinding->GetArgument(i), pKey))
             {
-                rgpbToBeHashed[1] = reinterpret_cast<const BYTE *>(sbMethod.GetString());
-                rgcbToBeHashed[1] = (sbMethod.GetStringLength() * sizeof(WCHAR));
-                nValsToHash++;
+                return false;
             }
         }
-        else if (pnamed->IsStaticLocalBackingField() && pnamed->PStaticLocalBackingField()->GetProcDefiningStatic())
+
+        return AppendType(pGenericBinding->GetParentBinding(), pKey);
+    }
+
+    pKey->m_rgParts[pKey->m_cParts++] = (UINT_PTR)pType;
+    return true;
+}
+
+const MemberRefSignatureCache::Entry *MemberRefSignatureCache::Find(const Key &key)
+{
+    Entry *pEntry = NULL;
+
+    if (m_Entries.GetValue(key.m_pMember, &pEntry))
+    {
+        for (; pEntry; pEntry = pEntry->m_pNext)
         {
-            BCSYM_StaticLocalBackingField *pStaticLocalBackingField = pnamed->PStaticLocalBackingField();
-            pStaticLocalBackingField->GetProcDefiningStatic()->GetBasicRep(m_pCompiler, NULL, &sbMethod);
-            if (sbMethod.GetStringLength() > 0)
+            if (pEntry->m_cParts == key.m_cParts &&
+                memcmp(pEntry->m_rgParts, key.m_rgParts, key.m_cParts * sizeof(UINT_PTR)) == 0)
             {
-                rgpbToBeHashed[1] = reinterpret_cast<const BYTE *>(sbMethod.GetString());
-                rgcbToBeHashed[1] = (sbMethod.GetStringLength() * sizeof(WCHAR));
-                nValsToHash++;
+                m_cHits++;
+                return pEntry;
             }
         }
+    }
 
-        *pHash = ComputeCRC64(rgpbToBeHashed, rgcbToBeHashed, nValsToHash);
+    m_cMisses++;
+    return NULL;
+}
+
+void MemberRefSignatureCache::Add
+(
+    const Key &key,
+    mdMemberRef tkMemberRef,
+    _In_count_(cbSignature) const COR_SIGNATURE *pSignature,
+    unsigned long cbSignature
+)
+{
+    size_t cbEntry = sizeof(Entry) + key.m_cParts * sizeof(UINT_PTR) + cbSignature;
+
+    if (m_cbSize + cbEntry > MaxSize)
+    {
+        return;
+    }
+
+    Entry *pFirst = NULL;
+    m_Entries.GetValue(key.m_pMember, &pFirst);
+
+    Entry *pEntry = (Entry *)m_nra.Alloc(sizeof(Entry));
+
+    pEntry->m_pNext = pFirst;
+    pEntry->m_cParts = key.m_cParts;
+    pEntry->m_rgParts = (UINT_PTR *)m_nra.Alloc(key.m_cParts * sizeof(UINT_PTR));
+    memcpy(pEntry->m_rgParts, key.m_rgParts, key.m_cParts * sizeof(UINT_PTR));
+    pEntry->m_tkMemberRef = tkMemberRef;
+    pEntry->m_cbSignature = cbSignature;
+    pEntry->m_pSignature = (COR_SIGNATURE *)m_nra.Alloc(cbSignature);
+    memcpy(pEntry->m_pSignature, pSignature, cbSignature);
+
+    m_Entries.SetValue(key.m_pMember, pEntry);
+
+    m_cbSize += cbEntry;
+    m_cEntries++;
+}
+
+void MemberRefSignatureCache::Clear()
+{
+    m_Entries.Clear();
+    m_nra.FreeHeap();
+    m_cbSize = 0;
+    m_cEntries = 0;
+}
+
+#if DEBUG
+void MemberRefSignatureCache::DumpStats()
+{
+    DebPrintf("MemberRef hits=%5u miss=%5u entries=%5u bytes=%8Iu\n", m_cHits, m_cMisses, m_cEntries, m_cbSize);
+}
+#endif DEBUG
+
+#endif !IDE
+
+#if IDE 
+
+//============================================================================
+// The symbol hash key identifies a symbol across decompilations without
+// building its qualified name and signature as strings: it is a CRC64 over
+// the pointers of the interned emitted names of the symbol and its
+// containers, and for procedures over the structure of the signature.
+// STRINGs are interned for the lifetime of the compiler, so equal names
+// always give equal pointers.
+//============================================================================
+
+static void UpdateSymbolHashKeyWithName(
+    CRC64 &crc,
+    BCSYM_NamedRoot *pnamed)
+{
+    for (; pnamed; pnamed = pnamed->GetParent())
+    {
+        STRING *pstrName = pnamed->GetEmittedName() ? pnamed->GetEmittedName() : pnamed->GetName();
+        crc.Update(&pstrName);
+    }
+}
+
+static void UpdateSymbolHashKeyWithType(
+    CRC64 &crc,
+    BCSYM *pType)
+{
+    pType = pType->DigThroughNamedType();
+
+    if (pType == NULL)
+    {
+        crc.Update((BYTE)0);
+    }
+    else if (pType->IsPointerType())
+    {
+        crc.Update((BYTE)'&');
+        UpdateSymbolHashKeyWithType(crc, pType->PPointerType()->GetRoot());
+    }
+    else if (pType->IsArrayType())
+    {
+        unsigned Rank = pType->PArrayType()->GetRank();
+
+        crc.Update((BYTE)'[');
+        crc.Update(&Rank);
+        UpdateSymbolHashKeyWithType(crc, pType->PArrayType()->GetRoot());
+    }
+    else if (pType->IsGenericBinding())
+    {
+        BCSYM_GenericBinding *pBinding = pType->PGenericBinding();
+        unsigned ArgumentCount = pBinding->GetArgumentCount();
+
+        crc.Update((BYTE)'<');
+        UpdateSymbolHashKeyWithName(crc, pBinding->GetGeneric());
+        crc.Update(&ArgumentCount);
+
+        for (unsigned i = 0; i < ArgumentCount; i++)
+        {
+            UpdateSymbolHashKeyWithType(crc, pBinding->GetArgument(i));
+        }
+
+        if (pBinding->GetParentBinding())
+        {
+            UpdateSymbolHashKeyWithType(crc, pBinding->GetParentBinding());
+        }
+    }
+    else if (pType->IsGenericParam())
+    {
+        unsigned Position = pType->PGenericParam()->GetPosition();
+
+        crc.Update((BYTE)(pType->PGenericParam()->IsGenericMethodParam() ? 'M' : 'T'));
+        crc.Update(&Position);
+    }
+    else if (pType->IsNamedRoot())
+    {
+        crc.Update((BYTE)'N');
+        UpdateSymbolHashKeyWithName(crc, pType->PNamedRoot());
+    }
+    else
+    {
+        Vtypes vtype = pType->GetVtype();
+
+        crc.Update((BYTE)'?');
+        crc.Update(&vtype);
+    }
+}
+
+static void UpdateSymbolHashKeyWithSignature(
+    CRC64 &crc,
+    BCSYM_Proc *pProc)
+{
+    unsigned GenericParamCount = pProc->GetGenericParamCount();
+
+    crc.Update((BYTE)'(');
+    crc.Update(&GenericParamCount);
+
+    for (BCSYM_Param *pParam = pProc->GetFirstParam(); pParam; pParam = pParam->GetNext())
+    {
+        UpdateSymbolHashKeyWithType(crc, pParam->GetType());
+    }
+
+    crc.Update((BYTE)')');
+    UpdateSymbolHashKeyWithType(crc, pProc->GetType());
+}
+
+HRESULT Builder::GetSymbolHashKey(BCSYM_NamedRoot *pnamed, SymbolHash *pHash)
+{
+    AssertIfNull(pHash);
+    VerifyOutPtr(pHash);
+
+    if (pnamed)
+    {
+        if (!pnamed->HasSymbolHashKey())
+        {
+            CRC64 crc;
+
+            UpdateSymbolHashKeyWithName(crc, pnamed);
+
+            if (pnamed->IsProc())
+            {
+                UpdateSymbolHashKeyWithSignature(crc, pnamed->PProc());
+            }
+            else if (pnamed->IsStaticLocalBackingField() && pnamed->PStaticLocalBackingField()->GetProcDefiningStatic())
+            {
+                BCSYM_Proc *pProcDefiningStatic = pnamed->PStaticLocalBackingField()->GetProcDefiningStatic();
+
+                crc.Update((BYTE)'$');
+                UpdateSymbolHashKeyWithName(crc, pProcDefiningStatic);
+                UpdateSymbolHashKeyWithSignature(crc, pProcDefiningStatic);
+            }
+
+            pnamed->SetSymbolHashKey(crc);
+        }
+
+        *pHash = pnamed->GetSymbolHashKey();
     }
 
     return S_OK;
@@ -832,6 +1091,8 @@ mdToken Builder::GetToken(BCSYM_NamedRoot * pNamed, bool remap)
 {
     VSASSERT(pNamed,"Wrong Input");
 
+    MetaEmitLock lock(this);
+
     mdToken tk = mdTokenNil;
     if (IsPEBuilder())
     {
@@ -951,6 +1212,7 @@ mdToken Builder::GetToken(BCSYM_Param *pParam, BCSYM_Proc *pContext)
 {
     AssertIfNull(pParam);
     AssertIfNull(pContext);
+    MetaEmitLock lock(this);
     mdToken tk = mdTokenNil;
     mdToken *cachedEmitToken = NULL;
     if (pContext->GetContainingProject() != m_pCompilerProject)
@@ -1016,6 +1278,8 @@ in the project hash table, using the symbol pointer as a key.
 ******************************************************************************/
 void Builder::SetToken(BCSYM_NamedRoot *pNamed, mdToken tk)
 {
+    MetaEmitLock lock(this);
+
     if (pNamed->GetContainingProject() == m_pCompilerProject)
     {
 #if !IDE 
@@ -1050,6 +1314,7 @@ void Builder::SetToken(BCSYM_Param *pParam, BCSYM_Proc *pContext, mdToken tk)
 {
     AssertIfNull(pParam);
     AssertIfNull(pContext);
+    MetaEmitLock lock(this);
     if (pContext->GetContainingProject() == m_pCompilerProject)
     {
 #if !IDE 
@@ -2519,6 +2784,17 @@ void PEBuilder::Destroy()
 
     m_Transients.Clear();
 
+#if !IDE
+    for (unsigned iWorker = 0; iWorker < m_cConcurrentDebugSpace; iWorker++)
+    {
+        delete m_rgpnraConcurrentDebugSpace[iWorker];
+    }
+
+    delete [] m_rgpnraConcurrentDebugSpace;
+    m_rgpnraConcurrentDebugSpace = NULL;
+    m_cConcurrentDebugSpace = 0;
+#endif !IDE
+
     m_State = BS_Empty;
 
     Builder::Destroy();
@@ -5127,6 +5403,8 @@ ILTree::ILNode *PEBuilder::GenerateBoundTreeForProc
     CallGraph *pCallTracking
 )
 {
+    TIMEBLOCKDETAIL(TIME_MethodBoundTree, pProc->GetName());
+
     SourceFile * pSourceFile = pProc->GetSourceFile();
     ErrorTable * pErrorTable = pSourceFile->GetCurrentErrorTable();
 
@@ -5305,6 +5583,16 @@ bool PEBuilder::GenerateCodeForContainer
 
     if (!pInfo->m_hasErrors && !m_pCompilerProject->OutputIsNone())
     {
+#if !IDE
+        WorkStealingPool *pWorkerPool = m_pCompiler->GetWorkerPool();
+
+        if (pWorkerPool && pCodeGenInfos->Count() > 1)
+        {
+            GenerateCodeForContainerConcurrently(pInfo, pWorkerPool, pCodeGenInfos);
+            return fAborted;
+        }
+#endif !IDE
+
         BCSYM_Proc * pProc = NULL;
         ILTree::ILNode * pTree = NULL;
         NorlsAllocator * pNraSymbolStorage = NULL;
@@ -5351,6 +5639,8 @@ bool PEBuilder::GenerateCodeForContainer
 
                 VSASSERT(pMetaemitHelper->IsPrivateMembersEmpty(), "MetaEmit helper contains old data.");
 
+                TIMEBLOCKDETAIL(TIME_MethodCodeGen, pProc->GetName());
+
                 CodeGenerator codegen(m_pCompiler, &nraCodeGen, pNraSymbolStorage, pMetaemitHelper, NULL);
                 BYTE *pbImage;
                 unsigned cbImage;
@@ -5407,6 +5697,312 @@ Abort:
     return fAborted;
 }
 
+#if !IDE
+
+//============================================================================
+// Concurrent code generation.
+//
+// Generating the IL for a method body only depends on its bound tree, so
+// the bodies of a container are generated on the worker pool.  Each method
+// gets its own error table and each worker its own MetaEmit and allocators.
+//
+// Tokens are numbered in the order they are first defined, so the workers
+// must not define them as they go.  Each body is first generated only to
+// record the tokens it asks for, the requests are then defined on this
+// thread in method order, and the bodies are generated again, now finding
+// their tokens already defined (see TokenRequestLog).  Everything else that
+// is shared - the project's token tables, the metadata emitter and the
+// builder's error table - is serialized by MetaEmitLock while
+// Builder::m_fConcurrentCodeGen is set.
+//
+// The images are built in scratch memory and copied into the PE afterwards,
+// in the original order, so the IL layout does not depend on scheduling.
+//============================================================================
+
+// The result of generating one method body.
+struct ConcurrentMethodBody
+{
+    CodeGenInfo *m_pCodeGenInfo;
+    ErrorTable *m_pErrorTable;
+    TokenRequestLog *m_pTokenRequests;
+    BYTE *m_pbImage;
+    unsigned m_cbImage;
+    mdSignature m_SignatureToken;
+};
+
+// State owned by a single worker, so it is never shared.
+struct ConcurrentCodeGenWorker
+{
+    MetaEmit *m_pMetaemit;
+    NorlsAllocator *m_pnraDebugSpace;
+    NorlsAllocator *m_pnraImages;
+    NorlsAllocator *m_pnraRecording;
+};
+
+struct ConcurrentCodeGenBatch
+{
+    Compiler *m_pCompiler;
+    ConcurrentMethodBody *m_rgMethodBodies;
+    ConcurrentCodeGenWorker *m_rgWorkers;
+};
+
+static void RecordTokenRequestsWorkItem
+(
+    void *pvContext,
+    unsigned iItem,
+    unsigned iWorker
+)
+{
+    ConcurrentCodeGenBatch *pBatch = (ConcurrentCodeGenBatch *)pvContext;
+    ConcurrentMethodBody *pMethodBody = &pBatch->m_rgMethodBodies[iItem];
+    ConcurrentCodeGenWorker *pWorker = &pBatch->m_rgWorkers[iWorker];
+    MetaEmit *pMetaemit = pWorker->m_pMetaemit;
+
+    // The errors are reported when the body is generated again.
+    ErrorTable errorsDiscarded(*pMethodBody->m_pErrorTable);
+
+    pMethodBody->m_pTokenRequests->SetAllocator(pWorker->m_pnraRecording);
+    pMetaemit->SetErrorTable(&errorsDiscarded);
+    pMetaemit->SetTokenRequestLog(pMethodBody->m_pTokenRequests);
+
+    {
+        NewMetaEmitSignature signature(pMetaemit);
+
+        VSASSERT(pMetaemit->IsPrivateMembersEmpty(), "MetaEmit helper contains old data.");
+
+        // The requests may point into what the code generator allocates, so
+        // that has to stay around until they are replayed.
+        CodeGenerator codegen(pBatch->m_pCompiler, pWorker->m_pnraRecording, pWorker->m_pnraRecording, pMetaemit, NULL);
+
+        codegen.GenerateMethod(pMethodBody->m_pCodeGenInfo->m_pBoundTree);
+    }
+
+    pMetaemit->ResetSignatureToken();
+    pMetaemit->ClearExceptions();
+
+    pMetaemit->SetTokenRequestLog(NULL);
+    pMetaemit->SetErrorTable(NULL);
+}
+
+static void GenerateMethodBodyWorkItem
+(
+    void *pvContext,
+    unsigned iItem,
+    unsigned iWorker
+)
+{
+    ConcurrentCodeGenBatch *pBatch = (ConcurrentCodeGenBatch *)pvContext;
+    ConcurrentMethodBody *pMethodBody = &pBatch->m_rgMethodBodies[iItem];
+    ConcurrentCodeGenWorker *pWorker = &pBatch->m_rgWorkers[iWorker];
+    MetaEmit *pMetaemit = pWorker->m_pMetaemit;
+
+    TIMEBLOCKDETAIL(TIME_MethodCodeGen, pMethodBody->m_pCodeGenInfo->m_pProc->GetName());
+
+    NorlsAllocator nraCodeGen(NORLSLOC);
+
+    pMethodBody->m_pTokenRequests->SetAllocator(pWorker->m_pnraImages);
+    pMetaemit->SetErrorTable(pMethodBody->m_pErrorTable);
+    pMetaemit->SetTokenRequestLog(pMethodBody->m_pTokenRequests);
+
+    {
+        // Start a new signature for method
+        NewMetaEmitSignature signature(pMetaemit);
+
+        VSASSERT(pMetaemit->IsPrivateMembersEmpty(), "MetaEmit helper contains old data.");
+
+        CodeGenerator codegen(pBatch->m_pCompiler, &nraCodeGen, pWorker->m_pnraDebugSpace, pMetaemit, NULL);
+
+        codegen.GenerateMethod(pMethodBody->m_pCodeGenInfo->m_pBoundTree);
+
+        pMethodBody->m_cbImage = codegen.GetImageSize();
+        pMethodBody->m_pbImage = (BYTE *)pWorker->m_pnraImages->Alloc(pMethodBody->m_cbImage);
+
+        codegen.EmitImage(pMethodBody->m_pbImage);
+        pMethodBody->m_SignatureToken = pMetaemit->GetSignatureToken();
+    }
+
+    pMetaemit->ResetSignatureToken();
+
+    // Clear the exceptions table for next method
+    pMetaemit->ClearExceptions();
+
+    pMetaemit->SetTokenRequestLog(NULL);
+    pMetaemit->SetErrorTable(NULL);
+}
+
+NorlsAllocator *PEBuilder::GetConcurrentDebugSpace
+(
+    unsigned iWorker
+)
+{
+    if (iWorker >= m_cConcurrentDebugSpace)
+    {
+        unsigned cDebugSpace = m_pCompiler->GetWorkerPool()->GetThreadCount();
+        NorlsAllocator **rgpnraDebugSpace = new (zeromemory) NorlsAllocator *[cDebugSpace];
+
+        VSASSERT(iWorker < cDebugSpace, "Worker out of range.");
+
+        for (unsigned iDebugSpace = 0; iDebugSpace < m_cConcurrentDebugSpace; iDebugSpace++)
+        {
+            rgpnraDebugSpace[iDebugSpace] = m_rgpnraConcurrentDebugSpace[iDebugSpace];
+        }
+
+        for (unsigned iDebugSpace = m_cConcurrentDebugSpace; iDebugSpace < cDebugSpace; iDebugSpace++)
+        {
+            rgpnraDebugSpace[iDebugSpace] = new NorlsAllocator(NORLSLOC);
+        }
+
+        delete [] m_rgpnraConcurrentDebugSpace;
+        m_rgpnraConcurrentDebugSpace = rgpnraDebugSpace;
+        m_cConcurrentDebugSpace = cDebugSpace;
+    }
+
+    return m_rgpnraConcurrentDebugSpace[iWorker];
+}
+
+void PEBuilder::GenerateCodeForContainerConcurrently
+(
+    _In_ PEInfo * pInfo,
+    _In_ WorkStealingPool *pWorkerPool,
+    _In_ DynamicArray<CodeGenInfo>* pCodeGenInfos
+)
+{
+    unsigned cWorkers = pWorkerPool->GetThreadCount();
+    DynamicArray<ConcurrentMethodBody> daMethodBodies;
+
+    for (ULONG index = 0; index < pCodeGenInfos->Count(); ++index)
+    {
+        CodeGenInfo *pCodeGenInfo = &pCodeGenInfos->Element(index);
+
+        // If the current procedure is a partial method declaration, don't emit
+        // any code for it.
+        if (pCodeGenInfo->m_pProc->IsPartialMethodDeclaration())
+        {
+            continue;
+        }
+
+        ConcurrentMethodBody &methodBody = daMethodBodies.Add();
+
+        methodBody.m_pCodeGenInfo = pCodeGenInfo;
+        methodBody.m_pErrorTable = new ErrorTable(*pCodeGenInfo->m_pSourceFile->GetCurrentErrorTable());
+        methodBody.m_pTokenRequests = new TokenRequestLog();
+        methodBody.m_pbImage = NULL;
+        methodBody.m_cbImage = 0;
+        methodBody.m_SignatureToken = mdTokenNil;
+    }
+
+    ConcurrentCodeGenWorker *rgWorkers = new (zeromemory) ConcurrentCodeGenWorker[cWorkers];
+    HRESULT hr = S_OK;
+
+    for (unsigned iWorker = 0; iWorker < cWorkers; iWorker++)
+    {
+        rgWorkers[iWorker].m_pMetaemit = new MetaEmit(this,
+                                                      m_pCompilerProject,
+                                                      pInfo->m_pALink,
+                                                      pInfo->m_pALink3,
+                                                      pInfo->m_mdAssemblyOrModule,
+                                                      pInfo->m_mdFileForModule);
+        rgWorkers[iWorker].m_pnraDebugSpace = GetConcurrentDebugSpace(iWorker);
+        rgWorkers[iWorker].m_pnraImages = new NorlsAllocator(NORLSLOC);
+        rgWorkers[iWorker].m_pnraRecording = new NorlsAllocator(NORLSLOC);
+    }
+
+    ConcurrentCodeGenBatch batch;
+
+    batch.m_pCompiler = m_pCompiler;
+    batch.m_rgMethodBodies = daMethodBodies.Array();
+    batch.m_rgWorkers = rgWorkers;
+
+    m_fConcurrentCodeGen = true;
+    hr = pWorkerPool->Run(daMethodBodies.Count(), RecordTokenRequestsWorkItem, &batch);
+    m_fConcurrentCodeGen = false;
+
+    if (SUCCEEDED(hr))
+    {
+        // Define the tokens in the order a serial build would have.
+        for (ULONG iMethodBody = 0; iMethodBody < daMethodBodies.Count(); iMethodBody++)
+        {
+            ConcurrentMethodBody *pMethodBody = &daMethodBodies.Element(iMethodBody);
+            BackupValue<ErrorTable*> backupErrorTable(&m_pErrorTable);
+
+            m_pErrorTable = pMethodBody->m_pErrorTable;
+
+            pMethodBody->m_pTokenRequests->StopRecording();
+            pMethodBody->m_pTokenRequests->Replay(rgWorkers[0].m_pMetaemit);
+
+            backupErrorTable.Restore();
+        }
+
+        m_fConcurrentCodeGen = true;
+        hr = pWorkerPool->Run(daMethodBodies.Count(), GenerateMethodBodyWorkItem, &batch);
+        m_fConcurrentCodeGen = false;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // Only the signatures of locals and constants are new by now.
+        for (ULONG iMethodBody = 0; iMethodBody < daMethodBodies.Count(); iMethodBody++)
+        {
+            ConcurrentMethodBody *pMethodBody = &daMethodBodies.Element(iMethodBody);
+
+            pMethodBody->m_pTokenRequests->DefineSignatures(rgWorkers[0].m_pMetaemit);
+
+            if (!IsNilToken(pMethodBody->m_SignatureToken))
+            {
+                pMethodBody->m_SignatureToken = pMethodBody->m_pTokenRequests->GetSignatureToken(pMethodBody->m_SignatureToken);
+            }
+        }
+    }
+
+    // Place the images and report the errors in the original order.
+    for (ULONG iMethodBody = 0; iMethodBody < daMethodBodies.Count(); iMethodBody++)
+    {
+        ConcurrentMethodBody *pMethodBody = &daMethodBodies.Element(iMethodBody);
+        BCSYM_Proc *pProc = pMethodBody->m_pCodeGenInfo->m_pProc;
+
+        if (SUCCEEDED(hr))
+        {
+            BYTE *pbImage = AllocatePEStorageForImage(pInfo, pProc, pMethodBody->m_cbImage);
+
+            memcpy(pbImage, pMethodBody->m_pbImage, pMethodBody->m_cbImage);
+
+            if (pProc->IsMethodImpl())
+            {
+                pProc->PMethodImpl()->SetSignatureToken(pMethodBody->m_SignatureToken);
+            }
+            else if (pProc->IsSyntheticMethod())
+            {
+                pProc->PSyntheticMethod()->SetSignatureToken(pMethodBody->m_SignatureToken);
+
+                if (pProc->GetSourceFile() &&
+                    (pProc->PSyntheticMethod()->IsLambda() ||
+                    pProc->PSyntheticMethod()->IsResumable()))
+                {
+                    m_SyntheticMethods[pProc->GetSourceFile()].push_back(pProc->PSyntheticMethod());
+                }
+            }
+
+            pMethodBody->m_pCodeGenInfo->m_pSourceFile->GetCurrentErrorTable()->MergeTemporaryTable(pMethodBody->m_pErrorTable);
+        }
+
+        delete pMethodBody->m_pErrorTable;
+        delete pMethodBody->m_pTokenRequests;
+    }
+
+    for (unsigned iWorker = 0; iWorker < cWorkers; iWorker++)
+    {
+        delete rgWorkers[iWorker].m_pMetaemit;
+        delete rgWorkers[iWorker].m_pnraImages;
+        delete rgWorkers[iWorker].m_pnraRecording;
+    }
+
+    delete [] rgWorkers;
+
+    IfFailThrow(hr);
+}
+
+#endif !IDE
+
 bool PEBuilder::ProcessTransientSymbols
 (
     BCSYM_Container * pContainer,
@@ -106,6 +106,115 @@ typedef RedBlackTreeT<
     ConsolidatedModulesNode,
     ConsolidatedModulesNodeOperations> ConsolidatedModulesTree;
 
+#if !IDE
+
+//=============================================================================
+// MemberRefSignatureCache
+//
+// MetaEmit::DefineMemberRefBySymbol encodes the signature of the referenced
+// member every time it is called, only to find the MemberRef it defined the
+// first time in the project hash table.  The members of common generic
+// instantiations are referenced thousands of times in a project, so the
+// encoded signature and its MemberRef are remembered here, keyed by the
+// member and the structure of the generic type binding it was encoded for.
+//
+// Bindings, arrays and pointer types may live in the bound tree allocator of
+// a method, so the key stores the symbols they are built from rather than the
+// binding itself.  Bindings too deep for Key::MaxParts are not cached.
+//
+// The cache is cleared with the other caches of the Builder and stops growing
+// once its entries use MaxSize bytes.  It is not used by the IDE, where the
+// symbols it refers to can be decompiled while the Builder lives on.
+//=============================================================================
+class MemberRefSignatureCache
+{
+public:
+    static const size_t MaxSize = 8 * 1024 * 1024;
+
+    struct Key
+    {
+        static const unsigned MaxParts = 32;
+
+        BCSYM_NamedRoot *m_pMember;
+        unsigned m_cParts;
+        UINT_PTR m_rgParts[MaxParts];
+    };
+
+    struct Entry
+    {
+        Entry *m_pNext;                 // next entry for the same member
+        unsigned m_cParts;
+        UINT_PTR *m_rgParts;
+        mdMemberRef m_tkMemberRef;
+        unsigned long m_cbSignature;
+        COR_SIGNATURE *m_pSignature;    // the signature of the MemberRef
+    };
+
+    MemberRefSignatureCache();
+
+    // Returns false if the binding cannot be cached.
+    static bool BuildKey(
+        BCSYM_NamedRoot *pMember,
+        BCSYM_GenericTypeBinding *pBinding,
+        _Out_ Key *pKey);
+
+    const Entry *Find(const Key &key);
+
+    void Add(
+        const Key &key,
+        mdMemberRef tkMemberRef,
+        _In_count_(cbSignature) const COR_SIGNATURE *pSignature,
+        unsigned long cbSignature);
+
+    void Clear();
+
+    unsigned GetHitCount()
+    {
+        return m_cHits;
+    }
+
+    unsigned GetMissCount()
+    {
+        return m_cMisses;
+    }
+
+    size_t GetSize()
+    {
+        return m_cbSize;
+    }
+
+#if DEBUG
+    void DumpStats();
+#endif DEBUG
+
+private:
+    // Do not generate
+    MemberRefSignatureCache(const MemberRefSignatureCache&);
+    MemberRefSignatureCache& operator=(const MemberRefSignatureCache&);
+
+    // The parts that start a type in a key.  Any other part is a symbol.
+    enum KeyPart
+    {
+        KeyPart_Null,
+        KeyPart_Array,              // followed by the rank and the element type
+        KeyPart_Pointer,            // followed by the pointed to type
+        KeyPart_Binding             // followed by the generic, the argument count, the arguments and the parent binding
+    };
+
+    static bool AppendType(
+        BCSYM *pType,
+        _Inout_ Key *pKey);
+
+    NorlsAllocator m_nra;
+    DynamicHashTable<BCSYM_NamedRoot *, Entry *> m_Entries;
+    size_t m_cbSize;
+    unsigned m_cEntries;
+    unsigned m_cHits;
+    unsigned m_cMisses;
+};
+
+#endif !IDE
+
 //Factor out all data and code from PEBuilder so it will be shared by our
 //EnCBuilder.
 class Builder
@@ -154,11 +263,18 @@ public:
         return m_pErrorTable;
     }
 
+    // True while method bodies are being compiled on the compiler's worker pool.
+    bool IsConcurrentCodeGen()
+    {
+        return m_fConcurrentCodeGen;
+    }
+
 protected:
     Builder(Compiler *pCompiler, CompilerProject *pProject);
     ~Builder() {}
 
     friend class MetaEmit;
+    friend class MetaEmitLock;
 
     // Set up the cache for a file.
     void SetSourceFile(SourceFile *pSourceFile) { m_pSourceFile = pSourceFile; }
@@ -209,6 +325,11 @@ protected:
     // Table to put compile-time errors into.
     ErrorTable *m_pErrorTable;
 
+    // Set while method bodies are compiled concurrently.  All access to the
+    // state below then goes through m_csMetadata, see MetaEmitLock.
+    bool m_fConcurrentCodeGen;
+    SafeCriticalSection m_csMetadata;
+
     //
     // Project-wide compilation information.
     //
@@ -237,6 +358,11 @@ protected:
     mdTypeRef m_rgRTTypRef[MaxRuntimeClass];
     mdMemberRef m_rgRTMemRef[MaxRuntimeMember];
 
+#if !IDE
+    // The MemberRefs of members of other projects and of generic instantiations.
+    MemberRefSignatureCache m_MemberRefSignatureCache;
+#endif !IDE
+
     //
     // Per-file compilation information
     //
@@ -464,6 +590,18 @@ private:
                                   _Inout_ MetaEmit *pMetaemitHelper,
                                   _In_ DynamicArray<CodeGenInfo>* pCodeGenInfos);
 
+#if !IDE
+    // Generates the method bodies on the compiler's worker pool and then
+    // copies them into the PE in the order GenerateCodeForContainer would.
+    void GenerateCodeForContainerConcurrently(_In_ PEInfo * pInfo,
+                                              _In_ WorkStealingPool *pWorkerPool,
+                                              _In_ DynamicArray<CodeGenInfo>* pCodeGenInfos);
+
+    // Returns the allocator for the debug information of the method bodies
+    // compiled by worker iWorker.
+    NorlsAllocator *GetConcurrentDebugSpace(unsigned iWorker);
+#endif !IDE
+
     bool ProcessTransientSymbols(BCSYM_Container * pContainer,
                                  Text *pText,
                                  _Inout_ PEInfo * pInfo,
@@ -651,4 +789,12 @@ private:
 #endif
 
     DynamicHashTable<STRING*, ISymUnmanagedDocumentWriter*> m_pdbDocs;
+
+#if !IDE
+    // Method bodies compiled concurrently cannot share the NorlsAllocator of
+    // their file, so their method slots, block scopes and line tables come
+    // from one of these instead.  They must live until the PDB is written.
+    NorlsAllocator **m_rgpnraConcurrentDebugSpace;
+    unsigned m_cConcurrentDebugSpace;
+#endif !IDE
 };
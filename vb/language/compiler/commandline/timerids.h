@@ -19,11 +19,26 @@
 #define LAST_TIMER_GROUP_ID -1
 
 TIMER_GROUP (0, "Parser")
+TIMER_GROUP (1, "Project")
+TIMER_GROUP (2, "SourceFile")
+TIMER_GROUP (3, "Method")
 TIMER_GROUP (LAST_TIMER_GROUP_ID, "")    //end marker
 
 TIMERID(TIME_ParserMethodBody,	    		"ParserMethodBody",		            0)
 TIMERID(TIME_ParserDecls,                       "ParserDecls",                              0)
 
+TIMERID(TIME_PromoteToDeclared,                 "PromoteToDeclared",                        1)
+TIMERID(TIME_PromoteToBound,                    "PromoteToBound",                           1)
+TIMERID(TIME_PromoteToTypesEmitted,             "PromoteToTypesEmitted",                    1)
+TIMERID(TIME_PromoteToCompiled,                 "PromoteToCompiled",                        1)
+
+TIMERID(TIME_FileBuildSymbols,                  "FileBuildSymbols",                         2)
+TIMERID(TIME_FileBindSymbols,                   "FileBindSymbols",                          2)
+TIMERID(TIME_FileEmitMethodBodies,              "FileEmitMethodBodies",                     2)
+
+TIMERID(TIME_MethodBoundTree,                   "MethodBoundTree",                          3)
+TIMERID(TIME_MethodCodeGen,                     "MethodCodeGen",                            3)
+
 
 
 
@@ -17,11 +17,13 @@
 #include "stdafx.h"
 
 // Although it is verboten in most parts of the compiler, we use static
-// data in the timings module. This means that the timings will
-// not be correct if multiple compiles happen at the same time. Since
-// this is an internal debugging tool anyway, that's OK for this
-// one specific thing. It's important to be static because we want this
-// to be very low overhead if it's not in use.
+// data in the timings module. Every thread that enters a section gets its
+// own TIMERTHREADDATA through thread local storage, so the threads of a
+// parallel compile time their sections without locking each other, and the
+// reports add the threads up. Only one timing can be active in a process,
+// though: ActivateTiming throws away the data of the previous one. Since
+// this is an internal debugging tool anyway, that's OK, and it keeps the
+// overhead very low if it's not in use.
 
 bool g_isTimingActive = false;
 
@@ -29,10 +31,7 @@ LARGE_INTEGER g_qpcStartTime;  // In units returns by QueryPerformanceCounter
 LARGE_INTEGER g_qpcStopTime;
 
 __int64 g_startTime;            // In units returned by GetTickCountrTick
-__int64 g_lastTime;
 __int64 g_stopTime;
-TIMERID g_timeridStack[1000];
-int g_timeridStackPtr; // points to top USED value on stack, or -1 if stack is empty.
 
 struct TIMERSECTIONINFO
 {
@@ -43,10 +42,72 @@ struct TIMERSECTIONINFO
 struct TIMERSECTIONDATA
 {
     unsigned totalCount;
-    __int64 totalTime;
+    __int64 totalTime;          // Exclusive of nested sections
+    __int64 inclusiveTime;
 };
 
-TIMERSECTIONDATA g_timerData[TIMERID_MAX];
+// A section that is currently being timed on a thread.
+struct TIMERFRAME
+{
+    TIMERID timerId;
+    const WCHAR * detail;
+    __int64 startTime;
+};
+
+// A finished section, kept for the trace output.
+struct TIMEREVENT
+{
+    TIMERID timerId;
+    const WCHAR * detail;
+    __int64 startTime;
+    __int64 duration;
+};
+
+#define TIMER_EVENTS_PER_BLOCK 4096
+
+struct TIMEREVENTBLOCK
+{
+    TIMEREVENTBLOCK * next;
+    unsigned count;
+    TIMEREVENT events[TIMER_EVENTS_PER_BLOCK];
+};
+
+// Everything that is timed on one thread.  The threads are kept on a list
+// so the reports can add them up.
+struct TIMERTHREADDATA
+{
+    TIMERTHREADDATA * next;
+    DWORD threadId;
+    __int64 lastTime;
+    int timeridStackPtr; // points to top USED value on stack, or -1 if stack is empty.
+    TIMERFRAME timeridStack[256];
+    TIMERSECTIONDATA timerData[TIMERID_MAX];
+    TIMEREVENTBLOCK * firstEvents;
+    TIMEREVENTBLOCK * lastEvents;
+};
+
+DWORD g_timerTlsIndex = TLS_OUT_OF_INDEXES;
+TIMERTHREADDATA * volatile g_timerThreads;
+
+#ifndef CSEE
+
+// The NorlsAllocator counters when the timing started and stopped, and the
+// peak sizes of the shared page heap in between.
+struct TIMERMEMORYDATA
+{
+    unsigned __int64 startAllocations;
+    unsigned __int64 startBytesAllocated;
+    unsigned __int64 stopAllocations;
+    unsigned __int64 stopBytesAllocated;
+    unsigned maxPageHeapUse;
+    unsigned maxPageHeapReserve;
+    unsigned __int64 pageMagazineHits;
+    unsigned __int64 pageMagazineMisses;
+};
+
+TIMERMEMORYDATA g_timerMemory;
+
+#endif
 
 #define TIMER_GROUP(cat, name)
 #define TIMERID(id, text, subtotal) { L##text, subtotal} ,
@@ -73,34 +134,11 @@ const TimerGroupName g_timergroups[] =
     };
 
 
-// QueryPerformanceCounter is slow enough that is skews the
-// timing somewhat. The rdtsc (read cycle counter) instruction
-// is much better. We have to restrict execution to a single
-// processor to make it reliable, though.
-#if defined(_M_IX86) && !defined(FEATURE_PAL)
-
-#pragma warning(disable: 4035)  // no return value
-__forceinline __int64 GetCurrentTimerTick()
-{
-    __asm rdtsc
-}
-#pragma warning(default: 4035)
-
-typedef BOOL (WINAPI *PFNSETPROCESSAFFINITYMASK)(HANDLE, DWORD_PTR);
-
-void InitializeTimerTick()
-{
-    // SetProcessAffinityMask not available on Win95.
-    PFNSETPROCESSAFFINITYMASK pfnSetProcessAffinityMask =
-        (PFNSETPROCESSAFFINITYMASK)GetProcAddress (GetModuleHandleW(L"kernel32.dll"), "SetProcessAffinityMask");
-
-    // Set to only run on one processor so that they processor time count is accurate.
-    if (pfnSetProcessAffinityMask != NULL)
-        pfnSetProcessAffinityMask(GetCurrentProcess(), 1);
-}
-
-#else //_M_IX86 && !FEATURE_PAL
-
+// The rdtsc (read cycle counter) instruction used to be used here, but it
+// is only reliable when the process is restricted to a single processor,
+// which would defeat the parallel phases of the compile.  The trace output
+// also needs a clock that is consistent across threads, so
+// QueryPerformanceCounter is used everywhere.
 __forceinline __int64 GetCurrentTimerTick()
 {
     LARGE_INTEGER li;
@@ -112,31 +150,132 @@ __forceinline __int64 GetCurrentTimerTick()
 void InitializeTimerTick()
 {}
 
-#endif //_M_IX86 && !FEATURE_PAL
-
 __int64 GetCurrentTimerTickM()
 {
     return GetCurrentTimerTick();
 }
 
+/*
+ * Throw away the data of the last timing run, if any.
+ */
+static void FreeTimingData()
+{
+    TIMERTHREADDATA * threadData = g_timerThreads;
+
+    while (threadData)
+    {
+        TIMERTHREADDATA * nextThreadData = threadData->next;
+        TIMEREVENTBLOCK * eventBlock = threadData->firstEvents;
+
+        while (eventBlock)
+        {
+            TIMEREVENTBLOCK * nextEventBlock = eventBlock->next;
+            delete eventBlock;
+            eventBlock = nextEventBlock;
+        }
+
+        delete threadData;
+        threadData = nextThreadData;
+    }
+
+    g_timerThreads = NULL;
+
+    // A fresh TLS index starts out empty on every thread, so no thread can
+    // hold on to the data freed above.
+    if (g_timerTlsIndex != TLS_OUT_OF_INDEXES)
+    {
+        TlsFree(g_timerTlsIndex);
+        g_timerTlsIndex = TLS_OUT_OF_INDEXES;
+    }
+}
+
+/*
+ * Get the timing data of the current thread, creating it on first use.
+ */
+static TIMERTHREADDATA * GetTimerThreadData()
+{
+    TIMERTHREADDATA * threadData = (TIMERTHREADDATA *)TlsGetValue(g_timerTlsIndex);
+
+    if (!threadData)
+    {
+        threadData = new (zeromemory) TIMERTHREADDATA;
+        threadData->threadId = GetCurrentThreadId();
+        threadData->timeridStackPtr = -1;
+        threadData->lastTime = GetCurrentTimerTick();
+
+        TIMERTHREADDATA * head;
+
+        do
+        {
+            head = g_timerThreads;
+            threadData->next = head;
+        }
+        while (InterlockedCompareExchangePointer((PVOID volatile *)&g_timerThreads, threadData, head) != head);
+
+        TlsSetValue(g_timerTlsIndex, threadData);
+    }
+
+    return threadData;
+}
+
+/*
+ * Remember a finished section for the trace output.
+ */
+static void RecordTimerEvent(TIMERTHREADDATA * threadData, const TIMERFRAME * frame, __int64 now)
+{
+    TIMEREVENTBLOCK * eventBlock = threadData->lastEvents;
+
+    if (!eventBlock || eventBlock->count == TIMER_EVENTS_PER_BLOCK)
+    {
+        eventBlock = new (zeromemory) TIMEREVENTBLOCK;
+
+        if (threadData->lastEvents)
+        {
+            threadData->lastEvents->next = eventBlock;
+        }
+        else
+        {
+            threadData->firstEvents = eventBlock;
+        }
+
+        threadData->lastEvents = eventBlock;
+    }
+
+    TIMEREVENT * event = &eventBlock->events[eventBlock->count++];
+
+    event->timerId = frame->timerId;
+    event->detail = frame->detail;
+    event->startTime = frame->startTime;
+    event->duration = now - frame->startTime;
+}
+
 /*
  * Start the timing and reset all timer counts.
  */
 void ActivateTiming()
 {
+    FreeTimingData();
+
+    g_timerTlsIndex = TlsAlloc();
 
-    for (TIMERID id = (TIMERID) 0; id < TIMERID_MAX; id = (TIMERID) (id + 1))
+    if (g_timerTlsIndex == TLS_OUT_OF_INDEXES)
     {
-        g_timerData[id].totalCount = 0;
-        g_timerData[id].totalTime = 0;
+        return;
     }
 
     InitializeTimerTick();
     g_stopTime = 0;
-    g_timeridStackPtr = -1;
+
+#ifndef CSEE
+    memset(&g_timerMemory, 0, sizeof(g_timerMemory));
+    g_pvbNorlsManager->GetPageHeap().ResetMaxSizes();
+    NorlsAllocator::GetStatistics(&g_timerMemory.startAllocations, &g_timerMemory.startBytesAllocated);
+    NorlsAllocator::CollectStatistics(true);
+#endif
+
     g_isTimingActive = true;
     QueryPerformanceCounter(&g_qpcStartTime);
-    g_lastTime = g_startTime = GetCurrentTimerTick();
+    g_startTime = GetCurrentTimerTick();
 }
 
 /*
@@ -147,6 +286,16 @@ void FinishTiming()
     g_stopTime = GetCurrentTimerTick();
     QueryPerformanceCounter(&g_qpcStopTime);
     g_isTimingActive = false;
+
+#ifndef CSEE
+    unsigned __int64 pageMagazineReturned;
+
+    NorlsAllocator::CollectStatistics(false);
+    NorlsAllocator::GetStatistics(&g_timerMemory.stopAllocations, &g_timerMemory.stopBytesAllocated);
+    g_timerMemory.maxPageHeapUse = g_pvbNorlsManager->GetPageHeap().GetMaxUseSize();
+    g_timerMemory.maxPageHeapReserve = g_pvbNorlsManager->GetPageHeap().GetMaxReserveSize();
+    g_pvbNorlsManager->GetPageMagazineStatistics(&g_timerMemory.pageMagazineHits, &g_timerMemory.pageMagazineMisses, &pageMagazineReturned);
+#endif
 }
 
 
@@ -161,17 +310,18 @@ void FinishTiming()
 /*
  * Record the start of a new section of timing
  */
-void DoTimerStart(TIMERID timerId)
+void DoTimerStart(TIMERID timerId, _In_opt_z_ const WCHAR * detail)
 {
+    TIMERTHREADDATA * threadData = GetTimerThreadData();
     __int64 now = GetCurrentTimerTick();
-    int stackPtr = g_timeridStackPtr;
+    int stackPtr = threadData->timeridStackPtr;
     TIMERID oldId;
 
     // Record the amount of time so far in the containing section, if any.
     if (stackPtr >= 0)
     {
-        oldId = g_timeridStack[stackPtr];
-        g_timerData[oldId].totalTime += (now - g_lastTime);
+        oldId = threadData->timeridStack[stackPtr].timerId;
+        threadData->timerData[oldId].totalTime += (now - threadData->lastTime);
     }
 
     // update the stack
@@ -185,11 +335,13 @@ void DoTimerStart(TIMERID timerId)
 
 #define lengthof(a) (sizeof(a) / sizeof((a)[0]))
 
-    if (newStackPtr < (int)lengthof(g_timeridStack))
+    if (newStackPtr < (int)lengthof(threadData->timeridStack))
     {
         ++stackPtr;
-        g_timeridStack[stackPtr] = timerId;
-        g_timeridStackPtr = stackPtr;
+        threadData->timeridStack[stackPtr].timerId = timerId;
+        threadData->timeridStack[stackPtr].detail = detail;
+        threadData->timeridStack[stackPtr].startTime = now;
+        threadData->timeridStackPtr = stackPtr;
     }
     else
     {
@@ -197,8 +349,8 @@ void DoTimerStart(TIMERID timerId)
     }
 
     // update the count and remember when we started.
-    ++g_timerData[timerId].totalCount;
-    g_lastTime = now;
+    ++threadData->timerData[timerId].totalCount;
+    threadData->lastTime = now;
 }
 
 
@@ -207,23 +359,34 @@ void DoTimerStart(TIMERID timerId)
  */
 void DoTimerStop(TIMERID timerId)
 {
+    TIMERTHREADDATA * threadData = GetTimerThreadData();
     __int64 now = GetCurrentTimerTick();
-    int stackPtr = g_timeridStackPtr;
+    int stackPtr = threadData->timeridStackPtr;
 
     // Pop the stack. If the id doesn't match, pop until it does (exception thrown, maybe?)
-    while (stackPtr > 0 && g_timeridStack[stackPtr] != timerId)
+    // The sections skipped over still end here, so the trace stays properly nested.
+    while (stackPtr > 0 && threadData->timeridStack[stackPtr].timerId != timerId)
+    {
+        RecordTimerEvent(threadData, &threadData->timeridStack[stackPtr], now);
+        --stackPtr;
+    }
+    ASSERT(stackPtr >= 0 && threadData->timeridStack[stackPtr].timerId == timerId, "in timing.cpp");  // if this is hit, we never found our timer id. Probably logic bug.
+
+    if (stackPtr >= 0)
     {
+        const TIMERFRAME * frame = &threadData->timeridStack[stackPtr];
+
+        threadData->timerData[timerId].inclusiveTime += (now - frame->startTime);
+        RecordTimerEvent(threadData, frame, now);
         --stackPtr;
     }
-    ASSERT(stackPtr >= 0 && g_timeridStack[stackPtr] == timerId, "in timing.cpp");  // if this is hit, we never found our timer id. Probably logic bug.
-    --stackPtr;
 
     // Record the amount of time so far in the current section, if any.
-    g_timerData[timerId].totalTime += (now - g_lastTime);
-    g_timeridStackPtr = stackPtr;
+    threadData->timerData[timerId].totalTime += (now - threadData->lastTime);
+    threadData->timeridStackPtr = stackPtr;
 
     // remember the new time
-    g_lastTime = now;
+    threadData->lastTime = now;
 }
 
 #ifndef CSEE
@@ -319,38 +482,78 @@ void ReportTimesInXML (FILE* file)
 */
 
 /*
- * Print a report of the times spent in each timed section to a file.
+ * Convert a number of timer ticks to milliseconds.
  */
-void ReportTimes(FILE * outputFile)
+static double TimerTicksToMsec(__int64 ticks)
 {
-    double elapsedTime = (double)(g_stopTime - g_startTime);
-
     LARGE_INTEGER qpcFreq;
     QueryPerformanceFrequency(& qpcFreq);
 
-    double elapsedTimeMsec = (double)(g_qpcStopTime.QuadPart - g_qpcStartTime.QuadPart) / (double) qpcFreq.QuadPart * 1000.0;
+    return (double) ticks / (double) qpcFreq.QuadPart * 1000.0;
+}
+
+/*
+ * Add up the times of all the threads.  Returns the number of threads.
+ */
+static unsigned SumTimerThreads(TIMERSECTIONDATA timerData[TIMERID_MAX], __int64 * threadTotal)
+{
+    unsigned threadCount = 0;
+
+    memset(timerData, 0, sizeof(TIMERSECTIONDATA) * TIMERID_MAX);
+    *threadTotal = 0;
+
+    for (TIMERTHREADDATA * threadData = g_timerThreads; threadData; threadData = threadData->next)
+    {
+        ++threadCount;
+
+        for (TIMERID id = (TIMERID)0; id < TIMERID_MAX; id = (TIMERID) (id + 1))
+        {
+            timerData[id].totalCount += threadData->timerData[id].totalCount;
+            timerData[id].totalTime += threadData->timerData[id].totalTime;
+            timerData[id].inclusiveTime += threadData->timerData[id].inclusiveTime;
+            *threadTotal += threadData->timerData[id].totalTime;
+        }
+    }
+
+    return threadCount;
+}
+
+/*
+ * Print a report of the times spent in each timed section to a file.
+ */
+void ReportTimes(FILE * outputFile)
+{
+    TIMERSECTIONDATA timerData[TIMERID_MAX];
+    __int64 threadTotal;
+    unsigned threadCount = SumTimerThreads(timerData, &threadTotal);
+
+    double elapsedTimeMsec = TimerTicksToMsec(g_qpcStopTime.QuadPart - g_qpcStartTime.QuadPart);
+    double elapsedTime = threadTotal > 0 ? (double) threadTotal : 1.0;
     __int64 subTotal;
     __int64 total;
 
-    fwprintf(outputFile, L"All times are mutually exclusive. Total compile time: %.1f ms.\n", elapsedTimeMsec);
+    fwprintf(outputFile, L"All times are mutually exclusive within a thread and added up over %u threads. Total compile time: %.1f ms.\n", threadCount, elapsedTimeMsec);
+    fwprintf(outputFile, L"Time %% is relative to all timed sections on all threads.\n");
     fwprintf(outputFile, L"\n");
 
     subTotal = 0;
     total = 0;
 
-    fwprintf(outputFile, L"%-50s  %10s  %7s\n", L"Name of code section", L"Hits", L"  Time %");
-    fwprintf(outputFile, L"==========================================================================\n");
+    fwprintf(outputFile, L"%-40s  %10s  %12s  %12s  %7s\n", L"Name of code section", L"Hits", L"Time (ms)", L"Incl. (ms)", L"  Time %");
+    fwprintf(outputFile, L"==========================================================================================\n");
     for (TIMERID id = (TIMERID)0; id < TIMERID_MAX; id = (TIMERID) (id + 1))
     {
-        if (g_timerData[id].totalCount != 0)
+        if (timerData[id].totalCount != 0)
         {
-            fwprintf(outputFile, L"%-50s  %10d  %7.3f%%\n", g_timerInfo[id].name,
-                     g_timerData[id].totalCount,
-                     (double) g_timerData[id].totalTime / elapsedTime * 100.0);
+            fwprintf(outputFile, L"%-40s  %10d  %12.1f  %12.1f  %7.3f%%\n", g_timerInfo[id].name,
+                     timerData[id].totalCount,
+                     TimerTicksToMsec(timerData[id].totalTime),
+                     TimerTicksToMsec(timerData[id].inclusiveTime),
+                     (double) timerData[id].totalTime / elapsedTime * 100.0);
         }
 
-        subTotal += g_timerData[id].totalTime;
-        total += g_timerData[id].totalTime;
+        subTotal += timerData[id].totalTime;
+        total += timerData[id].totalTime;
 
 #pragma warning(suppress: 6200)
         if (id + 1 >= TIMERID_MAX || g_timerInfo[id + 1].subTotal != g_timerInfo[id].subTotal)
@@ -358,8 +561,9 @@ void ReportTimes(FILE * outputFile)
             // print subtotal
             if (subTotal > 0)
             {
-                fwprintf(outputFile, L"--------------------------------------------------------------------------\n");
-                fwprintf(outputFile, L"%-50s  %10s  %7.3f%%\n\n", L"SUBTOTAL", L"",
+                fwprintf(outputFile, L"------------------------------------------------------------------------------------------\n");
+                fwprintf(outputFile, L"%-40s  %10s  %12.1f  %12s  %7.3f%%\n\n", L"SUBTOTAL", L"",
+                         TimerTicksToMsec(subTotal), L"",
                          (double) subTotal / elapsedTime * 100.0);
             }
 
@@ -368,9 +572,194 @@ void ReportTimes(FILE * outputFile)
     }
 
     // print total
-    fwprintf(outputFile, L"--------------------------------------------------------------------------\n");
-    fwprintf(outputFile, L"%-50s  %10s  %7.3f%%\n\n", L"TOTAL OF TIMED SECTIONS", L"",
+    fwprintf(outputFile, L"------------------------------------------------------------------------------------------\n");
+    fwprintf(outputFile, L"%-40s  %10s  %12.1f  %12s  %7.3f%%\n\n", L"TOTAL OF TIMED SECTIONS", L"",
+             TimerTicksToMsec(total), L"",
              (double) total / elapsedTime * 100.0);
+
+    // How busy each thread was.
+    fwprintf(outputFile, L"%-40s  %10s  %12s\n", L"Thread", L"Sections", L"Time (ms)");
+    fwprintf(outputFile, L"==========================================================================================\n");
+    for (TIMERTHREADDATA * threadData = g_timerThreads; threadData; threadData = threadData->next)
+    {
+        unsigned sectionCount = 0;
+        __int64 threadTime = 0;
+
+        for (TIMERID id = (TIMERID)0; id < TIMERID_MAX; id = (TIMERID) (id + 1))
+        {
+            sectionCount += threadData->timerData[id].totalCount;
+            threadTime += threadData->timerData[id].totalTime;
+        }
+
+        fwprintf(outputFile, L"%-40u  %10u  %12.1f\n", threadData->threadId, sectionCount, TimerTicksToMsec(threadTime));
+    }
+    fwprintf(outputFile, L"\n");
+
+    // The memory used by the NorlsAllocators.
+    fwprintf(outputFile, L"%-40s  %22s\n", L"NorlsAllocator memory", L"");
+    fwprintf(outputFile, L"==========================================================================================\n");
+    fwprintf(outputFile, L"%-40s  %22I64u\n", L"Allocations", g_timerMemory.stopAllocations - g_timerMemory.startAllocations);
+    fwprintf(outputFile, L"%-40s  %22I64u\n", L"Bytes allocated", g_timerMemory.stopBytesAllocated - g_timerMemory.startBytesAllocated);
+    fwprintf(outputFile, L"%-40s  %22u\n", L"Peak page heap use (bytes)", g_timerMemory.maxPageHeapUse);
+    fwprintf(outputFile, L"%-40s  %22u\n", L"Peak page heap reserve (bytes)", g_timerMemory.maxPageHeapReserve);
+    fwprintf(outputFile, L"%-40s  %22I64u\n", L"Page magazine hits", g_timerMemory.pageMagazineHits);
+    fwprintf(outputFile, L"%-40s  %22I64u\n", L"Page magazine misses", g_timerMemory.pageMagazineMisses);
+    fwprintf(outputFile, L"\n");
+}
+
+/*
+ * Find the name of the group a timer id belongs to.
+ */
+static PCWSTR GetTimerGroupName(TIMERID timerId)
+{
+    const TimerGroupName* tgroup = g_timergroups;
+
+    while (tgroup->m_group_id != LAST_TIMER_GROUP_ID)
+    {
+        if (tgroup->m_group_id == g_timerInfo[timerId].subTotal)
+        {
+            return tgroup->m_group_name;
+        }
+
+        tgroup++;
+    }
+
+    return L"";
+}
+
+/*
+ * Write a string as a JSON string literal.  Anything outside of printable
+ * ASCII is escaped, so the file is plain ASCII whatever the locale.
+ */
+static void WriteJsonString(FILE * outputFile, PCWSTR string)
+{
+    fputwc(L'"', outputFile);
+
+    for (PCWSTR pch = string; *pch; pch++)
+    {
+        if (*pch == L'"' || *pch == L'\\')
+        {
+            fwprintf(outputFile, L"\\%c", *pch);
+        }
+        else if (*pch < 0x20 || *pch > 0x7e)
+        {
+            fwprintf(outputFile, L"\\u%04x", (unsigned)*pch);
+        }
+        else
+        {
+            fputwc(*pch, outputFile);
+        }
+    }
+
+    fputwc(L'"', outputFile);
+}
+
+/*
+ * Write every finished section as a "complete" event in the trace event
+ * format understood by chrome://tracing.  Times are in microseconds from
+ * the start of the timing.
+ */
+void ReportTimesAsTrace(FILE * outputFile)
+{
+    DWORD processId = GetCurrentProcessId();
+    bool firstEvent = true;
+    double usecPerTick = TimerTicksToMsec(1000000) / 1000.0;
+
+    fwprintf(outputFile, L"{\"traceEvents\":[\n");
+
+    for (TIMERTHREADDATA * threadData = g_timerThreads; threadData; threadData = threadData->next)
+    {
+        for (TIMEREVENTBLOCK * eventBlock = threadData->firstEvents; eventBlock; eventBlock = eventBlock->next)
+        {
+            for (unsigned i = 0; i < eventBlock->count; i++)
+            {
+                const TIMEREVENT * event = &eventBlock->events[i];
+
+                fwprintf(outputFile, firstEvent ? L"{\"name\":" : L",\n{\"name\":");
+                WriteJsonString(outputFile, g_timerInfo[event->timerId].name);
+                fwprintf(outputFile, L",\"cat\":");
+                WriteJsonString(outputFile, GetTimerGroupName(event->timerId));
+                fwprintf(outputFile, L",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                         processId,
+                         threadData->threadId,
+                         (double)(event->startTime - g_startTime) * usecPerTick,
+                         (double)event->duration * usecPerTick);
+
+                if (event->detail)
+                {
+                    fwprintf(outputFile, L",\"args\":{\"detail\":");
+                    WriteJsonString(outputFile, event->detail);
+                    fwprintf(outputFile, L"}");
+                }
+
+                fwprintf(outputFile, L"}");
+                firstEvent = false;
+            }
+        }
+    }
+
+    fwprintf(outputFile, L"\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+void ReportTimesAsTrace(PCWSTR fname)
+{
+    FILE* f = NULL;
+    if (!_wfopen_s (&f, fname, L"w"))
+    {
+        ReportTimesAsTrace (f);
+        fclose (f);
+    }
+}
+
+/*
+ * Write the totals of every timed section and the memory counters as one
+ * JSON object.  Times are in milliseconds; the sections that were never
+ * entered are left out.
+ */
+void ReportTimesAsJson(FILE * outputFile)
+{
+    TIMERSECTIONDATA timerData[TIMERID_MAX];
+    __int64 threadTotal;
+    unsigned threadCount = SumTimerThreads(timerData, &threadTotal);
+    bool firstSection = true;
+
+    fwprintf(outputFile, L"{\"elapsedMs\":%.3f,\"threads\":%u,\"sections\":[\n",
+             TimerTicksToMsec(g_qpcStopTime.QuadPart - g_qpcStartTime.QuadPart),
+             threadCount);
+
+    for (TIMERID id = (TIMERID)0; id < TIMERID_MAX; id = (TIMERID) (id + 1))
+    {
+        if (timerData[id].totalCount != 0)
+        {
+            fwprintf(outputFile, firstSection ? L"{\"name\":" : L",\n{\"name\":");
+            WriteJsonString(outputFile, g_timerInfo[id].name);
+            fwprintf(outputFile, L",\"group\":");
+            WriteJsonString(outputFile, GetTimerGroupName(id));
+            fwprintf(outputFile, L",\"hits\":%u,\"timeMs\":%.3f,\"inclusiveMs\":%.3f}",
+                     timerData[id].totalCount,
+                     TimerTicksToMsec(timerData[id].totalTime),
+                     TimerTicksToMsec(timerData[id].inclusiveTime));
+            firstSection = false;
+        }
+    }
+
+    fwprintf(outputFile, L"\n],\"memory\":{\"allocations\":%I64u,\"bytesAllocated\":%I64u,\"peakPageHeapUse\":%u,\"peakPageHeapReserve\":%u,\"pageMagazineHits\":%I64u,\"pageMagazineMisses\":%I64u}}\n",
+             g_timerMemory.stopAllocations - g_timerMemory.startAllocations,
+             g_timerMemory.stopBytesAllocated - g_timerMemory.startBytesAllocated,
+             g_timerMemory.maxPageHeapUse,
+             g_timerMemory.maxPageHeapReserve,
+             g_timerMemory.pageMagazineHits,
+             g_timerMemory.pageMagazineMisses);
+}
+
+void ReportTimesAsJson(PCWSTR fname)
+{
+    FILE* f = NULL;
+    if (!_wfopen_s (&f, fname, L"w"))
+    {
+        ReportTimesAsJson (f);
+        fclose (f);
+    }
 }
 #endif
 
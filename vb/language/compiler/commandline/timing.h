@@ -35,6 +35,9 @@ enum TIMERID {
 // this is an internal debugging tool anyway, that's OK for this
 // one specific thing. It's important to be static because we want this
 // to be very low overhead if it's not in use.
+//
+// The timer stacks and totals are kept per thread, so the parallel phases of
+// a single compile are timed correctly and every thread shows up in the trace.
 
 
 // Is timing on?
@@ -43,14 +46,16 @@ extern bool g_isTimingActive;
 // The timer functions.
 extern void ActivateTiming();
 extern void FinishTiming();
-extern void DoTimerStart(TIMERID timerId);
+extern void DoTimerStart(TIMERID timerId, _In_opt_z_ const WCHAR * detail);
 extern void DoTimerStop(TIMERID timerId);
 
-// Begin timing something.
-__forceinline void TimerStart(TIMERID timerId)
+// Begin timing something.  The detail (a file or method name, say) shows up
+// in the trace output.  It is not copied, so it has to stay alive until the
+// times are reported; strings from the string pool do.
+__forceinline void TimerStart(TIMERID timerId, _In_opt_z_ const WCHAR * detail = NULL)
 {
     if (g_isTimingActive)
-        DoTimerStart(timerId);
+        DoTimerStart(timerId, detail);
 }
 
 // Finish timing something
@@ -64,9 +69,9 @@ __forceinline void TimerStop(TIMERID timerId)
 class TIMERBLOCK
 {
 public:
-    TIMERBLOCK(TIMERID timerId) : timerId(timerId)
+    TIMERBLOCK(TIMERID timerId, _In_opt_z_ const WCHAR * detail = NULL) : timerId(timerId)
     {
-        TimerStart(timerId);
+        TimerStart(timerId, detail);
     }
     ~TIMERBLOCK()
     {
@@ -78,8 +83,10 @@ private:
 
 #if IDE || IDE64
 #define TIMEBLOCK(timerId) 
+#define TIMEBLOCKDETAIL(timerId, detail) 
 #else
 #define TIMEBLOCK(timerId) TIMERBLOCK __timerId(timerId)
+#define TIMEBLOCKDETAIL(timerId, detail) TIMERBLOCK __timerId(timerId, detail)
 #endif
 
 #ifndef CSEE 
@@ -90,6 +97,17 @@ void ReportTimesInXML(FILE * outputFile);
 // pass in "stdout" to output to console. Otherwise, specified file is opened for append.
 void ReportTimesInXML(PCWSTR outputFile);
 
+// Writes every timed section as a trace event file that can be loaded into
+// chrome://tracing.  The specified file is overwritten.
+void ReportTimesAsTrace(FILE * outputFile);
+void ReportTimesAsTrace(PCWSTR outputFile);
+
+// Writes the totals of ReportTimes, including the memory used by the
+// NorlsAllocators, as a JSON object so that runs can be compared by a
+// script.  The specified file is overwritten.
+void ReportTimesAsJson(FILE * outputFile);
+void ReportTimesAsJson(PCWSTR outputFile);
+
 #else   //CSEE
 
 extern __int64 GetCurrentTimerTickM();
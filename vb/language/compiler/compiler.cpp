@@ -1611,7 +1611,37 @@ Compiler::Compiler
     {
         m_NamesOfRiskyMSVBFSFunctions.Add(GetStringConstant(i));
     }
+
+#if !IDE
+    ReadEnvironmentSettings();
+#endif
+}
+
+#if !IDE
+//============================================================================
+// Read the command line compiler settings passed in the environment.
+//
+//   VBC_COMPILER_PARALLELISM=<n>   threads for the parallel phases, 0 means
+//                                  one per processor (default 1, serial)
+//============================================================================
+
+void Compiler::ReadEnvironmentSettings()
+{
+    WCHAR wszValue[MAX_PATH];
+    DWORD cch = GetEnvironmentVariableW(L"VBC_COMPILER_PARALLELISM", wszValue, DIM(wszValue));
+
+    if (cch > 0 && cch < DIM(wszValue))
+    {
+        WCHAR *pwchEnd = NULL;
+        unsigned long cThreads = wcstoul(wszValue, &pwchEnd, 10);
+
+        if (pwchEnd != wszValue && *pwchEnd == L'\0')
+        {
+            SetMaxDegreeOfParallelism(cThreads > WorkStealingPool::MaxThreads ? WorkStealingPool::MaxThreads : (unsigned)cThreads);
+        }
+    }
 }
+#endif
 
 //============================================================================
 // Terminate the internal compiler data structures.
@@ -1632,6 +1662,10 @@ Compiler::~Compiler()
     _Module.ForceTerminate();
 #endif
 
+    // Stop the parallel compilation workers.
+    delete m_pWorkerPool;
+    m_pWorkerPool = NULL;
+
     // Destroy the string pool.
     delete m_pStringPool;
     m_pStringPool = NULL;
@@ -2135,6 +2169,47 @@ STDMETHODIMP Compiler::SetLoggingOptions(DWORD options)
     return S_OK;
 }
 
+//==============================================================================
+// Set the number of threads the parallel compilation phases may use
+//==============================================================================
+void Compiler::SetMaxDegreeOfParallelism(unsigned cThreads)
+{
+    cThreads = WorkStealingPool::ResolveDegreeOfParallelism(cThreads);
+
+    if (cThreads != GetMaxDegreeOfParallelism())
+    {
+        // The pool is sized when it is created, so start over with a new one.
+        delete m_pWorkerPool;
+        m_pWorkerPool = NULL;
+    }
+
+    m_cMaxDegreeOfParallelism = cThreads;
+}
+
+//==============================================================================
+// Get the worker pool for the parallel compilation phases
+//==============================================================================
+WorkStealingPool *Compiler::GetWorkerPool()
+{
+#if IDE 
+    // The background compiler relies on the compile thread owning the project
+    // locks, so the IDE always compiles serially.
+    return NULL;
+#else
+    if (GetMaxDegreeOfParallelism() <= 1)
+    {
+        return NULL;
+    }
+
+    if (!m_pWorkerPool)
+    {
+        m_pWorkerPool = new WorkStealingPool(GetMaxDegreeOfParallelism());
+    }
+
+    return m_pWorkerPool;
+#endif
+}
+
 // Finds the CompilerHost associated with pVbCompilerHost. Returns true found, or false if not.
 bool Compiler::FindCompilerHost(IVbCompilerHost *pVbCompilerHost, CompilerHost **ppCompilerHost)
 {
@@ -632,6 +632,26 @@ public:
     // Return the project that's currently being compiled
     CompilerProject *GetProjectBeingCompiled();
 
+    //========================================================================
+    // Parallelism.
+    //========================================================================
+
+    // The number of threads that the compilation phases which can work on
+    // independent files or methods concurrently are allowed to use.  Zero
+    // means one thread per processor.  By default everything runs serially
+    // on the compile thread.  The command line compiler takes the setting
+    // from VBC_COMPILER_PARALLELISM, see ReadEnvironmentSettings.
+    void SetMaxDegreeOfParallelism(unsigned cThreads);
+
+    unsigned GetMaxDegreeOfParallelism()
+    {
+        return m_cMaxDegreeOfParallelism ? m_cMaxDegreeOfParallelism : 1;
+    }
+
+    // The worker pool shared by all of the parallel compilation phases.
+    // Returns NULL when the degree of parallelism is 1.
+    WorkStealingPool *GetWorkerPool();
+
     //========================================================================
     // Compilation stats.
     //========================================================================
@@ -885,6 +905,12 @@ protected:
 
     HRESULT LoadDefaultLibraries(bool CompilingTheVBRuntime, CompilerHost *pCompilerHost);
 
+#if !IDE
+    // Picks up the command line compiler settings that are passed in the
+    // environment rather than through IVbCompiler.
+    void ReadEnvironmentSettings();
+#endif
+
     // Structure that holds information required to detect and generate reference cycle
     // errors involving metadata to source project references.
     struct ProjectSortInfo
@@ -1072,6 +1098,10 @@ protected:
     // Compilation switches.
     OUTPUT_LEVEL m_OutputLevel;
 
+    // Parallel compilation.  Zero means not set, i.e. serial.
+    unsigned m_cMaxDegreeOfParallelism;
+    WorkStealingPool *m_pWorkerPool;
+
     // List of library calls that can be compiled out.
     STRING *m_pstrRuntimeFunction[RuntimeFunctionMax];
 
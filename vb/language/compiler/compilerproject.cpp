@@ -130,6 +130,11 @@ int LiftedUserDefinedOperatorCache::KeyOperations::compare(
     }
 }
 
+unsigned LiftedUserDefinedOperatorCache::KeyOperations::hash(const Key * pKey)
+{
+    return HashCacheKeyPointer(pKey->pSourceOperator);
+}
+
 void LiftedUserDefinedOperatorCache::NodeOperations::copy(
     Node * pNodeDest,
     const Node * pNodeSrc)
@@ -137,6 +142,764 @@ void LiftedUserDefinedOperatorCache::NodeOperations::copy(
     pNodeDest->pLiftedOperator = pNodeSrc->pLiftedOperator;
 }
 
+// How the conversion classification cache looks at a type symbol.  Two
+// types with the same shape are identical if their components are.
+enum ConversionCacheTypeShape
+{
+    ConversionCacheTypeShape_Symbol,
+    ConversionCacheTypeShape_Array,
+    ConversionCacheTypeShape_Pointer,
+    ConversionCacheTypeShape_GenericBinding
+};
+
+static ConversionCacheTypeShape
+GetConversionCacheTypeShape
+(
+    BCSYM * pType
+)
+{
+    // Array literals have conversions of their own, so they are only ever
+    // identical to themselves.
+    if (pType->IsArrayLiteralType())
+    {
+        return ConversionCacheTypeShape_Symbol;
+    }
+    else if (pType->IsArrayType())
+    {
+        return ConversionCacheTypeShape_Array;
+    }
+    else if (pType->IsPointerType())
+    {
+        return ConversionCacheTypeShape_Pointer;
+    }
+    else if (pType->IsGenericBinding())
+    {
+        return ConversionCacheTypeShape_GenericBinding;
+    }
+
+    return ConversionCacheTypeShape_Symbol;
+}
+
+ConversionClassificationCache::ConversionClassificationCache(NorlsAllocator * pNorls) :
+    m_cache(pNorls),
+    m_cHits(0),
+    m_cMisses(0)
+{
+    ThrowIfNull(pNorls);
+}
+
+bool
+ConversionClassificationCache::LookupInCache
+(
+    BCSYM * pTargetType,
+    BCSYM * pSourceType,
+    unsigned Flags,
+    Entry * pCacheValue             //[out] - stores the cached classification
+)
+{
+    Key key(pTargetType, pSourceType, Flags);
+    Node * pNode = NULL;
+
+    if (m_cache.Find(&key, &pNode))
+    {
+        m_cHits++;
+        *pCacheValue = pNode->CacheValue;
+        return true;
+    }
+
+    m_cMisses++;
+    return false;
+}
+
+void
+ConversionClassificationCache::AddEntry
+(
+    Compiler * pCompiler,
+    BCSYM * pTargetType,
+    BCSYM * pSourceType,
+    unsigned Flags,
+    const Entry & cacheValue
+)
+{
+    if (!CanCacheSymbol(pTargetType) || !CanCacheSymbol(pSourceType))
+    {
+        return;
+    }
+
+    Entry value = cacheValue;
+
+    if (!value.m_UserDefinedConversionConsidered)
+    {
+        value.m_pOperatorMethod = NULL;
+        value.m_pOperatorMethodGenericContext = NULL;
+    }
+    // Lifted operators are only shared through the lifted operator cache if they
+    // are not generic; the others live in the storage of the method body.
+    else if ((value.m_pOperatorMethod &&
+                (value.m_pOperatorMethod->IsLiftedOperatorMethod() || !CanCacheSymbol(value.m_pOperatorMethod))) ||
+             (value.m_pOperatorMethodGenericContext && !CanCacheSymbol(value.m_pOperatorMethodGenericContext)))
+    {
+        return;
+    }
+
+    Symbols SymbolCreator(pCompiler, GetNorlsAllocator(), NULL);
+
+    if (value.m_pOperatorMethodGenericContext)
+    {
+        value.m_pOperatorMethodGenericContext =
+            CopyType(value.m_pOperatorMethodGenericContext, SymbolCreator)->PGenericBinding();
+    }
+
+    Key key(CopyType(pTargetType, SymbolCreator), CopyType(pSourceType, SymbolCreator), Flags);
+    Node * pNode = NULL;
+
+    m_cache.Insert(&key, &pNode);
+    pNode->CacheValue = value;
+}
+
+void ConversionClassificationCache::Clear()
+{
+    m_cache.Clear();
+}
+
+NorlsAllocator * ConversionClassificationCache::GetNorlsAllocator()
+{
+    return m_cache.GetNorlsAllocator();
+}
+
+#if DEBUG
+void ConversionClassificationCache::DumpStats()
+{
+    DebPrintf("Convert  hits=%5u miss=%5u entries=%5u\n", m_cHits, m_cMisses, m_cache.Count());
+}
+#endif DEBUG
+
+//============================================================================
+// Structural hash of a type, consistent with CompareTypes.
+//============================================================================
+unsigned ConversionClassificationCache::HashType(BCSYM * pType)
+{
+    if (!pType)
+    {
+        return 0;
+    }
+
+    switch (GetConversionCacheTypeShape(pType))
+    {
+        case ConversionCacheTypeShape_Array:
+            return HashType(pType->PArrayType()->GetRoot()) * 31 + pType->PArrayType()->GetRank();
+
+        case ConversionCacheTypeShape_Pointer:
+            return HashType(pType->PPointerType()->GetRoot()) * 31 + 0x5bd1e995;
+
+        case ConversionCacheTypeShape_GenericBinding:
+            {
+                BCSYM_GenericBinding * pBinding = pType->PGenericBinding();
+                unsigned Hash = HashType(pBinding->GetGeneric());
+
+                for (unsigned i = 0; i < pBinding->GetArgumentCount(); i++)
+                {
+                    Hash = Hash * 31 + HashType(pBinding->GetArgument(i));
+                }
+
+                return Hash * 31 + HashType(pBinding->GetParentBinding());
+            }
+    }
+
+    return (unsigned)((size_t)pType >> 3);
+}
+
+//============================================================================
+// Orders types by their identity: array, pointer and generic binding symbols
+// are equal if they are built from the same symbols.  Unlike
+// BCSYM::AreTypesEqual no equivalence between different types is considered.
+//============================================================================
+int ConversionClassificationCache::CompareTypes
+(
+    BCSYM * pType1,
+    BCSYM * pType2
+)
+{
+    if (pType1 == pType2)
+    {
+        return 0;
+    }
+    else if (!pType1 || !pType2)
+    {
+        return pType1 ? 1 : -1;
+    }
+
+    ConversionCacheTypeShape Shape1 = GetConversionCacheTypeShape(pType1);
+    ConversionCacheTypeShape Shape2 = GetConversionCacheTypeShape(pType2);
+
+    if (Shape1 != Shape2)
+    {
+        return Shape1 < Shape2 ? -1 : 1;
+    }
+
+    switch (Shape1)
+    {
+        case ConversionCacheTypeShape_Array:
+            {
+                unsigned Rank1 = pType1->PArrayType()->GetRank();
+                unsigned Rank2 = pType2->PArrayType()->GetRank();
+
+                if (Rank1 != Rank2)
+                {
+                    return Rank1 < Rank2 ? -1 : 1;
+                }
+
+                return CompareTypes(pType1->PArrayType()->GetRoot(), pType2->PArrayType()->GetRoot());
+            }
+
+        case ConversionCacheTypeShape_Pointer:
+            return CompareTypes(pType1->PPointerType()->GetRoot(), pType2->PPointerType()->GetRoot());
+
+        case ConversionCacheTypeShape_GenericBinding:
+            {
+                BCSYM_GenericBinding * pBinding1 = pType1->PGenericBinding();
+                BCSYM_GenericBinding * pBinding2 = pType2->PGenericBinding();
+
+                if (pBinding1->GetGeneric() != pBinding2->GetGeneric())
+                {
+                    return pBinding1->GetGeneric() < pBinding2->GetGeneric() ? -1 : 1;
+                }
+
+                if (pBinding1->IsBadNamedRoot() != pBinding2->IsBadNamedRoot())
+                {
+                    return pBinding1->IsBadNamedRoot() ? 1 : -1;
+                }
+
+                unsigned ArgumentCount = pBinding1->GetArgumentCount();
+
+                if (ArgumentCount != pBinding2->GetArgumentCount())
+                {
+                    return ArgumentCount < pBinding2->GetArgumentCount() ? -1 : 1;
+                }
+
+                for (unsigned i = 0; i < ArgumentCount; i++)
+                {
+                    int Result = CompareTypes(pBinding1->GetArgument(i), pBinding2->GetArgument(i));
+
+                    if (Result != 0)
+                    {
+                        return Result;
+                    }
+                }
+
+                return CompareTypes(pBinding1->GetParentBinding(), pBinding2->GetParentBinding());
+            }
+    }
+
+    return pType1 < pType2 ? -1 : 1;
+}
+
+//============================================================================
+// Whether the symbol, and every symbol it is built from, lives until the
+// compilation caches are cleared.  Transient symbols (anonymous types,
+// anonymous delegates, closures and so on) and anything nested in them are
+// created by the method body being interpreted and may go away with it.
+//============================================================================
+bool ConversionClassificationCache::CanCacheSymbol(BCSYM * pSymbol)
+{
+    if (!pSymbol)
+    {
+        return false;
+    }
+
+    switch (GetConversionCacheTypeShape(pSymbol))
+    {
+        case ConversionCacheTypeShape_Array:
+            return CanCacheSymbol(pSymbol->PArrayType()->GetRoot());
+
+        case ConversionCacheTypeShape_Pointer:
+            return CanCacheSymbol(pSymbol->PPointerType()->GetRoot());
+
+        case ConversionCacheTypeShape_GenericBinding:
+            {
+                BCSYM_GenericBinding * pBinding = pSymbol->PGenericBinding();
+
+                if (pBinding->IsBadNamedRoot() || !CanCacheSymbol(pBinding->GetGeneric()))
+                {
+                    return false;
+                }
+
+                for (unsigned i = 0; i < pBinding->GetArgumentCount(); i++)
+                {
+                    if (!CanCacheSymbol(pBinding->GetArgument(i)))
+                    {
+                        return false;
+                    }
+                }
+
+                return !pBinding->GetParentBinding() || CanCacheSymbol(pBinding->GetParentBinding());
+            }
+    }
+
+    if (pSymbol->IsArrayLiteralType())
+    {
+        return false;
+    }
+
+    if (pSymbol->IsNamedRoot())
+    {
+        for (BCSYM_NamedRoot * pNamed = pSymbol->PNamedRoot(); pNamed; pNamed = pNamed->GetParent())
+        {
+            if (pNamed->IsTransient() || pNamed->IsAnonymousType() || pNamed->IsAnonymousDelegate())
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    return pSymbol->IsSimpleType() || pSymbol->IsVoidType();
+}
+
+//============================================================================
+// Returns a type identical to pType whose array, pointer and generic binding
+// symbols are allocated by SymbolCreator.
+//============================================================================
+BCSYM * ConversionClassificationCache::CopyType
+(
+    BCSYM * pType,
+    Symbols & SymbolCreator
+)
+{
+    switch (GetConversionCacheTypeShape(pType))
+    {
+        case ConversionCacheTypeShape_Array:
+            return SymbolCreator.GetArrayType(
+                pType->PArrayType()->GetRank(),
+                CopyType(pType->PArrayType()->GetRoot(), SymbolCreator));
+
+        case ConversionCacheTypeShape_Pointer:
+            return SymbolCreator.MakePtrType(CopyType(pType->PPointerType()->GetRoot(), SymbolCreator));
+
+        case ConversionCacheTypeShape_GenericBinding:
+            {
+                BCSYM_GenericBinding * pBinding = pType->PGenericBinding();
+                BCSYM_GenericTypeBinding * pParentBinding = pBinding->GetParentBinding();
+                unsigned ArgumentCount = pBinding->GetArgumentCount();
+                NorlsAllocator Scratch(NORLSLOC);
+                BCSYM ** Arguments = NULL;
+
+                if (ArgumentCount > 0)
+                {
+                    Arguments = Scratch.AllocArray<BCSYM *>(ArgumentCount);
+
+                    for (unsigned i = 0; i < ArgumentCount; i++)
+                    {
+                        Arguments[i] = CopyType(pBinding->GetArgument(i), SymbolCreator);
+                    }
+                }
+
+                if (pParentBinding)
+                {
+                    pParentBinding = CopyType(pParentBinding, SymbolCreator)->PGenericTypeBinding();
+                }
+
+                return SymbolCreator.GetGenericBinding(
+                    false,
+                    pBinding->GetGeneric(),
+                    Arguments,
+                    ArgumentCount,
+                    pParentBinding,
+                    true);  // AllocAndCopyArgumentsToNewList, the arguments are in scratch storage
+            }
+    }
+
+    return pType;
+}
+
+ConversionClassificationCache::Key::Key() :
+    m_Hash(0),
+    m_Flags(0),
+    m_pTargetType(NULL),
+    m_pSourceType(NULL)
+{
+}
+
+ConversionClassificationCache::Key::Key
+(
+    BCSYM * pTargetType,
+    BCSYM * pSourceType,
+    unsigned Flags
+) :
+    m_Hash(HashType(pTargetType) * 31 + HashType(pSourceType)),
+    m_Flags(Flags),
+    m_pTargetType(pTargetType),
+    m_pSourceType(pSourceType)
+{
+}
+
+int ConversionClassificationCache::KeyOperations::compare(
+    const Key * pKey1,
+    const Key * pKey2)
+{
+    // The hash only orders the keys cheaply; the types still have to be
+    // compared if it matches.
+    if (pKey1->m_Hash != pKey2->m_Hash)
+    {
+        return pKey1->m_Hash < pKey2->m_Hash ? -1 : 1;
+    }
+
+    if (pKey1->m_Flags != pKey2->m_Flags)
+    {
+        return pKey1->m_Flags < pKey2->m_Flags ? -1 : 1;
+    }
+
+    int Result = CompareTypes(pKey1->m_pTargetType, pKey2->m_pTargetType);
+
+    if (Result == 0)
+    {
+        Result = CompareTypes(pKey1->m_pSourceType, pKey2->m_pSourceType);
+    }
+
+    return Result;
+}
+
+unsigned ConversionClassificationCache::KeyOperations::hash(const Key * pKey)
+{
+    return pKey->m_Hash * 31 + pKey->m_Flags;
+}
+
+void ConversionClassificationCache::NodeOperations::copy(
+    Node * pNodeDest,
+    const Node * pNodeSrc)
+{
+    pNodeDest->CacheValue = pNodeSrc->CacheValue;
+}
+
+OverloadResolutionCache::OverloadResolutionCache(NorlsAllocator * pNorls) :
+    m_cache(pNorls),
+    m_cHits(0),
+    m_cMisses(0)
+{
+    ThrowIfNull(pNorls);
+}
+
+bool
+OverloadResolutionCache::LookupInCache
+(
+    const Request & request,
+    Entry * pCacheValue             //[out] - stores the cached resolution
+)
+{
+    Key key(request);
+    Node * pNode = NULL;
+
+    if (m_cache.Find(&key, &pNode))
+    {
+        m_cHits++;
+        *pCacheValue = pNode->CacheValue;
+        return true;
+    }
+
+    m_cMisses++;
+    return false;
+}
+
+void
+OverloadResolutionCache::AddEntry
+(
+    Compiler * pCompiler,
+    const Request & request,
+    const Entry & cacheValue
+)
+{
+    if (!CanCacheRequest(request) ||
+        !ConversionClassificationCache::CanCacheSymbol(cacheValue.m_pResult) ||
+        (cacheValue.m_pGenericBindingContext &&
+            !ConversionClassificationCache::CanCacheSymbol(cacheValue.m_pGenericBindingContext)))
+    {
+        return;
+    }
+
+    Symbols SymbolCreator(pCompiler, GetNorlsAllocator(), NULL);
+    Entry value = cacheValue;
+
+    if (value.m_pGenericBindingContext)
+    {
+        value.m_pGenericBindingContext =
+            ConversionClassificationCache::CopyType(value.m_pGenericBindingContext, SymbolCreator)->PGenericBinding();
+    }
+
+    Key key(request);
+    Node * pNode = NULL;
+
+    CopyRequest(&key.m_Request, SymbolCreator);
+
+    m_cache.Insert(&key, &pNode);
+    pNode->CacheValue = value;
+}
+
+void OverloadResolutionCache::Clear()
+{
+    m_cache.Clear();
+}
+
+NorlsAllocator * OverloadResolutionCache::GetNorlsAllocator()
+{
+    return m_cache.GetNorlsAllocator();
+}
+
+#if DEBUG
+void OverloadResolutionCache::DumpStats()
+{
+    DebPrintf("Overload hits=%5u miss=%5u entries=%5u\n", m_cHits, m_cMisses, m_cache.Count());
+}
+#endif DEBUG
+
+//============================================================================
+// Structural hash of a request, consistent with CompareRequests.
+//============================================================================
+unsigned OverloadResolutionCache::HashRequest(const Request & request)
+{
+    unsigned Hash = ConversionClassificationCache::HashType(request.m_pOverloadedProcedure);
+
+    Hash = Hash * 31 + ConversionClassificationCache::HashType(request.m_pGenericBindingContext);
+    Hash = Hash * 31 + ConversionClassificationCache::HashType(request.m_pContext);
+    Hash = Hash * 31 + ConversionClassificationCache::HashType(request.m_pAccessingInstanceType);
+    Hash = Hash * 31 + ConversionClassificationCache::HashType(request.m_pDelegateType);
+    Hash = Hash * 31 + ConversionClassificationCache::HashType(request.m_pDelegateReturnType);
+    Hash = Hash * 31 + (unsigned)request.m_ExpressionFlags;
+    Hash = Hash * 31 + (unsigned)(request.m_ExpressionFlags >> 32);
+    Hash = Hash * 31 + request.m_OverloadResolutionFlags;
+    Hash = Hash * 31 + (request.m_OptionStrict ? 1 : 0);
+
+    for (unsigned i = 0; i < request.m_TypeArgumentCount; i++)
+    {
+        Hash = Hash * 31 + ConversionClassificationCache::HashType(request.m_TypeArguments[i]);
+    }
+
+    for (unsigned i = 0; i < request.m_ArgumentCount; i++)
+    {
+        const Argument & argument = request.m_Arguments[i];
+
+        Hash = Hash * 31 + ConversionClassificationCache::HashType(argument.m_pType);
+        Hash = Hash * 31 + argument.m_Opcode * 2 + (argument.m_IsLValue ? 1 : 0);
+    }
+
+    return Hash * 31 + request.m_TypeArgumentCount * 16 + request.m_ArgumentCount;
+}
+
+//============================================================================
+// Orders requests; the types in them are compared by identity.
+//============================================================================
+int OverloadResolutionCache::CompareRequests
+(
+    const Request & request1,
+    const Request & request2
+)
+{
+    int Result =
+        CompareValues(request1.m_pOverloadedProcedure, request2.m_pOverloadedProcedure);
+
+    if (Result == 0)
+    {
+        Result = CompareValues(request1.m_pContext, request2.m_pContext);
+    }
+
+    if (Result == 0)
+    {
+        Result = CompareValues(request1.m_ExpressionFlags, request2.m_ExpressionFlags);
+    }
+
+    if (Result == 0)
+    {
+        Result = CompareValues(request1.m_OverloadResolutionFlags, request2.m_OverloadResolutionFlags);
+    }
+
+    if (Result == 0)
+    {
+        Result = CompareValues(request1.m_OptionStrict, request2.m_OptionStrict);
+    }
+
+    if (Result == 0)
+    {
+        Result = CompareValues(request1.m_TypeArgumentCount, request2.m_TypeArgumentCount);
+    }
+
+    if (Result == 0)
+    {
+        Result = CompareValues(request1.m_ArgumentCount, request2.m_ArgumentCount);
+    }
+
+    if (Result == 0)
+    {
+        Result = ConversionClassificationCache::CompareTypes(request1.m_pGenericBindingContext, request2.m_pGenericBindingContext);
+    }
+
+    if (Result == 0)
+    {
+        Result = ConversionClassificationCache::CompareTypes(request1.m_pAccessingInstanceType, request2.m_pAccessingInstanceType);
+    }
+
+    if (Result == 0)
+    {
+        Result = ConversionClassificationCache::CompareTypes(request1.m_pDelegateType, request2.m_pDelegateType);
+    }
+
+    if (Result == 0)
+    {
+        Result = ConversionClassificationCache::CompareTypes(request1.m_pDelegateReturnType, request2.m_pDelegateReturnType);
+    }
+
+    for (unsigned i = 0; Result == 0 && i < request1.m_TypeArgumentCount; i++)
+    {
+        Result = ConversionClassificationCache::CompareTypes(request1.m_TypeArguments[i], request2.m_TypeArguments[i]);
+    }
+
+    for (unsigned i = 0; Result == 0 && i < request1.m_ArgumentCount; i++)
+    {
+        const Argument & argument1 = request1.m_Arguments[i];
+        const Argument & argument2 = request2.m_Arguments[i];
+
+        Result = CompareValues(argument1.m_Opcode, argument2.m_Opcode);
+
+        if (Result == 0)
+        {
+            Result = CompareValues(argument1.m_IsLValue, argument2.m_IsLValue);
+        }
+
+        if (Result == 0)
+        {
+            Result = ConversionClassificationCache::CompareTypes(argument1.m_pType, argument2.m_pType);
+        }
+    }
+
+    return Result;
+}
+
+//============================================================================
+// Whether every symbol of the request lives as long as the cache.
+//============================================================================
+bool OverloadResolutionCache::CanCacheRequest(const Request & request)
+{
+    BCSYM * OptionalTypes[] =
+    {
+        request.m_pGenericBindingContext,
+        request.m_pAccessingInstanceType,
+        request.m_pDelegateType,
+        request.m_pDelegateReturnType
+    };
+
+    if (!ConversionClassificationCache::CanCacheSymbol(request.m_pOverloadedProcedure) ||
+        !ConversionClassificationCache::CanCacheSymbol(request.m_pContext))
+    {
+        return false;
+    }
+
+    for (unsigned i = 0; i < DIM(OptionalTypes); i++)
+    {
+        if (OptionalTypes[i] && !ConversionClassificationCache::CanCacheSymbol(OptionalTypes[i]))
+        {
+            return false;
+        }
+    }
+
+    for (unsigned i = 0; i < request.m_TypeArgumentCount; i++)
+    {
+        if (!ConversionClassificationCache::CanCacheSymbol(request.m_TypeArguments[i]))
+        {
+            return false;
+        }
+    }
+
+    for (unsigned i = 0; i < request.m_ArgumentCount; i++)
+    {
+        if (!ConversionClassificationCache::CanCacheSymbol(request.m_Arguments[i].m_pType))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//============================================================================
+// Replaces the types of the request by identical ones allocated by
+// SymbolCreator.
+//============================================================================
+void OverloadResolutionCache::CopyRequest
+(
+    Request * pRequest,
+    Symbols & SymbolCreator
+)
+{
+    if (pRequest->m_pGenericBindingContext)
+    {
+        pRequest->m_pGenericBindingContext =
+            ConversionClassificationCache::CopyType(pRequest->m_pGenericBindingContext, SymbolCreator)->PGenericBinding();
+    }
+
+    if (pRequest->m_pAccessingInstanceType)
+    {
+        pRequest->m_pAccessingInstanceType = ConversionClassificationCache::CopyType(pRequest->m_pAccessingInstanceType, SymbolCreator);
+    }
+
+    if (pRequest->m_pDelegateType)
+    {
+        pRequest->m_pDelegateType = ConversionClassificationCache::CopyType(pRequest->m_pDelegateType, SymbolCreator);
+    }
+
+    if (pRequest->m_pDelegateReturnType)
+    {
+        pRequest->m_pDelegateReturnType = ConversionClassificationCache::CopyType(pRequest->m_pDelegateReturnType, SymbolCreator);
+    }
+
+    for (unsigned i = 0; i < pRequest->m_TypeArgumentCount; i++)
+    {
+        pRequest->m_TypeArguments[i] = ConversionClassificationCache::CopyType(pRequest->m_TypeArguments[i], SymbolCreator);
+    }
+
+    for (unsigned i = 0; i < pRequest->m_ArgumentCount; i++)
+    {
+        pRequest->m_Arguments[i].m_pType = ConversionClassificationCache::CopyType(pRequest->m_Arguments[i].m_pType, SymbolCreator);
+    }
+}
+
+OverloadResolutionCache::Key::Key() :
+    m_Hash(0)
+{
+    memset(&m_Request, 0, sizeof(m_Request));
+}
+
+OverloadResolutionCache::Key::Key
+(
+    const Request & request
+) :
+    m_Hash(HashRequest(request)),
+    m_Request(request)
+{
+}
+
+int OverloadResolutionCache::KeyOperations::compare(
+    const Key * pKey1,
+    const Key * pKey2)
+{
+    if (pKey1->m_Hash != pKey2->m_Hash)
+    {
+        return pKey1->m_Hash < pKey2->m_Hash ? -1 : 1;
+    }
+
+    return CompareRequests(pKey1->m_Request, pKey2->m_Request);
+}
+
+unsigned OverloadResolutionCache::KeyOperations::hash(const Key * pKey)
+{
+    return pKey->m_Hash;
+}
+
+void OverloadResolutionCache::NodeOperations::copy(
+    Node * pNodeDest,
+    const Node * pNodeSrc)
+{
+    pNodeDest->CacheValue = pNodeSrc->CacheValue;
+}
+
 //forward declaration
 bool IsEqual(
     DynamicArray<VbCompilerWarningItemLevel> * memberWarningsLevelTable,
@@ -180,6 +943,12 @@ int ExtensionMethodLookupCacheKeyObject::Compare(
     return memcmp(pLeft, pRight, sizeof(ExtensionMethodLookupCacheKeyObject));
 }
 
+// The constructors zero the whole object, so hashing its bytes agrees with Compare.
+unsigned ExtensionMethodLookupCacheKeyObject::Hash(const ExtensionMethodLookupCacheKeyObject * pKeyObject)
+{
+    return HashCacheKeyBytes(pKeyObject, sizeof(ExtensionMethodLookupCacheKeyObject));
+}
+
 ExtensionMethodNameLookupCache::Key::Key(
     _In_ STRING * pMethodName,
     const ExtensionMethodLookupCacheKeyObject &keyObject,
@@ -250,6 +1019,16 @@ int ExtensionMethodNameLookupCache::KeyOperations::compare(
     }
 }
 
+unsigned ExtensionMethodNameLookupCache::KeyOperations::hash(const Key * pKey)
+{
+    // Hash the string info rather than the name, like compare.
+    unsigned Hash = HashCacheKeyPointer(StringPool::Pstrinfo(pKey->m_pMethodName));
+
+    Hash = Hash * 31 + pKey->m_usageType;
+
+    return Hash * 31 + ExtensionMethodLookupCacheKeyObject::Hash(&pKey->m_keyObject);
+}
+
 void ExtensionMethodNameLookupCache::NodeOperations::copy(
     Node * pNodeDest,
     const Node * pNodeSrc)
@@ -309,6 +1088,8 @@ CompilationCaches::CompilationCaches():
     m_LookupCache(&m_nrlsCachedData),
     m_ExtensionMethodLookupCache(&m_nrlsCachedData),  
     m_LiftedOperatorCache(&m_nrlsCachedData),
+    m_ConversionCache(&m_nrlsCachedData),
+    m_OverloadResolutionCache(&m_nrlsCachedData),
     m_MergedNamespaceCache(&m_nrlsCachedData)
 {
 #if IDE  
@@ -322,6 +1103,8 @@ CompilationCaches::CompilationCaches(NorlsAllocator * pnorls):
     m_LookupCache(pnorls),
     m_ExtensionMethodLookupCache(pnorls),  
     m_LiftedOperatorCache(pnorls),
+    m_ConversionCache(pnorls),
+    m_OverloadResolutionCache(pnorls),
     m_MergedNamespaceCache(pnorls)
 {
     VSASSERT(GetCompilerSharedState()->IsInMainThread(), "GetCompilerSharedState()->IsInMainThread()");
@@ -373,6 +1156,11 @@ void CompilationCaches::ClearCompilationCaches(int  cacheType /*= 0*/)
         m_MergedNamespaceCache.Clear();
     }
 
+    // Classified conversions and resolved overloads can refer to symbols held
+    // by any of the other caches, so they go whenever anything is cleared.
+    m_ConversionCache.Clear();
+    m_OverloadResolutionCache.Clear();
+
     if (cacheType == CompCacheType_AllCaches )
     {
         m_nrlsCachedData.FreeHeap();
@@ -701,10 +1489,18 @@ void CompilationCaches::DumpStats()
     m_MergedNamespaceCache.DumpTreeStats();
     m_MergedNamespaceCache.GetNodeDump(true);
 
+    m_ConversionCache.DumpStats();
+    m_ConversionCache.m_cache.DumpTreeStats();
+
+    m_OverloadResolutionCache.DumpStats();
+    m_OverloadResolutionCache.m_cache.DumpTreeStats();
+
     m_LookupCache.ClearTreeStats();
     m_ExtensionMethodLookupCache.m_cache.ClearTreeStats();
     m_LiftedOperatorCache.m_cache.ClearTreeStats();
     m_MergedNamespaceCache.ClearTreeStats();
+    m_ConversionCache.m_cache.ClearTreeStats();
+    m_OverloadResolutionCache.m_cache.ClearTreeStats();
     
 }
 
@@ -855,6 +1651,8 @@ CompilerProject::CompilerProject(Compiler * pCompiler)
 ,m_ImportsCache(&m_nrlsLookupCaches)
 ,m_ExtensionMethodLookupCache(&m_nrlsLookupCaches)
 ,m_LiftedOperatorCache(&m_nrlsLookupCaches)
+,m_ConversionCache(&m_nrlsLookupCaches)
+,m_OverloadResolutionCache(&m_nrlsLookupCaches)
 ,m_SourceFileCache(pCompiler)
 ,m_LangVersion(LANGUAGE_CURRENT)
 ,m_PotentiallyEmbedsPiaTypes(false)
@@ -7945,12 +8743,159 @@ void CompilerProject::RemoveCompilerFile(CompilerFile* pCompilerFile)
 // a file.
 //****************************************************************************
 
+//============================================================================
+// Parses the declaration trees of a batch of source files on the worker
+// pool, for the parallel declared phase.  Only the parse runs concurrently:
+// building the symbols from the trees touches the compiler-wide namespace
+// rings and so is still done on the compile thread, one file at a time and
+// in the same order as the serial path.
+//
+// Files are parsed in batches so that we never hold on to the declaration
+// trees of more than DeclTreeBatchSize files at once.
+//============================================================================
+
+class DeclTreeBatchParser
+{
+public:
+    struct ParsedFile
+    {
+        SourceFile *m_pFile;
+        NorlsAllocator *m_pnraDeclTrees;
+        BCSYM_Container *m_pcontainerConditionalConstants;
+        ParseTree::FileBlockStatement *m_pDeclTrees;
+        HRESULT m_hr;
+        bool m_fStarted;
+    };
+
+    DeclTreeBatchParser(WorkStealingPool *pPool) :
+        m_pPool(pPool),
+        m_iNext(0)
+    {
+    }
+
+    ~DeclTreeBatchParser()
+    {
+        Reset();
+    }
+
+    // Returns the trees for pFile, parsing the batch of files starting at
+    // pFile if needed.  Returns NULL if pFile is not a source file, or if
+    // the batch was cancelled before pFile was parsed; the caller then
+    // parses it serially.
+    ParsedFile *GetParsedFile(CompilerFile *pFile)
+    {
+        if (!pFile->IsSourceFile())
+        {
+            return NULL;
+        }
+
+        if (m_iNext == m_daParsed.Count() || m_daParsed.Element(m_iNext).m_pFile != pFile)
+        {
+            ParseBatch(pFile);
+        }
+
+        VSASSERT(m_daParsed.Element(m_iNext).m_pFile == pFile, "Files parsed out of order.");
+
+        ParsedFile *pParsed = &m_daParsed.Element(m_iNext++);
+
+        if (!pParsed->m_fStarted)
+        {
+            ReleaseParsedFile(pParsed);
+            return NULL;
+        }
+
+        return pParsed;
+    }
+
+    // Releases the trees once the symbols for the file have been built.
+    void ReleaseParsedFile(ParsedFile *pParsed)
+    {
+        delete pParsed->m_pnraDeclTrees;
+        pParsed->m_pnraDeclTrees = NULL;
+        pParsed->m_pDeclTrees = NULL;
+    }
+
+private:
+    static const unsigned DeclTreeBatchSize = 256;
+
+    void ParseBatch(CompilerFile *pFirstFile)
+    {
+        Reset();
+
+        for (CompilerFile *pFile = pFirstFile;
+             pFile && m_daParsed.Count() < DeclTreeBatchSize;
+             pFile = pFile->Next())
+        {
+            if (pFile->IsSourceFile())
+            {
+                ParsedFile &parsed = m_daParsed.Add();
+
+                parsed.m_pFile = pFile->PSourceFile();
+                parsed.m_pnraDeclTrees = new NorlsAllocator(NORLSLOC);
+                parsed.m_pcontainerConditionalConstants = NULL;
+                parsed.m_pDeclTrees = NULL;
+                parsed.m_hr = E_ABORT;
+                parsed.m_fStarted = false;
+            }
+        }
+
+        HRESULT hr = m_pPool->Run(m_daParsed.Count(), ParseWorkItem, this);
+
+        if (FAILED(hr))
+        {
+            // The pool cancels the rest of the batch after the first
+            // failure.  Items that never started are left for the serial
+            // path, but an item that threw part way through has to report
+            // the failure: its file may already be half parsed.
+            for (ULONG iParsed = 0; iParsed < m_daParsed.Count(); iParsed++)
+            {
+                ParsedFile &parsed = m_daParsed.Element(iParsed);
+
+                if (parsed.m_fStarted && parsed.m_hr == E_ABORT)
+                {
+                    parsed.m_hr = hr;
+                }
+            }
+        }
+    }
+
+    static void ParseWorkItem(void *pvContext, unsigned iItem, unsigned iWorker)
+    {
+        DeclTreeBatchParser *pParser = (DeclTreeBatchParser *)pvContext;
+        ParsedFile &parsed = pParser->m_daParsed.Element(iItem);
+
+        // m_hr stays E_ABORT if the parse throws.
+        parsed.m_fStarted = true;
+        parsed.m_hr = parsed.m_pFile->ParseDeclTreesForBuiltSymbols(
+            parsed.m_pnraDeclTrees,
+            &parsed.m_pcontainerConditionalConstants,
+            &parsed.m_pDeclTrees);
+    }
+
+    void Reset()
+    {
+        for (ULONG iParsed = 0; iParsed < m_daParsed.Count(); iParsed++)
+        {
+            ReleaseParsedFile(&m_daParsed.Element(iParsed));
+        }
+
+        m_daParsed.Reset();
+        m_iNext = 0;
+    }
+
+    WorkStealingPool *m_pPool;
+    DynamicArray<ParsedFile> m_daParsed;
+    ULONG m_iNext;
+};
+
 //============================================================================
 // Do the work to bring the project to declared state.
 //============================================================================
 
 bool CompilerProject::_PromoteToDeclared()
 {
+    TIMEBLOCKDETAIL(TIME_PromoteToDeclared, GetAssemblyName());
+
     bool fAborted = false;
     CompilerFile *pfile = NULL;
     ErrorTable errors(m_pCompiler, this, NULL);
@@ -7995,6 +8940,11 @@ bool CompilerProject::_PromoteToDeclared()
     // Bring each file to declared.
     //========================================================================
 
+    // Metadata files share the MetaImport state, so only source projects
+    // parse their files on the worker pool.
+    WorkStealingPool *pWorkerPool = IsMetaData() ? NULL : m_pCompiler->GetWorkerPool();
+    DeclTreeBatchParser parallelParser(pWorkerPool);
+
     // Move all of the files in the project to the next state.
     while (pfile = m_dlFiles[CS_NoState].GetFirst())
     {
@@ -8008,7 +8958,20 @@ bool CompilerProject::_PromoteToDeclared()
 #endif IDE
 
         // Do the promotion.
-        IfTrueAbort(pfile->_StepToBuiltSymbols());
+        DeclTreeBatchParser::ParsedFile *pParsed = pWorkerPool ? parallelParser.GetParsedFile(pfile) : NULL;
+
+        if (pParsed)
+        {
+            IfFailThrow(pParsed->m_hr);
+            IfTrueAbort(pParsed->m_pFile->StepToBuiltSymbolsFromDeclTrees(
+                pParsed->m_pcontainerConditionalConstants,
+                pParsed->m_pDeclTrees));
+            parallelParser.ReleaseParsedFile(pParsed);
+        }
+        else
+        {
+            IfTrueAbort(pfile->_StepToBuiltSymbols());
+        }
 
         // Mark this module as being in declared state.
         VSASSERT(pfile->m_cs == CS_NoState, "State changed unexpectedly.");
@@ -8096,6 +9059,8 @@ Abort:
 
 bool CompilerProject::_PromoteToBound()
 {
+    TIMEBLOCKDETAIL(TIME_PromoteToBound, GetAssemblyName());
+
     bool fAborted = false;
     CompilerFile *pfile;
 
@@ -8640,6 +9605,8 @@ CompilerProject::FinishPromoteToBoundForFile
 
 bool CompilerProject::_PromoteToTypesEmitted()
 {
+    TIMEBLOCKDETAIL(TIME_PromoteToTypesEmitted, GetAssemblyName());
+
     VSASSERT(m_cs < CS_TypesEmitted, "Attempt to promote a project to TypesEmitted that is already in this state.");
 
     bool fAborted = false;
@@ -8746,6 +9713,8 @@ Abort:
 //============================================================================
 bool CompilerProject::_PromoteToCompiled()
 {
+    TIMEBLOCKDETAIL(TIME_PromoteToCompiled, GetAssemblyName());
+
     bool fAborted = false;
     bool fGeneratedOutput = false;
     CompilerFile *pFile = NULL;
@@ -165,6 +165,8 @@ struct ExtensionMethodLookupCacheKeyObject
         const ExtensionMethodLookupCacheKeyObject * pLeft,
         const ExtensionMethodLookupCacheKeyObject * pRight
     );
+
+    static unsigned Hash(const ExtensionMethodLookupCacheKeyObject * pKeyObject);
 };
 
 //The extension method name lookup cache.
@@ -242,7 +244,7 @@ private:
     };
 public:
     struct Node :
-        public RedBlackNodeBaseT<Key>
+        public CompilationCacheNodeBaseT<Key>
     {
         ExtensionMethodLookupCacheEntry * pCacheEntry;
     };
@@ -251,6 +253,7 @@ private:
         public SimpleKeyOperationsT<Key>
     {
         int compare(const Key *pKey1, const Key * pKey2);
+        unsigned hash(const Key *pKey);
     };
 
     struct NodeOperations :
@@ -259,7 +262,7 @@ private:
         void copy(Node *pNodeDest, const Node *pNodeSrc);
     };
 public:
-    typedef RedBlackTreeT<Key, KeyOperations, Node, NodeOperations> tree_type;
+    typedef CompilationCacheT<Key, KeyOperations, Node, NodeOperations> tree_type;
 private:
     tree_type m_cache;
 };
@@ -358,7 +361,7 @@ private:
     };
 public:
     struct Node :
-        public RedBlackNodeBaseT<Key>
+        public CompilationCacheNodeBaseT<Key>
     {
         BCSYM_UserDefinedOperator * pLiftedOperator;
     };
@@ -367,6 +370,265 @@ private:
         public SimpleKeyOperationsT<Key>
     {
         int compare(const Key *pKey1, const Key * pKey2);
+        unsigned hash(const Key *pKey);
+    };
+
+    struct NodeOperations :
+        public EmptyNodeOperationsT<Node>
+    {
+        void copy(Node *pNodeDest, const Node *pNodeSrc);
+    };
+public:
+    typedef CompilationCacheT<Key, KeyOperations, Node, NodeOperations> tree_type;
+private:
+    tree_type m_cache;
+};
+
+//The conversion classification cache.
+//Remembers the results of Semantics::ClassifyConversion, which overload resolution and type inference
+//ask for the same pairs of types over and over again.
+//
+//The key is the identity of the target and source types rather than the type symbols themselves, because
+//generic bindings and array types are created again by every method body that uses them. An entry is only
+//added if every symbol it refers to lives as long as the cache, i.e. nothing transient or anonymous, and the
+//generic bindings, array types and pointer types of the entry are copied into the allocator of the cache so that
+//it never refers to the temporary symbols of the method body that added it.
+//
+//Option Strict is not part of the key: the classification itself never depends on it, only what the caller
+//does with the result.
+class ConversionClassificationCache
+{
+    friend class CompilationCaches;
+    friend class CVbCompilerCompCache;
+    friend class OverloadResolutionCache;   // shares the type identity helpers
+public:
+
+    // Flags that are part of the key.
+    enum
+    {
+        ConsiderConversionsOnNullableBool = 0x1,
+        IgnoreOperatorMethod = 0x2
+    };
+
+    struct Entry
+    {
+        unsigned char m_ConversionClass;                    // ConversionClass
+        unsigned char m_ConversionRelaxationLevel;          // DelegateRelaxationLevel
+        bool m_OperatorMethodIsLifted : 1;
+        bool m_ConversionRequiresUnliftedAccessToNullableValue : 1;
+        bool m_ConversionIsNarrowingDueToAmbiguity : 1;
+        bool m_UserDefinedConversionConsidered : 1;         // the operator method fields are only valid if this is set
+        BCSYM_Proc * m_pOperatorMethod;
+        BCSYM_GenericBinding * m_pOperatorMethodGenericContext;
+    };
+
+    ConversionClassificationCache
+    (
+        NorlsAllocator * pNorls
+    );
+
+    bool
+    LookupInCache
+    (
+        BCSYM * pTargetType,
+        BCSYM * pSourceType,
+        unsigned Flags,
+        Entry * pCacheValue             //[out] - stores the cached classification
+    );
+
+    void
+    AddEntry
+    (
+        Compiler * pCompiler,
+        BCSYM * pTargetType,
+        BCSYM * pSourceType,
+        unsigned Flags,
+        const Entry & cacheValue
+    );
+
+    void Clear();
+    NorlsAllocator * GetNorlsAllocator();
+
+    unsigned GetHitCount()
+    {
+        return m_cHits;
+    }
+
+    unsigned GetMissCount()
+    {
+        return m_cMisses;
+    }
+
+#if DEBUG
+    void DumpStats();
+#endif DEBUG
+
+private:
+    struct Key
+    {
+        unsigned m_Hash;
+        unsigned m_Flags;
+        BCSYM * m_pTargetType;
+        BCSYM * m_pSourceType;
+
+        Key();
+        Key
+        (
+            BCSYM * pTargetType,
+            BCSYM * pSourceType,
+            unsigned Flags
+        );
+    };
+public:
+    struct Node :
+        public CompilationCacheNodeBaseT<Key>
+    {
+        Entry CacheValue;
+    };
+private:
+    struct KeyOperations :
+        public SimpleKeyOperationsT<Key>
+    {
+        int compare(const Key *pKey1, const Key * pKey2);
+        unsigned hash(const Key *pKey);
+    };
+
+    struct NodeOperations :
+        public EmptyNodeOperationsT<Node>
+    {
+        void copy(Node *pNodeDest, const Node *pNodeSrc);
+    };
+
+    static unsigned HashType(BCSYM * pType);
+    static int CompareTypes(BCSYM * pType1, BCSYM * pType2);
+    static bool CanCacheSymbol(BCSYM * pSymbol);
+    static BCSYM * CopyType(BCSYM * pType, Symbols & SymbolCreator);
+public:
+    typedef CompilationCacheT<Key, KeyOperations, Node, NodeOperations> tree_type;
+private:
+    tree_type m_cache;
+    unsigned m_cHits;
+    unsigned m_cMisses;
+};
+
+
+//The overload resolution cache.
+//Remembers which overload Semantics::ResolveOverloadedCall picked for a method group, so that calling the
+//same overloads with the same argument types over and over again (generated code does this a lot) does not
+//collect, match and compare all the candidates every time.
+//
+//A request is only cached if the outcome can depend on nothing but the data in the request: every argument
+//is positional and its expression is of a kind whose conversions only depend on its type (no constants,
+//Nothing, lambdas, AddressOf or array literals). Only clean resolutions are added: a single winner that is
+//not late bound and for which nothing at all was reported. The caller interprets the call against the winner
+//exactly as before, so the diagnostics of the call itself are unchanged.
+//
+//Types are keyed and copied like in the conversion classification cache.
+class OverloadResolutionCache
+{
+    friend class CompilationCaches;
+    friend class CVbCompilerCompCache;
+public:
+
+    // Calls with more arguments or type arguments are not cached.
+    enum
+    {
+        MaxArgumentCount = 8,
+        MaxTypeArgumentCount = 4
+    };
+
+    struct Argument
+    {
+        BCSYM * m_pType;
+        unsigned short m_Opcode;                    // BILOP of the argument expression
+        bool m_IsLValue;                            // decides how ByRef parameters are matched
+    };
+
+    // Everything the outcome of the resolution depends on, besides the declarations.
+    struct Request
+    {
+        BCSYM_NamedRoot * m_pOverloadedProcedure;
+        BCSYM_GenericBinding * m_pGenericBindingContext;
+        BCSYM_Container * m_pContext;               // accessibility is checked from here
+        BCSYM * m_pAccessingInstanceType;
+        BCSYM * m_pDelegateType;
+        BCSYM * m_pDelegateReturnType;
+        unsigned __int64 m_ExpressionFlags;
+        unsigned m_OverloadResolutionFlags;
+        bool m_OptionStrict;
+        unsigned m_TypeArgumentCount;
+        BCSYM * m_TypeArguments[MaxTypeArgumentCount];
+        unsigned m_ArgumentCount;
+        Argument m_Arguments[MaxArgumentCount];
+    };
+
+    struct Entry
+    {
+        BCSYM_NamedRoot * m_pResult;
+        BCSYM_GenericBinding * m_pGenericBindingContext;
+    };
+
+    OverloadResolutionCache
+    (
+        NorlsAllocator * pNorls
+    );
+
+    bool
+    LookupInCache
+    (
+        const Request & request,
+        Entry * pCacheValue             //[out] - stores the cached resolution
+    );
+
+    void
+    AddEntry
+    (
+        Compiler * pCompiler,
+        const Request & request,
+        const Entry & cacheValue
+    );
+
+    void Clear();
+    NorlsAllocator * GetNorlsAllocator();
+
+    unsigned GetHitCount()
+    {
+        return m_cHits;
+    }
+
+    unsigned GetMissCount()
+    {
+        return m_cMisses;
+    }
+
+#if DEBUG
+    void DumpStats();
+#endif DEBUG
+
+private:
+    struct Key
+    {
+        unsigned m_Hash;
+        Request m_Request;
+
+        Key();
+        Key
+        (
+            const Request & request
+        );
+    };
+public:
+    struct Node :
+        public CompilationCacheNodeBaseT<Key>
+    {
+        Entry CacheValue;
+    };
+private:
+    struct KeyOperations :
+        public SimpleKeyOperationsT<Key>
+    {
+        int compare(const Key *pKey1, const Key * pKey2);
+        unsigned hash(const Key *pKey);
     };
 
     struct NodeOperations :
@@ -374,10 +636,17 @@ private:
     {
         void copy(Node *pNodeDest, const Node *pNodeSrc);
     };
+
+    static unsigned HashRequest(const Request & request);
+    static int CompareRequests(const Request & request1, const Request & request2);
+    static bool CanCacheRequest(const Request & request);
+    static void CopyRequest(Request * pRequest, Symbols & SymbolCreator);
 public:
-    typedef RedBlackTreeT<Key, KeyOperations, Node, NodeOperations> tree_type;
+    typedef CompilationCacheT<Key, KeyOperations, Node, NodeOperations> tree_type;
 private:
     tree_type m_cache;
+    unsigned m_cHits;
+    unsigned m_cMisses;
 };
 
 
@@ -439,10 +708,15 @@ struct LookupKeyOperations :
     {
         return memcmp(pKey1, pKey2, sizeof(LookupKey));
     }
+
+    unsigned hash(const LookupKey *pKey)
+    {
+        return HashCacheKeyBytes(pKey, sizeof(LookupKey));
+    }
 };
 
 struct LookupNode :
-    public RedBlackNodeBaseT<LookupKey>
+    public CompilationCacheNodeBaseT<LookupKey>
 {
     BCSYM_NamedRoot *Result;
     BCSYM_GenericBinding *GenericBindingContext;
@@ -458,7 +732,7 @@ struct LookupNodeOperations :
     }
 };
 
-typedef RedBlackTreeT<
+typedef CompilationCacheT<
     LookupKey,
     LookupKeyOperations,
     LookupNode,
@@ -491,10 +765,15 @@ struct NamespaceRingKeyOperations :
     {
         return memcmp(pKey1, pKey2, sizeof(NamespaceRingKey));
     }
+
+    unsigned hash(_In_ const NamespaceRingKey *pKey)
+    {
+        return HashCacheKeyBytes(pKey, sizeof(NamespaceRingKey));
+    }
 };
 
 struct NamespaceRingNode :
-    public RedBlackNodeBaseT<NamespaceRingKey>
+    public CompilationCacheNodeBaseT<NamespaceRingKey>
 {
 
     NamespaceRingNode() :
@@ -529,7 +808,7 @@ struct NamespaceRingNodeOperations :
     }
 };
 
-typedef RedBlackTreeT<
+typedef CompilationCacheT<
     NamespaceRingKey,
     NamespaceRingKeyOperations,
     NamespaceRingNode,
@@ -567,6 +846,16 @@ public:
         return &m_LiftedOperatorCache;
     }
 
+    ConversionClassificationCache *GetConversionCache()
+    {
+        return &m_ConversionCache;
+    }
+
+    OverloadResolutionCache *GetOverloadResolutionCache()
+    {
+        return &m_OverloadResolutionCache;
+    }
+
     NamespaceRingTree *GetMergedNamespaceCache()
     {
         return &m_MergedNamespaceCache;
@@ -585,6 +874,8 @@ private:
     LookupTree m_LookupCache;
     ExtensionMethodNameLookupCache m_ExtensionMethodLookupCache;
     LiftedUserDefinedOperatorCache m_LiftedOperatorCache;
+    ConversionClassificationCache m_ConversionCache;
+    OverloadResolutionCache m_OverloadResolutionCache;
     NamespaceRingTree m_MergedNamespaceCache;
     NorlsAllocator m_nrlsCachedData;
 };
@@ -3367,12 +3658,32 @@ public:
         return &m_LiftedOperatorCache;
     }
 
+    ConversionClassificationCache * GetConversionCache()
+    {
+        return &m_ConversionCache;
+    }
+
+    OverloadResolutionCache * GetOverloadResolutionCache()
+    {
+        return &m_OverloadResolutionCache;
+    }
+
     void ClearLookupCaches()
     {
+#if DEBUG
+        if (VSFSWITCH(fCompCaches))
+        {
+            m_ConversionCache.DumpStats();
+            m_OverloadResolutionCache.DumpStats();
+        }
+#endif DEBUG
+
         m_LookupCache.Clear();
         m_ImportsCache.Clear();
         m_ExtensionMethodLookupCache.Clear();
         m_LiftedOperatorCache.Clear();
+        m_ConversionCache.Clear();
+        m_OverloadResolutionCache.Clear();
         m_nrlsLookupCaches.FreeHeap();   
     }
 
@@ -3424,6 +3735,8 @@ private:
     // Note, this cache does not return the extension method symbol, it only answers whether the project contains an extension method with this name.
     HashSet<STRING_INFO*> m_ExtensionMethodExistsCache; // Entry for existence of an extension method with the name    
     LiftedUserDefinedOperatorCache m_LiftedOperatorCache;
+    ConversionClassificationCache m_ConversionCache;
+    OverloadResolutionCache m_OverloadResolutionCache;
 
     // The declaration type refs are populated when going to Declared state.
     HashSet<BCSYM*> m_DeclarationPiaTypeRefCache;
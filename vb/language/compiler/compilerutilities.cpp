@@ -1428,6 +1428,14 @@ HRESULT ParseCodeBlock(
             pCodeBlock->m_lBegLine,
             pCodeBlock->m_lBegColumn,
             methodDeclKind);
+
+        // Reuse the tokens scanned when the declarations of the file were parsed.
+        TokenStreamCache *pTokenCache = pSourceFile ? pSourceFile->GetTokenStreamCache() : NULL;
+
+        if (pTokenCache && !pTokenCache->IsRecording())
+        {
+            tsBody.ReplayLines(pTokenCache, pCodeBlock->m_oBegin);
+        }
         
         bool IsXMLDocOn = alwaysParseXmlDocComments;
         CompilerHost *pCompilerHost = NULL;
@@ -1602,6 +1610,13 @@ HRESULT GetDeclTrees(
             0,
             NormalKind); // don't assume await/yield are keywords
 
+        TokenStreamCache *pTokenCache = pSourceFile ? pSourceFile->GetTokenStreamCache() : NULL;
+
+        if (pTokenCache && pTokenCache->IsRecording() && startLine == 0)
+        {
+            fileTokens.RecordLines(pTokenCache, initialAbsOffset);
+        }
+
         
         bool IsXMLDocOn = alwaysParseXmlDocComments;
         CompilerHost *pCompilerHost = NULL;
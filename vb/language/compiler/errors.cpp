@@ -1006,6 +1006,16 @@ unsigned ErrorTable::GetErrorCount()
     return errorCount;
 }
 
+//=============================================================================
+// Get the number of errors, warnings and comments together.
+//=============================================================================
+
+unsigned ErrorTable::GetEntryCount()
+{
+    CompilerIdeTransientLock lock(m_csErrorTable, GetTransientLockMode());
+    return (unsigned)m_Errors.size();
+}
+
 //=============================================================================
 // Does this table contain any Warnings?  Ignore comments.
 //=============================================================================
@@ -371,6 +371,11 @@ public:
     unsigned GetErrorCount();
     bool HasWarnings();
     unsigned GetWarningCount();
+
+    // Number of errors, warnings and comments together. Unlike the counts
+    // above this doesn't walk the table, so it is cheap enough to tell whether
+    // anything was reported by a piece of code.
+    unsigned GetEntryCount();
     bool HasComments();
 
     bool HasErrorsThroughStep(CompilationSteps step);
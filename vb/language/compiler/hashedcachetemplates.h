@@ -0,0 +1,512 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Open addressed hash table template for the compilation caches.
+//
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+//============================================================================
+// HASHED_COMPILATION_CACHES:
+//
+//      Selects the container behind the name lookup, merged namespace,
+//      extension method, lifted operator and conversion caches.  The caches
+//      are only ever searched for an exact key, so the order kept by a Red
+//      Black Tree buys nothing; with a non zero value they are built on
+//      HashedCacheT instead, which finds a key in a single probe in the
+//      common case.  Define it to 0 to go back to RedBlackTreeT.
+//============================================================================
+#ifndef HASHED_COMPILATION_CACHES
+#define HASHED_COMPILATION_CACHES 1
+#endif
+
+//============================================================================
+// Hash helpers for the KeyOperations of the caches (FNV-1a).
+//============================================================================
+inline unsigned HashCacheKeyBytes
+(
+    _In_bytecount_(cbKey) const void *pvKey,
+    size_t cbKey
+)
+{
+    const unsigned char *pbKey = (const unsigned char *)pvKey;
+    unsigned Hash = 2166136261u;
+
+    for (size_t i = 0; i < cbKey; i++)
+    {
+        Hash = (Hash ^ pbKey[i]) * 16777619u;
+    }
+
+    return Hash;
+}
+
+inline unsigned HashCacheKeyPointer(const void *pv)
+{
+    return HashCacheKeyBytes(&pv, sizeof(pv));
+}
+
+//============================================================================
+// HashedCacheNodeBaseT:
+//
+//      Base class template for nodes stored in a HashedCacheT. It is the
+//      counterpart of RedBlackNodeBaseT and is used the same way.
+//============================================================================
+template <typename KeyType>
+struct HashedCacheNodeBaseT
+{
+    public:
+        HashedCacheNodeBaseT()
+#if DEBUG
+            : pOwner(NULL)
+#endif
+        {
+        }
+
+    public:
+        KeyType key;                        // Index key
+
+#if DEBUG
+        void *pOwner;           // Pointer to the table that owns this node.
+#endif
+};
+
+//============================================================================
+// HashedCacheT:
+//
+//      Insert-only hash table with linear probing, offering the subset of the
+//      RedBlackTreeT interface the compilation caches use. The table doesn't
+//      support insertion of duplicate items, nor removal.
+//
+//      The nodes and the slot array come from the NorlsAllocator, like the
+//      nodes of a RedBlackTreeT. The slot array is replaced when it gets half
+//      full; the old one is only given back when the allocator is freed, which
+//      at most doubles the memory taken by the slots. Clear forgets the table
+//      without touching the allocator, so the owner may free it right after.
+//
+//  Template Parameters:
+//
+//      KeyType, NodeType, NodeOperations: as for RedBlackTreeT, except that
+//                      NodeType must derive from HashedCacheNodeBaseT.
+//
+//      KeyOperations: as for RedBlackTreeT, with one more method:
+//
+//           unsigned hash(const <KeyType> *key)
+//                  - returns the same value for any two keys that compare
+//                    equal.
+//
+//      The destroy methods of the behavior classes are never called.
+//============================================================================
+template
+    <
+        typename KeyType,
+        typename KeyOperations,
+        typename NodeType = HashedCacheNodeBaseT<KeyType>,
+        typename NodeOperations = EmptyNodeOperationsT<NodeType>
+    >
+class HashedCacheT
+{
+    friend class CVbCompilerCompCache; // test hook
+
+    protected:
+        typedef HashedCacheT<KeyType, KeyOperations, NodeType, NodeOperations> HashedCache;
+
+        struct Slot
+        {
+            unsigned Hash;
+            NodeType *pNode;    // NULL if the slot is free
+        };
+
+        static const unsigned InitialSlotCount = 16;   // must be a power of two
+
+    public:
+        NorlsAllocator * GetNorlsAllocator()
+        {
+            return m_pNoReleaseAllocator;
+        }
+
+        NorlsAllocator * GetAllocator()
+        {
+            return m_pNoReleaseAllocator;
+        }
+
+#if DEBUG
+        CComBSTR GetNodeDump(_In_opt_ bool fOutputDebugWindow ) ; // dump the contents into a string
+        void ValidateNodes();   // assert on the nodes
+#endif DEBUG
+
+        //============================================================================
+        //     Nested class that iterates over the nodes in slot order.
+        //============================================================================
+        class Iterator
+        {
+            public:
+                Iterator
+                (
+                    HashedCache *pHashedCache  // [in] Table to get the iterator for. It shouldn't be null
+                ) :
+                    m_pTable(pHashedCache)
+                {
+                    VSASSERT(pHashedCache != NULL, "Invalid Null Pointer");
+
+                    Reset();
+                }
+
+                void Reset()
+                {
+                    m_iSlot = 0;
+                }
+
+                //============================================================================
+                // Return values:
+                //        A pointer to the next node in the table, or
+                //        NULL if the iterator has reached the end of the table.
+                //============================================================================
+                NodeType * Next()
+                {
+                    while (m_iSlot < m_pTable->m_cSlots)
+                    {
+                        NodeType *pNode = m_pTable->m_pSlots[m_iSlot++].pNode;
+
+                        if (pNode)
+                        {
+                            return pNode;
+                        }
+                    }
+
+                    return NULL;
+                }
+
+            private:
+                HashedCache *m_pTable;
+                unsigned m_iSlot;
+        };
+
+    friend Iterator;
+
+    public:
+        HashedCacheT() :
+            m_pNoReleaseAllocator(NULL),
+            m_pSlots(NULL),
+            m_cSlots(0),
+            m_cNodes(0),
+            m_nodeOperations(),
+            m_keyOperations()
+        {
+            Clear();
+        }
+
+        HashedCacheT
+        (
+            _In_ NorlsAllocator *pNoReleaseAllocator    // [in] Pointer to the allocator to use
+        ) :
+            m_pNoReleaseAllocator(pNoReleaseAllocator),
+            m_pSlots(NULL),
+            m_cSlots(0),
+            m_cNodes(0),
+            m_nodeOperations(),
+            m_keyOperations()
+        {
+            Clear();
+        }
+
+        ~HashedCacheT()
+        {
+            Clear();
+        }
+
+        void
+        Init
+        (
+            NorlsAllocator *pNoReleaseAllocator    // [in] Pointer to the allocator to use
+        )
+        {
+            VSASSERT(m_pNoReleaseAllocator == NULL, "Hashed cache has already been initialized");
+
+            if (m_pNoReleaseAllocator == NULL)
+            {
+                m_pNoReleaseAllocator = pNoReleaseAllocator;
+                Clear();
+            }
+        }
+
+        //============================================================================
+        // Clear: Clears the contents of the table.
+        //============================================================================
+        void Clear()
+        {
+            m_pSlots = NULL;
+            m_cSlots = 0;
+            m_cNodes = 0;
+
+#if DEBUG
+            ClearTreeStats();
+#endif
+        }
+
+        ULONG Count()
+        {
+            return m_cNodes;
+        }
+
+        //============================================================================
+        // Find:
+        //
+        //      Searches the table for a node that matches the specified key.
+        //
+        //      Return values:
+        //          -True, if a node matching the key was found; or
+        //          -False, if such a node couldn't be found.
+        //============================================================================
+        bool
+        Find
+        (
+            const KeyType *pKey,    // [in] Key of the node to find. It shouldn't be NULL.
+            _Out_opt_ NodeType **ppNode = NULL  // [optional, out] If not NULL, on return it will contain the pointer to the node matching the given key or NULL if it wasn't found.
+        )
+        {
+            VSASSERT(pKey != NULL, "Invalid Null Pointer");
+
+            Slot *pSlot = m_cSlots ? FindSlot(pKey, MixHash(m_keyOperations.hash(pKey))) : NULL;
+            NodeType *pNode = pSlot ? pSlot->pNode : NULL;
+
+#if DEBUG
+            if (pNode)
+            {
+                m_cSearchHits++;
+            }
+            else
+            {
+                m_cSearchMisses++;
+            }
+#endif
+
+            if (ppNode)
+            {
+                *ppNode = pNode;
+            }
+
+            return pNode != NULL;
+        }
+
+        //============================================================================
+        // Insert:
+        //
+        //      Function to insert a new node with the given key into the table.
+        //
+        //      Return value:
+        //          -True, if the node was inserted; or
+        //          -False, if the node already existed in the table.
+        //============================================================================
+        bool
+        Insert
+        (
+            const KeyType *pKey,    // [in] Key of the new node to insert. It shouldn't be NULL.
+            _Out_opt_ NodeType **ppNode  = NULL // [optional, out] If not null, on return it will contain the pointer to the node matching the given key.
+        )
+        {
+            VSASSERT(pKey != NULL, "Invalid Null Pointer");
+
+            // Keep the table at most half full so that the probe sequences stay short.
+            if ((m_cNodes + 1) * 2 > m_cSlots)
+            {
+                Grow();
+            }
+
+            unsigned Hash = MixHash(m_keyOperations.hash(pKey));
+            Slot *pSlot = FindSlot(pKey, Hash);
+
+            if (pSlot->pNode)
+            {
+#if DEBUG
+                m_cInsertionMisses++;
+#endif
+
+                if (ppNode)
+                {
+                    *ppNode = pSlot->pNode;
+                }
+
+                return false;
+            }
+
+            NodeType *pNewNode = (NodeType *) m_pNoReleaseAllocator->Alloc(sizeof(NodeType));
+
+            //Call the constructor for the memory allocated
+            pNewNode = new ((void*)pNewNode) NodeType;
+
+            // Copy the key into the new node.
+            m_keyOperations.copy(&pNewNode->key, pKey);
+
+#if DEBUG
+            pNewNode->pOwner = this;
+            m_cInsertionHits++;
+#endif
+
+            pSlot->Hash = Hash;
+            pSlot->pNode = pNewNode;
+            m_cNodes++;
+
+            if (ppNode)
+            {
+                *ppNode = pNewNode;
+            }
+
+            return true;
+        }
+
+#if DEBUG
+        //============================================================================
+        // ClearTreeStats (DEBUG ONLY):
+        //
+        //      Function to reset table statistics to 0. Named after the
+        //      RedBlackTreeT method so that either container can be dumped.
+        //============================================================================
+        void ClearTreeStats()
+        {
+            m_cProbes = 0;
+            m_cSearchHits = 0;
+            m_cSearchMisses = 0;
+            m_cInsertionHits = 0;
+            m_cInsertionMisses = 0;
+            m_cGrowths = 0;
+        }
+
+        //============================================================================
+        // DumpTreeStats (DEBUG ONLY):
+        //
+        //      Function to dump table statistics to the output window.
+        //============================================================================
+        void DumpTreeStats()
+        {
+            unsigned cLookups = m_cSearchHits + m_cSearchMisses + m_cInsertionHits + m_cInsertionMisses;
+
+            DebPrintf("Node Mem=%8u = %4u  X %5u  Slots=%5u Grown=%2u",
+                sizeof(NodeType) * m_cNodes, sizeof(NodeType), m_cNodes, m_cSlots, m_cGrowths);
+
+            DebPrintf(" SRCH hits=%5u miss=%5u", m_cSearchHits, m_cSearchMisses);
+
+            DebPrintf("  INS hits=%5u miss=%5u", m_cInsertionHits, m_cInsertionMisses);
+
+            DebPrintf("  Probes avg=%5.2f\n",
+                cLookups ? ((double) m_cProbes / cLookups) : (double) 0.0);
+        }
+#endif
+
+    protected:
+        //============================================================================
+        // The slot of the node matching the key, or of the free slot where it
+        // would go. The table must not be full.
+        //============================================================================
+        Slot *
+        FindSlot
+        (
+            const KeyType *pKey,
+            unsigned Hash
+        )
+        {
+            unsigned Mask = m_cSlots - 1;
+
+            for (unsigned iSlot = Hash & Mask; ; iSlot = (iSlot + 1) & Mask)
+            {
+                Slot *pSlot = &m_pSlots[iSlot];
+
+#if DEBUG
+                m_cProbes++;
+#endif
+
+                if (!pSlot->pNode ||
+                    (pSlot->Hash == Hash && m_keyOperations.compare(pKey, &pSlot->pNode->key) == 0))
+                {
+                    return pSlot;
+                }
+            }
+        }
+
+        //============================================================================
+        // Doubles the number of slots and rehashes the nodes into them.
+        //============================================================================
+        void Grow()
+        {
+            VSASSERT(m_pNoReleaseAllocator != NULL, "Hashed cache has not been initialized");
+
+            Slot *pOldSlots = m_pSlots;
+            unsigned cOldSlots = m_cSlots;
+            unsigned cNewSlots = cOldSlots ? cOldSlots * 2 : InitialSlotCount;
+
+            // Alloc zeroes the memory, which marks every slot free.
+            m_pSlots = (Slot *) m_pNoReleaseAllocator->Alloc(cNewSlots * sizeof(Slot));
+            m_cSlots = cNewSlots;
+
+            unsigned Mask = cNewSlots - 1;
+
+            for (unsigned iOldSlot = 0; iOldSlot < cOldSlots; iOldSlot++)
+            {
+                if (pOldSlots[iOldSlot].pNode)
+                {
+                    unsigned iSlot = pOldSlots[iOldSlot].Hash & Mask;
+
+                    while (m_pSlots[iSlot].pNode)
+                    {
+                        iSlot = (iSlot + 1) & Mask;
+                    }
+
+                    m_pSlots[iSlot] = pOldSlots[iOldSlot];
+                }
+            }
+
+#if DEBUG
+            m_cGrowths++;
+#endif
+        }
+
+        //============================================================================
+        // Spreads the bits of the key hash so that hashes which only differ in
+        // their upper bits, as pointers tend to, don't land in the same slots.
+        //============================================================================
+        static
+        unsigned MixHash(unsigned Hash)
+        {
+            Hash ^= Hash >> 16;
+            Hash *= 0x85ebca6b;
+            Hash ^= Hash >> 13;
+            Hash *= 0xc2b2ae35;
+            Hash ^= Hash >> 16;
+
+            return Hash;
+        }
+
+    protected:
+        NorlsAllocator *m_pNoReleaseAllocator;  // Memory allocator
+
+        Slot *m_pSlots;                     // m_cSlots entries, m_cSlots is zero or a power of two
+        unsigned m_cSlots;
+
+        unsigned long m_cNodes;
+        NodeOperations m_nodeOperations;
+        KeyOperations m_keyOperations;
+
+#if DEBUG
+        unsigned m_cProbes;                 // Total number of slots looked at by Find and Insert.
+        unsigned m_cSearchHits;
+        unsigned m_cSearchMisses;
+        unsigned m_cInsertionHits;          // Insert added a node.
+        unsigned m_cInsertionMisses;        // Insert found an existing node.
+        unsigned m_cGrowths;
+#endif
+};
+
+//============================================================================
+// CompilationCacheT, CompilationCacheNodeBaseT:
+//
+//      The container template, and the matching node base, of the
+//      compilation caches. See HASHED_COMPILATION_CACHES.
+//============================================================================
+#if HASHED_COMPILATION_CACHES
+#define CompilationCacheT HashedCacheT
+#define CompilationCacheNodeBaseT HashedCacheNodeBaseT
+#else
+#define CompilationCacheT RedBlackTreeT
+#define CompilationCacheNodeBaseT RedBlackNodeBaseT
+#endif
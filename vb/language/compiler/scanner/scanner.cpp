@@ -211,6 +211,9 @@ Scanner::Init(
     m_LineStart = InputStream - InitialColumnNumber;
     m_FirstInUseToken = NULL;
     m_MethodDeclKind = InitialMethodDeclKind;
+    m_pTokenCache = NULL;
+    m_ichTokenCacheInputStream = 0;
+    m_fRecordingTokens = false;
 
     Token *First = new(m_Storage) Token;
     Token *Second = new(m_Storage) Token;
@@ -4145,9 +4148,292 @@ Scanner::GetNextLine(
     m_AllowXmlFeatures = true; // we always allow xml features when this function is called.  The colorizer is the only one that sets
                                // this to be false and it has a separate entry point to the scanner.  So force true.
 
+    if (m_pTokenCache)
+    {
+        return GetNextLineThroughTokenCache();
+    }
+
     return GetNextLineHelper();
 }
 
+//
+// Token stream cache
+//
+
+// Copies everything but the ring links of a token.
+static void
+CopyTokenData
+(
+    _Out_ Token *Target,
+    _In_ const Token *Source
+)
+{
+    memcpy(((BYTE *)Target) + FIELD_OFFSET(struct Token, m_DummyFirstField),
+           ((const BYTE *)Source) + FIELD_OFFSET(struct Token, m_DummyFirstField),
+           FIELD_OFFSET(struct Token, m_Next) - FIELD_OFFSET(struct Token, m_DummyFirstField));
+}
+
+void
+Scanner::RecordLines
+(
+    _In_ TokenStreamCache *pCache,
+    long ichInputStream
+)
+{
+    VSASSERT(pCache->IsRecording(), "The token stream cache has already been recorded.");
+
+    m_pTokenCache = pCache;
+    m_ichTokenCacheInputStream = ichInputStream;
+    m_fRecordingTokens = true;
+}
+
+void
+Scanner::ReplayLines
+(
+    _In_ TokenStreamCache *pCache,
+    long ichInputStream
+)
+{
+    VSASSERT(!pCache->IsRecording(), "The token stream cache is still being recorded.");
+
+    m_pTokenCache = pCache;
+    m_ichTokenCacheInputStream = ichInputStream;
+    m_fRecordingTokens = false;
+}
+
+Token *
+Scanner::GetNextLineThroughTokenCache
+(
+)
+{
+    CachedLineContext Context;
+
+    if (!GetTokenCacheContext(&Context))
+    {
+        return GetNextLineHelper();
+    }
+
+    if (!m_fRecordingTokens)
+    {
+        const CachedLine *pLine = m_pTokenCache->FindLine(Context);
+
+        if (pLine && ReplayLine(pLine))
+        {
+            return m_FirstTokenOfLine;
+        }
+
+        return GetNextLineHelper();
+    }
+
+    GetNextLineHelper();
+    RecordLine(Context);
+
+    return m_FirstTokenOfLine;
+}
+
+// Fills in the context of the line about to be scanned.  Returns false if
+// scanning the line depends on more than that context and the text.
+bool
+Scanner::GetTokenCacheContext
+(
+    _Out_ CachedLineContext *pContext
+)
+{
+    memset(pContext, 0, sizeof(*pContext));
+
+    // MakeToken looks at the token the first token of the line is linked to
+    // even if that token is no longer in use.
+    Token *PreviousToken = m_FirstFreeToken->m_Prev;
+
+    if (!NotAtEndOfInput() ||
+        PendingStates() ||
+        !m_State.IsVBState() ||
+        !m_SeenAsyncOrIteratorInCurrentLine.Empty() ||
+        (PreviousToken->m_TokenType != tkNone &&
+         PreviousToken->m_TokenType != tkEOL &&
+         PreviousToken->m_TokenType != tkEOF))
+    {
+        return false;
+    }
+
+    pContext->m_ichStart = TokenCacheOffset(m_InputStreamPosition);
+    pContext->m_LineNumber = m_LineNumber;
+    pContext->m_Column = (long)(m_InputStreamPosition - m_LineStart);
+    pContext->m_State = m_State;
+    pContext->m_MethodDeclKind = m_MethodDeclKind;
+
+    Token *LastToken = GetLastToken();
+
+    if (LastToken)
+    {
+        pContext->m_HasPreviousToken = true;
+        pContext->m_PreviousTokenType = LastToken->m_TokenType;
+        pContext->m_PreviousTokenState = LastToken->m_State;
+    }
+
+    return true;
+}
+
+// Adds the line just scanned to the token stream cache.
+void
+Scanner::RecordLine
+(
+    const CachedLineContext &Context
+)
+{
+    Token *LastToken = GetLastToken();
+
+    // Only a line that ends in VB, with text following it, can be replayed
+    // in the middle of another stream.
+    if (!LastToken ||
+        LastToken->m_TokenType != tkEOL ||
+        !NotAtEndOfInput() ||
+        PendingStates() ||
+        !m_State.IsVBState() ||
+        !m_SeenAsyncOrIteratorInCurrentLine.Empty())
+    {
+        return;
+    }
+
+    // CheckForAnotherBlankLine looks past the end of the line.
+    unsigned LookaheadCount = FindEndOfWhitespace(0);
+
+    if (!NotCloseToEndOfInput(LookaheadCount))
+    {
+        return;
+    }
+
+    unsigned TokenCount = 0;
+    size_t StringLength = 0;
+    Token *T;
+
+    for (T = m_FirstTokenOfLine; T != m_FirstFreeToken; T = T->m_Next)
+    {
+        if (T->m_State.IsXmlState())
+        {
+            return;
+        }
+
+        switch (T->m_TokenType)
+        {
+            case tkStrCon:
+                // Literals with escaped quotes have their value copied.
+                if (T->m_StringLiteral.m_Value != TokenToStreamPosition(T) + 1)
+                {
+                    StringLength += T->m_StringLiteral.m_Length;
+                }
+                break;
+
+            case tkREM:
+            case tkXMLDocComment:
+                if (T->m_Comment.m_Spelling != TokenToStreamPosition(T) + T->m_Width - T->m_Comment.m_Length)
+                {
+                    return;
+                }
+                break;
+        }
+
+        TokenCount++;
+    }
+
+    CachedLine Line;
+    memset(&Line, 0, sizeof(Line));
+
+    Line.m_Context = Context;
+    Line.m_ichEnd = TokenCacheOffset(m_InputStreamPosition);
+    Line.m_ichLookaheadEnd = TokenCacheOffset(m_InputStreamPosition + LookaheadCount + 1);
+    Line.m_EndLineNumber = m_LineNumber;
+    Line.m_ichEndLineStart = TokenCacheOffset(m_LineStart);
+    Line.m_EndState = m_State;
+
+    Token *Cached = m_pTokenCache->AddLine(Line, TokenCount, StringLength);
+
+    if (!Cached)
+    {
+        return;
+    }
+
+    for (T = m_FirstTokenOfLine; T != m_FirstFreeToken; T = T->m_Next, Cached++)
+    {
+        CopyTokenData(Cached, T);
+
+        Cached->m_StartCharacterPosition =
+            m_ichTokenCacheInputStream + (T->m_StartCharacterPosition - m_CharacterPositionOfCurrentClusterStart);
+
+        // Pointers into the text are recomputed when the line is replayed.
+        switch (T->m_TokenType)
+        {
+            case tkStrCon:
+                Cached->m_StringLiteral.m_Value =
+                    T->m_StringLiteral.m_Value != TokenToStreamPosition(T) + 1 ?
+                        m_pTokenCache->AddString(T->m_StringLiteral.m_Value, T->m_StringLiteral.m_Length) :
+                        NULL;
+                break;
+
+            case tkREM:
+            case tkXMLDocComment:
+                Cached->m_Comment.m_Spelling = NULL;
+                break;
+        }
+    }
+}
+
+// Appends the tokens of a cached line to the token ring and moves past the
+// line.  Returns false if the line cannot be replayed in this stream.
+bool
+Scanner::ReplayLine
+(
+    _In_ const CachedLine *pLine
+)
+{
+    // The end of the input stream changes how the lines close to it are
+    // scanned, so all the text looked at must be there.
+    if (pLine->m_ichLookaheadEnd > TokenCacheOffset(m_InputStreamEnd))
+    {
+        return false;
+    }
+
+    const Token *Cached = m_pTokenCache->GetTokens(pLine);
+
+    for (unsigned i = 0; i < pLine->m_cTokens; i++, Cached++)
+    {
+        Token *T = NextFreeToken();
+
+        CopyTokenData(T, Cached);
+
+        T->m_StartCharacterPosition =
+            m_CharacterPositionOfCurrentClusterStart + (Cached->m_StartCharacterPosition - m_ichTokenCacheInputStream);
+
+        switch (T->m_TokenType)
+        {
+            case tkStrCon:
+                if (Cached->m_StringLiteral.m_Value)
+                {
+                    WCHAR *Value = new(m_Storage) WCHAR[T->m_StringLiteral.m_Length];
+                    memcpy(Value, Cached->m_StringLiteral.m_Value, T->m_StringLiteral.m_Length * sizeof(WCHAR));
+                    T->m_StringLiteral.m_Value = Value;
+                }
+                else
+                {
+                    T->m_StringLiteral.m_Value = TokenToStreamPosition(T) + 1;
+                }
+                break;
+
+            case tkREM:
+            case tkXMLDocComment:
+                T->m_Comment.m_Spelling = TokenToStreamPosition(T) + T->m_Width - T->m_Comment.m_Length;
+                break;
+        }
+    }
+
+    m_InputStreamPosition = TokenCachePosition(pLine->m_ichEnd);
+    m_LineNumber = pLine->m_EndLineNumber;
+    m_LineStart = TokenCachePosition(pLine->m_ichEndLineStart);
+    m_State = pLine->m_EndState;
+
+    return true;
+}
+
 Token * 
 Scanner::GetAllLines()
 {
@@ -10,6 +10,9 @@
 
 struct Token;
 enum typeChars;
+class TokenStreamCache;
+struct CachedLineContext;
+struct CachedLine;
 
 // URT imposed limit.  This limit should be removed for the next version.
 const unsigned MaxIdentifierLength = 1023;
@@ -896,6 +899,16 @@ public:
 
    void SetMethodDeclKind(MethodDeclKind methodDeclKind){ m_MethodDeclKind = methodDeclKind;}
 
+    //
+    // Token stream cache
+    //
+
+    // Records the lines returned by GetNextLine in pCache, or replays the lines recorded in pCache
+    // instead of scanning them.  ichInputStream is the offset in the file of the start of the input
+    // stream.
+    void RecordLines(_In_ TokenStreamCache *pCache, long ichInputStream);
+    void ReplayLines(_In_ TokenStreamCache *pCache, long ichInputStream);
+
 protected:
 
     
@@ -935,6 +948,10 @@ protected:
 
     MethodDeclKind m_MethodDeclKind;
 
+    TokenStreamCache *m_pTokenCache;
+    long m_ichTokenCacheInputStream;
+    bool m_fRecordingTokens;
+
     //
     // Private routines
     //
@@ -942,6 +959,25 @@ protected:
     // GetNextLineHelper returns a list of all the tokens for the next line.
     Token *GetNextLineHelper ();
 
+    // GetNextLineThroughTokenCache returns the tokens for the next line from the token
+    // stream cache if it has them, and records them there otherwise.
+    Token *GetNextLineThroughTokenCache ();
+    bool GetTokenCacheContext (_Out_ CachedLineContext *pContext);
+    bool ReplayLine (_In_ const CachedLine *pLine);
+    void RecordLine (const CachedLineContext &Context);
+
+    // Offset in the file of a position in the input stream.
+    long TokenCacheOffset (_In_ const WCHAR *Position)
+    {
+        return m_ichTokenCacheInputStream + (long)(Position - m_InputStream);
+    }
+
+    // Position in the input stream of an offset in the file.
+    const WCHAR *TokenCachePosition (long ich)
+    {
+        return m_InputStream + (ich - m_ichTokenCacheInputStream);
+    }
+
 
     // Advance characters in the stream
     void AdvanceChars (long AdvanceCount)
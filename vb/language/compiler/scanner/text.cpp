@@ -19,6 +19,17 @@ Text::Text() :
 #if DEBUG
     m_fFileOpen = false;
 #endif
+
+#if !IDE
+    m_pCachedTextView = NULL;
+#endif
+}
+
+Text::~Text()
+{
+#if !IDE
+    delete m_pCachedTextView;
+#endif
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -39,6 +50,13 @@ HRESULT Text::Init(SourceFile *pfile)
 #endif
     }
 
+#if !IDE
+    if (m_pCachedTextView)
+    {
+        m_pCachedTextView->Close();
+    }
+#endif
+
     // if it's a readony My or XML template
     SolutionExtensionData * pSolutionExtensionData = pfile->GetSolutionExtension();
     if (pSolutionExtensionData &&
@@ -58,9 +76,26 @@ HRESULT Text::Init(SourceFile *pfile)
                                                        __ref m_maybeSnapshot));
         }
 #else
-        IfFailGo(pfile->GetTextFile()->GetFileText(&m_nraText,
-                                                   &m_wszText,
-                                                   &m_cchText));
+        // Once a file has been loaded its text is scanned in place in the
+        // source file cache instead of being copied again.
+        if (!m_pCachedTextView)
+        {
+            m_pCachedTextView = new TextFileCacheView();
+        }
+
+        const WCHAR *wszCachedText;
+
+        if (pfile->GetTextFile()->GetFileTextView(m_pCachedTextView, &wszCachedText, &m_cchText))
+        {
+            // The text is never written through m_wszText.
+            m_wszText = const_cast<WCHAR *>(wszCachedText);
+        }
+        else
+        {
+            IfFailGo(pfile->GetTextFile()->GetFileText(&m_nraText,
+                                                       &m_wszText,
+                                                       &m_cchText));
+        }
 #endif
 
     }
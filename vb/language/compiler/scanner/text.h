@@ -56,7 +56,7 @@ struct Text
     NEW_CTOR_SAFE()
 
     Text();
-    virtual ~Text() {} 
+    virtual ~Text();
 
     // Prepare to get the text for a file.
     HRESULT Init(SourceFile *pfile);
@@ -99,6 +99,11 @@ protected:
     // Where to store the text.
     NorlsAllocator m_nraText;
 
+#if !IDE
+    // Pins the text when it is read in place from the source file cache.
+    TextFileCacheView *m_pCachedTextView;
+#endif
+
     //
     // Optimization for "OutSpan".
     //
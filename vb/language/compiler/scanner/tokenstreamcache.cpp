@@ -0,0 +1,166 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Cache of the lines scanned while the declarations of a source file are parsed.
+//
+//-------------------------------------------------------------------------------------------------
+
+#include "StdAfx.h"
+
+volatile LONG TokenStreamCache::s_cbTotalSize = 0;
+
+TokenStreamCache::TokenStreamCache() :
+    m_nraStrings(NORLSLOC),
+    m_cbSize(0),
+    m_fRecording(true),
+    m_fFull(false)
+{
+}
+
+TokenStreamCache::~TokenStreamCache()
+{
+    InterlockedExchangeAdd(&s_cbTotalSize, -(LONG)m_cbSize);
+}
+
+//============================================================================
+// Accounts for cbSize more bytes.  Returns false, and stops the recording of
+// any further lines, if that would exceed the size limits.
+//============================================================================
+bool TokenStreamCache::Reserve(size_t cbSize)
+{
+    if (m_fFull ||
+        m_cbSize + cbSize > MaxFileSize)
+    {
+        m_fFull = true;
+        return false;
+    }
+
+    if ((size_t)InterlockedExchangeAdd(&s_cbTotalSize, (LONG)cbSize) + cbSize > MaxTotalSize)
+    {
+        InterlockedExchangeAdd(&s_cbTotalSize, -(LONG)cbSize);
+        m_fFull = true;
+        return false;
+    }
+
+    m_cbSize += cbSize;
+    return true;
+}
+
+Token *TokenStreamCache::AddLine
+(
+    const CachedLine &Line,
+    unsigned cTokens,
+    size_t cchStrings
+)
+{
+    VSASSERT(m_fRecording, "Adding a line after the recording was completed.");
+    VSASSERT(cTokens > 0, "A line has at least its end of line token.");
+
+    if (m_daLines.Count() > 0 &&
+        Line.m_Context.m_ichStart < m_daLines.Element(m_daLines.Count() - 1).m_ichEnd)
+    {
+        return NULL;
+    }
+
+    if (!Reserve(sizeof(CachedLine) + cTokens * sizeof(Token) + cchStrings * sizeof(WCHAR)))
+    {
+        return NULL;
+    }
+
+    CachedLine &NewLine = m_daLines.Add();
+
+    NewLine = Line;
+    NewLine.m_iFirstToken = m_daTokens.Count();
+    NewLine.m_cTokens = cTokens;
+
+    return &m_daTokens.Grow(cTokens);
+}
+
+const WCHAR *TokenStreamCache::AddString
+(
+    _In_count_(cchValue) const WCHAR *wszValue,
+    size_t cchValue
+)
+{
+    WCHAR *wszCopy = new(m_nraStrings) WCHAR[cchValue];
+    memcpy(wszCopy, wszValue, cchValue * sizeof(WCHAR));
+
+    return wszCopy;
+}
+
+const CachedLine *TokenStreamCache::FindLine(const CachedLineContext &Context)
+{
+    VSASSERT(!m_fRecording, "Replaying a cache that is still being recorded.");
+
+    unsigned iLow = 0;
+    unsigned iHigh = m_daLines.Count();
+
+    while (iLow < iHigh)
+    {
+        unsigned iMiddle = iLow + (iHigh - iLow) / 2;
+        const CachedLine &Line = m_daLines.Element(iMiddle);
+
+        if (Line.m_Context.m_ichStart < Context.m_ichStart)
+        {
+            iLow = iMiddle + 1;
+        }
+        else if (Line.m_Context.m_ichStart > Context.m_ichStart)
+        {
+            iHigh = iMiddle;
+        }
+        else
+        {
+            return IsSameContext(Line.m_Context, Context) ? &Line : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+bool TokenStreamCache::IsSameContext
+(
+    const CachedLineContext &Context1,
+    const CachedLineContext &Context2
+)
+{
+    if (Context1.m_ichStart != Context2.m_ichStart ||
+        Context1.m_LineNumber != Context2.m_LineNumber ||
+        Context1.m_Column != Context2.m_Column ||
+        !IsSameState(Context1.m_State, Context2.m_State) ||
+        Context1.m_MethodDeclKind != Context2.m_MethodDeclKind ||
+        Context1.m_HasPreviousToken != Context2.m_HasPreviousToken)
+    {
+        return false;
+    }
+
+    return
+        !Context1.m_HasPreviousToken ||
+        (Context1.m_PreviousTokenType == Context2.m_PreviousTokenType &&
+         IsSameState(Context1.m_PreviousTokenState, Context2.m_PreviousTokenState));
+}
+
+//============================================================================
+// Compares the fields of two states.  The bits of a ScannerState that no
+// field uses are not initialized, so the states cannot be compared as longs.
+//============================================================================
+bool TokenStreamCache::IsSameState
+(
+    const ScannerState &State1,
+    const ScannerState &State2
+)
+{
+    return
+        State1.m_IsSimpleState == State2.m_IsSimpleState &&
+        State1.m_LexicalState == State2.m_LexicalState &&
+        State1.m_IsXmlError == State2.m_IsXmlError &&
+        State1.m_IsDocument == State2.m_IsDocument &&
+        State1.m_InDTD == State2.m_InDTD &&
+        State1.m_ScannedElement == State2.m_ScannedElement &&
+        State1.m_IsEndElement == State2.m_IsEndElement &&
+        State1.m_ExplicitLineContinuation == State2.m_ExplicitLineContinuation &&
+        State1.m_IsSimpleQuery == State2.m_IsSimpleQuery &&
+        State1.m_IsRParensOfLambdaParameter == State2.m_IsRParensOfLambdaParameter &&
+        State1.m_LineType == State2.m_LineType &&
+        State1.m_Data == State2.m_Data;
+}
@@ -0,0 +1,132 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  Cache of the lines scanned while the declarations of a source file are parsed.
+//
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+// Everything besides the text that the tokens of a line depend on.
+struct CachedLineContext
+{
+    long m_ichStart;                    // offset in the file of the first character of the line
+    long m_LineNumber;
+    long m_Column;
+    ScannerState m_State;
+    MethodDeclKind m_MethodDeclKind;
+
+    // The token preceding the line in the token ring, which the scanner looks at
+    // for implicit line continuations and contextual keywords.
+    bool m_HasPreviousToken;
+    tokens m_PreviousTokenType;
+    ScannerState m_PreviousTokenState;
+};
+
+struct CachedLine
+{
+    CachedLineContext m_Context;
+
+    long m_ichEnd;                      // offset of the first character after the line
+    long m_ichLookaheadEnd;             // offset of the first character the scanner did not look at
+    long m_EndLineNumber;
+    long m_ichEndLineStart;
+    ScannerState m_EndState;
+
+    unsigned m_iFirstToken;
+    unsigned m_cTokens;
+};
+
+//-------------------------------------------------------------------------------------------------
+//
+// TokenStreamCache
+//
+// Parsing the declarations of a file scans all of its lines, including the method bodies that
+// FindEndProc skips over, and GetUnboundMethodBodyTrees scans the bodies again when they are
+// compiled.  The scanner that parses the declarations records the tokens of its lines here, and
+// the scanner of a method body replays them instead of scanning the text a second time.
+//
+// The tokens of all lines are kept in one array.  Identifier spellings are the string pool
+// entries the scanner produced; string literals and comments that point into the text are
+// stored without the pointer and pointed at the text of the replaying scanner.
+//
+// A line is found by the offset of its first character and is only replayed if its context and
+// all the text the scanner looked at are the same.  Lines that contain Xml literals, that end
+// the file or that are scanned again after a reset are not recorded.
+//
+// The cache is written by the thread parsing the declarations and only read after that, so it
+// needs no lock.  Recording stops once a file uses MaxFileSize bytes or all files together use
+// MaxTotalSize bytes.
+//
+//-------------------------------------------------------------------------------------------------
+class TokenStreamCache
+{
+public:
+    NEW_CTOR_SAFE()
+
+    TokenStreamCache();
+    ~TokenStreamCache();
+
+    static const size_t MaxFileSize = 4 * 1024 * 1024;
+    static const size_t MaxTotalSize = 64 * 1024 * 1024;
+
+    bool IsRecording()
+    {
+        return m_fRecording;
+    }
+
+    // Ends the recording.  The lines can be replayed from now on.
+    void CompleteRecording()
+    {
+        m_fRecording = false;
+    }
+
+    // Adds a line of cTokens tokens and returns the slots for its tokens, or NULL if the line
+    // would overlap the last line added or the cache is full.  cchStrings is the length of the
+    // string literal values that will be added for the line.
+    Token *AddLine(
+        const CachedLine &Line,
+        unsigned cTokens,
+        size_t cchStrings);
+
+    // Copies the value of a string literal that does not point into the text.  The space has
+    // been reserved by AddLine.
+    const WCHAR *AddString(
+        _In_count_(cchValue) const WCHAR *wszValue,
+        size_t cchValue);
+
+    // Returns the line recorded for Context, or NULL if there is none.
+    const CachedLine *FindLine(const CachedLineContext &Context);
+
+    const Token *GetTokens(const CachedLine *pLine)
+    {
+        return &m_daTokens.Element(pLine->m_iFirstToken);
+    }
+
+private:
+    // Do not generate
+    TokenStreamCache(const TokenStreamCache&);
+    TokenStreamCache& operator=(const TokenStreamCache&);
+
+    static bool IsSameContext(
+        const CachedLineContext &Context1,
+        const CachedLineContext &Context2);
+
+    static bool IsSameState(
+        const ScannerState &State1,
+        const ScannerState &State2);
+
+    bool Reserve(size_t cbSize);
+
+    DynamicArray<CachedLine> m_daLines;     // in the order of their offsets
+    DynamicArray<Token> m_daTokens;         // m_Next and m_Prev are not used
+    NorlsAllocator m_nraStrings;
+
+    size_t m_cbSize;
+    bool m_fRecording;
+    bool m_fFull;
+
+    // The size of all the caches together.
+    static volatile LONG s_cbTotalSize;
+};
@@ -237,6 +237,9 @@ ClassifyConversion
 This function classifies the nature of the conversion from the source type to the target
 type. If such a conversion requires a user-defined conversion, it will be supplied as an
 out parameter.
+
+The classification only depends on the two types and the flags, so it is remembered in
+the conversion classification cache of the compilation.
 =======================================================================================*/
 ConversionClass
 Semantics::ClassifyConversion
@@ -253,6 +256,54 @@ Semantics::ClassifyConversion
     bool IgnoreOperatorMethod
 )
 {
+    ConversionClassificationCache::Entry CacheValue;
+    unsigned CacheFlags =
+        (considerConversionsOnNullableBool ? ConversionClassificationCache::ConsiderConversionsOnNullableBool : 0) |
+        (IgnoreOperatorMethod ? ConversionClassificationCache::IgnoreOperatorMethod : 0);
+
+    // Same rules as for the lifted operator cache: nothing is cached if a demotion could
+    // be racing with us.
+    bool UseCache =
+        m_PermitDeclarationCaching &&
+        m_ConversionCache &&
+        TargetType &&
+        SourceType &&
+        TargetType != SourceType;
+
+    if (UseCache &&
+        m_ConversionCache->LookupInCache(TargetType, SourceType, CacheFlags, &CacheValue))
+    {
+        if (CacheValue.m_UserDefinedConversionConsidered)
+        {
+            OperatorMethod = CacheValue.m_pOperatorMethod;
+            OperatorMethodGenericContext = CacheValue.m_pOperatorMethodGenericContext;
+        }
+
+        OperatorMethodIsLifted = CacheValue.m_OperatorMethodIsLifted;
+
+        if (pConversionRequiresUnliftedAccessToNullableValue)
+        {
+            *pConversionRequiresUnliftedAccessToNullableValue = CacheValue.m_ConversionRequiresUnliftedAccessToNullableValue;
+        }
+
+        if (pConversionIsNarrowingDueToAmbiguity)
+        {
+            *pConversionIsNarrowingDueToAmbiguity = CacheValue.m_ConversionIsNarrowingDueToAmbiguity;
+        }
+
+        if (pConversionRelaxationLevel)
+        {
+            *pConversionRelaxationLevel = (DelegateRelaxationLevel)CacheValue.m_ConversionRelaxationLevel;
+        }
+
+        return (ConversionClass)CacheValue.m_ConversionClass;
+    }
+
+    // The optional results are always computed so that they can be cached.
+    bool ConversionRequiresUnliftedAccessToNullableValue = false;
+    bool ConversionIsNarrowingDueToAmbiguity = false;
+    DelegateRelaxationLevel ConversionRelaxationLevel = DelegateRelaxationLevelNone;
+    bool UserDefinedConversionConsidered = false;
 
     ConversionClass Result =
         ClassifyPredefinedConversion
@@ -264,9 +315,9 @@ Semantics::ClassifyConversion
             NULL,
             false,
             considerConversionsOnNullableBool,
-            pConversionRequiresUnliftedAccessToNullableValue,
-            pConversionIsNarrowingDueToAmbiguity,
-            pConversionRelaxationLevel
+            &ConversionRequiresUnliftedAccessToNullableValue,
+            &ConversionIsNarrowingDueToAmbiguity,
+            &ConversionRelaxationLevel
         );
 
     OperatorMethodIsLifted = false;
@@ -283,10 +334,8 @@ Semantics::ClassifyConversion
         !(TypeHelpers::IsIntrinsicType(TypeHelpers::GetElementTypeOfNullable(SourceType, m_CompilerHost)) && 
             TypeHelpers::IsIntrinsicType(TypeHelpers::GetElementTypeOfNullable(TargetType, m_CompilerHost))))
     {
-        if (pConversionRequiresUnliftedAccessToNullableValue)
-        {
-            *pConversionRequiresUnliftedAccessToNullableValue = false;
-        }
+        UserDefinedConversionConsidered = true;
+        ConversionRequiresUnliftedAccessToNullableValue = false;
 
         Result =
             ClassifyUserDefinedConversion
@@ -297,10 +346,42 @@ Semantics::ClassifyConversion
                 OperatorMethodGenericContext,
                 &OperatorMethodIsLifted,
                 considerConversionsOnNullableBool,
-                pConversionRequiresUnliftedAccessToNullableValue
+                &ConversionRequiresUnliftedAccessToNullableValue
             );
     }
 
+    if (pConversionRequiresUnliftedAccessToNullableValue)
+    {
+        *pConversionRequiresUnliftedAccessToNullableValue = ConversionRequiresUnliftedAccessToNullableValue;
+    }
+
+    if (pConversionIsNarrowingDueToAmbiguity)
+    {
+        *pConversionIsNarrowingDueToAmbiguity = ConversionIsNarrowingDueToAmbiguity;
+    }
+
+    if (pConversionRelaxationLevel)
+    {
+        *pConversionRelaxationLevel = ConversionRelaxationLevel;
+    }
+
+    // A failed user-defined conversion can leave behind whatever operator method the
+    // caller passed in, which must not be handed to other callers.
+    if (UseCache &&
+        !(UserDefinedConversionConsidered && Result == ConversionError && (OperatorMethod || OperatorMethodGenericContext)))
+    {
+        CacheValue.m_ConversionClass = (unsigned char)Result;
+        CacheValue.m_ConversionRelaxationLevel = (unsigned char)ConversionRelaxationLevel;
+        CacheValue.m_OperatorMethodIsLifted = OperatorMethodIsLifted;
+        CacheValue.m_ConversionRequiresUnliftedAccessToNullableValue = ConversionRequiresUnliftedAccessToNullableValue;
+        CacheValue.m_ConversionIsNarrowingDueToAmbiguity = ConversionIsNarrowingDueToAmbiguity;
+        CacheValue.m_UserDefinedConversionConsidered = UserDefinedConversionConsidered;
+        CacheValue.m_pOperatorMethod = UserDefinedConversionConsidered ? OperatorMethod : NULL;
+        CacheValue.m_pOperatorMethodGenericContext = UserDefinedConversionConsidered ? OperatorMethodGenericContext : NULL;
+
+        m_ConversionCache->AddEntry(m_Compiler, TargetType, SourceType, CacheFlags, CacheValue);
+    }
+
     return Result;
 }
 
@@ -4274,11 +4274,16 @@ Semantics::ResolveOverloadedCall
     }
 
     AsyncSubAmbiguityFlagCollection *pAsyncSubArgumentListAmbiguity = NULL;
-
-    Declaration *Result =
-        CollectCandidatesAndResolveOverloading
-        (
-            CallLocation,
+    Declaration *Result = NULL;
+
+    // Same rules as for the other declaration caches: nothing is cached if a
+    // demotion could be racing with us.
+    OverloadResolutionCache::Request CacheRequest;
+    OverloadResolutionCache::Entry CacheValue;
+    bool UseCache =
+        m_PermitDeclarationCaching &&
+        m_OverloadResolutionCache &&
+        GetOverloadResolutionCacheRequest(
             OverloadedProcedure,
             Arguments,
             DelegateType,
@@ -4289,11 +4294,64 @@ Semantics::ResolveOverloadedCall
             Flags,
             OvrldFlags,
             AccessingInstanceType,
-            ResolutionFailed,
-            ResolutionIsLateBound,
-            ResolutionIsAmbiguous,
-            &pAsyncSubArgumentListAmbiguity
-        );
+            CacheRequest);
+
+    if (UseCache &&
+        m_OverloadResolutionCache->LookupInCache(CacheRequest, &CacheValue))
+    {
+        // Only clean resolutions are cached, for which ResolutionIsAmbiguous is
+        // left alone.
+        ResolutionFailed = false;
+        ResolutionIsLateBound = false;
+        GenericBindingContext = CacheValue.m_pGenericBindingContext;
+        Result = CacheValue.m_pResult;
+    }
+    else
+    {
+        // A resolution that reports anything, even a warning, is not cached
+        // because a cache hit would not report it again.
+        ErrorTable *ErrorsBefore = m_Errors;
+        unsigned ErrorCountBefore = m_Errors ? m_Errors->GetEntryCount() : 0;
+        bool ResolutionWasAmbiguous = ResolutionIsAmbiguous;
+
+        Result =
+            CollectCandidatesAndResolveOverloading
+            (
+                CallLocation,
+                OverloadedProcedure,
+                Arguments,
+                DelegateType,
+                DelegateReturnType,
+                GenericBindingContext,
+                TypeArguments,
+                TypeArgumentCount,
+                Flags,
+                OvrldFlags,
+                AccessingInstanceType,
+                ResolutionFailed,
+                ResolutionIsLateBound,
+                ResolutionIsAmbiguous,
+                &pAsyncSubArgumentListAmbiguity
+            );
+
+        if (UseCache &&
+            m_ReportErrors &&
+            m_Errors &&
+            m_Errors == ErrorsBefore &&
+            m_Errors->GetEntryCount() == ErrorCountBefore &&
+            Result &&
+            !IsBad(Result) &&
+            !ResolutionFailed &&
+            !ResolutionIsLateBound &&
+            ResolutionIsAmbiguous == ResolutionWasAmbiguous &&
+            !pAsyncSubArgumentListAmbiguity)
+        {
+            CacheValue.m_pResult = Result;
+            CacheValue.m_pGenericBindingContext = GenericBindingContext;
+
+            m_OverloadResolutionCache->AddEntry(m_Compiler, CacheRequest, CacheValue);
+        }
+    }
 
     if (LastArgument)
     {
@@ -4305,6 +4363,116 @@ Semantics::ResolveOverloadedCall
     return Result;
 }
 
+/*=======================================================================================
+GetOverloadResolutionCacheRequest
+
+Fills in the overload resolution cache request for a call. Returns false if the outcome of
+the resolution could depend on more than the types of the arguments, in which case the
+call must not be cached.
+=======================================================================================*/
+bool
+Semantics::GetOverloadResolutionCacheRequest
+(
+    _In_ Declaration *OverloadedProcedure,
+    _In_opt_ ExpressionList *Arguments,
+    _In_opt_ Type *DelegateType,
+    _In_opt_ Type *DelegateReturnType,
+    _In_opt_ GenericBinding *GenericBindingContext,
+    _In_count_(TypeArgumentCount) Type **TypeArguments,
+    unsigned TypeArgumentCount,
+    ExpressionFlags Flags,
+    OverloadResolutionFlags OvrldFlags,
+    _In_opt_ Type *AccessingInstanceType,
+    _Out_ OverloadResolutionCache::Request &Request
+)
+{
+    memset(&Request, 0, sizeof(Request));
+
+    if (TypeArgumentCount > OverloadResolutionCache::MaxTypeArgumentCount ||
+        !ContainingContainer())
+    {
+        return false;
+    }
+
+    Request.m_pOverloadedProcedure = OverloadedProcedure;
+    Request.m_pGenericBindingContext = GenericBindingContext;
+    Request.m_pContext = ContainingContainer();
+    Request.m_pAccessingInstanceType = AccessingInstanceType;
+    Request.m_pDelegateType = DelegateType;
+    Request.m_pDelegateReturnType = DelegateReturnType;
+    Request.m_ExpressionFlags = Flags;
+    Request.m_OverloadResolutionFlags = OvrldFlags;
+    Request.m_OptionStrict = m_UsingOptionTypeStrict;
+    Request.m_TypeArgumentCount = TypeArgumentCount;
+
+    for (unsigned i = 0; i < TypeArgumentCount; i++)
+    {
+        if (!TypeArguments[i] || TypeHelpers::IsBadType(TypeArguments[i]))
+        {
+            return false;
+        }
+
+        Request.m_TypeArguments[i] = TypeArguments[i];
+    }
+
+    for (ExpressionList *ArgumentList = Arguments;
+         ArgumentList;
+         ArgumentList = ArgumentList->AsExpressionWithChildren().Right)
+    {
+        ILTree::Expression *ArgumentHolder = ArgumentList->AsExpressionWithChildren().Left;
+
+        // Omitted and named arguments are matched by position and name rather than type.
+        if (Request.m_ArgumentCount == OverloadResolutionCache::MaxArgumentCount ||
+            !ArgumentHolder ||
+            HasFlag32(ArgumentHolder, SXF_ARG_NAMED) ||
+            !ArgumentHolder->AsArgumentExpression().Left)
+        {
+            return false;
+        }
+
+        ILTree::Expression *Argument = ArgumentHolder->AsArgumentExpression().Left;
+
+        if (IsBad(Argument) ||
+            !Argument->ResultType ||
+            TypeHelpers::IsBadType(Argument->ResultType))
+        {
+            return false;
+        }
+
+        // Only expressions whose conversions depend on nothing but their type.
+        // Constants and Nothing take part in literal conversions, and lambdas,
+        // AddressOf and array literals are typed by the parameter they match.
+        switch (Argument->bilop)
+        {
+            case SX_SYM:
+                if (IsConstant(Argument->AsSymbolReferenceExpression().Symbol))
+                {
+                    return false;
+                }
+                break;
+
+            case SX_INDEX:
+            case SX_CALL:
+            case SX_NEW:
+            case SX_CTYPE:
+            case SX_DIRECTCAST:
+            case SX_TRYCAST:
+                break;
+
+            default:
+                return false;
+        }
+
+        OverloadResolutionCache::Argument &CacheArgument = Request.m_Arguments[Request.m_ArgumentCount++];
+
+        CacheArgument.m_pType = Argument->ResultType;
+        CacheArgument.m_Opcode = (unsigned short)Argument->bilop;
+        CacheArgument.m_IsLValue = HasFlag32(Argument, SXF_LVALUE);
+    }
+
+    return true;
+}
+
 Declaration *
 Semantics::CollectCandidatesAndResolveOverloading
 (
@@ -2838,6 +2838,16 @@ Semantics::InitializeInterpretationState
             {
                 m_LiftedOperatorCache = m_Project->GetLiftedOperatorCache();
             }
+
+            if (!m_ConversionCache)
+            {
+                m_ConversionCache = m_Project->GetConversionCache();
+            }
+
+            if (!m_OverloadResolutionCache)
+            {
+                m_OverloadResolutionCache = m_Project->GetOverloadResolutionCache();
+            }
         }
 
         if (GetCompilerHost() && !m_MergedNamespaceCache)
@@ -3602,6 +3612,8 @@ Semantics::Semantics
     m_statementGroupId(1),
     m_ExtensionMethodLookupCache(NULL),
     m_LiftedOperatorCache(NULL),
+    m_ConversionCache(NULL),
+    m_OverloadResolutionCache(NULL),
     m_InterpretingMethodBody(false),
     m_XmlNameVars(NULL),
     m_AnonymousTypeBindingTable(NULL),
@@ -3663,6 +3675,8 @@ Semantics::Semantics
             m_LookupCache = m_SourceFile->GetProject()->GetLookupCache();
             m_ExtensionMethodLookupCache = m_SourceFile->GetProject()->GetExtensionMethodLookupCache();
             m_LiftedOperatorCache = m_SourceFile->GetProject()->GetLiftedOperatorCache();
+            m_ConversionCache = m_SourceFile->GetProject()->GetConversionCache();
+            m_OverloadResolutionCache = m_SourceFile->GetProject()->GetOverloadResolutionCache();
         }
 
         if (GetCompilerHost())
@@ -3725,6 +3739,8 @@ Semantics::SetIDECompilationCaches(CompilationCaches *pCompilationCaches)
         m_LookupCache = pCompilationCaches->GetLookupCache();
         m_ExtensionMethodLookupCache = pCompilationCaches->GetExtensionMethodLookupCache();
         m_LiftedOperatorCache = pCompilationCaches->GetLiftedOperatorCache();
+        m_ConversionCache = pCompilationCaches->GetConversionCache();
+        m_OverloadResolutionCache = pCompilationCaches->GetOverloadResolutionCache();
         m_MergedNamespaceCache = pCompilationCaches->GetMergedNamespaceCache();
 
         m_CompilationCaches = pCompilationCaches;
@@ -6208,6 +6208,22 @@ protected:
         _Out_ bool &ResolutionIsAmbiguous
     );
 
+    bool
+    GetOverloadResolutionCacheRequest
+    (
+        _In_ Declaration *OverloadedProcedure,
+        _In_opt_ ExpressionList *Arguments,
+        _In_opt_ Type *DelegateType,
+        _In_opt_ Type *DelegateReturnType,
+        _In_opt_ GenericBinding *GenericBindingContext,
+        _In_count_(TypeArgumentCount) Type **TypeArguments,
+        unsigned TypeArgumentCount,
+        ExpressionFlags Flags,
+        OverloadResolutionFlags OvrldFlags,
+        _In_opt_ Type *AccessingInstanceType,
+        _Out_ OverloadResolutionCache::Request &Request
+    );
+
 
     // *** Begin helper procedures for overload resolution ***
 
@@ -10786,6 +10802,8 @@ protected:
     LookupTree *m_LookupCache;
     ExtensionMethodNameLookupCache * m_ExtensionMethodLookupCache;
     LiftedUserDefinedOperatorCache * m_LiftedOperatorCache;
+    ConversionClassificationCache * m_ConversionCache;
+    OverloadResolutionCache * m_OverloadResolutionCache;
     NamespaceRingTree *m_MergedNamespaceCache;
     bool m_DoNotMergeNamespaceCaches;
     CompilationCaches *m_CompilationCaches;
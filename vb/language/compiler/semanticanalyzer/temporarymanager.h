@@ -26,7 +26,9 @@ enum LifetimeClass
                          
     LifetimeNone,        // The temporary variable is always available.
     LifetimeShortLived,  // The temporary variable has a per-statement lifetime.
-    LifetimeLongLived    // The temporary variable lives for the entire function.
+    LifetimeLongLived    // The temporary variable lives for the entire function.  Code generation
+                         // may still give the temps of For, For Each, Select, With and Using blocks
+                         // a shared slot, so those must only be referenced inside their Block.
 };
 
 struct Temporary
@@ -33,8 +33,8 @@ using namespace std;
 bool SourceFile::_StepToBuiltSymbols()
 {
     DebCheckInCompileThread(m_pCompiler);
+    TIMEBLOCKDETAIL(TIME_FileBuildSymbols, m_pstrFileName);
 
-    ErrorTable       *perrorTable = this->GetCurrentErrorTable();
     BCSYM_Container  *pcontainer = NULL;
 
     VSASSERT(m_cs == CS_NoState, "Bad state.");
@@ -55,12 +55,74 @@ bool SourceFile::_StepToBuiltSymbols()
 
     // Get the trees.
 
-    IfFailThrow(GetDeclTrees(&nraDeclTrees,
+    IfFailThrow(ParseDeclTreesForBuiltSymbols(&nraDeclTrees, &pcontainer, &ptree));
+
+    return StepToBuiltSymbolsFromDeclTrees(pcontainer, ptree);
+}
+
+//============================================================================
+// Parse the declarations of this file in preparation for building its
+// symbols.  This can run on a worker thread: everything it allocates comes
+// from the symbol allocator of this file and errors go to its current error
+// table.
+//============================================================================
+
+HRESULT SourceFile::ParseDeclTreesForBuiltSymbols
+(
+    NorlsAllocator *pnraDeclTrees,
+    BCSYM_Container **ppcontainerConditionalConstants,
+    ParseTree::FileBlockStatement **ppDeclTrees
+)
+{
+    VSASSERT(m_cs == CS_NoState, "Bad state.");
+    VSASSERT(m_step == CS_NoStep, "Bad step.");
+
+#if !IDE
+    // Keep the tokens of the method bodies so that they are not scanned
+    // again when the bodies are compiled.  The IDE parses method bodies from
+    // the current text of the buffer, so it cannot use them.
+    ReleaseTokenStreamCache();
+    m_pTokenStreamCache = new TokenStreamCache();
+#endif !IDE
+
+    HRESULT hr = GetDeclTrees(pnraDeclTrees,
         &m_nraSymbols,
-        perrorTable,
-        &pcontainer,
+        GetCurrentErrorTable(),
+        ppcontainerConditionalConstants,
         GetLineMarkerTable(),
-        &ptree));
+        ppDeclTrees);
+
+    if (m_pTokenStreamCache)
+    {
+        if (FAILED(hr))
+        {
+            ReleaseTokenStreamCache();
+        }
+        else
+        {
+            m_pTokenStreamCache->CompleteRecording();
+        }
+    }
+
+    return hr;
+}
+
+//============================================================================
+// Build the declared symbols of this file from its declaration trees.
+//============================================================================
+
+bool SourceFile::StepToBuiltSymbolsFromDeclTrees
+(
+    BCSYM_Container *pcontainer,
+    ParseTree::FileBlockStatement *ptree
+)
+{
+    DebCheckInCompileThread(m_pCompiler);
+
+    ErrorTable *perrorTable = this->GetCurrentErrorTable();
+
+    VSASSERT(m_cs == CS_NoState, "Bad state.");
+    VSASSERT(m_step == CS_NoStep, "Bad step.");
 
 #if IDE 
     m_HasParseErrors = perrorTable->HasErrorsThroughStep(CS_NoStep);
@@ -178,6 +240,7 @@ bool SourceFile::_StepToBuiltSymbols()
 bool SourceFile::_StepToBoundSymbols()
 {
     DebCheckInCompileThread(m_pCompiler);
+    TIMEBLOCKDETAIL(TIME_FileBindSymbols, m_pstrFileName);
 
     ErrorTable errors(m_pCompiler, m_pProject, NULL);
 
@@ -402,6 +465,7 @@ bool SourceFile::_StepToEmitTypeMembers()
 bool SourceFile::_StepToEmitMethodBodies()
 {
     DebCheckInCompileThread(m_pCompiler);
+    TIMEBLOCKDETAIL(TIME_FileEmitMethodBodies, m_pstrFileName);
 
     bool fAborted = false;
 
@@ -480,6 +544,9 @@ bool SourceFile::_StepToEmitMethodBodies()
     }
 #endif
 
+    // The method bodies have all been compiled.
+    ReleaseTokenStreamCache();
+
     VSASSERT(m_step == CS_EmitTypeMembers, "Bad step.");
     m_step = CS_GeneratedCode;
 
@@ -537,6 +604,7 @@ SourceFile::SourceFile
     , m_pstrKeyContainerNameFromAttr(NULL)
     , m_pImportTracker(NULL)
     , m_pDaUnprocessedFriends(NULL)
+    , m_pTokenStreamCache(NULL)
 {
 
 #if IDE 
@@ -643,6 +711,8 @@ void SourceFile::Invalidate(bool SkipDemoteNodesCheck /* = true */)
         delete m_pDaUnprocessedFriends;
         m_pDaUnprocessedFriends = NULL;
     }
+
+    ReleaseTokenStreamCache();
 }
 
 //============================================================================
@@ -846,6 +916,10 @@ void SourceFile::ReleaseFileFromProject(bool SkipDemoteNodesCheck)
     // from the destructor then the compilerfile will still be alive
     // after the compilerproject is gone!! since the compilerfile has
     // a back pointer to the project we'll GP fault.
+    //
+    // For the same reason give the cached text back to the project's source
+    // file cache while the project is still there.
+    m_TextFile.ReleaseSourceFileCache();
     UnlinkFromProject();
 
 #if DEBUG
@@ -1853,7 +1927,7 @@ public:
         if (pRef)
         {
             // copy in case the original is deleted.
-            TextFileCacheRef* pFileCacheRef = new (zeromemory) TextFileCacheRef(pRef->GetOffset(), pRef->GetSize(), pRef->GetTimestamp(), pRef->IsDetectUTF8WithoutSig());
+            TextFileCacheRef* pFileCacheRef = new (zeromemory) TextFileCacheRef(*pRef);
             pFileCacheRef->SetUnicode(true);
 
             CComPtr<IVsTaskSchedulerService> spTaskSchedulerService = GetCompilerPackage()->GetTaskSchedulerService();
@@ -3067,6 +3141,9 @@ void SourceFile::_DemoteToNoState()
         // Throw the symbols away along with their line markers.
         m_LineMarkerTable.RemoveAllDeclLocations();
 
+        // The text may have changed.
+        ReleaseTokenStreamCache();
+
         // Reset the file load error flag if we had a file load error previously.
         SetHasFileLoadError(false);
 
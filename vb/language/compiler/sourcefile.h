@@ -210,6 +210,7 @@ protected:
     friend class PEBuilder;
     friend class CommitEditList;
     friend class BCSYM;
+    friend class DeclTreeBatchParser;
 
     //========================================================================
     // The following methods should only be called from the master
@@ -227,6 +228,32 @@ protected:
     // invoked by _PromoteToBound to complete the task started by _StepToBoundSymbols()
     virtual void CompleteStepToBoundSymbols();
 
+    // _StepToBuiltSymbols split in two for the parallel declared phase.  The
+    // parse only touches this file's allocator and error table and may run on
+    // any thread; building the symbols must happen on the compile thread, in
+    // project order.
+    HRESULT ParseDeclTreesForBuiltSymbols(
+        NorlsAllocator * pnraDeclTrees,
+        BCSYM_Container ** ppcontainerConditionalConstants,
+        ParseTree::FileBlockStatement ** ppDeclTrees);
+
+    bool StepToBuiltSymbolsFromDeclTrees(
+        BCSYM_Container * pcontainerConditionalConstants,
+        ParseTree::FileBlockStatement * pDeclTrees);
+
+    // The tokens scanned while parsing the declarations, which the method
+    // body parser replays.  NULL unless the file is being compiled.
+    TokenStreamCache * GetTokenStreamCache()
+    {
+        return m_pTokenStreamCache;
+    }
+
+    void ReleaseTokenStreamCache()
+    {
+        delete m_pTokenStreamCache;
+        m_pTokenStreamCache = NULL;
+    }
+
     //========================================================================
     // The following methods should only be called from the master
     // project decompilation routines and themselves.  They should
@@ -1188,6 +1215,8 @@ private:
     // Friends.
     // A list of unprocessed friend declarations.
     DynamicArray< UnprocessedFriend > * m_pDaUnprocessedFriends;
+
+    TokenStreamCache * m_pTokenStreamCache;
     
 };
 
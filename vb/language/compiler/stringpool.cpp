@@ -10,6 +10,10 @@
 
 #include "StdAfx.h"
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 // The size of the hash table.  Should be a power of 2. Must be >= 1024
 #define BaseSpellingHashTableSize 4096
 #define BaseStrInfoHashTableSize  4096
@@ -27,23 +31,23 @@
 // Initialize the string pool.
 //============================================================================
 
-StringPool::StringPool() :
-    m_nraStrings(NORLSLOC, m_heap)
+StringPool::StringPool()
 {
     // Allocate the stringinfo hash table.
-    m_ulStrInfoHashTableSize = BaseStrInfoHashTableSize;
-    m_ulStrInfoHashTableMask = m_ulStrInfoHashTableSize - 1;
-    m_strinfoHashTable = VBAllocator::AllocateArray<STRING_INFO*>(BaseStrInfoHashTableSize);
+    m_pStrInfoBuckets = AllocateBuckets<STRING_INFO>(BaseStrInfoHashTableSize);
 
     // Allocate the spelling hash table.
-    m_ulSpellingHashTableSize = BaseSpellingHashTableSize;
-    m_ulSpellingHashTableMask = m_ulSpellingHashTableSize - 1;
-    m_spellingHashTable = VBAllocator::AllocateArray<Casing*>(BaseSpellingHashTableSize);
+    m_pSpellingBuckets = AllocateBuckets<Casing>(BaseSpellingHashTableSize);
 
     // calculate thresholds.
     m_ulStrInfoThreshold = IdealBucketSize * BaseStrInfoHashTableSize;
     m_ulSpellingThreshold = IdealBucketSize * BaseSpellingHashTableSize;
 
+    for (unsigned iStripe = 0; iStripe < LockStripeCount; iStripe++)
+    {
+        m_rgLockStripes[iStripe].m_pnraStrings = new NorlsAllocator(NORLSLOC, m_heap);
+    }
+
     // Port Note: The below code was moved from Compiler::Compiler(3 params) 
     // inside Compiler.cpp around line 1324
     //
@@ -135,8 +139,116 @@ StringPool::StringPool() :
 
 StringPool::~StringPool()
 {
-    VBFree(m_strinfoHashTable);
-    VBFree(m_spellingHashTable);
+    FreeBuckets(m_pStrInfoBuckets);
+    FreeBuckets(m_pSpellingBuckets);
+
+    for (unsigned iStripe = 0; iStripe < LockStripeCount; iStripe++)
+    {
+        delete m_rgLockStripes[iStripe].m_pnraStrings;
+    }
+}
+
+//============================================================================
+// Hash table helpers.
+//============================================================================
+
+template <class T>
+StringPool::Buckets<T> * StringPool::AllocateBuckets(unsigned ulSize)
+{
+    size_t cbBuckets = VBMath::Add(sizeof(Buckets<T>), VBMath::Multiply(ulSize, sizeof(T *)));
+    Buckets<T> *pBuckets = (Buckets<T> *)VBAllocator::Allocate(cbBuckets);
+
+    pBuckets->m_ulMask = ulSize - 1;
+    return pBuckets;
+}
+
+template <class T>
+void StringPool::FreeBuckets(_In_opt_ Buckets<T> * pBuckets)
+{
+    while (pBuckets)
+    {
+        Buckets<T> *pRetired = pBuckets->m_pRetired;
+
+        VBFree(pBuckets);
+        pBuckets = pRetired;
+    }
+}
+
+// Links pEntry in at the head of a bucket.  Entries of the same bucket can
+// be added under different lock stripes, so the head is swapped atomically.
+// *ppEntryNext is the link field of pEntry.
+template <class T>
+void StringPool::LinkBucketEntry(
+    _Inout_ T * volatile * ppBucket,
+    _Inout_ T * pEntry,
+    _Inout_ T ** ppEntryNext)
+{
+    T *pHead;
+
+    do
+    {
+        pHead = *ppBucket;
+        *ppEntryNext = pHead;
+    }
+    while (InterlockedCompareExchangePointer((PVOID volatile *)ppBucket, pEntry, pHead) != pHead);
+}
+
+//============================================================================
+// Lock stripes.
+//============================================================================
+
+void StringPool::EnterLockStripe(unsigned iStripe)
+{
+    CriticalSection *pLock = &m_rgLockStripes[iStripe].m_lock;
+
+    if (!pLock->TryEnter())
+    {
+#if FV_TRACK_MEMORY
+        InterlockedIncrement(&m_cLockContentions);
+#endif
+
+        pLock->Enter();
+    }
+}
+
+void StringPool::LeaveLockStripe(unsigned iStripe)
+{
+    m_rgLockStripes[iStripe].m_lock.Leave();
+}
+
+StringPool::StripeLock::StripeLock(
+    _In_ StringPool * pPool,
+    unsigned iStripe) :
+    m_pPool(pPool),
+    m_iStripe(iStripe)
+{
+    if (iStripe == AllLockStripes)
+    {
+        // Always in the same order, so this cannot deadlock with itself.
+        for (unsigned iCurrent = 0; iCurrent < LockStripeCount; iCurrent++)
+        {
+            pPool->EnterLockStripe(iCurrent);
+        }
+    }
+    else
+    {
+        pPool->EnterLockStripe(iStripe);
+    }
+}
+
+StringPool::StripeLock::~StripeLock()
+{
+    if (m_iStripe == AllLockStripes)
+    {
+        for (unsigned iCurrent = LockStripeCount; iCurrent > 0; iCurrent--)
+        {
+            m_pPool->LeaveLockStripe(iCurrent - 1);
+        }
+    }
+    else
+    {
+        m_pPool->LeaveLockStripe(m_iStripe);
+    }
 }
 
 //============================================================================
@@ -283,14 +395,21 @@ STRING * StringPool::ConcatStringsArray(
 
 //============================================================================
 // Doubles the size of the string info hash table.  Returns false if
-// the table cannot be expanded, either because it cannot allocate
-// memory, or because the table is already at max size.
+// the table cannot be expanded because it is already at max size.
+//
+// The entries are moved into a new bucket array, which is then published.
+// Readers may still be walking the old array while entries are being
+// moved; they can miss an entry but always reach the end of a chain,
+// because every chain stays NULL-terminated at each step.
 //============================================================================
 
 bool StringPool::ExpandStrInfoTable()
 {
+    Buckets<STRING_INFO> *pOldBuckets = m_pStrInfoBuckets;
+    unsigned ulOldSize = pOldBuckets->m_ulMask + 1;
+
     // fail if not allowed to expand table further
-    if (m_ulStrInfoHashTableSize == MaxStrInfoHashTableSize)
+    if (ulOldSize == MaxStrInfoHashTableSize)
     {
         m_ulStrInfoThreshold = 0xFFFFFFFF;      // make sure we're never called again.
         return false;
@@ -299,89 +418,49 @@ bool StringPool::ExpandStrInfoTable()
     // move up StrInfo threshold.
     m_ulStrInfoThreshold = m_ulStrInfoThreshold << 1;
 
-    STRING_INFO** strinfoNewHashTable = NULL;
-
-    // Reallocate the stringinfo hash table with new size
-    strinfoNewHashTable =
-        (STRING_INFO**)VBRealloc(m_strinfoHashTable,
-                                 2 * m_ulStrInfoHashTableSize * sizeof(STRING_INFO*));
-
-    // fail if unable to expand table further
-    if (strinfoNewHashTable == NULL)
-    {
-        return false;
-    }
-
-    m_strinfoHashTable = strinfoNewHashTable;
-
-    // zerofill newly allocated memory
-    memset(m_strinfoHashTable + m_ulStrInfoHashTableSize,
-           0,
-           m_ulStrInfoHashTableSize  * sizeof(STRING_INFO *));
-
-    // take old table and fill into new table, starting at bottom
-    unsigned istrinfoTablePos = m_ulStrInfoHashTableSize;
+    Buckets<STRING_INFO> *pNewBuckets = AllocateBuckets<STRING_INFO>(2 * ulOldSize);
     unsigned index;
-    STRING_INFO *pstrinfoPrev, *pstrinfoCur, *pstrinfoNext;
+    STRING_INFO *pstrinfoCur, *pstrinfoNext;
 
-    unsigned ulPrevHashTableDoublings = (m_ulStrInfoHashTableSize / 1024) - 1;
-    m_ulStrInfoHashTableSize *= 2;
-    m_ulStrInfoHashTableMask = m_ulStrInfoHashTableSize - 1;
+    pNewBuckets->m_pRetired = pOldBuckets;
 
-    do
+    InterlockedIncrement(&m_lRehashGeneration);
+
+    // take old table and fill into new table
+    for (unsigned istrinfoTablePos = 0; istrinfoTablePos < ulOldSize; istrinfoTablePos++)
     {
-        // go though one bucket of the table and place items elsewhere
-        istrinfoTablePos--;
-        pstrinfoPrev = NULL;
-        pstrinfoCur = m_strinfoHashTable[istrinfoTablePos];
-        while (pstrinfoCur != NULL)
+        for (pstrinfoCur = pOldBuckets->m_rgpBuckets[istrinfoTablePos];
+             pstrinfoCur != NULL;
+             pstrinfoCur = pstrinfoNext)
         {
-
             pstrinfoNext = pstrinfoCur->m_pstrinfoNext;
             index = ((pstrinfoCur->m_ulSysHash << 10)+(istrinfoTablePos & 1023))
-                    & (m_ulStrInfoHashTableSize-1);
-
-            // move it if necessary
-            if (index != istrinfoTablePos)
-            {
-                // remove it from the current bucket
-                if (pstrinfoPrev == NULL)
-                {
-                    m_strinfoHashTable[istrinfoTablePos] = pstrinfoNext;
-                }
-                else
-                {
-                    pstrinfoPrev->m_pstrinfoNext = pstrinfoNext;
-                }
-
-                // place it in a new bucket
-                pstrinfoCur->m_pstrinfoNext = m_strinfoHashTable[index];
-                m_strinfoHashTable[index] = pstrinfoCur;
+                    & pNewBuckets->m_ulMask;
 
-            }
-            else
-            {
-                pstrinfoPrev = pstrinfoCur;
-            }
-
-            pstrinfoCur = pstrinfoNext;
+            pstrinfoCur->m_pstrinfoNext = pNewBuckets->m_rgpBuckets[index];
+            pNewBuckets->m_rgpBuckets[index] = pstrinfoCur;
         }
+    }
 
-    } while (istrinfoTablePos > 0);
+    InterlockedExchangePointer((PVOID volatile *)&m_pStrInfoBuckets, pNewBuckets);
+    InterlockedIncrement(&m_lRehashGeneration);
 
     return true;
 }
 
 //============================================================================
 // Doubles the size of the spelling hash table.  Returns false if
-// the table cannot be expanded, either because it cannot allocate
-// memory, or because the table is already at max size.
+// the table cannot be expanded because it is already at max size.
+// See ExpandStrInfoTable.
 //============================================================================
 
 bool StringPool::ExpandSpellingTable()
 {
+    Buckets<Casing> *pOldBuckets = m_pSpellingBuckets;
+    unsigned ulOldSize = pOldBuckets->m_ulMask + 1;
+
     // fail if not allowed to expand table further
-    if (m_ulSpellingHashTableSize == MaxSpellingHashTableSize)
+    if (ulOldSize == MaxSpellingHashTableSize)
     {
         m_ulSpellingThreshold = 0xFFFFFFFF;     // make sure we're never called again.
         return false;
@@ -390,76 +469,61 @@ bool StringPool::ExpandSpellingTable()
     // move up spelling threshold.
     m_ulSpellingThreshold = m_ulSpellingThreshold << 1;
 
-    Casing** spellingNewHashTable = NULL;
-
-    // Reallocate the stringinfo hash table with new size
-    spellingNewHashTable =
-        (Casing**)VBRealloc(  m_spellingHashTable,
-                              2 * m_ulSpellingHashTableSize * sizeof(Casing*));
-
-    // fail if unable to expand table further
-    if (spellingNewHashTable == NULL)
-    {
-        return false;
-    }
-
-    m_spellingHashTable = spellingNewHashTable;
-
-    // zerofill newly allocated memory
-    memset( m_spellingHashTable + m_ulSpellingHashTableSize,
-            0,
-            (size_t)(m_ulSpellingHashTableSize * sizeof(Casing*)));
-
-    // take old table and fill into new table, starting at bottom
-    unsigned ispellingTablePos = m_ulSpellingHashTableSize;
+    Buckets<Casing> *pNewBuckets = AllocateBuckets<Casing>(2 * ulOldSize);
     unsigned index;
-    Casing *pspellingPrev, *pspellingCur, *pspellingNext;
+    Casing *pspellingCur, *pspellingNext;
 
-    unsigned ulPrevHashTableDoublings = (m_ulSpellingHashTableSize / 1024) - 1;
-    m_ulSpellingHashTableSize *= 2;
-    m_ulSpellingHashTableMask = m_ulSpellingHashTableSize - 1;
+    pNewBuckets->m_pRetired = pOldBuckets;
 
-    do
+    InterlockedIncrement(&m_lRehashGeneration);
+
+    // take old table and fill into new table
+    for (unsigned ispellingTablePos = 0; ispellingTablePos < ulOldSize; ispellingTablePos++)
     {
-        // go though one bucket of the table and place items elsewhere
-        ispellingTablePos--;
-        pspellingPrev = NULL;
-        pspellingCur = m_spellingHashTable[ispellingTablePos];
-        while (pspellingCur != NULL)
+        for (pspellingCur = pOldBuckets->m_rgpBuckets[ispellingTablePos];
+             pspellingCur != NULL;
+             pspellingCur = pspellingNext)
         {
-
             pspellingNext = pspellingCur->m_pspellingNext;
             index = ((pspellingCur->m_ulSpellingHash << 10)+(ispellingTablePos & 1023))
-                    & (m_ulSpellingHashTableSize-1);
+                    & pNewBuckets->m_ulMask;
 
-            // move it if necessary
-            if (index != ispellingTablePos)
-            {
-                // remove it from the current bucket
-                if (pspellingPrev == NULL)
-                {
-                    m_spellingHashTable[ispellingTablePos] = pspellingNext;
-                }
-                else
-                {
-                    pspellingPrev->m_pspellingNext = pspellingNext;
-                }
-
-                // place it in a new bucket
-                pspellingCur->m_pspellingNext = m_spellingHashTable[index];
-                m_spellingHashTable[index] = pspellingCur;
+            pspellingCur->m_pspellingNext = pNewBuckets->m_rgpBuckets[index];
+            pNewBuckets->m_rgpBuckets[index] = pspellingCur;
+        }
+    }
 
-            }
-            else
-            {
-                pspellingPrev = pspellingCur;
-            }
+    InterlockedExchangePointer((PVOID volatile *)&m_pSpellingBuckets, pNewBuckets);
+    InterlockedIncrement(&m_lRehashGeneration);
+
+    return true;
+}
+
+//============================================================================
+// Grows the tables once they pass their thresholds.  Called without any
+// lock stripe held.
+//============================================================================
+
+void StringPool::ExpandTablesIfNeeded()
+{
+    if ((unsigned)m_ulSpellingCount > m_ulSpellingThreshold)
+    {
+        StripeLock lock(this, AllLockStripes);
 
-            pspellingCur = pspellingNext;
+        // Somebody else may have grown the table while we waited.
+        if ((unsigned)m_ulSpellingCount > m_ulSpellingThreshold)
+        {
+            ExpandSpellingTable();
         }
-    } while (ispellingTablePos > 0);
 
-    return true;
+        // now check if we have to grow the strinfo table, too.  the only time we add
+        // a strinfo we also add a spelling.
+        //
+        if ((unsigned)m_ulNameCount > m_ulStrInfoThreshold)
+        {
+            ExpandStrInfoTable();
+        }
+    }
 }
 
 
@@ -583,12 +647,14 @@ SAFEARRAY * StringPool::GetStringPoolData()
     WCHAR szBuffer[TEMPBUFSIZE];
     const WCHAR* szFmt =  L"%c,%6d,%08x,%08x,%7d,%4d,%3d,";
 
-    CompilerIdeLock lock(m_CriticalSection);
+    StripeLock lock(this, AllLockStripes);
 
-    for (iBucket = 0; iBucket < m_ulSpellingHashTableSize; iBucket++)
+    Buckets<Casing> *pSpellingBuckets = m_pSpellingBuckets;
+
+    for (iBucket = 0; iBucket <= pSpellingBuckets->m_ulMask; iBucket++)
     {
 
-        pspelling = m_spellingHashTable[iBucket];
+        pspelling = pSpellingBuckets->m_rgpBuckets[iBucket];
 
         for (; pspelling; pspelling = pspelling->m_pspellingNext)
         {
@@ -613,10 +679,12 @@ SAFEARRAY * StringPool::GetStringPoolData()
 
     STRING_INFO *pstrinfo;
 
-    for (iBucket = 0; iBucket < m_ulStrInfoHashTableSize; iBucket++)
+    Buckets<STRING_INFO> *pStrInfoBuckets = m_pStrInfoBuckets;
+
+    for (iBucket = 0; iBucket <= pStrInfoBuckets->m_ulMask; iBucket++)
     {
 
-        pstrinfo = m_strinfoHashTable[iBucket];
+        pstrinfo = pStrInfoBuckets->m_rgpBuckets[iBucket];
 
         for (; pstrinfo; pstrinfo = pstrinfo->m_pstrinfoNext)
         {
@@ -647,6 +715,89 @@ SAFEARRAY * StringPool::GetStringPoolData()
 
 //#pragma optimize("atw", on)
 
+//============================================================================
+// SSE2 kernels.  SSE2 is always there on x64 and is detected once on x86.
+// The scalar code is the reference implementation and handles whatever the
+// kernels leave over: the tail of a string, and non-ASCII text when folding
+// case.  AVX2 is not worth it here, most identifiers are shorter than one
+// 16-byte block.
+//============================================================================
+
+#if defined(_M_IX86) || defined(_M_X64)
+
+#define STRINGPOOL_SSE2 1
+
+#if defined(_M_X64)
+static const bool g_fStringPoolUseSSE2 = true;
+#else
+static const bool g_fStringPoolUseSSE2 = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE) != FALSE;
+#endif
+
+// Mixes 4 longs (8 WCHARs) into the hash.  The per-long step of the scalar
+// loop, ((l >> 9) + l) * 0x10004001, is done for all 4 at once; the constant
+// is 2^28 + 2^14 + 1 so the multiply is just shifts and adds.  The
+// rotate-and-add chain is inherently serial and stays scalar, so the result
+// is exactly what the scalar loop computes.
+inline
+unsigned long HashBlockSSE2(
+    unsigned long hash,
+    __m128i x)
+{
+    unsigned long rgul[4];
+
+    x = _mm_add_epi32(_mm_srli_epi32(x, 9), x);
+    x = _mm_add_epi32(_mm_add_epi32(x, _mm_slli_epi32(x, 14)), _mm_slli_epi32(x, 28));
+    _mm_storeu_si128((__m128i *)rgul, x);
+
+    hash = _lrotl(hash, 2) + rgul[0];
+    hash = _lrotl(hash, 2) + rgul[1];
+    hash = _lrotl(hash, 2) + rgul[2];
+    hash = _lrotl(hash, 2) + rgul[3];
+
+    return hash;
+}
+
+// Hashes whole blocks of 4 longs and returns how many longs were consumed.
+// When folding case it stops at the first block with a non-ASCII character,
+// which the scalar loop lowercases properly.
+inline
+size_t HashBlocksSSE2(
+    _Inout_ unsigned long * phash,
+    _In_ const unsigned long * pl,
+    size_t cl,
+    bool CaseSensitive)
+{
+    const __m128i xNonAscii = _mm_set1_epi16((short)0xff80);
+    const __m128i xLowerCase = _mm_set1_epi16(0x0020);
+    const __m128i xZero = _mm_setzero_si128();
+
+    unsigned long hash = *phash;
+    size_t clDone = 0;
+
+    for (; cl - clDone >= 4; clDone += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(pl + clDone));
+
+        if (!CaseSensitive)
+        {
+            // Same as SleazyLowerCasePair for a block of ASCII characters.
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(x, xNonAscii), xZero)) != 0xFFFF)
+            {
+                break;
+            }
+
+            x = _mm_or_si128(x, xLowerCase);
+        }
+
+        hash = HashBlockSSE2(hash, x);
+    }
+
+    *phash = hash;
+    return clDone;
+}
+
+#endif
+
 inline
 int dmemcmp(
     const unsigned * pul1,
@@ -654,6 +805,24 @@ int dmemcmp(
     size_t N,
     size_t r)
 {
+#if STRINGPOOL_SSE2
+    // Compare 8 WCHARs at a time.  Unaligned loads are fine, and stepping
+    // 16 bytes keeps the alignment the scalar code below looks at.
+    if (g_fStringPoolUseSSE2)
+    {
+        for (; 4 <= N; pul1 += 4, pul2 += 4, N -= 4)
+        {
+            __m128i x1 = _mm_loadu_si128((const __m128i *)pul1);
+            __m128i x2 = _mm_loadu_si128((const __m128i *)pul2);
+
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(x1, x2)) != 0xFFFF)
+            {
+                return 1;
+            }
+        }
+    }
+#endif
+
 
 #ifdef _WIN64
 
@@ -810,6 +979,18 @@ unsigned long _fastcall StringPool::ComputeStringHashValue(
     unsigned long hash = 0;
     unsigned long l =0 ;
 
+#if STRINGPOOL_SSE2
+    // Do as much as possible 8 WCHARs at a time.  The scalar loops below
+    // pick up where this left off and produce the same hash.
+    if (g_fStringPoolUseSSE2 && 4 <= cl)
+    {
+        size_t clDone = HashBlocksSSE2(&hash, pl, cl, CaseSensitive);
+
+        pl += clDone;
+        cl -= clDone;
+    }
+#endif
+
 #ifdef _WIN64
     bool IsNotAligned = (size_t) pl & 0x3;
 #endif
@@ -920,121 +1101,167 @@ unsigned long _fastcall StringPool::ComputeStringHashValue(
 }
 
 //============================================================================
-// Lookup a string without adding it if it isn't already there.
+// Look for an exact spelling of a string.  Takes no lock.
 //============================================================================
 
-STRING * StringPool::LookupStringWithLen(
+Casing * StringPool::FindSpelling(
     _In_count_(cchSize)const WCHAR * pwchar,
     size_t cchSize,
-    bool isCaseSensitive)
+    unsigned ulSpHash)
 {
     size_t clSizeLong = cchSize >> 1;
     size_t cchAfterLong = (cchSize) & 1;
 
-    unsigned ulCompare, index, ulHash;
+    Buckets<Casing> *pBuckets = m_pSpellingBuckets;
+    unsigned ulSpCompare = GetCompareValue(cchSize, GetSignificantSpellingHashValue(ulSpHash));
     Casing *pspelling;
-    STRING_INFO *pstrinfo;
-    STRING *pstr = NULL;
-
-    //
-    // Check the spelling hash table to see if we can do this via a fast
-    // lookup.
-    //
-
-    ulHash = ComputeStringHashValue((unsigned long *)pwchar, clSizeLong, cchAfterLong, true);
-
-    // Grab the lock after ComputeStringHashValue.  Profiles show that this method in particular 
-    // is very expensive and accounts to up to 2/3 of the entire AddStringWithLength call.  It is 
-    // a static method which does not touch any shared variables so it is safe to execute outside
-    // the lock.  Putting it outside the lock allows for the most expensive part of the function
-    // to execute in parallel
-    // Lock after ComputeStringHashValue because 2/3 of the time is spent 
-    CompilerIdeLock lock(m_CriticalSection);
 
-    index = ulHash & (m_ulSpellingHashTableMask);
-    ulCompare = GetCompareValue(cchSize, GetSignificantSpellingHashValue(ulHash));
-
-    for (pspelling = m_spellingHashTable[index];
+    for (pspelling = pBuckets->m_rgpBuckets[ulSpHash & pBuckets->m_ulMask];
          pspelling;
          pspelling = pspelling->m_pspellingNext)
     {
 
 #if FV_TRACK_MEMORY
         m_cSpellingProbes++;
-#endif  // DEBUG
+#endif // DEBUG
 
         // If this string doesn't even match case insensitively,
         // find something else.
         //
-        if (pspelling->m_ulCompare != ulCompare)
+        if (pspelling->m_ulCompare != ulSpCompare)
         {
             continue;
         }
 
-        // If we want a case sensitive match, check further to see if
-        // we got it.
-
 #if FV_TRACK_MEMORY
         m_cDeepSpellingProbes++;
 #endif // DEBUG
 
         if (!dmemcmp((const unsigned *)pspelling->m_str, (const unsigned *)pwchar, clSizeLong, cchAfterLong))
         {
-            pstr = pspelling->m_str;
-            goto Done;
+            return pspelling;
         }
 
 #if FV_TRACK_MEMORY
         m_cFailedDeepSpellingProbes++;
 #endif // DEBUG
-    } // end for
+    }
 
-    // We failed to find an exact case match, so now
-    // try to find a case-insensitive match.
-    if (!isCaseSensitive)
+    return NULL;
+}
+
+//============================================================================
+// Look for a string with any spelling.  Takes no lock.
+//============================================================================
+
+STRING_INFO * StringPool::FindStrInfo(
+    _In_count_(cchSize)const WCHAR * pwchar,
+    size_t cchSize,
+    unsigned ulHash)
+{
+    Buckets<STRING_INFO> *pBuckets = m_pStrInfoBuckets;
+    unsigned ulCompare = GetCompareValue(cchSize, GetSignificantSpellingHashValue(ulHash));
+    STRING_INFO *pstrinfo;
+
+    for (pstrinfo = pBuckets->m_rgpBuckets[ulHash & pBuckets->m_ulMask];
+        pstrinfo;
+        pstrinfo = pstrinfo->m_pstrinfoNext)
     {
-        // Compute the hash value for the stringinfo
-        ulHash = ComputeStringHashValue((unsigned long *)pwchar, clSizeLong, cchAfterLong, false);
-        index = ulHash & (m_ulStrInfoHashTableMask);
-        ulCompare = GetCompareValue(cchSize, GetSignificantSpellingHashValue(ulHash));
 
 #if FV_TRACK_MEMORY
-        m_cStringAttempts++;
+        m_cStringProbes++;
 #endif // DEBUG
 
-        for (pstrinfo = m_strinfoHashTable[index];
-            pstrinfo;
-            pstrinfo = pstrinfo->m_pstrinfoNext)
+        if (pstrinfo->m_ulCompare != ulCompare)
         {
+            continue;
+        }
 
 #if FV_TRACK_MEMORY
-            m_cStringProbes++;
+        m_cDeepStringProbes++;
 #endif // DEBUG
 
-            if (pstrinfo->m_ulCompare != ulCompare)
-            {
-                continue;
-            }
+        // compare the strings. Note that we use a local-insensitive compare here,
+        // which is correct both from the standpoint of normal comparison, but also
+        // from the standpoint of case sensitivity (i.e. we use the standard Unicode
+        // 1-1 case mappings rather than dealing with local sensitive casing)
+        if (!CompareNoCaseN(pwchar, pstrinfo->m_spelling.m_str, (int)cchSize))
+        {
+            return pstrinfo;
+        }
+    }
+
+    return NULL;
+}
+
+//============================================================================
+// Lookup a string without adding it if it isn't already there.
+//============================================================================
+
+STRING * StringPool::LookupStringWithLen(
+    _In_count_(cchSize)const WCHAR * pwchar,
+    size_t cchSize,
+    bool isCaseSensitive)
+{
+    size_t clSizeLong = cchSize >> 1;
+    size_t cchAfterLong = (cchSize) & 1;
+
+    unsigned ulSpHash, ulHash = 0;
+    Casing *pspelling;
+    STRING_INFO *pstrinfo = NULL;
+
+    // No lock is taken for a lookup.  An entry can only be missed if it was
+    // being moved by a rehash, so a miss is trusted unless a rehash overlapped
+    // with the lookup.
+    LONG lRehashGeneration = m_lRehashGeneration;
+
+    //
+    // Check the spelling hash table to see if we can do this via a fast
+    // lookup.
+    //
+
+    ulSpHash = ComputeStringHashValue((unsigned long *)pwchar, clSizeLong, cchAfterLong, true);
+    pspelling = FindSpelling(pwchar, cchSize, ulSpHash);
+
+    // We failed to find an exact case match, so now
+    // try to find a case-insensitive match.
+    if (!pspelling && !isCaseSensitive)
+    {
+        // Compute the hash value for the stringinfo
+        ulHash = ComputeStringHashValue((unsigned long *)pwchar, clSizeLong, cchAfterLong, false);
 
 #if FV_TRACK_MEMORY
-            m_cDeepStringProbes++;
+        m_cStringAttempts++;
 #endif // DEBUG
 
-            // compare the strings. Note that we use a local-insensitive compare here,
-            // which is correct both from the standpoint of normal comparison, but also
-            // from the standpoint of case sensitivity (i.e. we use the standard Unicode
-            // 1-1 case mappings rather than dealing with local sensitive casing)
-            if (!CompareNoCaseN(pwchar, pstrinfo->m_spelling.m_str, (int)cchSize))
-            {
-                pstr = pstrinfo->m_spelling.m_str;
-                goto Done;
-            }
+        pstrinfo = FindStrInfo(pwchar, cchSize, ulHash);
+    }
+
+    if (!pspelling && !pstrinfo &&
+        ((lRehashGeneration & 1) || lRehashGeneration != m_lRehashGeneration))
+    {
+        if (isCaseSensitive)
+        {
+            ulHash = ComputeStringHashValue((unsigned long *)pwchar, clSizeLong, cchAfterLong, false);
         }
-    } // end if
 
-Done:
+        // Holding any stripe keeps the tables from being rehashed.
+        StripeLock lock(this, GetLockStripe(ulHash));
 
-    return pstr;
+        pspelling = FindSpelling(pwchar, cchSize, ulSpHash);
+
+        if (!pspelling && !isCaseSensitive)
+        {
+            pstrinfo = FindStrInfo(pwchar, cchSize, ulHash);
+        }
+    }
+
+    if (pspelling)
+    {
+        return pspelling->m_str;
+    }
+
+    return pstrinfo ? pstrinfo->m_spelling.m_str : NULL;
 }
 
 //============================================================================
@@ -1064,201 +1291,167 @@ STRING *
     m_cCalls++;
 #endif // DEBUG
 
-    unsigned ulCompare, ulSpCompare, index, indexSp, ulSpHash, ulHash;
+    unsigned ulCompare, ulSpCompare, ulSpHash, ulHash, iStripe;
     Casing *pspelling;
     STRING_INFO *pstrinfo;
 
     //
     // Check the spelling hash table to see if we can do this via a fast
-    // lookup.
+    // lookup.  Almost every string is already in the pool, so this is done
+    // without a lock.
     //
 
     ulSpHash = ComputeStringHashValue((unsigned long *)pwchar, clSizeLong, cchAfterLong, true);
+    pspelling = FindSpelling(pwchar, cchSize, ulSpHash);
 
-    // Grab the lock after ComputeStringHashValue.  Profiles show that this method in particular 
-    // is very expensive and accounts to up to 2/3 of the entire AddStringWithLength call.  It is 
-    // a static method which does not touch any shared variables so it is safe to execute outside
-    // the lock.  Putting it outside the lock allows for the most expensive part of the function
-    // to execute in parallel
-    CompilerIdeLock lock(m_CriticalSection);
+    if (pspelling)
+    {
+        return pspelling->m_str;
+    }
 
-    indexSp = ulSpHash & (m_ulSpellingHashTableMask);
+    // Compute the hash value for the stringinfo.  It also picks the lock
+    // stripe, so that all the spellings of a string are added under the
+    // same lock.
+    ulHash = ComputeStringHashValue((unsigned long *)pwchar, clSizeLong, cchAfterLong, false);
+    ulCompare = GetCompareValue(cchSize, GetSignificantSpellingHashValue(ulHash));
     ulSpCompare = GetCompareValue(cchSize, GetSignificantSpellingHashValue(ulSpHash));
+    iStripe = GetLockStripe(ulHash);
 
-    for (pspelling = m_spellingHashTable[indexSp];
-         pspelling;
-         pspelling = pspelling->m_pspellingNext)
     {
+        StripeLock lock(this, iStripe);
 
-#if FV_TRACK_MEMORY
-        m_cSpellingProbes++;
-#endif // DEBUG
-
-        if (pspelling->m_ulCompare != ulSpCompare)
-        {
-            continue;
-        }
-
-#if FV_TRACK_MEMORY
-        m_cDeepSpellingProbes++;
-#endif // DEBUG
+        // Look again, somebody may have added the spelling before we got
+        // the lock.
+        pspelling = FindSpelling(pwchar, cchSize, ulSpHash);
 
-        if (!dmemcmp((const unsigned *)pspelling->m_str, (const unsigned *)pwchar, clSizeLong, cchAfterLong))
+        if (pspelling)
         {
             return pspelling->m_str;
         }
 
-#if FV_TRACK_MEMORY
-        m_cFailedDeepSpellingProbes++;
-#endif // DEBUG
-    }
-
-    //
-    // Spelling does not exist.  Before we add one, see if there is
-    // a stringinfo with the same case-insensitive spelling as
-    // the one we're adding.
-    //
-
-    // Compute the hash value for the stringinfo
-    ulHash = ComputeStringHashValue((unsigned long *)pwchar, clSizeLong, cchAfterLong, false);
-    index = ulHash & (m_ulStrInfoHashTableMask);
-    ulCompare = GetCompareValue(cchSize, GetSignificantSpellingHashValue(ulHash));
+        //
+        // Spelling does not exist.  Before we add one, see if there is
+        // a stringinfo with the same case-insensitive spelling as
+        // the one we're adding.
+        //
 
 #if FV_TRACK_MEMORY
-    m_cStringAttempts++;
+        m_cStringAttempts++;
 #endif // DEBUG
 
-    for (pstrinfo = m_strinfoHashTable[index];
-        pstrinfo;
-        pstrinfo = pstrinfo->m_pstrinfoNext)
-    {
+        pstrinfo = FindStrInfo(pwchar, cchSize, ulHash);
 
-#if FV_TRACK_MEMORY
-        m_cStringProbes++;
-#endif // DEBUG
+        //
+        // Go ahead an add the new spelling.
+        //
 
-        if (pstrinfo->m_ulCompare != ulCompare)
-        {
-            continue;
-        }
+        // If we matched a string, add a new spelling.  We know that there is no existing
+        // spelling for this or we would have matched in the lookup above.
+        //
 
-#if FV_TRACK_MEMORY
-        m_cDeepStringProbes++;
-#endif // DEBUG
+        NorlsAllocator *pnraStrings = m_rgLockStripes[iStripe].m_pnraStrings;
+        bool fNewStrInfo = (pstrinfo == NULL);
+        size_t cbSize;
 
-        // compare the strings.
-        if (!CompareNoCaseN(pwchar, pstrinfo->m_spelling.m_str, (int)cchSize))
+        if (pstrinfo)
         {
-            break;
-        }
-    }
-
-    //
-    // Go ahead an add the new spelling.
-    //
-
-    // If we matched a string, add a new spelling.  We know that there is no existing
-    // spelling for this or we would have matched in the first lookup above.
-    //
-
-    size_t cbSize;
-    if (pstrinfo)
-    {
-        // Allocate the new spelling, aligning it on a 4-byte boundary.
-        // Note: For 64 bit it is possible to allocate slightly more than necessary because the structure
-        // end by an [0] array. For now, it doesnt seem to be worth to  change.
-        IfFalseThrow(cchSize + 1 >= 1);
-        cbSize = VBMath::Add(VBMath::Multiply((cchSize + 1), sizeof(WCHAR)), sizeof(Casing));
-        pspelling = (Casing *)m_nraStrings.AllocNonZero(cbSize);
+            // Allocate the new spelling, aligning it on a 4-byte boundary.
+            // Note: For 64 bit it is possible to allocate slightly more than necessary because the structure
+            // end by an [0] array. For now, it doesn't seem to be worth to  change.
+            IfFalseThrow(cchSize + 1 >= 1);
+            cbSize = VBMath::Add(VBMath::Multiply((cchSize + 1), sizeof(WCHAR)), sizeof(Casing));
+            pspelling = (Casing *)pnraStrings->AllocNonZero(cbSize);
 
 #if FV_TRACK_MEMORY
-        m_cAddtlSpellingMemory += ((cchSize + 1) * sizeof(WCHAR) + sizeof(Casing));
-        m_cNonStringMemory += sizeof(Casing);
+            m_cAddtlSpellingMemory += ((cchSize + 1) * sizeof(WCHAR) + sizeof(Casing));
+            m_cNonStringMemory += sizeof(Casing);
 #if DEBUG
-        m_cDebugOnlyMemory += sizeof(SZ_SIGNATURE);
+            m_cDebugOnlyMemory += sizeof(SZ_SIGNATURE);
 #endif
 #endif
-    }
+        }
 
-    // Otherwise, create a new stringinfo.
-    else
-    {
-        // Alloc the memory, aligning it on a 4-byte boundary.
-        IfFalseThrow(cchSize + 1 >= 1);
-        cbSize = VBMath::Add(VBMath::Multiply((cchSize + 1), sizeof(WCHAR)), sizeof(STRING_INFO));
-        pstrinfo = (STRING_INFO *)m_nraStrings.AllocNonZero(cbSize);
+        // Otherwise, create a new stringinfo.
+        else
+        {
+            // Alloc the memory, aligning it on a 4-byte boundary.
+            IfFalseThrow(cchSize + 1 >= 1);
+            cbSize = VBMath::Add(VBMath::Multiply((cchSize + 1), sizeof(WCHAR)), sizeof(STRING_INFO));
+            pstrinfo = (STRING_INFO *)pnraStrings->AllocNonZero(cbSize);
 
 #if FV_TRACK_MEMORY
-        m_cStringMemory += (cchSize + 1) * sizeof(WCHAR) + sizeof(STRING_INFO);
-        m_cNonStringMemory += sizeof(STRING_INFO);
+            m_cStringMemory += (cchSize + 1) * sizeof(WCHAR) + sizeof(STRING_INFO);
+            m_cNonStringMemory += sizeof(STRING_INFO);
 #if DEBUG
-        m_cDebugOnlyMemory += sizeof(SZ_SIGNATURE);
+            m_cDebugOnlyMemory += sizeof(SZ_SIGNATURE);
 #endif
 #endif
 
-        // Set it up.
-        pstrinfo->m_ulCompare = ulCompare;
-        pstrinfo->m_ulLocalHash = m_ulNameCount++;
+            // Set it up.
+            pstrinfo->m_ulCompare = ulCompare;
+            pstrinfo->m_ulLocalHash = GetLocalHashValue(ulHash);
 
-        pstrinfo->m_UniqueNamespace = NULL;
-        pstrinfo->m_MatchingToken =
-        pstrinfo->m_DeclaredInModule = 
-        pstrinfo->m_DeclaredInNamespace = 0;
+            InterlockedIncrement(&m_ulNameCount);
 
-        pstrinfo->m_pstrinfoNext = m_strinfoHashTable[index];
-        m_strinfoHashTable[index] = pstrinfo;
+            pstrinfo->m_UniqueNamespace = NULL;
+            pstrinfo->m_MatchingToken =
+            pstrinfo->m_DeclaredInModule = 
+            pstrinfo->m_DeclaredInNamespace = 0;
 
-        // Fix up the spelling.
-        pspelling = &pstrinfo->m_spelling;
-    }
+            // Fix up the spelling.
+            pspelling = &pstrinfo->m_spelling;
+        }
 
-    // fix up the back pointer.
-    pspelling->m_pstrinfo = pstrinfo;
+        // fix up the back pointer.
+        pspelling->m_pstrinfo = pstrinfo;
 
 #if DEBUG
-    // put the signature.
-    strcpy_s(pspelling->m_pstrDebSignature, _countof(pspelling->m_pstrDebSignature), SZ_SIGNATURE);
+        // put the signature.
+        strcpy_s(pspelling->m_pstrDebSignature, _countof(pspelling->m_pstrDebSignature), SZ_SIGNATURE);
 
 #endif // DEBUG
 
-    // copy the string
-    dmemcpy((unsigned *)pspelling->m_str, (const unsigned *)pwchar, clSizeLong, cchAfterLong);
-    pspelling->m_str[cchSize] = 0;
+        // copy the string
+        dmemcpy((unsigned *)pspelling->m_str, (const unsigned *)pwchar, clSizeLong, cchAfterLong);
+        pspelling->m_str[cchSize] = 0;
 
 #if DEBUG && _X86_ 
-    if ((ulSpCompare & 0xffff) != cchSize) // it's a union: pspelling->m_ulCompare 
-    {
-        // can't use VSASSERT: the background thread will continue
-        _asm int 3
-    }
+        if ((ulSpCompare & 0xffff) != cchSize) // it's a union: pspelling->m_ulCompare 
+        {
+            // can't use VSASSERT: the background thread will continue
+            _asm int 3
+        }
 #endif DEBUG
-    // Save the extra info.
-    pspelling->m_ulCompare = ulSpCompare;
+        // Save the extra info.
+        pspelling->m_ulCompare = ulSpCompare;
 
 
-    VSASSERT(pspelling->m_cchLength == cchSize, "Overflow.");
-    VSASSERT(pspelling->m_ulCompare == ulSpCompare, "Overflow.");
+        VSASSERT(pspelling->m_cchLength == cchSize, "Overflow.");
+        VSASSERT(pspelling->m_ulCompare == ulSpCompare, "Overflow.");
+
+        // Only now that the entries are complete can other threads see them.
+        if (fNewStrInfo)
+        {
+            Buckets<STRING_INFO> *pStrInfoBuckets = m_pStrInfoBuckets;
 
-    pspelling->m_pspellingNext = m_spellingHashTable[indexSp];
-    m_spellingHashTable[indexSp] = pspelling;
+            LinkBucketEntry(&pStrInfoBuckets->m_rgpBuckets[ulHash & pStrInfoBuckets->m_ulMask],
+                            pstrinfo,
+                            &pstrinfo->m_pstrinfoNext);
+        }
 
-    // update the counter
-    m_ulSpellingCount++;
+        Buckets<Casing> *pSpellingBuckets = m_pSpellingBuckets;
 
-    // expand the tables if necessary
-    if (m_ulSpellingCount > m_ulSpellingThreshold)
-    {
-        ExpandSpellingTable();
+        LinkBucketEntry(&pSpellingBuckets->m_rgpBuckets[ulSpHash & pSpellingBuckets->m_ulMask],
+                        pspelling,
+                        &pspelling->m_pspellingNext);
 
-        // now check if we have to grow the strinfo table, too.  the only time we add
-        // a strinfo we also add a spelling.
-        //
-        if (m_ulNameCount > m_ulStrInfoThreshold)
-        {
-            ExpandStrInfoTable();
-        }
+        // update the counter
+        InterlockedIncrement(&m_ulSpellingCount);
     }
 
+    // expand the tables if necessary
+    ExpandTablesIfNeeded();
+
     // return the string.
     return pspelling->m_str;
 }
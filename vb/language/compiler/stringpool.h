@@ -188,9 +188,11 @@ private:
         return pspelling;
     }
 
-    // double the size of the current hash tables if possible
+    // double the size of the current hash tables if possible.  The caller
+    // must hold every lock stripe.
     bool ExpandStrInfoTable();
     bool ExpandSpellingTable();
+    void ExpandTablesIfNeeded();
 
 public:
     NEW_MUST_ZERO()
@@ -448,6 +450,17 @@ public:
 
 
     SAFEARRAY * GetStringPoolData();
+
+    // Get the hash value of a WCHAR string.  Persisted data depends on the
+    // values, so tools\bench\stringpool checks them against the scalar
+    // reference; that is why this is public.
+    static
+    unsigned long _fastcall ComputeStringHashValue(
+        _In_ unsigned long * wsz,
+        size_t cl,
+        size_t r,
+        bool CaseSensitive);
+
 private:
 
     // Get the significant portion of the spelling hash value.  Ignore the
@@ -461,6 +474,17 @@ private:
         return(ulSpellingHash >> 10) & 0xFFFF;
     }
 
+    // Get the local hash value of a string from its case-insensitive hash
+    // value.  It must not depend on the order strings are added in, or the
+    // buckets of symbol hash tables would depend on which parser thread got
+    // to a name first.
+    //
+    static
+    unsigned GetLocalHashValue(unsigned ulHash)
+    {
+        return(ulHash ^ (ulHash >> 16)) & 0xFFFF;
+    }
+
     // Convert a hash value and a length into a compare value.
     static
     unsigned GetCompareValue(
@@ -470,32 +494,109 @@ private:
         return(ulSpellingHash << 16) | (unsigned)cchLength;
     }
 
-    // Get the hash value of a WCHAR string.
-    static
-    unsigned long _fastcall ComputeStringHashValue(
-        _In_ unsigned long * wsz,
-        size_t cl,
-        size_t r,
-        bool CaseSensitive);
+    // Probe the hash tables.  These take no lock; see m_lRehashGeneration.
+    Casing * FindSpelling(
+        _In_count_(cchSize)const WCHAR * pwchar,
+        size_t cchSize,
+        unsigned ulSpHash);
+
+    STRING_INFO * FindStrInfo(
+        _In_count_(cchSize)const WCHAR * pwchar,
+        size_t cchSize,
+        unsigned ulHash);
+
+    // Lock stripes.
+    unsigned GetLockStripe(unsigned ulHash)
+    {
+        return (ulHash >> 16) & (LockStripeCount - 1);
+    }
+
+    void EnterLockStripe(unsigned iStripe);
+    void LeaveLockStripe(unsigned iStripe);
+
+    // Holds one lock stripe, or all of them if iStripe is AllLockStripes.
+    class StripeLock
+    {
+    public:
+        StripeLock(
+            _In_ StringPool * pPool,
+            unsigned iStripe);
+
+        ~StripeLock();
+
+    private:
+        // Do not generate
+        StripeLock(const StripeLock&);
+        StripeLock& operator=(const StripeLock&);
+
+        StringPool *m_pPool;
+        unsigned m_iStripe;
+    };
+
+    friend class StripeLock;
 
     //
     // private data members
     //
 
-    STRING_INFO **m_strinfoHashTable;     // string hash table
-    Casing **m_spellingHashTable;       // spelling hash table
+    // Writers are serialized by one of LockStripeCount locks, chosen by the
+    // case-insensitive hash of the string so that all the spellings of a
+    // STRING_INFO are added under the same lock.  Readers take no lock at
+    // all: entries are fully initialized before they are linked in with an
+    // interlocked compare-exchange, and nothing is ever removed.
+    static const unsigned LockStripeCount = 16;
+    static const unsigned AllLockStripes = (unsigned)-1;
+
+    struct LockStripe
+    {
+        CriticalSection m_lock;
+        NorlsAllocator *m_pnraStrings;  // strings added under this stripe
+    };
+
+    // Don't give a warning on the zero-sized array within the structure.
+#pragma warning( disable : 4200 )
+
+    // The bucket array of one of the hash tables.  A bucket array is never
+    // reallocated in place: growing a table publishes a new array and keeps
+    // the old one until the pool is destroyed, so a reader still walking the
+    // old array never touches freed memory.
+    template <class T>
+    struct Buckets
+    {
+        unsigned m_ulMask;              // size of the array minus 1
+        Buckets<T> *m_pRetired;         // the smaller array this one replaced
+        T * volatile m_rgpBuckets[0];
+    };
+
+#pragma warning( default : 4200 )
+
+    template <class T>
+    static Buckets<T> * AllocateBuckets(unsigned ulSize);
+
+    template <class T>
+    static void FreeBuckets(_In_opt_ Buckets<T> * pBuckets);
 
-    unsigned m_ulStrInfoHashTableSize;    // current size of the strinfo hash table
-    unsigned m_ulSpellingHashTableSize;   // current size of the spelling hash table
+    template <class T>
+    static void LinkBucketEntry(
+        _Inout_ T * volatile * ppBucket,
+        _Inout_ T * pEntry,
+        _Inout_ T ** ppEntryNext);
 
-    unsigned m_ulStrInfoHashTableMask;    // size of hash table minus 1.
-    unsigned m_ulSpellingHashTableMask;
+    Buckets<STRING_INFO> * volatile m_pStrInfoBuckets;  // string hash table
+    Buckets<Casing> * volatile m_pSpellingBuckets;      // spelling hash table
 
     unsigned m_ulStrInfoThreshold;        // thresholds for resizing hash table.
     unsigned m_ulSpellingThreshold;
 
-    unsigned m_ulNameCount;               // number of names in the table
-    unsigned m_ulSpellingCount;           // number of spellings in the table
+    volatile LONG m_ulNameCount;          // number of names in the table
+    volatile LONG m_ulSpellingCount;      // number of spellings in the table
+
+    // Incremented before and after a table is rehashed, so it is odd while
+    // entries are being moved between buckets.  A reader that misses while
+    // this is odd or changing may have missed an entry that was being moved.
+    volatile LONG m_lRehashGeneration;
+
+    LockStripe m_rgLockStripes[LockStripeCount];
 
 #if FV_TRACK_MEMORY
 
@@ -509,6 +610,11 @@ private:
     unsigned m_cStringProbes;
     unsigned m_cDeepStringProbes;
 
+    // Number of times a lock stripe was already held when we wanted it.  The
+    // stats above are not updated atomically, so they are approximate when
+    // several threads use the pool; this one is exact.
+    volatile LONG m_cLockContentions;
+
     size_t m_cStringMemory;           // memory used by first spelling of a string
     size_t m_cAddtlSpellingMemory;    // memory used by additional spellings
     size_t m_cNonStringMemory;        // memory used for misc. overhead (included in above) not incl. tables
@@ -521,27 +627,10 @@ private:
                                         // across pages allocated for other purposes.  It makes it 
                                         // nearly impossible to free arenas when there are StringPool
                                         // entries fragmented across each of them
-    
-    NorlsAllocator m_nraStrings;        // memory allocator
 
     // String constant table.
     STRING *m_rgStringConstantTable[STRING_CONST_MAX];
 
     // Keyword tables.
     STRING *m_pstrTokenToString[tkCount];
-
-    // This critical section is used to serialize access to the underlying shared
-    // memory of the StringPool.  In the IDE, the StringPool can and will be accessed 
-    // from multiple threads and we need to protect the resources which get updated 
-    // and accessed in this context.  In particular this lock is designed to 
-    // protect access to 
-    //
-    //   - m_strinfoHashTable
-    //   - m_spellingHashTable
-    //   - m_ul*
-    //
-    // All other member variables, while potentially accessed in multiple threads, are
-    // initialized to their final state within the StringPool constructor and hence
-    // are safe to read from multiple threads
-    CompilerIdeCriticalSection m_CriticalSection;
 };
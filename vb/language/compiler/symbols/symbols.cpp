@@ -2315,6 +2315,8 @@ void Symbols::AddSymbolToHash
         IfFalseThrow(phash->CSymbols() >= pnamed->DigThroughAlias()->PHash()->CSymbols());
     }
 
+    phash->UpdateLookupIndex(pnamed);
+
     // set its parent
     if (SetParent)
     {
@@ -2393,6 +2395,7 @@ Symbols::RemoveSymbolFromHash
                 Hash->Rgpnamed()[ HashBucket ] = Candidate->GetNextInSymbolList();
             }
             Hash->SetCSymbols(Hash->CSymbols() -1);
+            Hash->InvalidateLookupIndex();
             return Candidate;
         }
         PreviousGuy = Candidate;
@@ -2706,6 +2709,11 @@ BCSYM *Symbols::AllocSymbol
     AllocatedSymbol->SetSkKind(SymbolKind);
     AllocatedSymbol->SetHasLocation(LocationInfoAvail);
 
+    if (SymbolKind == SYM_Hash)
+    {
+        ((BCSYM_Hash *)AllocatedSymbol)->SetAllocator(m_Allocator);
+    }
+
 #if FV_TRACK_MEMORY && IDE
 
     AllocatedSymbol->m_totalSize= BytesToAlloc;
@@ -884,8 +884,8 @@ BCSYM_NamedRoot *BCSYM_Hash::SimpleBind
         return NULL;
     }
 
-    // get the correct bucket
-    BCSYM_NamedRoot *pBucket = Rgpnamed()[StringPool::HashValOfString(pstrName) % CBuckets()];
+    // get the correct bucket, or straight to the first symbol with the name
+    BCSYM_NamedRoot *pBucket = FindFirstCandidate(pstrName);
 
     {
         // Search the bucket for a matching symbol
@@ -935,6 +935,174 @@ BCSYM_NamedRoot *BCSYM_Hash::SimpleBind
     return pBucket;
 }
 
+//============================================================================
+// Returns where SimpleBind should start walking the bucket chain for
+// pstrName.  Without an index that is the head of the bucket.  With one it
+// is the first symbol with that name, since nothing before it in the chain
+// can match.
+//============================================================================
+
+BCSYM_NamedRoot *BCSYM_Hash::FindFirstCandidate
+(
+    _In_z_ const STRING *pstrName
+)
+{
+    SymbolEntryFunction;
+    unsigned long ulHash = StringPool::HashValOfString(pstrName);
+    BCSYM_HashIndex *pIndex = m_pLookupIndex;
+
+    if (!pIndex)
+    {
+        return Rgpnamed()[ulHash % CBuckets()];
+    }
+
+    unsigned ulMask = pIndex->m_cSlots - 1;
+
+    for (unsigned iSlot = ulHash & ulMask; ; iSlot = (iSlot + 1) & ulMask)
+    {
+        BCSYM_HashIndexEntry *pEntry = &pIndex->m_rgEntries[iSlot];
+
+#if TRACK_BCSYMHASH
+        g_LookupIterations++;
+#endif
+
+        if (!pEntry->m_pnamed)
+        {
+            return NULL;
+        }
+
+        if (pEntry->m_ulHash == ulHash &&
+            StringPool::IsEqual(pstrName, pEntry->m_pnamed->GetName()))
+        {
+            return pEntry->m_pnamed;
+        }
+    }
+}
+
+//============================================================================
+// Keeps the lookup index in step with pnamed, which was just put at the
+// front of its bucket by Symbols::AddSymbolToHash.
+//============================================================================
+
+void BCSYM_Hash::UpdateLookupIndex
+(
+    _In_ BCSYM_NamedRoot *pnamed
+)
+{
+    SymbolEntryFunction;
+    BCSYM_HashIndex *pIndex = m_pLookupIndex;
+
+    if (!pIndex)
+    {
+        // Hashes not made by Symbols::AllocSymbol have no owning allocator
+        // and simply keep using the buckets.
+        if (CSymbols() < LookupIndexThreshold || !m_pAllocator)
+        {
+            return;
+        }
+
+        // Build the index from the buckets.  Walking each chain from its head
+        // means the first symbol seen for a name is the one SimpleBind would
+        // find first, so later ones must not replace it.
+        pIndex = AllocateLookupIndex(CSymbols());
+
+        for (unsigned iBucket = 0; iBucket < CBuckets(); iBucket++)
+        {
+            for (BCSYM_NamedRoot *pBucket = Rgpnamed()[iBucket]; pBucket; pBucket = pBucket->GetNextInHash())
+            {
+                AddToLookupIndex(pIndex, pBucket, false);
+            }
+        }
+
+        m_pLookupIndex = pIndex;
+        return;
+    }
+
+    // pnamed is now the first symbol with its name.
+    if (AddToLookupIndex(pIndex, pnamed, true) && pIndex->m_cNames * 2 > pIndex->m_cSlots)
+    {
+        // Keep the load factor under one half.  The old index stays in the
+        // allocator until the hash itself goes away.
+        BCSYM_HashIndex *pNewIndex = AllocateLookupIndex(pIndex->m_cNames);
+
+        for (unsigned iSlot = 0; iSlot < pIndex->m_cSlots; iSlot++)
+        {
+            if (pIndex->m_rgEntries[iSlot].m_pnamed)
+            {
+                AddToLookupIndex(pNewIndex, pIndex->m_rgEntries[iSlot].m_pnamed, false);
+            }
+        }
+
+        m_pLookupIndex = pNewIndex;
+    }
+}
+
+BCSYM_HashIndex *BCSYM_Hash::AllocateLookupIndex
+(
+    unsigned cNames
+)
+{
+    SymbolEntryFunction;
+    unsigned cSlots = 2 * LookupIndexThreshold;
+
+    while (cSlots < VBMath::Multiply(cNames, 4u))
+    {
+        cSlots = VBMath::Multiply(cSlots, 2u);
+    }
+
+    BCSYM_HashIndex *pIndex = (BCSYM_HashIndex *)m_pAllocator->Alloc(
+        VBMath::Add(
+            sizeof(BCSYM_HashIndex),
+            VBMath::Multiply(cSlots, sizeof(BCSYM_HashIndexEntry))));
+
+    pIndex->m_cSlots = cSlots;
+    pIndex->m_cNames = 0;
+
+    return pIndex;
+}
+
+//============================================================================
+// Puts pnamed in the slot for its name.  If the name already has a slot it
+// is only pointed at pnamed when fReplace is set.  Returns true if a new
+// name was added.
+//============================================================================
+
+bool BCSYM_Hash::AddToLookupIndex
+(
+    _Inout_ BCSYM_HashIndex *pIndex,
+    _In_ BCSYM_NamedRoot *pnamed,
+    bool fReplace
+)
+{
+    STRING *pstrName = pnamed->GetName();
+    unsigned long ulHash = StringPool::HashValOfString(pstrName);
+    unsigned ulMask = pIndex->m_cSlots - 1;
+
+    for (unsigned iSlot = ulHash & ulMask; ; iSlot = (iSlot + 1) & ulMask)
+    {
+        BCSYM_HashIndexEntry *pEntry = &pIndex->m_rgEntries[iSlot];
+
+        if (!pEntry->m_pnamed)
+        {
+            pEntry->m_ulHash = ulHash;
+            pEntry->m_pnamed = pnamed;
+            pIndex->m_cNames++;
+            return true;
+        }
+
+        if (pEntry->m_ulHash == ulHash &&
+            StringPool::IsEqual(pstrName, pEntry->m_pnamed->GetName()))
+        {
+            if (fReplace)
+            {
+                pEntry->m_pnamed = pnamed;
+            }
+
+            return false;
+        }
+    }
+}
+
 bool BCSYM_Hash::HasGenericParent()
 {
     SymbolEntryFunction;
@@ -2219,6 +2219,9 @@ public:
     {
         SymbolEntryFunction;
         m_pstrName = pstrName;
+#if IDE
+        m_HasSymbolHashKey = false;
+#endif
     }
 
     STRING *GetUntransformedName() const
@@ -2322,6 +2325,9 @@ public:
     {
         SymbolEntryFunction;
         m_pstrEmittedName = value;
+#if IDE
+        m_HasSymbolHashKey = false;
+#endif
     }
 
     // This symbol's parent symbol.  Only NULL for projects and unnamed namespaces.
@@ -2353,6 +2359,9 @@ public:
     {
         SymbolEntryFunction;
         m_pnamedParent = value;
+#if IDE
+        m_HasSymbolHashKey = false;
+#endif
     }
 
     BCSYM_Container *GetPhysicalContainer();
@@ -2917,6 +2926,28 @@ public:
         m_fCachedQualifyIntrinsicTypes = value;
     }
 
+#if IDE
+    // The key Builder::GetSymbolHashKey computed for this symbol.  Changing the
+    // name or the parent of the symbol discards it.
+    bool HasSymbolHashKey() const
+    {
+        SymbolEntryFunction;
+        return m_HasSymbolHashKey;
+    }
+    UINT64 GetSymbolHashKey() const
+    {
+        SymbolEntryFunction;
+        VSASSERT(m_HasSymbolHashKey, "No symbol hash key has been computed.");
+        return m_SymbolHashKey;
+    }
+    void SetSymbolHashKey(UINT64 value)
+    {
+        SymbolEntryFunction;
+        m_SymbolHashKey = value;
+        m_HasSymbolHashKey = true;
+    }
+#endif
+
 protected:
 
     // This symbol's name.
@@ -2983,6 +3014,10 @@ protected:
     STRING * m_pstrCachedQualifiedName;
     BCSYM_Container* m_pCachedContainer;
 
+#if IDE
+    UINT64 m_SymbolHashKey;
+#endif
+
     // XMLDocumentation associated with this NamedRoot symbol.
     XMLDocNode *m_pXMLDocNode;
 
@@ -3031,7 +3066,12 @@ protected:
     // This is to indigate that the generated method is managed by the runtime so doesn't need a body.
     unsigned __int8 m_IsMethodCodeTypeRuntime : 1;
 
-    //  There are 3 free bits left. If you need more, pack one of the other
+#if IDE
+    // Is m_SymbolHashKey set?
+    unsigned __int8 m_HasSymbolHashKey : 1;
+#endif
+
+    //  There are 2 free bits left. If you need more, pack one of the other
     // __int8 fields into a bitfield. We are currently using m_BindingSpace
     // and m_access.
 
@@ -3068,6 +3108,26 @@ public:
     }
 };
 
+// Open-addressed lookup index kept alongside the bucket chains of large hashes.
+// Each distinct name (compared case insensitively) has one slot, which caches
+// the name's hash value and points at the first symbol with that name in its
+// bucket chain.  The slot count is a power of two and slots are probed linearly.
+//
+struct BCSYM_HashIndexEntry
+{
+    unsigned long m_ulHash;
+    BCSYM_NamedRoot *m_pnamed;
+};
+
+struct BCSYM_HashIndex
+{
+    unsigned m_cSlots;
+    unsigned m_cNames;
+
+    #pragma warning (suppress  : 4200)
+    BCSYM_HashIndexEntry m_rgEntries[0];
+};
+
 /**************************************************************************************************
 ;Hash
 
@@ -3284,8 +3344,47 @@ public:
         return m_pHashTable; 
     }
 
+    // Hashes with at least this many symbols get a lookup index.
+    static const unsigned LookupIndexThreshold = 32;
+
+    // The allocator the hash itself was allocated from.  The lookup index is
+    // allocated from it too, so that it lives exactly as long as the hash.
+    NorlsAllocator *GetAllocator()
+    {
+        SymbolEntryFunction;
+        return m_pAllocator;
+    }
+
+    void SetAllocator(_In_ NorlsAllocator *pnra)
+    {
+        SymbolEntryFunction;
+        m_pAllocator = pnra;
+    }
+
+    // Keeps the lookup index in step with a symbol that was just put at the
+    // front of its bucket.  Builds the index once the hash is large enough.
+    void UpdateLookupIndex(_In_ BCSYM_NamedRoot *pnamed);
+
+    // Drops the lookup index after a symbol was removed from the buckets.
+    // It is rebuilt by the next UpdateLookupIndex.
+    void InvalidateLookupIndex()
+    {
+        SymbolEntryFunction;
+        m_pLookupIndex = NULL;
+    }
+
 protected:
 
+    // Returns the first symbol in the bucket chain that could match pstrName.
+    BCSYM_NamedRoot *FindFirstCandidate(_In_z_ const STRING *pstrName);
+
+    BCSYM_HashIndex *AllocateLookupIndex(unsigned cNames);
+
+    static bool AddToLookupIndex(
+        _Inout_ BCSYM_HashIndex *pIndex,
+        _In_ BCSYM_NamedRoot *pnamed,
+        bool fReplace);
+
     // Nobody should use this directly unless they take partial types
     // into account.
     //
@@ -3326,6 +3425,12 @@ protected:
     BCSYM_Hash *m_psymPrevHash;
     BCSYM_Hash *m_psymNextHash;
 
+    // Lookup index over the buckets, NULL for small hashes.
+    BCSYM_HashIndex *m_pLookupIndex;
+
+    // Allocator that owns this hash, set by Symbols::AllocSymbol.
+    NorlsAllocator *m_pAllocator;
+
     // Bucket array.
     #pragma warning (suppress  : 4200)
     BCSYM_NamedRoot * m_pHashTable[0];
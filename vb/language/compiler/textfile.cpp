@@ -350,6 +350,8 @@ bool TextFile::ReadByteSourceFileCache(
                 cbFileSize = 0;
             }
 
+            // Let the cache recycle the space of a stale entry.
+            pTextFileCache->Release(*ppTextFileCacheRef);
             delete *ppTextFileCacheRef;
             *ppTextFileCacheRef = NULL;
         }
@@ -395,8 +397,8 @@ void TextFile::WriteByteSourceFileCache(
     const FILETIME &timestamp,
     const bool IsDetectUTF8WithoutSig)
 {
-    // Get rid of any stale cache pointer
-    ClearSourceFileCache();
+    // Get rid of any stale cache pointer, and of the entry it refers to.
+    ReleaseSourceFileCache();
 
     // Try to write the new data for this file.
     SehGuard guard;
@@ -445,6 +447,72 @@ void TextFile::ClearSourceFileCache()
     m_pTextFileCacheRef = NULL;
 }
 
+//=============================================================================
+// Releases the cache entry of the file, so that the cache can recycle its
+// space, and forgets about it.
+//=============================================================================
+
+void TextFile::ReleaseSourceFileCache()
+{
+    CompilerIdeLock spLock(m_TextFileCriticalSection);
+
+    if (m_pTextFileCacheRef && m_pfile && m_pfile->GetProject())
+    {
+        m_pfile->GetProject()->GetSourceFileCache()->Release(m_pTextFileCacheRef);
+    }
+
+    ClearSourceFileCache();
+}
+
+#if !IDE
+//=============================================================================
+// Returns the text of the file in place from the source file cache.  This
+// is the path GetFileText takes once the text has been loaded, minus the
+// copy into the caller's allocator.
+//=============================================================================
+
+bool TextFile::GetFileTextView(
+    _Inout_ TextFileCacheView * pView,
+    __deref_out_ecount_opt(* pcchText) const WCHAR * * pwszText,
+    _Out_ size_t * pcchText)
+{
+    *pwszText = NULL;
+    *pcchText = 0;
+
+    CompilerIdeLock spLock(m_TextFileCriticalSection);
+
+    // Same precedence as GetFileText: a host buffer wins over the cache.
+    if (m_bstrBuffer != NULL ||
+        m_pstrFileName == NULL ||
+        !m_pTextFileCacheRef ||
+        !m_pTextFileCacheRef->IsUnicode() ||
+        !m_pTextFileCacheRef->IsDetectUTF8WithoutSig() ||
+        !m_pfile->GetProject())
+    {
+        return false;
+    }
+
+    TextFileCache *pCache = m_pfile->GetProject()->GetSourceFileCache();
+
+    SehGuard guard;
+    try
+    {
+        pCache->OpenView(m_pstrFileName, m_pTextFileCacheRef, pView);
+    }
+    catch ( SehException& )
+    {
+        // Stale, let GetFileText reload the file and cache it again.
+        ReleaseSourceFileCache();
+        return false;
+    }
+
+    *pwszText = (const WCHAR *)pView->GetData();
+    *pcchText = pView->GetSize() / sizeof(WCHAR);
+
+    return true;
+}
+#endif
+
 #if IDE
 bool TextFile::DifferentCacheAndDiskTimestamps() const 
 {
@@ -485,7 +553,16 @@ void TextFile::CloseFile()
     if (m_bstrBuffer != NULL)           // VBA in-memory buffer
         ::SysFreeString(m_bstrBuffer);
 
-    ClearSourceFileCache();
+    // Once the file has been unlinked its project may be gone, see
+    // SourceFile::ReleaseFileFromProject.
+    if (m_pfile && !m_pfile->IsUnlinkedFromProject())
+    {
+        ReleaseSourceFileCache();
+    }
+    else
+    {
+        ClearSourceFileCache();
+    }
 
     spLock.Unlock();
 }
@@ -971,37 +1048,66 @@ void TemporaryFile::Close()
 //============================================================================
 TextFileCacheRef::TextFileCacheRef()
 {
+    m_iSegment = 0;
+    m_lGeneration = 0;
     m_Offset = 0;
     m_Size = 0;
     m_IsUnicode = false;
     m_HasCryptHash = false;
     m_DetectUTF8WithoutSig = true;
+    m_OwnsEntry = false;
     m_Timestamp = TextFileCache::NullFileTime;
 }
 
 //============================================================================
 // TextFileCacheRef::TextFileCacheRef
+// A reference created by TextFileCache::Append owns its entry.
 //============================================================================
 TextFileCacheRef::TextFileCacheRef(
-    LONG offset,
+    unsigned iSegment,
+    LONG lGeneration,
+    DWORD offset,
     DWORD size,
     const FILETIME &timestamp,
     const bool IsDetectUTF8WithoutSig)
 {
+    m_iSegment = iSegment;
+    m_lGeneration = lGeneration;
     m_Offset = offset;
     m_Size = size;
     m_IsUnicode = false;
     m_HasCryptHash = false;
     m_DetectUTF8WithoutSig = IsDetectUTF8WithoutSig;
+    m_OwnsEntry = true;
     m_Timestamp = timestamp;
 }
 
+//============================================================================
+// TextFileCacheRef::TextFileCacheRef
+// Copies a reference.  Only the original keeps the entry alive.
+//============================================================================
+TextFileCacheRef::TextFileCacheRef(const TextFileCacheRef &src)
+{
+    m_iSegment = src.m_iSegment;
+    m_lGeneration = src.m_lGeneration;
+    m_Offset = src.m_Offset;
+    m_Size = src.m_Size;
+    memcpy(m_bCryptHash, src.m_bCryptHash, CRYPT_HASHSIZE);
+    m_Timestamp = src.m_Timestamp;
+    m_IsUnicode = src.m_IsUnicode;
+    m_DetectUTF8WithoutSig = src.m_DetectUTF8WithoutSig;
+    m_HasCryptHash = src.m_HasCryptHash;
+    m_OwnsEntry = false;
+}
+
 //============================================================================
 // TextFileCacheRef::operator==
 //============================================================================
 bool TextFileCacheRef::operator ==(const TextFileCacheRef &e) const
 {
-    return (m_Offset == e.m_Offset &&
+    return (m_iSegment == e.m_iSegment &&
+            m_lGeneration == e.m_lGeneration &&
+            m_Offset == e.m_Offset &&
             m_Size == e.m_Size &&
             m_Timestamp.dwLowDateTime == e.m_Timestamp.dwLowDateTime &&
             m_Timestamp.dwHighDateTime == e.m_Timestamp.dwHighDateTime);
@@ -1073,10 +1179,26 @@ TextFileCache::IsOpen()
 void
 TextFileCache::EnsureOpen()
 {
+    if (IsOpen())
+    {
+        return;
+    }
+
     // Protect access to the temp file
-    CompilerIdeLock lock(m_CriticalSection);
+    SafeCriticalSectionLock lock(m_CriticalSection);
     if ( !IsOpen() )
     {
+        // The segment table has to exist before the file is seen as open.
+        if (!m_rgpSegments)
+        {
+            m_rgpSegments = new (zeromemory) Segment *[MaxSegments];
+        }
+
+        m_cSegments = 0;
+        m_iCurrentSegment = -1;
+        m_cbFile = 0;
+        m_cbMapped = 0;
+
         m_TempFile.Open(L"vbc");    
     }
 }
@@ -1088,10 +1210,336 @@ TextFileCache::EnsureOpen()
 void TextFileCache::Close()
 {
     // Protect access to the temp file
-    CompilerIdeLock lock(m_CriticalSection);
+    SafeCriticalSectionLock lock(m_CriticalSection);
+
+    if (m_rgpSegments)
+    {
+        for (LONG iSegment = 0; iSegment < m_cSegments; iSegment++)
+        {
+            Segment *pSegment = m_rgpSegments[iSegment];
+
+            VSASSERT(pSegment->m_cPins == 0, "Closing the source file cache while a view is open.");
+
+            if (pSegment->m_pbView)
+            {
+                UnmapViewOfFile(pSegment->m_pbView);
+            }
+
+            delete pSegment;
+        }
+
+        delete [] m_rgpSegments;
+        m_rgpSegments = NULL;
+    }
+
+    if (m_hMap)
+    {
+        CloseHandle(m_hMap);
+        m_hMap = NULL;
+    }
+
+    m_cSegments = 0;
+    m_iCurrentSegment = -1;
+    m_cbFile = 0;
+    m_cbMapped = 0;
+
     m_TempFile.Close();
 }
 
+//============================================================================
+// TextFileCache::CreateSegment
+// Adds cbSize more bytes at the end of the cache file as a new segment and
+// returns its index.  The segment is mapped when it is first pinned.  Must
+// be called under m_CriticalSection.
+//============================================================================
+unsigned TextFileCache::CreateSegment(DWORD cbSize)
+{
+    if (m_cSegments >= MaxSegments)
+    {
+        // Only happens if the live entries really add up to that much, which
+        // should only occur in stress scenarios.  The text files will be
+        // reread from disk until entries are released again.
+        VbThrowNoAssert(E_FAIL);
+    }
+
+    unsigned __int64 cbNewFile = m_cbFile + cbSize;
+
+    // Grow the file.  Views of the old mapping object stay valid.
+    HANDLE hMap = CreateFileMappingW(
+        m_TempFile.GetHandle(),
+        NULL,
+        PAGE_READWRITE,
+        (DWORD)(cbNewFile >> 32),
+        (DWORD)cbNewFile,
+        NULL);
+
+    if (!hMap)
+    {
+        VbThrow(GetLastHResultError());
+    }
+
+    if (m_hMap)
+    {
+        CloseHandle(m_hMap);
+    }
+
+    m_hMap = hMap;
+
+    Segment *pSegment = new (zeromemory) Segment;
+    pSegment->m_ibFile = m_cbFile;
+    pSegment->m_cbSize = cbSize;
+
+    m_cbFile = cbNewFile;
+    m_rgpSegments[m_cSegments] = pSegment;
+
+    // Publish the segment only once it is filled in.
+    return InterlockedIncrement(&m_cSegments) - 1;
+}
+
+//============================================================================
+// TextFileCache::MapSegment
+// Maps a segment into memory if it is not mapped yet, unmapping idle ones
+// first if that would take too much address space.  Must be called under
+// m_CriticalSection.
+//============================================================================
+void TextFileCache::MapSegment(_Inout_ Segment * pSegment)
+{
+    if (pSegment->m_pbView)
+    {
+        return;
+    }
+
+    UnmapIdleSegments(pSegment->m_cbSize);
+
+    BYTE *pbView = (BYTE *)MapViewOfFile(
+        m_hMap,
+        FILE_MAP_WRITE,
+        (DWORD)(pSegment->m_ibFile >> 32),
+        (DWORD)pSegment->m_ibFile,
+        pSegment->m_cbSize);
+
+    if (!pbView)
+    {
+        VbThrow(GetLastHResultError());
+    }
+
+    m_cbMapped += pSegment->m_cbSize;
+    pSegment->m_pbView = pbView;
+}
+
+//============================================================================
+// TextFileCache::UnmapIdleSegments
+// Unmaps the least recently used segments that nobody has pinned until
+// cbNeeded more bytes fit under MaxMappedBytes.  Pinned segments are never
+// unmapped, so with enough open views the cap is exceeded rather than
+// failing.  Must be called under m_CriticalSection.
+//============================================================================
+void TextFileCache::UnmapIdleSegments(size_t cbNeeded)
+{
+    for (LONG cTries = 0;
+         cTries < m_cSegments && m_cbMapped + cbNeeded > MaxMappedBytes;
+         cTries++)
+    {
+        Segment *pVictim = NULL;
+
+        for (LONG iSegment = 0; iSegment < m_cSegments; iSegment++)
+        {
+            Segment *pSegment = m_rgpSegments[iSegment];
+
+            if (pSegment->m_pbView &&
+                pSegment->m_cPins == 0 &&
+                (!pVictim || pSegment->m_lLastUse - pVictim->m_lLastUse < 0))
+            {
+                pVictim = pSegment;
+            }
+        }
+
+        if (!pVictim)
+        {
+            break;
+        }
+
+        // Claim the segment, so nobody can pin it while it is unmapped.  If
+        // somebody pinned it in the meantime it is no longer idle.
+        if (InterlockedCompareExchange(&pVictim->m_cPins, -1, 0) == 0)
+        {
+            BYTE *pbView = pVictim->m_pbView;
+
+            pVictim->m_pbView = NULL;
+            UnmapViewOfFile(pbView);
+            m_cbMapped -= pVictim->m_cbSize;
+
+            InterlockedExchange(&pVictim->m_cPins, 0);
+        }
+    }
+}
+
+//============================================================================
+// TextFileCache::PinSegment
+// Pins a segment into pView, mapping it if needed.  A mapped segment is
+// pinned without taking the lock.
+//============================================================================
+void TextFileCache::PinSegment(
+    _Inout_ Segment * pSegment,
+    _Inout_ TextFileCacheView * pView)
+{
+    VSASSERT(!pView->IsOpen(), "View already open.");
+
+    LONG cPins = pSegment->m_cPins;
+
+    // A negative count means the segment is being unmapped or recycled under
+    // the lock; wait for that on the lock below.
+    while (cPins >= 0)
+    {
+        LONG cSeen = InterlockedCompareExchange(&pSegment->m_cPins, cPins + 1, cPins);
+
+        if (cSeen == cPins)
+        {
+            BYTE *pbView = pSegment->m_pbView;
+
+            if (pbView)
+            {
+                pSegment->m_lLastUse = InterlockedIncrement(&m_lUseClock);
+
+                pView->m_pCache = this;
+                pView->m_pSegment = pSegment;
+                pView->m_pbView = pbView;
+                return;
+            }
+
+            // Not mapped, do that under the lock.
+            InterlockedDecrement(&pSegment->m_cPins);
+            break;
+        }
+
+        cPins = cSeen;
+    }
+
+    SafeCriticalSectionLock lock(m_CriticalSection);
+    PinSegmentLocked(pSegment, pView);
+}
+
+//============================================================================
+// TextFileCache::PinSegmentLocked
+// Maps and pins a segment.  Must be called under m_CriticalSection, which
+// also serializes with unmapping and recycling.
+//============================================================================
+void TextFileCache::PinSegmentLocked(
+    _Inout_ Segment * pSegment,
+    _Inout_ TextFileCacheView * pView)
+{
+    VSASSERT(!pView->IsOpen(), "View already open.");
+
+    MapSegment(pSegment);
+
+    InterlockedIncrement(&pSegment->m_cPins);
+    pSegment->m_lLastUse = InterlockedIncrement(&m_lUseClock);
+
+    pView->m_pCache = this;
+    pView->m_pSegment = pSegment;
+    pView->m_pbView = pSegment->m_pbView;
+}
+
+//============================================================================
+// TextFileCache::UnpinSegment
+//============================================================================
+void TextFileCache::UnpinSegment(_Inout_ Segment * pSegment)
+{
+    VSASSERT(pSegment->m_cPins > 0, "Segment unpinned twice?");
+    InterlockedDecrement(&pSegment->m_cPins);
+}
+
+//============================================================================
+// TextFileCacheView::Close
+//============================================================================
+void TextFileCacheView::Close()
+{
+    if (m_pSegment)
+    {
+        m_pCache->UnpinSegment(m_pSegment);
+    }
+
+    m_pCache = NULL;
+    m_pSegment = NULL;
+    m_pbView = NULL;
+    m_pbData = NULL;
+    m_cbData = 0;
+}
+
+//============================================================================
+// TextFileCache::AcquireSegment
+// Finds room for an entry of cbEntry bytes when it does not fit into the
+// current segment.  A segment none of whose entries is alive anymore is
+// reused before the file is grown.  Entries that fit into a normal segment
+// make the returned segment current; bigger ones get a segment of their own
+// that the caller writes into.  Must be called under m_CriticalSection.
+//============================================================================
+unsigned TextFileCache::AcquireSegment(DWORD cbEntry)
+{
+    DWORD cbSize = SegmentSize;
+
+    if (cbEntry > SegmentSize)
+    {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        cbSize = VBMath::RoundUp(cbEntry, si.dwAllocationGranularity);
+    }
+
+    for (LONG iSegment = 0; iSegment < m_cSegments; iSegment++)
+    {
+        Segment *pSegment = m_rgpSegments[iSegment];
+
+        // Claim the segment, so no writer or open view is using it while its
+        // old entries are invalidated.
+        if (iSegment != m_iCurrentSegment &&
+            pSegment->m_cbSize == cbSize &&
+            pSegment->m_cLiveEntries == 0 &&
+            InterlockedCompareExchange(&pSegment->m_cPins, -1, 0) == 0)
+        {
+            InterlockedIncrement(&pSegment->m_lGeneration);
+            pSegment->m_cbUsed = 0;
+
+            InterlockedExchange(&pSegment->m_cPins, 0);
+            return iSegment;
+        }
+    }
+
+    return CreateSegment(cbSize);
+}
+
+//============================================================================
+// TextFileCache::WriteEntry
+// Writes an entry into space reserved for it in a pinned segment and
+// creates the reference the caller gets to own.
+//============================================================================
+TextFileCacheRef * TextFileCache::WriteEntry(
+    unsigned iSegment,
+    BYTE * pbView,
+    DWORD ibEntry,
+    LPVOID lpBuffer,
+    DWORD cbBytes,
+    const FILETIME &ftTimestamp,
+    const bool IsDetectUTF8WithoutSig)
+{
+    Segment *pSegment = m_rgpSegments[iSegment];
+    EntryHeader header(cbBytes, ftTimestamp);
+
+    // Write the header element, then the file text and its terminator.
+    memcpy(pbView + ibEntry, &header, sizeof(header));
+    memcpy(pbView + ibEntry + sizeof(header), lpBuffer, cbBytes);
+    memset(pbView + ibEntry + sizeof(header) + cbBytes, 0, sizeof(WCHAR));
+
+    InterlockedIncrement(&pSegment->m_cLiveEntries);
+
+    return new (zeromemory) TextFileCacheRef(
+        iSegment,
+        pSegment->m_lGeneration,
+        ibEntry,
+        cbBytes,
+        ftTimestamp,
+        IsDetectUTF8WithoutSig);
+}
+
 //============================================================================
 // TextFileCache::Append
 // Appends a block to the file cache. The bock consists of a header
@@ -1107,57 +1555,162 @@ TextFileCacheRef * TextFileCache::Append(
     const bool IsDetectUTF8WithoutSig)
 {
     EnsureOpen();
-    TextFileCacheRef* pTextFileCacheRef = NULL;
-    HRESULT hr = S_OK;
 
-    {
-        // Protect access to the temp file
-        CompilerIdeLock lock(m_CriticalSection);
+    // Leave room for the terminator and keep the headers aligned.
+    DWORD cbEntry = VBMath::RoundUp(
+        VBMath::Add(VBMath::Add(cbBytes, (DWORD)sizeof(EntryHeader)), (DWORD)sizeof(WCHAR)),
+        (DWORD)sizeof(__int64));
 
-        LONG                newOffset;
-        DWORD               bytesWritten;
-        EntryHeader         header(cbBytes, ftTimestamp);
+    if (cbEntry > SegmentSize)
+    {
+        TextFileCacheView pin;
+        unsigned iSegment;
 
-        // Seek to the end of the cache file
-        newOffset = SetFilePointer(m_TempFile.GetHandle(), 0, NULL, FILE_END);
-        if ((newOffset == INVALID_SET_FILE_POINTER) && (GetLastError() != NO_ERROR))
         {
-            VbThrow(GetLastHResultError());
+            SafeCriticalSectionLock lock(m_CriticalSection);
+
+            iSegment = AcquireSegment(cbEntry);
+            m_rgpSegments[iSegment]->m_cbUsed = cbEntry;
+            PinSegmentLocked(m_rgpSegments[iSegment], &pin);
         }
-#if IDE
-        if (newOffset < 0)
+
+        return WriteEntry(iSegment, pin.m_pbView, 0, lpBuffer, cbBytes, ftTimestamp, IsDetectUTF8WithoutSig);
+    }
+
+    while (true)
+    {
+        LONG iSegment = m_iCurrentSegment;
+
+        if (iSegment >= 0)
         {
-            // Dev11 344896
-            // Our file size went over 2GB.  Let's throw away this temp file.  A new one will be created
-            // and all the text files will be reread from disk until they've each been placed in the
-            // new cache.  This will cause some asserts, but should only occur in stress scenarios.
-            m_TempFile.Close();
-            VbThrowNoAssert(E_FAIL);
+            Segment *pSegment = m_rgpSegments[iSegment];
+            TextFileCacheView pin;
+
+            // Pin the segment, then make sure it was not retired and recycled
+            // in the meantime; a recycle skips pinned segments.
+            PinSegment(pSegment, &pin);
+
+            if (m_iCurrentSegment == iSegment)
+            {
+                LONG ibEntry = InterlockedExchangeAdd(&pSegment->m_cbUsed, (LONG)cbEntry);
+
+                if ((DWORD)ibEntry <= pSegment->m_cbSize - cbEntry)
+                {
+                    return WriteEntry(iSegment, pin.m_pbView, ibEntry, lpBuffer, cbBytes, ftTimestamp, IsDetectUTF8WithoutSig);
+                }
+            }
         }
-#endif
-        // Write the header element
-        if (!WriteFile(m_TempFile.GetHandle(), (LPVOID)&header, sizeof(header), &bytesWritten, NULL))
+
+        // The current segment is full, switch to another one unless somebody
+        // else already did.
+        SafeCriticalSectionLock lock(m_CriticalSection);
+
+        if (m_iCurrentSegment == iSegment)
         {
-            VbThrow(GetLastHResultError());
+            m_iCurrentSegment = AcquireSegment(cbEntry);
         }
+    }
+}
 
-        // Write the file text
-        if (!WriteFile(m_TempFile.GetHandle(), lpBuffer, cbBytes, &bytesWritten, NULL))
+//============================================================================
+// TextFileCache::GetSegment
+// Returns the segment an entry lives in, or NULL if the reference does not
+// belong to the currently open file.
+//============================================================================
+TextFileCache::Segment * TextFileCache::GetSegment(const TextFileCacheRef * pRef)
+{
+    if (!m_rgpSegments || pRef->GetSegment() >= (unsigned)m_cSegments)
+    {
+        return NULL;
+    }
+
+    return m_rgpSegments[pRef->GetSegment()];
+}
+
+//============================================================================
+// TextFileCache::OpenView
+// Pins the segment of an entry and points pView at the entry's bytes after
+// checking that the header matches the reference.
+// If wszFileName is non-null, it will check whether the last-write-time for
+// the file is equal to the value specified in pRef. If not, it will
+// throw an error.
+//============================================================================
+void TextFileCache::OpenView
+(
+    LPCWSTR                 wszFileName,
+    const TextFileCacheRef* pRef,
+    _Inout_ TextFileCacheView * pView
+)
+{
+    pView->Close();
+    EnsureOpen();
+
+    // Check if the cache timestamp is curent
+    if (wszFileName)
+    {
+        FILETIME ftCache = pRef->GetTimestamp();
+        FILETIME ftCurrent;
+        GetFileModificationTime(wszFileName, &ftCurrent);
+
+        if (ftCurrent.dwLowDateTime != ftCache.dwLowDateTime ||
+            ftCurrent.dwHighDateTime != ftCache.dwHighDateTime)
         {
-            VbThrow(GetLastHResultError());
+            VbThrowNoAssert(E_FAIL);
         }
+    }
 
-        // Success. Allocate the output object
-        pTextFileCacheRef = new (zeromemory) TextFileCacheRef(newOffset, cbBytes, ftTimestamp, IsDetectUTF8WithoutSig);
-        IfNullThrow(pTextFileCacheRef);
+    Segment *pSegment = GetSegment(pRef);
+
+    if (!pSegment)
+    {
+        VbThrowNoAssert(E_FAIL);
     }
 
-    if (FAILED(hr))
+    PinSegment(pSegment, pView);
+
+    // The segment cannot be recycled while it is pinned, so if the entry is
+    // still there it stays intact until the view is closed.
+    if (pSegment->m_lGeneration != pRef->GetGeneration() ||
+        pRef->GetOffset() > pSegment->m_cbSize - sizeof(EntryHeader))
+    {
+        pView->Close();
+        VbThrowNoAssert(E_FAIL);
+    }
+
+    const EntryHeader *pHeader = (const EntryHeader *)(pView->m_pbView + pRef->GetOffset());
+
+    // Verify that the data matches the requested TextFileCacheRef
+    if (pHeader->m_Size != pRef->GetSize() ||
+        pHeader->m_Size > pSegment->m_cbSize - sizeof(EntryHeader) - pRef->GetOffset() ||
+        pHeader->m_Timestamp.dwLowDateTime != pRef->GetTimestamp().dwLowDateTime ||
+        pHeader->m_Timestamp.dwHighDateTime != pRef->GetTimestamp().dwHighDateTime)
     {
-        VbThrow(hr);
+        pView->Close();
+        VbThrow(E_FAIL);
     }
 
-    return pTextFileCacheRef;
+    pView->m_pbData = (const BYTE *)(pHeader + 1);
+    pView->m_cbData = pRef->GetSize();
+}
+
+//============================================================================
+// TextFileCache::Release
+// The owner of an entry no longer needs it.  A segment is recycled once all
+// of its entries are released.
+//============================================================================
+void TextFileCache::Release(const TextFileCacheRef * pRef)
+{
+    SafeCriticalSectionLock lock(m_CriticalSection);
+
+    Segment *pSegment = GetSegment(pRef);
+
+    if (pRef->OwnsEntry() &&
+        pSegment &&
+        pSegment->m_lGeneration == pRef->GetGeneration())
+    {
+        VSASSERT(pSegment->m_cLiveEntries > 0, "Entry released twice?");
+        InterlockedDecrement(&pSegment->m_cLiveEntries);
+    }
 }
 
 //============================================================================
@@ -1191,78 +1744,21 @@ DWORD TextFileCache::Read
     DWORD                   cbBytes
 )
 {
-    EnsureOpen();
-    DWORD bytesRead = 0;
-    HRESULT hr = S_OK;
+    TextFileCacheView view;
+    OpenView(wszFileName, pRef, &view);
 
+    if (cbBytes == 0)
     {
-        // Protext access to the temp file
-        CompilerIdeLock lock(m_CriticalSection);
-
-        LONG newOffset;
-
-        // Check if the cache timestamp is curent
-        if (wszFileName)
-        {
-            FILETIME ftCache = pRef->GetTimestamp();
-            FILETIME ftCurrent;
-            GetFileModificationTime(wszFileName, &ftCurrent);
-
-            if (ftCurrent.dwLowDateTime != ftCache.dwLowDateTime ||
-                ftCurrent.dwHighDateTime != ftCache.dwHighDateTime)
-            {
-                VbThrowNoAssert(E_FAIL);
-            }
-        }
-
-        // Find and reaad the cache element.
-        newOffset = SetFilePointer(m_TempFile.GetHandle(), pRef->GetOffset(), NULL, FILE_BEGIN);
-        if ((newOffset == INVALID_SET_FILE_POINTER) && (GetLastError() != NO_ERROR))
-        {
-            VbThrow(GetLastHResultError());
-        }
-
-        // Read in the header
-        EntryHeader header;
-        if (!ReadFile(m_TempFile.GetHandle(),&header, sizeof(header), &bytesRead, NULL))
-        {
-            VbThrow(GetLastHResultError());
-        }
-
-        TextFileCacheRef thisRef(newOffset, header.m_Size, header.m_Timestamp);
-
-        // Verify that the data matches the requested TextFileCacheRef
-        if (thisRef != *pRef)
-        {
-            VbThrow(E_FAIL);
-        }
-
-        if (cbBytes > 0)
-        {
-            // Verify that the caller's buffer is large enough
-            if (cbBytes < header.m_Size)
-            {
-                VbThrow(HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
-            }
-
-            // Read the data
-            if (!ReadFile(m_TempFile.GetHandle(), lpBuffer, header.m_Size, &bytesRead, NULL))
-            {
-                VbThrow(GetLastHResultError());
-            }
-        }
-        else
-        {
-            bytesRead = 0;
-        }
+        return 0;
     }
 
-    // re-throw errors to the caller
-    if (FAILED(hr))
+    // Verify that the caller's buffer is large enough
+    if (cbBytes < view.GetSize())
     {
-        VbThrow(hr);
+        VbThrow(HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
     }
 
-    return bytesRead;
-}
+    memcpy(lpBuffer, view.GetData(), view.GetSize());
 
+    return view.GetSize();
+}
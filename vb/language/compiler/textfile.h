@@ -12,6 +12,7 @@
 class SourceFile;
 class TextFileCacheRef;
 class TextFileCache;
+class TextFileCacheView;
 
 //-------------------------------------------------------------------------------------------------
 //
@@ -54,7 +55,19 @@ struct TextFile : ZeroInit<TextFile>
 #endif
         );
 
+#if !IDE
+    // Get the text for a file in place from the source file cache.  Returns
+    // false, leaving pView closed, if the text is not cached; GetFileText
+    // then loads it.  The text is valid until pView is closed.
+    bool GetFileTextView(
+        _Inout_ TextFileCacheView * pView,
+        __deref_out_ecount_opt(* pcchText) const WCHAR * * pwszText,
+        _Out_ size_t * pcchText);
+#endif
 
+    // Gives the cached text of the file back to the source file cache.
+    // Must be called while the file still belongs to its project.
+    void ReleaseSourceFileCache();
 
     HRESULT SetBuffer(
         _In_opt_bytecount_(dwLen)WCHAR * wszBuffer,
@@ -227,8 +240,8 @@ private:
 
 //
 // The TextFileCacheRef object points to an entry in
-// the TextFileCache. The offset, size and timestamp
-// of the entry are maintained to ensure that the
+// the TextFileCache. The segment, generation, offset, size and
+// timestamp of the entry are maintained to ensure that the
 // element in the caches matches the reference.
 //
 class TextFileCacheRef
@@ -239,15 +252,36 @@ public:
     TextFileCacheRef();
 
     TextFileCacheRef(
-        LONG offset,
+        unsigned iSegment,
+        LONG lGeneration,
+        DWORD offset,
         DWORD size,
         const FILETIME &lastWriteTime,
         const bool IsDetectUTF8WithoutSig = true);
 
-    LONG GetOffset() const 
+    // A copy refers to the same entry but does not keep it alive, see
+    // TextFileCache::Release.
+    TextFileCacheRef(const TextFileCacheRef &src);
+
+    unsigned GetSegment() const
+    {
+         return m_iSegment;
+    }
+
+    LONG GetGeneration() const
+    {
+         return m_lGeneration;
+    }
+
+    DWORD GetOffset() const 
     {
          return m_Offset; 
     }
+
+    bool OwnsEntry() const
+    {
+         return m_OwnsEntry;
+    }
     
     void SetUnicode(bool fUnicode) 
     {
@@ -300,13 +334,19 @@ public:
     bool operator !=(const TextFileCacheRef &e) const;
 
 private:
-    LONG                m_Offset;   // bytes
+    // Do not generate
+    TextFileCacheRef& operator=(const TextFileCacheRef&);
+
+    unsigned            m_iSegment;
+    LONG                m_lGeneration;
+    DWORD               m_Offset;   // bytes, within the segment
     DWORD               m_Size;     // bytes
     BYTE                m_bCryptHash[CRYPT_HASHSIZE];
     FILETIME            m_Timestamp;
     bool                m_IsUnicode:1;
     bool                m_DetectUTF8WithoutSig:1;
     bool                m_HasCryptHash:1;
+    bool                m_OwnsEntry:1;
 };
 
 
@@ -316,13 +356,35 @@ private:
 // contains a header that consists of the size and timestamp of
 // the entry, followed by the actual bits.
 //
+// The file is divided into segments that are mapped into memory on demand.
+// Entries are appended to the current segment by bumping its fill offset
+// with an interlocked add, so appending and reading only take a lock when a
+// segment has to be mapped or a new one is needed.
+//
+// Anybody touching the bytes of a segment pins it first, see
+// TextFileCacheView.  Pinned segments stay mapped and are never recycled.
+// The mapped views are bounded by MaxMappedBytes: once that much is mapped,
+// the least recently used segments that are not pinned are unmapped again.
+//
+// Once every entry of a segment has been released the segment is recycled
+// for new entries.  Each recycle bumps the segment's generation, which makes
+// outstanding references to its old entries fail to read, the same as when
+// a source file changes on disk.
+//
 class TextFileCache
 {
 public:
 
-    TextFileCache(Compiler * pCompiler) 
+    TextFileCache(Compiler * pCompiler) :
+        m_pCompiler(pCompiler),
+        m_rgpSegments(NULL),
+        m_cSegments(0),
+        m_iCurrentSegment(-1),
+        m_cbFile(0),
+        m_hMap(NULL),
+        m_cbMapped(0),
+        m_lUseClock(0)
     {
-         m_pCompiler = pCompiler; 
     }
 
     ~TextFileCache()
@@ -350,11 +412,67 @@ public:
         LPVOID lpBuffer,
         DWORD cbBytes);
 
+    // Opens a view on the cached bytes, without copying them.  The bytes are
+    // followed by a zero WCHAR.  They stay valid until the view is closed,
+    // even if the entry is released in the meantime.  Throws like Read if
+    // the entry is gone.
+    void OpenView(
+        LPCWSTR pszFileName,
+        const TextFileCacheRef * pElement,
+        _Inout_ TextFileCacheView * pView);
+
+    // The owner of an entry no longer needs it.  Copies of the reference
+    // may still try to read it until the segment is recycled.
+    void Release(const TextFileCacheRef * pElement);
+
     static const FILETIME NullFileTime;
 
 private:
+    friend class TextFileCacheView;
+
+    // Entries up to this size share segments; bigger ones get a segment of
+    // their own.  Segments are a multiple of the allocation granularity so
+    // they can be mapped at any file offset.
+    static const DWORD SegmentSize = 4 * 1024 * 1024;
+
+    // Bounds the file at 4GB of normal segments.
+    static const unsigned MaxSegments = 1024;
+
+    // Address space the mapped segments may take up before idle ones are
+    // unmapped.  A 32-bit vbc or devenv has little to spare.
+    static const size_t MaxMappedBytes = sizeof(void *) > 4 ? 256 * 1024 * 1024 : 32 * 1024 * 1024;
+
+    struct Segment
+    {
+        unsigned __int64 m_ibFile;          // Offset of the segment in the file.
+        BYTE * volatile m_pbView;           // NULL while the segment is not mapped.
+        DWORD           m_cbSize;
+        volatile LONG   m_cbUsed;           // Bump offset of the next entry.
+        volatile LONG   m_cLiveEntries;     // Entries not yet released.
+        volatile LONG   m_cPins;            // Readers and writers, -1 while being unmapped or recycled.
+        volatile LONG   m_lGeneration;      // Bumped when the segment is recycled.
+        volatile LONG   m_lLastUse;         // m_lUseClock when the segment was last pinned.
+    };
 
     void EnsureOpen();
+    Segment * GetSegment(const TextFileCacheRef * pElement);
+    unsigned AcquireSegment(DWORD cbEntry);
+    unsigned CreateSegment(DWORD cbSize);
+    void MapSegment(_Inout_ Segment * pSegment);
+    void UnmapIdleSegments(size_t cbNeeded);
+    void PinSegment(_Inout_ Segment * pSegment, _Inout_ TextFileCacheView * pView);
+    void PinSegmentLocked(_Inout_ Segment * pSegment, _Inout_ TextFileCacheView * pView);
+    void UnpinSegment(_Inout_ Segment * pSegment);
+
+    TextFileCacheRef * WriteEntry(
+        unsigned iSegment,
+        BYTE * pbView,
+        DWORD ibEntry,
+        LPVOID lpBuffer,
+        DWORD cbBytes,
+        const FILETIME &ftTimestamp,
+        const bool IsDetectUTF8WithoutSig);
+
     struct EntryHeader
     {
         EntryHeader();
@@ -368,5 +486,73 @@ private:
 
     Compiler*           m_pCompiler;
     TemporaryFile       m_TempFile;
-    CompilerIdeCriticalSection m_CriticalSection;
+
+    // Protects opening and closing the file and mapping, unmapping, adding
+    // or recycling segments.  This is a real lock in the command line
+    // compiler too because source files are loaded on several threads.
+    SafeCriticalSection m_CriticalSection;
+
+    Segment * volatile * m_rgpSegments;
+    volatile LONG       m_cSegments;
+    volatile LONG       m_iCurrentSegment;
+    unsigned __int64    m_cbFile;
+
+    // Mapping object over the whole file.  Replaced whenever the file grows;
+    // views of the old one keep it alive.
+    HANDLE              m_hMap;
+    size_t              m_cbMapped;
+    volatile LONG       m_lUseClock;
+};
+
+//
+// A pin on a segment of a TextFileCache.  Views opened by
+// TextFileCache::OpenView expose one entry of the segment; the cache also
+// uses them internally to hold on to a segment while it writes to it.
+//
+class TextFileCacheView
+{
+public:
+    TextFileCacheView() :
+        m_pCache(NULL),
+        m_pSegment(NULL),
+        m_pbView(NULL),
+        m_pbData(NULL),
+        m_cbData(0)
+    {
+    }
+
+    ~TextFileCacheView()
+    {
+        Close();
+    }
+
+    bool IsOpen() const
+    {
+        return m_pSegment != NULL;
+    }
+
+    const BYTE * GetData() const
+    {
+        return m_pbData;
+    }
+
+    DWORD GetSize() const
+    {
+        return m_cbData;
+    }
+
+    void Close();
+
+private:
+    friend class TextFileCache;
+
+    // Do not generate
+    TextFileCacheView(const TextFileCacheView&);
+    TextFileCacheView& operator=(const TextFileCacheView&);
+
+    TextFileCache *             m_pCache;
+    TextFileCache::Segment *    m_pSegment;
+    BYTE *                      m_pbView;       // Start of the segment.
+    const BYTE *                m_pbData;       // The entry, for OpenView.
+    DWORD                       m_cbData;
 };
@@ -57,6 +57,7 @@ typedef CComCritSecLock<CompilerIdeCriticalSection> CompilerIdeLock;
 #include "..\Compiler\Templates.h"
 #include "..\Compiler\LinkedLists.h"
 #include "..\Compiler\TreeTemplates.h"
+#include "..\Compiler\HashedCacheTemplates.h"
 #include "..\Compiler\GraphTemplates.h"
 #include "..\Compiler\StringPoolEntry.h"
 #include "..\Compiler\StringBuffer.h"
@@ -85,6 +86,7 @@ typedef CComCritSecLock<CompilerIdeCriticalSection> CompilerIdeLock;
 #include "..\Compiler\Scanner\KeywordTable.h"
 #include "..\Compiler\StringPool.h"
 #include "..\Compiler\Scanner\scanner.h"
+#include "..\Compiler\Scanner\TokenStreamCache.h"
 #include "..\Compiler\Scanner\XmlCharacter.h"
 #include "..\Compiler\TreeHelpers.h"
 #include "..\Compiler\Errors.h"
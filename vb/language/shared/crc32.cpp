@@ -15,10 +15,22 @@
 //  reverse poly = x^32 + x^31 + x^30 + x^29 + x^27 + x^26 + x^24 + x^23 + x^21 + x^20 + x^19 + x^15 + x^9 + x^8 + x^5
 //                 (1)    1      1      10     1      10     1      10     1      1      1000   100000 1     100   100000 (0x1EDB88320)
 //
+//  Update runs one of three kernels that all give the same CRC: a carry-less multiply folding
+//  kernel (PCLMULQDQ, see Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+//  Instruction") for buffers of 64 bytes and more, a slice-by-8 table kernel, and the byte at a
+//  time table lookup for whatever is left over.  The SSE4.2 crc32 instruction is not used: it
+//  computes the Castagnoli CRC, not this one.
+//
 //-------------------------------------------------------------------------------------------------
 
 #include "StdAfx.h"
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#endif
+
 //#define USE_CRC_TABLE
 
 #ifdef USE_CRC_TABLE
@@ -146,6 +158,29 @@
     }
 #endif
 
+// The slice-by-8 tables: CRC32_SLICE_TABLE[k][i] is the table entry for byte i
+// followed by k + 1 zero bytes.
+static bool CRC32_SLICE_TABLE_INITIALIZED = false;
+static DWORD CRC32_SLICE_TABLE[7][256];
+
+static
+void initslicetable()
+{
+    inittable();
+
+    if( !CRC32_SLICE_TABLE_INITIALIZED ) {
+        for (unsigned i = 0; i < 256; ++i) {
+            DWORD entry = CRC32_LOOKUP_TABLE[i];
+
+            for (unsigned k = 0; k < 7; ++k) {
+                entry = CRC32_LOOKUP_TABLE[ entry & 0xFF ] ^ (entry >> 8);
+                CRC32_SLICE_TABLE[k][i] = entry;
+            }
+        }
+        CRC32_SLICE_TABLE_INITIALIZED = true;
+    }
+}
+
 static inline
 DWORD NewCRC32(
     DWORD crc,
@@ -155,6 +190,163 @@ DWORD NewCRC32(
     return CRC32_LOOKUP_TABLE[ (BYTE)(crc ^ bNextByte) ] ^ (crc >> 8);
 }
 
+// Consumes 8 bytes per step with 8 independent table lookups instead of a
+// chain of 8 dependent ones.  Assumes a little endian processor.
+static
+DWORD UpdateCRC32SliceBy8(
+    DWORD crc,
+    const BYTE * pByte,
+    size_t uLength)
+{
+    for(; uLength >= 8; uLength -= 8, pByte += 8 ) {
+        DWORD dwLow = *(UNALIGNED const DWORD *)pByte ^ crc;
+        DWORD dwHigh = *(UNALIGNED const DWORD *)(pByte + 4);
+
+        crc = CRC32_SLICE_TABLE[6][ dwLow & 0xFF ] ^
+              CRC32_SLICE_TABLE[5][ (dwLow >> 8) & 0xFF ] ^
+              CRC32_SLICE_TABLE[4][ (dwLow >> 16) & 0xFF ] ^
+              CRC32_SLICE_TABLE[3][ dwLow >> 24 ] ^
+              CRC32_SLICE_TABLE[2][ dwHigh & 0xFF ] ^
+              CRC32_SLICE_TABLE[1][ (dwHigh >> 8) & 0xFF ] ^
+              CRC32_SLICE_TABLE[0][ (dwHigh >> 16) & 0xFF ] ^
+              CRC32_LOOKUP_TABLE[ dwHigh >> 24 ];
+    }
+    // finish up the remainder
+    for(; uLength > 0; uLength-- ) {
+        crc = NewCRC32(crc, *pByte++);
+    }
+    return crc;
+}
+
+#if defined(_M_IX86) || defined(_M_X64)
+
+#define CRC32_CLMUL 1
+
+// The folding kernel needs 4 blocks of 16 bytes to start with.
+static const size_t CRC32_CLMUL_MINIMUM_LENGTH = 64;
+
+// PCLMULQDQ, and SSE4.1 for pextrd, are detected once.
+static
+bool HasCarrylessMultiply()
+{
+    int rgCpuInfo[4];
+    __cpuid(rgCpuInfo, 1);
+
+    return (rgCpuInfo[2] & (1 << 1)) != 0 &&     // PCLMULQDQ
+           (rgCpuInfo[2] & (1 << 19)) != 0;      // SSE4.1
+}
+
+static const bool g_fCRC32UseCarrylessMultiply = HasCarrylessMultiply();
+
+// Folds 64 bytes at a time into 4 128 bit remainders, folds those into one,
+// folds the remaining 16 byte blocks into it, and Barrett reduces the result
+// to 32 bits.  The constants are the bit reflected ones of the paper for the
+// CRC32 polynomial.  Bytes past the last 16 byte block are left to the
+// slice-by-8 kernel.
+static
+DWORD UpdateCRC32Clmul(
+    DWORD crc,
+    const BYTE * pByte,
+    size_t uLength)
+{
+    VSASSERT(uLength >= CRC32_CLMUL_MINIMUM_LENGTH, "The folding kernel needs at least 64 bytes.");
+
+    __declspec(align(16)) static const unsigned __int64 rgK1K2[2] = { 0x0154442bd4, 0x01c6e41596 };
+    __declspec(align(16)) static const unsigned __int64 rgK3K4[2] = { 0x01751997d0, 0x00ccaa009e };
+    __declspec(align(16)) static const unsigned __int64 rgK5K0[2] = { 0x0163cd6124, 0x0000000000 };
+    __declspec(align(16)) static const unsigned __int64 rgPoly[2] = { 0x01db710641, 0x01f7011641 };
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(pByte + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(pByte + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(pByte + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(pByte + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    x0 = _mm_load_si128((const __m128i *)rgK1K2);
+    pByte += 64;
+    uLength -= 64;
+
+    // Fold 64 bytes at a time
+    for(; uLength >= 64; uLength -= 64, pByte += 64 ) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(pByte + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(pByte + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(pByte + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(pByte + 0x30)));
+    }
+
+    // Fold the 4 remainders into one
+    x0 = _mm_load_si128((const __m128i *)rgK3K4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // Fold 16 bytes at a time
+    for(; uLength >= 16; uLength -= 16, pByte += 16 ) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)pByte)), x5);
+    }
+
+    // Fold 128 bits to 64
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i *)rgK5K0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduce to 32 bits
+    x0 = _mm_load_si128((const __m128i *)rgPoly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    crc = (DWORD)_mm_extract_epi32(x1, 1);
+
+    return UpdateCRC32SliceBy8(crc, pByte, uLength);
+}
+
+#endif
+
+static
+DWORD UpdateCRC32(
+    DWORD crc,
+    const void * pBuffer,
+    size_t uLength)
+{
+    initslicetable();
+
+#if CRC32_CLMUL
+    if (g_fCRC32UseCarrylessMultiply && uLength >= CRC32_CLMUL_MINIMUM_LENGTH)
+    {
+        return UpdateCRC32Clmul(crc, (const BYTE *)pBuffer, uLength);
+    }
+#endif
+
+    return UpdateCRC32SliceBy8(crc, (const BYTE *)pBuffer, uLength);
+}
+
 DWORD CRC32::Update(BYTE bNextByte)
 {
     inittable();
@@ -166,52 +358,14 @@ DWORD CRC32::Update(
     const void * pBuffer,
     size_t uLength)
 {
-    inittable();
-
     // modifies the current state
-    DWORD dwCurrentCRC32 = m_CRC32;
-
-    const BYTE* pByte= (const BYTE*)pBuffer;
-    for(; uLength > 4; uLength-=4 ) {
-        // constant unrolling 4x dramatically helps the crc code
-        // beyond that there's not much gain
-        dwCurrentCRC32 = NewCRC32(dwCurrentCRC32, *pByte++);
-        dwCurrentCRC32 = NewCRC32(dwCurrentCRC32, *pByte++);
-        dwCurrentCRC32 = NewCRC32(dwCurrentCRC32, *pByte++);
-        dwCurrentCRC32 = NewCRC32(dwCurrentCRC32, *pByte++);
-    }
-    // finish up the remainder
-    for(; uLength > 0; uLength-- ) {
-        dwCurrentCRC32 = NewCRC32(dwCurrentCRC32, *pByte++);
-    }
-    m_CRC32 = dwCurrentCRC32;
-    return dwCurrentCRC32;
+    m_CRC32 = UpdateCRC32(m_CRC32, pBuffer, uLength);
+    return m_CRC32;
 }
 
-// This function is nearly identical, but we win out on a few assignments
-// This is done for some speed (can avoid assigning m_CRC32 several times)
 CRC32::CRC32(
     const void * pPtr,
-    size_t uLength)
+    size_t uLength) :
+    m_CRC32(UpdateCRC32(~DWORD(0), pPtr, uLength))
 {
-    inittable();
-
-    // do not rely on the optimizer to treat m_CRC32 as a local variable
-    // assigned at the end
-    DWORD dwCurrentCRC32 = ~DWORD(0);
-
-    const BYTE* pByte= (const BYTE*)pPtr;
-    for(; uLength > 4; uLength-=4 ) {
-        // constant unrolling 4x dramatically helps the crc code
-        // beyond that there's not much gain
-        dwCurrentCRC32 = NewCRC32(dwCurrentCRC32, *pByte++);
-        dwCurrentCRC32 = NewCRC32(dwCurrentCRC32, *pByte++);
-        dwCurrentCRC32 = NewCRC32(dwCurrentCRC32, *pByte++);
-        dwCurrentCRC32 = NewCRC32(dwCurrentCRC32, *pByte++);
-    }
-    // finish up the remainder
-    for (; uLength > 0; uLength-- ) {
-        dwCurrentCRC32 = NewCRC32(dwCurrentCRC32, *pByte++);
-    }
-    m_CRC32 = dwCurrentCRC32;
 }
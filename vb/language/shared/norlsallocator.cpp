@@ -31,6 +31,10 @@
  */
  
 
+bool NorlsAllocator::s_fCollectStatistics = false;
+volatile LONGLONG NorlsAllocator::s_cAllocations = 0;
+volatile LONGLONG NorlsAllocator::s_cbAllocated = 0;
+
 NorlsAllocator::NorlsAllocator( 
 #if NRLSTRACK
      _In_ WCHAR *szFile
@@ -320,6 +324,12 @@ void* NorlsAllocator::_AllocNonZero(size_t& sz)
     
     MakeCurrentPageWriteableInternal();
 
+    if (s_fCollectStatistics)
+    {
+        InterlockedIncrement64(&s_cAllocations);
+        InterlockedExchangeAdd64(&s_cbAllocated, (LONGLONG)roundSize);
+    }
+
     AssertIfFalse((size_t)nextFree % sizeof(void*) == 0);
     AssertIfFalse((size_t)limitFree % sizeof(void*) == 0);
     AssertIfFalse((size_t)p % sizeof(void*) == 0);
@@ -489,7 +499,7 @@ NorlsPage * NorlsAllocator::NewPage(size_t sz)
     allocSize = VBMath::RoundUp(sz + sizeof(NorlsPage), pageSize);
 
     // Allocate the new page.
-    newPage = (NorlsPage *) m_heapPage.AllocPages(allocSize);
+    newPage = (NorlsPage *) g_pvbNorlsManager->AllocPages(m_heapPage, allocSize);
 
 #if DEBUG
     // Add buffer overflow detection
@@ -596,7 +606,7 @@ void NorlsAllocator::Free(NorlsMark * mark)
         for (page = mark->page->next; page != NULL; page = nextPage)
         {
             nextPage = page->next;
-            m_heapPage.FreePages(entity, page, (BYTE *)page->limitAvail - (BYTE *)page);
+            g_pvbNorlsManager->FreePages(m_heapPage, entity, page, (BYTE *)page->limitAvail - (BYTE *)page);
         }
 
         // Reset the last page and location.
@@ -633,7 +643,7 @@ void NorlsAllocator::FreeHeap()
     for (page = pageList; page != NULL; page = nextPage)
     {
         nextPage = page->next;
-        m_heapPage.FreePages(entity, page, (BYTE *)page->limitAvail - (BYTE *)page);
+        g_pvbNorlsManager->FreePages(m_heapPage, entity, page, (BYTE *)page->limitAvail - (BYTE *)page);
     }
 
     // Reset the allocator.
@@ -9,7 +9,9 @@ NrlsAllocTracker *g_NrlsAllocTracker = NULL;
 #endif NRLSTRACK
 
 
-NorlsAllocatorManager::NorlsAllocatorManager() 
+NorlsAllocatorManager::NorlsAllocatorManager() :
+    m_dwMagazineTlsIndex(TlsAlloc()),
+    m_pMagazines(NULL)
 {
 #if NRLSTRACK
     if (g_NrlsAllocTracker == NULL)
@@ -24,6 +26,25 @@ NorlsAllocatorManager::NorlsAllocatorManager()
 
 NorlsAllocatorManager::~NorlsAllocatorManager()
 {
+    // The pages go back to m_heap before it is destroyed.
+    FlushPageMagazines();
+
+    PageMagazine* pMagazine = m_pMagazines;
+
+    while (pMagazine)
+    {
+        PageMagazine* pNext = pMagazine->m_pNext;
+        delete pMagazine;
+        pMagazine = pNext;
+    }
+
+    m_pMagazines = NULL;
+
+    if (m_dwMagazineTlsIndex != TLS_OUT_OF_INDEXES)
+    {
+        TlsFree(m_dwMagazineTlsIndex);
+    }
+
 #if NRLSTRACK_GETSTACKS    
     if (NorlsAllocator::g_nraSymbolHeap)
     {
@@ -41,6 +62,150 @@ NorlsAllocatorManager::~NorlsAllocatorManager()
 
 }
 
+//-------------------------------------------------------------------------------------------------
+//
+// Returns the magazine of the current thread if a request for sz bytes from heap can be served
+// from it, NULL otherwise.
+//
+//-------------------------------------------------------------------------------------------------
+NorlsAllocatorManager::PageMagazine* NorlsAllocatorManager::GetPageMagazine(PageHeap& heap, size_t sz)
+{
+    // Pages are only cached for the shared heap, and not when unused memory
+    // is protected: cached pages would stay accessible.
+    if (&heap != &m_heap ||
+        sz != PageHeap::pageSize ||
+        m_dwMagazineTlsIndex == TLS_OUT_OF_INDEXES ||
+        PageProtect::IsEntityProtected(ProtectedEntityFlags::UnusedMemory))
+    {
+        return NULL;
+    }
+
+    PageMagazine* pMagazine = (PageMagazine*)TlsGetValue(m_dwMagazineTlsIndex);
+
+    if (!pMagazine)
+    {
+        pMagazine = new (zeromemory) PageMagazine;
+
+        PageMagazine* pHead;
+
+        do
+        {
+            pHead = m_pMagazines;
+            pMagazine->m_pNext = pHead;
+        }
+        while (InterlockedCompareExchangePointer((PVOID volatile*)&m_pMagazines, pMagazine, pHead) != pHead);
+
+        TlsSetValue(m_dwMagazineTlsIndex, pMagazine);
+    }
+
+    return pMagazine;
+}
+
+void* NorlsAllocatorManager::AllocPages(PageHeap& heap, size_t sz)
+{
+    PageMagazine* pMagazine = GetPageMagazine(heap, sz);
+
+    if (pMagazine)
+    {
+        CTinyGate gate(&pMagazine->m_lock);
+
+        if (pMagazine->m_cPages > 0)
+        {
+            void* p = pMagazine->m_rgpPages[--pMagazine->m_cPages];
+            pMagazine->m_cHits++;
+
+#ifdef DEBUG
+            // Make sure they aren't zero filled.
+            memset(p, 0xCC, sz);
+#endif //DEBUG
+
+            return p;
+        }
+
+        pMagazine->m_cMisses++;
+    }
+
+    return heap.AllocPages(sz);
+}
+
+void NorlsAllocatorManager::FreePages(PageHeap& heap, ProtectedEntityFlagsEnum entity, _Post_invalid_ void* p, size_t sz)
+{
+    PageMagazine* pMagazine = GetPageMagazine(heap, sz);
+
+    if (pMagazine)
+    {
+        CTinyGate gate(&pMagazine->m_lock);
+
+        // The allocator may have made the page read only.
+        PageProtect::AllowWrite(entity, p, sz);
+
+#ifdef DEBUG
+        // Fill pages with junk to indicated unused.
+        memset(p, 0xAE, sz);
+#endif //DEBUG
+
+        if (pMagazine->m_cPages == PageMagazineSize)
+        {
+            // Full, give the older half back to the heap.
+            ReturnMagazinePages(pMagazine, PageMagazineSize / 2);
+        }
+
+        pMagazine->m_rgpPages[pMagazine->m_cPages++] = p;
+        return;
+    }
+
+    heap.FreePages(entity, p, sz);
+}
+
+//-------------------------------------------------------------------------------------------------
+//
+// Gives the cPages oldest pages of a magazine back to the heap.  The magazine must be locked.
+//
+//-------------------------------------------------------------------------------------------------
+void NorlsAllocatorManager::ReturnMagazinePages(PageMagazine* pMagazine, unsigned cPages)
+{
+    VSASSERT(cPages <= pMagazine->m_cPages, "Invalid");
+
+    for (unsigned iPage = 0; iPage < cPages; iPage++)
+    {
+        m_heap.FreePages(ProtectedEntityFlags::Other, pMagazine->m_rgpPages[iPage], PageHeap::pageSize);
+    }
+
+    memmove(
+        pMagazine->m_rgpPages,
+        pMagazine->m_rgpPages + cPages,
+        (pMagazine->m_cPages - cPages) * sizeof(void*));
+
+    pMagazine->m_cPages -= cPages;
+    pMagazine->m_cReturned += cPages;
+}
+
+void NorlsAllocatorManager::FlushPageMagazines()
+{
+    for (PageMagazine* pMagazine = m_pMagazines; pMagazine; pMagazine = pMagazine->m_pNext)
+    {
+        CTinyGate gate(&pMagazine->m_lock);
+        ReturnMagazinePages(pMagazine, pMagazine->m_cPages);
+    }
+}
 
+void NorlsAllocatorManager::GetPageMagazineStatistics
+(
+    _Out_ unsigned __int64 *pcHits,
+    _Out_ unsigned __int64 *pcMisses,
+    _Out_ unsigned __int64 *pcReturned
+)
+{
+    *pcHits = 0;
+    *pcMisses = 0;
+    *pcReturned = 0;
 
+    for (PageMagazine* pMagazine = m_pMagazines; pMagazine; pMagazine = pMagazine->m_pNext)
+    {
+        CTinyGate gate(&pMagazine->m_lock);
 
+        *pcHits += pMagazine->m_cHits;
+        *pcMisses += pMagazine->m_cMisses;
+        *pcReturned += pMagazine->m_cReturned;
+    }
+}
@@ -23,9 +23,26 @@ public:
 
     void CleanupPageHeap()
     {
+        FlushPageMagazines();
         m_heap.DecommitUnusedPages();
     }
 
+    // Page allocation for NorlsAllocator.  Single pages of the shared heap go
+    // through a small per-thread cache first; anything else goes straight to
+    // the given heap.
+    void* AllocPages(PageHeap& heap, size_t sz);
+    void FreePages(PageHeap& heap, ProtectedEntityFlagsEnum entity, _Post_invalid_ void* p, size_t sz);
+
+    // Returns the pages held by all the per-thread caches to the heap.
+    void FlushPageMagazines();
+
+    // Single page allocations served from a per-thread cache (hits) or from
+    // the heap (misses), and pages handed back to the heap by full caches.
+    void GetPageMagazineStatistics(
+        _Out_ unsigned __int64 *pcHits,
+        _Out_ unsigned __int64 *pcMisses,
+        _Out_ unsigned __int64 *pcReturned);
+
     virtual 
     void LockAllocator()
     {
@@ -37,7 +54,31 @@ public:
     }
 
 private:
+    // Most NorlsAllocators live briefly and never outgrow a single page; code
+    // generation alone creates one per method.  Each thread keeps a few of
+    // the pages they free so the next allocator on that thread does not have
+    // to take the heap lock or search the arenas.
+    static const unsigned PageMagazineSize = 32;
+
+    struct PageMagazine
+    {
+        PageMagazine* m_pNext;      // All magazines, so they can be flushed.
+        CTinyLock m_lock;           // Only contended while flushing.
+        unsigned m_cPages;
+        void* m_rgpPages[PageMagazineSize];
+
+        unsigned __int64 m_cHits;
+        unsigned __int64 m_cMisses;
+        unsigned __int64 m_cReturned;
+    };
+
+    PageMagazine* GetPageMagazine(PageHeap& heap, size_t sz);
+    void ReturnMagazinePages(PageMagazine* pMagazine, unsigned cPages);
+
     PageHeap m_heap;
+
+    DWORD m_dwMagazineTlsIndex;
+    PageMagazine* volatile m_pMagazines;
 };
 
 
@@ -112,6 +112,13 @@ PageHeap::~PageHeap()
     FreeAllPages();
 }
 
+void PageHeap::ResetMaxSizes()
+{
+    CTinyGate gate (&lock ); // Acquire the lock
+    m_pageMaxUse = m_pageCurUse;
+    m_pageMaxReserve = m_pageCurReserve;
+}
+
 void PageHeap::ShrinkUnusedResources()
 {
     //Microsoft the ordering of these is important. First free all possible
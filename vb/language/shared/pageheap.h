@@ -171,6 +171,9 @@ public:
         return (unsigned)(m_pageMaxReserve * pageSize);
     }
 
+    // Starts measuring the peak use and reserve sizes from the current sizes.
+    void ResetMaxSizes();
+
     PageArena* FindArena(const void * p);
 
 private:
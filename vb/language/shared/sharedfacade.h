@@ -178,6 +178,7 @@
 #include "crc32.h"
 #include "crc64.h"
 #include "CriticalSection.h"
+#include "WorkStealingPool.h"
 #include "DynamicArray.h"
 #include "PageProtect.h"
 #include "PageHeap.h"
@@ -0,0 +1,356 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  A small pool of worker threads for running batches of independent work items.
+//
+//-------------------------------------------------------------------------------------------------
+
+#include "StdAfx.h"
+
+WorkStealingPool::WorkStealingPool(unsigned cThreads) :
+    m_cWorkers(ResolveDegreeOfParallelism(cThreads)),
+    m_pRanges(NULL),
+    m_pThreads(NULL),
+    m_fShutdown(false),
+    m_pfnWork(NULL),
+    m_pvContext(NULL),
+    m_fCancelled(FALSE),
+    m_hrFirstFailure(S_OK)
+{
+    m_pRanges = new (zeromemory) WorkerRange[m_cWorkers];
+
+    if (m_cWorkers > 1)
+    {
+        HRESULT hr = StartThreads();
+
+        if (FAILED(hr))
+        {
+            // The destructor does not run when the constructor throws, so the
+            // threads that did start have to be joined here.
+            StopThreads();
+            delete [] m_pRanges;
+            VbThrow(hr);
+        }
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    StopThreads();
+    delete [] m_pRanges;
+}
+
+HRESULT WorkStealingPool::StartThreads()
+{
+    m_pThreads = new (zeromemory) WorkerThread[m_cWorkers - 1];
+
+    for (unsigned iThread = 0; iThread < m_cWorkers - 1; iThread++)
+    {
+        WorkerThread *pThread = &m_pThreads[iThread];
+
+        pThread->m_pPool = this;
+        pThread->m_iWorker = iThread + 1;
+        IfNullRet(pThread->m_hStartEvent = CreateEvent(NULL, FALSE, FALSE, NULL));
+        IfNullRet(pThread->m_hDoneEvent = CreateEvent(NULL, FALSE, FALSE, NULL));
+        IfNullRet(pThread->m_hThread = CreateThread(NULL, 0, WorkerThreadProc, pThread, 0, NULL));
+    }
+
+    return S_OK;
+}
+
+void WorkStealingPool::StopThreads()
+{
+    if (m_pThreads)
+    {
+        m_fShutdown = true;
+
+        for (unsigned iThread = 0; iThread < m_cWorkers - 1; iThread++)
+        {
+            WorkerThread *pThread = &m_pThreads[iThread];
+
+            if (pThread->m_hThread)
+            {
+                SetEvent(pThread->m_hStartEvent);
+                WaitForSingleObject(pThread->m_hThread, INFINITE);
+                CloseHandle(pThread->m_hThread);
+            }
+
+            if (pThread->m_hStartEvent)
+            {
+                CloseHandle(pThread->m_hStartEvent);
+            }
+
+            if (pThread->m_hDoneEvent)
+            {
+                CloseHandle(pThread->m_hDoneEvent);
+            }
+        }
+
+        delete [] m_pThreads;
+        m_pThreads = NULL;
+    }
+}
+
+unsigned WorkStealingPool::ResolveDegreeOfParallelism(unsigned cRequested)
+{
+    if (cRequested == 0)
+    {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        cRequested = si.dwNumberOfProcessors;
+    }
+
+    return max(1u, min(cRequested, MaxThreads));
+}
+
+HRESULT WorkStealingPool::Run
+(
+    unsigned cItems,
+    WorkItemCallback pfnWork,
+    _In_opt_ void *pvContext
+)
+{
+    VSASSERT(pfnWork, "Invalid");
+
+    if (cItems == 0)
+    {
+        return S_OK;
+    }
+
+    m_pfnWork = pfnWork;
+    m_pvContext = pvContext;
+    m_fCancelled = FALSE;
+    m_hrFirstFailure = S_OK;
+
+    // Deal out the items as contiguous ranges.  Workers past the end of the
+    // batch start out empty and go straight to stealing.
+    unsigned cActiveWorkers = min(m_cWorkers, cItems);
+    unsigned cItemsPerWorker = cItems / cActiveWorkers;
+    unsigned cExtraItems = cItems % cActiveWorkers;
+    unsigned iItem = 0;
+
+    for (unsigned iWorker = 0; iWorker < m_cWorkers; iWorker++)
+    {
+        unsigned cThisWorker = 0;
+
+        if (iWorker < cActiveWorkers)
+        {
+            cThisWorker = cItemsPerWorker + (iWorker < cExtraItems ? 1 : 0);
+        }
+
+        m_pRanges[iWorker].m_iNext = iItem;
+        m_pRanges[iWorker].m_iEnd = iItem + cThisWorker;
+        iItem += cThisWorker;
+    }
+
+    VSASSERT(iItem == cItems, "Items were not all dealt out.");
+
+    // Only wake up as many threads as there is work for.
+    unsigned cThreadsToWake = cActiveWorkers - 1;
+    HANDLE rghDone[MaxThreads];
+
+    for (unsigned iThread = 0; iThread < cThreadsToWake; iThread++)
+    {
+        rghDone[iThread] = m_pThreads[iThread].m_hDoneEvent;
+        SetEvent(m_pThreads[iThread].m_hStartEvent);
+    }
+
+    RunWorker(0);
+
+    if (cThreadsToWake > 0)
+    {
+        WaitForMultipleObjects(cThreadsToWake, rghDone, TRUE, INFINITE);
+    }
+
+    m_pfnWork = NULL;
+    m_pvContext = NULL;
+
+    return m_hrFirstFailure;
+}
+
+DWORD WINAPI WorkStealingPool::WorkerThreadProc(_In_ void *pvWorkerThread)
+{
+    WorkerThread *pThread = (WorkerThread *)pvWorkerThread;
+    WorkStealingPool *pPool = pThread->m_pPool;
+
+    while (true)
+    {
+        WaitForSingleObject(pThread->m_hStartEvent, INFINITE);
+
+        if (pPool->m_fShutdown)
+        {
+            break;
+        }
+
+        pPool->RunWorker(pThread->m_iWorker);
+        SetEvent(pThread->m_hDoneEvent);
+    }
+
+    return 0;
+}
+
+void WorkStealingPool::RunWorker(unsigned iWorker)
+{
+    unsigned iItem;
+
+    do
+    {
+        while (!m_fCancelled && TryTakeOwnItem(iWorker, &iItem))
+        {
+            ExecuteItem(iItem, iWorker);
+        }
+    }
+    while (!m_fCancelled && TryStealItems(iWorker));
+}
+
+bool WorkStealingPool::TryTakeOwnItem
+(
+    unsigned iWorker,
+    _Out_ unsigned *piItem
+)
+{
+    WorkerRange *pRange = &m_pRanges[iWorker];
+    CTinyGate gate(&pRange->m_lock);
+
+    if (pRange->m_iNext < pRange->m_iEnd)
+    {
+        *piItem = pRange->m_iNext++;
+        return true;
+    }
+
+    return false;
+}
+
+//-------------------------------------------------------------------------------------------------
+//
+// Moves the back half of the largest range owned by another worker into the (empty) range of
+// iThief.  Returns false once there is nothing left to steal, which ends the batch for iThief.
+//
+//-------------------------------------------------------------------------------------------------
+bool WorkStealingPool::TryStealItems(unsigned iThief)
+{
+    while (true)
+    {
+        unsigned iVictim = iThief;
+        unsigned cVictimItems = 0;
+
+        // Unlocked scan; the sizes are only a hint and are re-checked under the lock below.
+        for (unsigned iWorker = 0; iWorker < m_cWorkers; iWorker++)
+        {
+            unsigned iNext = m_pRanges[iWorker].m_iNext;
+            unsigned iEnd = m_pRanges[iWorker].m_iEnd;
+
+            if (iWorker != iThief && iEnd > iNext && iEnd - iNext > cVictimItems)
+            {
+                iVictim = iWorker;
+                cVictimItems = iEnd - iNext;
+            }
+        }
+
+        if (iVictim == iThief)
+        {
+            return false;
+        }
+
+        unsigned iStolenBegin = 0;
+        unsigned iStolenEnd = 0;
+
+        {
+            WorkerRange *pVictim = &m_pRanges[iVictim];
+            CTinyGate gate(&pVictim->m_lock);
+
+            if (pVictim->m_iNext < pVictim->m_iEnd)
+            {
+                unsigned cRemaining = pVictim->m_iEnd - pVictim->m_iNext;
+
+                iStolenEnd = pVictim->m_iEnd;
+                iStolenBegin = iStolenEnd - (cRemaining + 1) / 2;
+                pVictim->m_iEnd = iStolenBegin;
+            }
+        }
+
+        if (iStolenBegin < iStolenEnd)
+        {
+            WorkerRange *pThief = &m_pRanges[iThief];
+            CTinyGate gate(&pThief->m_lock);
+
+            pThief->m_iNext = iStolenBegin;
+            pThief->m_iEnd = iStolenEnd;
+            return true;
+        }
+
+        // Somebody else emptied the victim first, look again.
+    }
+}
+
+void WorkStealingPool::ExecuteItem
+(
+    unsigned iItem,
+    unsigned iWorker
+)
+{
+    HRESULT hr = ExecuteItemGuarded(m_pfnWork, m_pvContext, iItem, iWorker);
+
+    if (FAILED(hr))
+    {
+        InterlockedCompareExchange(&m_hrFirstFailure, hr, S_OK);
+        InterlockedExchange(&m_fCancelled, TRUE);
+    }
+}
+
+// VbThrow raises a structured exception whose code is the HRESULT, so the
+// exception code is returned as-is.  This has to live apart from the C++
+// handlers below because a function cannot mix the two kinds of handler.
+HRESULT WorkStealingPool::ExecuteItemGuarded
+(
+    WorkItemCallback pfnWork,
+    _In_opt_ void *pvContext,
+    unsigned iItem,
+    unsigned iWorker
+)
+{
+    HRESULT hr = S_OK;
+
+    __try
+    {
+        hr = ExecuteItemCatchingExceptions(pfnWork, pvContext, iItem, iWorker);
+    }
+    __except(EXCEPTION_EXECUTE_HANDLER)
+    {
+        hr = (HRESULT)GetExceptionCode();
+
+        if (SUCCEEDED(hr))
+        {
+            hr = E_FAIL;
+        }
+    }
+
+    return hr;
+}
+
+HRESULT WorkStealingPool::ExecuteItemCatchingExceptions
+(
+    WorkItemCallback pfnWork,
+    _In_opt_ void *pvContext,
+    unsigned iItem,
+    unsigned iWorker
+)
+{
+    HRESULT hr = S_OK;
+
+    try
+    {
+        pfnWork(pvContext, iItem, iWorker);
+    }
+    catch (Exception &ex)
+    {
+        hr = ex.GetHResult();
+    }
+    catch (std::exception &)
+    {
+        hr = E_FAIL;
+    }
+
+    return hr;
+}
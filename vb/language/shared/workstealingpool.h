@@ -0,0 +1,104 @@
+//-------------------------------------------------------------------------------------------------
+//
+//  Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//  A small pool of worker threads for running batches of independent work items.
+//
+//-------------------------------------------------------------------------------------------------
+
+#pragma once
+
+//-------------------------------------------------------------------------------------------------
+//
+// WorkStealingPool
+//
+// Runs a batch of independent work items, identified by index, on a fixed set of worker threads.
+// The calling thread participates in every batch as worker 0, so a pool created with a single
+// thread runs everything inline and never creates a thread.
+//
+// The items of a batch are dealt out to the workers as contiguous index ranges.  A worker pops
+// items from the front of its own range; once that is empty it steals the back half of the
+// largest range still owned by another worker.  Files and methods vary wildly in cost, so this
+// keeps all the workers busy without any per-item synchronization in the common case.
+//
+// Work items must not depend on each other.  Any exception raised by a work item is captured,
+// the remaining items of the batch are cancelled and the HRESULT of the first failure is returned
+// from Run on the calling thread.
+//
+//-------------------------------------------------------------------------------------------------
+class WorkStealingPool
+{
+public:
+    // iWorker is the index of the worker running the item, in [0, GetThreadCount()).  It lets a
+    // callback keep per-worker scratch state without any locking.
+    typedef void (*WorkItemCallback)(void *pvContext, unsigned iItem, unsigned iWorker);
+
+    // A value of zero means "one thread per processor".
+    WorkStealingPool(unsigned cThreads);
+    ~WorkStealingPool();
+
+    unsigned GetThreadCount() const
+    {
+        return m_cWorkers;
+    }
+
+    // Runs pfnWork(pvContext, iItem, iWorker) for every iItem in [0, cItems) and waits for all of them to
+    // finish.  Not reentrant: a work item must not call Run on the pool that is executing it.
+    HRESULT Run(
+        unsigned cItems,
+        WorkItemCallback pfnWork,
+        _In_opt_ void *pvContext);
+
+    // Maps a requested degree of parallelism to an actual thread count.  Zero means one thread
+    // per processor; the result is always in [1, MaxThreads].
+    static unsigned ResolveDegreeOfParallelism(unsigned cRequested);
+
+    // The completion of a batch is tracked with WaitForMultipleObjects.
+    static const unsigned MaxThreads = MAXIMUM_WAIT_OBJECTS;
+
+private:
+    // Do not generate
+    WorkStealingPool(const WorkStealingPool&);
+    WorkStealingPool& operator=(const WorkStealingPool&);
+
+    struct WorkerRange
+    {
+        CTinyLock m_lock;
+        volatile unsigned m_iNext;
+        volatile unsigned m_iEnd;
+    };
+
+    struct WorkerThread
+    {
+        WorkStealingPool *m_pPool;
+        unsigned m_iWorker;
+        HANDLE m_hThread;
+        HANDLE m_hStartEvent;
+        HANDLE m_hDoneEvent;
+    };
+
+    // StopThreads joins whatever StartThreads got to, even when it failed part way.
+    HRESULT StartThreads();
+    void StopThreads();
+
+    static DWORD WINAPI WorkerThreadProc(_In_ void *pvWorkerThread);
+
+    void RunWorker(unsigned iWorker);
+    bool TryTakeOwnItem(unsigned iWorker, _Out_ unsigned *piItem);
+    bool TryStealItems(unsigned iThief);
+    void ExecuteItem(unsigned iItem, unsigned iWorker);
+
+    static HRESULT ExecuteItemGuarded(WorkItemCallback pfnWork, _In_opt_ void *pvContext, unsigned iItem, unsigned iWorker);
+    static HRESULT ExecuteItemCatchingExceptions(WorkItemCallback pfnWork, _In_opt_ void *pvContext, unsigned iItem, unsigned iWorker);
+
+    unsigned m_cWorkers;
+    WorkerRange *m_pRanges;
+    WorkerThread *m_pThreads;       // m_cWorkers - 1 entries, worker 0 is the calling thread
+    volatile bool m_fShutdown;
+
+    // State of the batch currently being run.
+    WorkItemCallback m_pfnWork;
+    void *m_pvContext;
+    volatile LONG m_fCancelled;
+    volatile LONG m_hrFirstFailure;
+};
@@ -74,6 +74,7 @@ STDMETHODIMP VbHostedCompiler::CompileExpression
         IfFailGo(session.CompileExpression(pParsed));
     }
 
+    g_pvbNorlsManager->FlushPageMagazines();
     g_pvbNorlsManager->GetPageHeap().ShrinkUnusedResources();
 
     VB_EXIT_LABEL();